@@ -0,0 +1,142 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+
+#include <err.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Logger.h"
+#include "AlignedBufPool.h"
+
+#define DEBUG_CLASS 0
+
+// Non-class specific defines & data structures.
+
+// Non-class specific utility functions.
+
+
+// AlignedBufPool Class.
+
+// Constructors and destructor.
+AlignedBufPool::AlignedBufPool(void) : free_() {
+#if DEBUG_CLASS
+  warnx("AlignedBufPool::AlignedBufPool(void) called.");
+#endif
+
+  buf_size_ = 0;
+  align_ = 0;
+  allocated_ = 0;
+  pthread_mutex_init(&mtx_, NULL);
+}
+
+AlignedBufPool::~AlignedBufPool(void) {
+#if DEBUG_CLASS
+  warnx("AlignedBufPool::~AlignedBufPool(void) called.");
+#endif
+
+  if (free_.size() < allocated_)
+    _LOGGER(LOG_WARNING, "AlignedBufPool::~AlignedBufPool(): "
+            "%lu buffers still in use",
+            (unsigned long)(allocated_ - free_.size()));
+
+  for (size_t i = 0; i < free_.size(); i++)
+    free(free_[i]);
+  pthread_mutex_destroy(&mtx_);
+}
+
+// Accessors.
+size_t AlignedBufPool::allocated(void) const {
+  pthread_mutex_lock(&mtx_);
+  size_t cnt = allocated_;
+  pthread_mutex_unlock(&mtx_);
+
+  return cnt;
+}
+
+size_t AlignedBufPool::available(void) const {
+  pthread_mutex_lock(&mtx_);
+  size_t cnt = free_.size();
+  pthread_mutex_unlock(&mtx_);
+
+  return cnt;
+}
+
+// Mutators.
+
+// AlignedBufPool manipulation.
+
+// Routine to set our buffer size & alignment, and preallocate cnt.
+//
+// Note, this routine can set an ErrorHandler event.
+void AlignedBufPool::Init(const size_t cnt, const size_t buf_size,
+                          const size_t align) {
+  if (IsInitialized()) {
+    error.Init(EX_SOFTWARE, "AlignedBufPool::Init(): already initialized");
+    return;
+  }
+
+  if (align == 0 || (align & (align - 1)) != 0 ||
+      align % sizeof(void*) != 0) {
+    error.Init(EX_SOFTWARE, "AlignedBufPool::Init(): "
+               "align %lu is not a power of two", (unsigned long)align);
+    return;
+  }
+
+  if (buf_size == 0) {
+    error.Init(EX_SOFTWARE, "AlignedBufPool::Init(): buf_size is 0");
+    return;
+  }
+
+  align_ = align;
+  buf_size_ = (buf_size + align - 1) & ~(align - 1);
+
+  for (size_t i = 0; i < cnt; i++) {
+    char* buf = Get();
+    if (buf == NULL) {
+      error.Init(EX_OSERR, "AlignedBufPool::Init(): "
+                 "posix_memalign(%lu) failed", (unsigned long)buf_size_);
+      return;
+    }
+    Put(buf);
+  }
+}
+
+// Routine to take a buffer off our free list (or make a new one).
+char* AlignedBufPool::Get(void) {
+  pthread_mutex_lock(&mtx_);
+  if (!free_.empty()) {
+    char* buf = free_.back();
+    free_.pop_back();
+    pthread_mutex_unlock(&mtx_);
+    return buf;
+  }
+  pthread_mutex_unlock(&mtx_);
+
+  if (!IsInitialized())
+    return NULL;
+
+  void* mem = NULL;
+  if (posix_memalign(&mem, align_, buf_size_) != 0)
+    return NULL;
+
+  pthread_mutex_lock(&mtx_);
+  allocated_++;
+  pthread_mutex_unlock(&mtx_);
+
+  return (char*)mem;
+}
+
+// Routine to put a buffer back on our free list.
+void AlignedBufPool::Put(char* buf) {
+  if (buf == NULL)
+    return;
+
+  pthread_mutex_lock(&mtx_);
+  free_.push_back(buf);
+  pthread_mutex_unlock(&mtx_);
+}
+
+// Boolean checks.
+
+// Private member functions.
@@ -0,0 +1,116 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+
+#ifndef _ALIGNEDBUFPOOL_H_
+#define _ALIGNEDBUFPOOL_H_
+
+#include <sys/types.h>
+
+#include <pthread.h>
+
+#include <vector>
+using namespace std;
+
+#include "ErrorHandler.h"
+
+
+// Forward declarations (used if only needed for member function parameters).
+
+// Non-class specific defines & data structures.
+#define ALIGNEDBUFPOOL_DEFAULT_BUF_SIZE (1024 * 1024)
+#define ALIGNEDBUFPOOL_DEFAULT_BUFS 16
+
+// Non-class specific utilities.
+
+
+/** Class for handing out buffers suitable for direct I/O.
+ *
+ *  File::OpenDirect()'d files can only be read into (or written from)
+ *  buffers whose address and length are multiples of the file
+ *  system's block size.  AlignedBufPool keeps a free list of
+ *  equal-sized buffers so aligned, which callers Get() and Put()
+ *  back when their read(2) or write(2) is done, i.e., we don't
+ *  posix_memalign(3) (and fault in) a megabyte for every chunk of a
+ *  transfer.  If none are free, Get() allocates another, so each
+ *  caller should limit how many it holds (see TCPSession's
+ *  TCPSESSION_DIRECT_IO_DEPTH).
+ *
+ *  AlignedBufPool is thread-safe, so one pool can be shared by all
+ *  sessions (and AsyncFileIO's workers); it must outlive everyone
+ *  holding one of its buffers.
+ *
+ *  RCSID: $Id: $
+ *
+ *  @see File::OpenDirect()
+ *  @see TCPSession::set_direct_io()
+ *  @author Andrew K. Adams <akadams@psc.edu>
+ */
+class AlignedBufPool {
+ public:
+  /** Constructor.
+   *
+   */
+  AlignedBufPool(void);
+
+  /** Destructor.
+   *
+   *  Frees our buffers; any not yet Put() back are leaked.
+   */
+  virtual ~AlignedBufPool(void);
+
+  // Accessors.
+  size_t buf_size(void) const { return buf_size_; }
+  size_t align(void) const { return align_; }
+  size_t allocated(void) const;
+  size_t available(void) const;
+
+  // Mutators.
+
+  // AlignedBufPool manipulation.
+
+  /** Routine to set up our buffers.
+   *
+   *  Note, this routine can set an ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   *  @param cnt a size_t of buffers to allocate now
+   *  @param buf_size a size_t of each buffer's bytes, rounded up to
+   *  a multiple of align
+   *  @param align a size_t power of two, e.g., FILE_DIRECT_IO_ALIGN
+   */
+  void Init(const size_t cnt, const size_t buf_size, const size_t align);
+
+  /** Routine to take a free buffer (of buf_size() bytes).
+   *
+   *  @return a char*, or NULL if we couldn't allocate another
+   */
+  char* Get(void);
+
+  /** Routine to give back a buffer taken with Get().
+   *
+   */
+  void Put(char* buf);
+
+  // Boolean checks.
+  bool IsInitialized(void) const { return (buf_size_ > 0) ? true : false; }
+
+  // Flags.
+
+ protected:
+  // Data members.
+  size_t buf_size_;
+  size_t align_;
+  size_t allocated_;            // buffers posix_memalign(3)'d
+  vector<char*> free_;          // buffers not handed out
+
+  mutable pthread_mutex_t mtx_;  // lock for allocated_ & free_
+
+ private:
+  // Dummy declarations for copy constructor and assignment & equality operator.
+  AlignedBufPool(const AlignedBufPool& src);
+  AlignedBufPool& operator =(const AlignedBufPool& src);
+  int operator ==(const AlignedBufPool& other) const;
+};
+
+
+#endif  /* #ifndef _ALIGNEDBUFPOOL_H_ */
@@ -0,0 +1,433 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "File.h"
+#include "Logger.h"
+#include "AsyncFileIO.h"
+
+#define DEBUG_CLASS 0
+
+// Non-class specific defines & data structures.
+
+// Non-class specific utility functions.
+
+// Routine run by a WorkerPool thread: do the operation's (blocking)
+// work, then queue it for AsyncFileIO::Complete().  Note, we can't
+// use the ErrorHandler in here.
+void async_file_io_run(void* arg) {
+  struct file_io_op* op = (struct file_io_op*)arg;
+
+  op->ret = 0;
+  switch (op->type) {
+    case AsyncFileIO::OP_OPEN :
+      op->ret = open(op->path.c_str(), op->flags, op->mode);
+      break;
+
+    case AsyncFileIO::OP_COPY :
+      {
+        int out_fd = open(op->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                          op->mode);
+        if (out_fd < 0) {
+          op->ret = -1;
+          break;
+        }
+        op->ret = copy_file_fd(op->fd, out_fd);
+        if (op->ret == File::COPY_NONE)
+          op->ret = -1;
+        int copy_errno = errno;
+        if (close(out_fd) < 0 && op->ret >= 0)
+          op->ret = -1;  // e.g., the file system's delayed write failed
+        else
+          errno = copy_errno;
+      }
+      break;
+
+    case AsyncFileIO::OP_RENAME :
+      op->ret = rename(op->path.c_str(), op->new_path.c_str());
+      break;
+
+    case AsyncFileIO::OP_UNLINK :
+      op->ret = unlink(op->path.c_str());
+      break;
+
+    case AsyncFileIO::OP_READ :
+      while ((size_t)op->ret < op->len) {
+        ssize_t n = pread(op->fd, op->buf + op->ret, op->len - op->ret,
+                          op->offset + op->ret);
+        if (n == 0)
+          break;  // EOF
+        if (n < 0) {
+          if (errno == EINTR)
+            continue;
+          op->ret = -1;
+          break;
+        }
+        op->ret += n;
+      }
+      break;
+
+    case AsyncFileIO::OP_WRITE :
+      while ((size_t)op->ret < op->len) {
+        ssize_t n = pwrite(op->fd, op->buf + op->ret, op->len - op->ret,
+                           op->offset + op->ret);
+        if (n < 0) {
+          if (errno == EINTR)
+            continue;
+          op->ret = -1;
+          break;
+        }
+        op->ret += n;
+      }
+      break;
+
+    case AsyncFileIO::OP_SYNC :
+      op->ret = fdatasync(op->fd);
+      break;
+
+    default :
+      op->ret = -1;
+      errno = EINVAL;
+  }
+  op->err = (op->ret < 0) ? errno : 0;
+
+  if (op->fd >= 0) {
+    close(op->fd);
+    op->fd = -1;
+  }
+
+  AsyncFileIO* owner = op->owner;
+  pthread_mutex_lock(&owner->done_mtx_);
+  owner->done_.push_back(op);
+  pthread_cond_broadcast(&owner->done_cond_);
+  pthread_mutex_unlock(&owner->done_mtx_);
+}
+
+// Routine run (by IOUring::Complete()) when one of our operations'
+// io_uring request completes.  Short reads & writes are continued,
+// anything else queues the operation for AsyncFileIO::Complete().
+void async_file_io_uring_done(const struct io_uring_cqe& cqe, void* arg) {
+  struct file_io_op* op = (struct file_io_op*)arg;
+  AsyncFileIO* owner = op->owner;
+
+  if (cqe.res < 0) {
+    op->ret = -1;
+    op->err = -cqe.res;
+  } else if (op->type == AsyncFileIO::OP_READ ||
+             op->type == AsyncFileIO::OP_WRITE) {
+    op->ret += cqe.res;
+    if ((size_t)op->ret < op->len && cqe.res > 0) {
+      struct io_uring_req* req = NULL;
+      if (op->type == AsyncFileIO::OP_READ)
+        req = owner->io_uring_->Read(op->fd, op->buf + op->ret,
+                                     op->len - op->ret, op->offset + op->ret,
+                                     async_file_io_uring_done, op);
+      else
+        req = owner->io_uring_->Write(op->fd, op->buf + op->ret,
+                                      op->len - op->ret, op->offset + op->ret,
+                                      async_file_io_uring_done, op);
+      if (req != NULL)
+        return;  // still ours
+
+      op->ret = -1;
+      op->err = EAGAIN;
+    } else if ((size_t)op->ret < op->len && op->type == AsyncFileIO::OP_WRITE) {
+      op->ret = -1;  // wrote nothing
+      op->err = EIO;
+    }
+  } else {
+    op->ret = cqe.res;
+  }
+
+  if (op->fd >= 0) {
+    close(op->fd);
+    op->fd = -1;
+  }
+
+  owner->ring_ops_--;
+  pthread_mutex_lock(&owner->done_mtx_);
+  owner->done_.push_back(op);
+  pthread_cond_broadcast(&owner->done_cond_);
+  pthread_mutex_unlock(&owner->done_mtx_);
+}
+
+
+// AsyncFileIO Class.
+
+// Constructors and destructor.
+AsyncFileIO::AsyncFileIO(void) {
+#if DEBUG_CLASS
+  warnx("AsyncFileIO::AsyncFileIO(void) called.");
+#endif
+
+  pool_ = NULL;
+  io_uring_ = NULL;
+  ring_ops_ = 0;
+  outstanding_ = 0;
+  pthread_mutex_init(&done_mtx_, NULL);
+  pthread_cond_init(&done_cond_, NULL);
+}
+
+AsyncFileIO::~AsyncFileIO(void) {
+#if DEBUG_CLASS
+  warnx("AsyncFileIO::~AsyncFileIO(void) called.");
+#endif
+
+  // The ring's completions are only reaped in this thread, so reap
+  // them ourselves; they (and our workers) still reference us.
+  while (ring_ops_ > 0 && io_uring_->IsInitialized()) {
+    io_uring_->Submit(1);
+    io_uring_->Complete();
+  }
+
+  pthread_mutex_lock(&done_mtx_);
+  while (done_.size() < outstanding_)
+    pthread_cond_wait(&done_cond_, &done_mtx_);
+
+  for (list<struct file_io_op*>::iterator itr = done_.begin();
+       itr != done_.end(); itr++) {
+    if ((*itr)->type == OP_OPEN && (*itr)->ret >= 0)
+      close((*itr)->ret);  // no one will ever see it
+    delete *itr;
+  }
+  done_.clear();
+  pthread_mutex_unlock(&done_mtx_);
+
+  pthread_cond_destroy(&done_cond_);
+  pthread_mutex_destroy(&done_mtx_);
+}
+
+// Accessors.
+size_t AsyncFileIO::outstanding(void) const {
+  pthread_mutex_lock(&done_mtx_);
+  size_t cnt = outstanding_;
+  pthread_mutex_unlock(&done_mtx_);
+
+  return cnt;
+}
+
+// Mutators.
+
+// AsyncFileIO manipulation.
+
+// Routine to set the WorkerPool we submit to.
+//
+// Note, this routine can set an ErrorHandler event.
+void AsyncFileIO::Init(WorkerPool* pool) {
+  if (pool == NULL || pool->num_threads() == 0) {
+    error.Init(EX_SOFTWARE, "AsyncFileIO::Init(): "
+               "WorkerPool is NULL or not running");
+    return;
+  }
+
+  pool_ = pool;
+}
+
+bool AsyncFileIO::Open(const char* path, const int flags, const mode_t mode,
+                       file_io_done_fn done, void* arg) {
+  struct file_io_op* op = new struct file_io_op();
+  op->type = OP_OPEN;
+  op->fd = -1;
+  op->path = path;
+  op->flags = flags;
+  op->mode = mode;
+  op->done = done;
+  op->arg = arg;
+
+  return Submit(op);
+}
+
+bool AsyncFileIO::Copy(const int fd, const char* path, const mode_t mode,
+                       file_io_done_fn done, void* arg) {
+  struct file_io_op* op = new struct file_io_op();
+  op->type = OP_COPY;
+  op->fd = dup(fd);
+  op->path = path;
+  op->mode = mode;
+  op->done = done;
+  op->arg = arg;
+
+  return Submit(op);
+}
+
+bool AsyncFileIO::Rename(const char* path, const char* new_path,
+                         file_io_done_fn done, void* arg) {
+  struct file_io_op* op = new struct file_io_op();
+  op->type = OP_RENAME;
+  op->fd = -1;
+  op->path = path;
+  op->new_path = new_path;
+  op->done = done;
+  op->arg = arg;
+
+  return Submit(op);
+}
+
+bool AsyncFileIO::Unlink(const char* path, file_io_done_fn done, void* arg) {
+  struct file_io_op* op = new struct file_io_op();
+  op->type = OP_UNLINK;
+  op->fd = -1;
+  op->path = path;
+  op->done = done;
+  op->arg = arg;
+
+  return Submit(op);
+}
+
+bool AsyncFileIO::Read(const int fd, char* buf, const size_t len,
+                       const off_t offset, file_io_done_fn done, void* arg) {
+  struct file_io_op* op = new struct file_io_op();
+  op->type = OP_READ;
+  op->fd = dup(fd);
+  op->buf = buf;
+  op->len = len;
+  op->offset = offset;
+  op->done = done;
+  op->arg = arg;
+
+  return Submit(op);
+}
+
+bool AsyncFileIO::Write(const int fd, char* buf, const size_t len,
+                        const off_t offset, file_io_done_fn done, void* arg) {
+  struct file_io_op* op = new struct file_io_op();
+  op->type = OP_WRITE;
+  op->fd = dup(fd);
+  op->buf = buf;
+  op->len = len;
+  op->offset = offset;
+  op->done = done;
+  op->arg = arg;
+
+  return Submit(op);
+}
+
+bool AsyncFileIO::Sync(const int fd, file_io_done_fn done, void* arg) {
+  struct file_io_op* op = new struct file_io_op();
+  op->type = OP_SYNC;
+  op->fd = dup(fd);
+  op->done = done;
+  op->arg = arg;
+
+  return Submit(op);
+}
+
+// Routine to run the callbacks of our finished operations.
+size_t AsyncFileIO::Complete(void) {
+  list<struct file_io_op*> done;
+  pthread_mutex_lock(&done_mtx_);
+  done.swap(done_);
+  outstanding_ -= done.size();
+  pthread_mutex_unlock(&done_mtx_);
+
+  // Callbacks may start new operations, so we no longer hold our lock.
+  for (list<struct file_io_op*>::iterator itr = done.begin();
+       itr != done.end(); itr++) {
+    if ((*itr)->done != NULL)
+      (*itr)->done(**itr, (*itr)->arg);
+    delete *itr;
+  }
+
+  return done.size();
+}
+
+// Boolean checks.
+
+// Private member functions.
+
+// Routine to hand op to our pool.  On failure, op is deleted.
+bool AsyncFileIO::Submit(struct file_io_op* op) {
+  op->ret = 0;
+  op->err = 0;
+  op->owner = this;
+
+  bool needs_fd = (op->type == OP_COPY || op->type == OP_READ ||
+                   op->type == OP_WRITE || op->type == OP_SYNC);
+  if (needs_fd && op->fd < 0) {
+    delete op;
+    return false;
+  }
+
+  if (io_uring_ != NULL && op->type != OP_COPY)
+    return SubmitIOUring(op);
+
+  if (pool_ == NULL) {
+    if (op->fd >= 0)
+      close(op->fd);
+    delete op;
+    return false;
+  }
+
+  pthread_mutex_lock(&done_mtx_);
+  outstanding_++;
+  pthread_mutex_unlock(&done_mtx_);
+
+  if (!pool_->Submit(async_file_io_run, op)) {
+    pthread_mutex_lock(&done_mtx_);
+    outstanding_--;
+    pthread_mutex_unlock(&done_mtx_);
+    if (op->fd >= 0)
+      close(op->fd);
+    delete op;
+    return false;
+  }
+
+  return true;
+}
+
+// Routine to queue op on our IOUring.  On failure, op is deleted.
+bool AsyncFileIO::SubmitIOUring(struct file_io_op* op) {
+  struct io_uring_req* req = NULL;
+  switch (op->type) {
+    case OP_OPEN :
+      req = io_uring_->Open(op->path.c_str(), op->flags, op->mode,
+                            async_file_io_uring_done, op);
+      break;
+
+    case OP_RENAME :
+      req = io_uring_->Rename(op->path.c_str(), op->new_path.c_str(),
+                              async_file_io_uring_done, op);
+      break;
+
+    case OP_UNLINK :
+      req = io_uring_->Unlink(op->path.c_str(), async_file_io_uring_done, op);
+      break;
+
+    case OP_READ :
+      req = io_uring_->Read(op->fd, op->buf, op->len, op->offset,
+                            async_file_io_uring_done, op);
+      break;
+
+    case OP_WRITE :
+      req = io_uring_->Write(op->fd, op->buf, op->len, op->offset,
+                             async_file_io_uring_done, op);
+      break;
+
+    case OP_SYNC :
+      req = io_uring_->Fsync(op->fd, true, async_file_io_uring_done, op);
+      break;
+
+    default :
+      break;
+  }
+
+  if (req == NULL) {
+    if (op->fd >= 0)
+      close(op->fd);
+    delete op;
+    return false;
+  }
+
+  ring_ops_++;
+  pthread_mutex_lock(&done_mtx_);
+  outstanding_++;
+  pthread_mutex_unlock(&done_mtx_);
+
+  return true;
+}
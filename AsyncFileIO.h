@@ -0,0 +1,215 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+
+#ifndef _ASYNCFILEIO_H_
+#define _ASYNCFILEIO_H_
+
+#include <sys/types.h>
+
+#include <pthread.h>
+
+#include <list>
+#include <string>
+using namespace std;
+
+#include "ErrorHandler.h"
+#include "WorkerPool.h"
+#include "IOUring.h"
+
+
+// Forward declarations (used if only needed for member function parameters).
+class AsyncFileIO;
+
+// Non-class specific defines & data structures.
+struct file_io_op;
+
+/** Callback run (by AsyncFileIO::Complete()) when an operation is done.
+ *
+ *  op.ret holds the result (see file_io_op), and if it's -1, op.err
+ *  holds the errno.
+ */
+typedef void (*file_io_done_fn)(const struct file_io_op& op, void* arg);
+
+struct file_io_op {
+  int type;                     // AsyncFileIO::OP_*
+  int fd;                       // our dup(2) of the caller's descriptor
+  string path;                  // OP_OPEN, OP_UNLINK, OP_RENAME & OP_COPY
+  string new_path;              // OP_RENAME
+  int flags;                    // OP_OPEN
+  mode_t mode;                  // OP_OPEN & OP_COPY
+  char* buf;                    // OP_READ & OP_WRITE
+  size_t len;                   // OP_READ & OP_WRITE
+  off_t offset;                 // OP_READ & OP_WRITE
+
+  ssize_t ret;                  // bytes (OP_READ & OP_WRITE), descriptor
+                                // (OP_OPEN), File::COPY_* method
+                                // (OP_COPY), else 0; -1 on error
+  int err;                      // errno, if ret is -1
+
+  file_io_done_fn done;         // may be NULL
+  void* arg;                    // passed to done
+  AsyncFileIO* owner;
+};
+
+// Non-class specific utilities.
+
+
+/** Class for running blocking file operations off of the event-loop.
+ *
+ *  AsyncFileIO hands open(2), File::Copy()'s work, rename(2),
+ *  unlink(2), pread(2), pwrite(2) and fdatasync(2) to a WorkerPool,
+ *  so a slow disk stalls a worker thread rather than every
+ *  connection.  When a worker finishes, the pool writes to its
+ *  notify_fd(); the event-loop should then call WorkerPool::Drain()
+ *  and our Complete(), which runs each finished operation's callback
+ *  (in the event-loop's thread, so callbacks may use the
+ *  ErrorHandler).
+ *
+ *  Operations on an open file work on a dup(2) of the caller's
+ *  descriptor, so the caller may close its own at any time.  Buffers
+ *  (OP_READ & OP_WRITE) must stay valid until the callback runs.
+ *  Like WorkerPool::Submit(), the routines that start an operation
+ *  never block; if the pool's queue is full they return false (and
+ *  the callback will not be called), and the caller can try again
+ *  later or do the work itself.
+ *
+ *  Alternatively (or as well), set_io_uring() has everything but
+ *  OP_COPY queued on an IOUring instead, which needs no threads; the
+ *  event-loop then calls IOUring::Submit() & Complete() before our
+ *  Complete().
+ *
+ *  RCSID: $Id: $
+ *
+ *  @see WorkerPool
+ *  @see IOUring
+ *  @see TCPSession::set_file_io()
+ *  @author Andrew K. Adams <akadams@psc.edu>
+ */
+class AsyncFileIO {
+ public:
+  /** Constructor.
+   *
+   */
+  AsyncFileIO(void);
+
+  /** Destructor.
+   *
+   *  Waits for outstanding operations to finish; callbacks of
+   *  operations that haven't been through Complete() are not run.
+   */
+  virtual ~AsyncFileIO(void);
+
+  // Accessors.
+  WorkerPool* pool(void) const { return pool_; }
+  IOUring* io_uring(void) const { return io_uring_; }
+  size_t outstanding(void) const;
+
+  // Mutators.
+
+  /** Routine to queue our operations (all but OP_COPY) on an IOUring.
+   *
+   *  The IOUring must be Init()'d, must outlive us, and is only used
+   *  from the event-loop's thread.  If set, Init() is only needed for
+   *  Copy().
+   *
+   *  @param io_uring an IOUring*, or NULL to go back to our WorkerPool
+   */
+  void set_io_uring(IOUring* io_uring) { io_uring_ = io_uring; }
+
+  // AsyncFileIO manipulation.
+
+  /** Routine to set the WorkerPool our operations run on.
+   *
+   *  The pool can be shared, e.g., with SSLContext::set_handshake_pool(),
+   *  and must outlive us.  Note, this routine can set an
+   *  ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   *  @param pool a WorkerPool* that has been Init()'d
+   */
+  void Init(WorkerPool* pool);
+
+  /** Routine to open(2) a file; op.ret is the new descriptor.
+   *
+   */
+  bool Open(const char* path, const int flags, const mode_t mode,
+            file_io_done_fn done, void* arg);
+
+  /** Routine to copy the rest of fd (from its offset) to a new file
+   *  at path (created with mode); op.ret is the File::COPY_* used.
+   *
+   */
+  bool Copy(const int fd, const char* path, const mode_t mode,
+            file_io_done_fn done, void* arg);
+
+  /** Routine to rename(2) a file.
+   *
+   */
+  bool Rename(const char* path, const char* new_path,
+              file_io_done_fn done, void* arg);
+
+  /** Routine to unlink(2) a file.
+   *
+   */
+  bool Unlink(const char* path, file_io_done_fn done, void* arg);
+
+  /** Routine to read up to len bytes at offset into buf; op.ret is
+   *  the number read (less than len only at the end of the file).
+   *
+   */
+  bool Read(const int fd, char* buf, const size_t len, const off_t offset,
+            file_io_done_fn done, void* arg);
+
+  /** Routine to write all len bytes of buf at offset.
+   *
+   */
+  bool Write(const int fd, char* buf, const size_t len, const off_t offset,
+             file_io_done_fn done, void* arg);
+
+  /** Routine to fdatasync(2) a file.
+   *
+   */
+  bool Sync(const int fd, file_io_done_fn done, void* arg);
+
+  /** Routine to run the callbacks of finished operations.
+   *
+   *  Should be called by the event-loop after the pool's
+   *  notify_fd() was readable (and WorkerPool::Drain()).
+   *
+   *  @return the number of operations completed
+   */
+  size_t Complete(void);
+
+  // Boolean checks.
+
+  // Flags.
+  enum { OP_OPEN, OP_COPY, OP_RENAME, OP_UNLINK, OP_READ, OP_WRITE,
+         OP_SYNC, };
+
+  friend void async_file_io_run(void* arg);
+  friend void async_file_io_uring_done(const struct io_uring_cqe& cqe,
+                                       void* arg);
+
+ protected:
+  // Data members.
+  WorkerPool* pool_;
+  IOUring* io_uring_;
+  size_t ring_ops_;             // outstanding on io_uring_
+  list<struct file_io_op*> done_;  // finished, awaiting Complete()
+  size_t outstanding_;          // submitted, not yet through Complete()
+
+  mutable pthread_mutex_t done_mtx_;  // lock for done_ & outstanding_
+  pthread_cond_t done_cond_;
+
+ private:
+  bool Submit(struct file_io_op* op);
+  bool SubmitIOUring(struct file_io_op* op);
+
+  // Dummy declarations for copy constructor and assignment & equality operator.
+  AsyncFileIO(const AsyncFileIO& src);
+  AsyncFileIO& operator =(const AsyncFileIO& src);
+  int operator ==(const AsyncFileIO& other) const;
+};
+
+
+#endif  /* #ifndef _ASYNCFILEIO_H_ */
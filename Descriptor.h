@@ -30,8 +30,8 @@
  * STL.
  *
  * Thus, the parent class is responsible for incrementing and
- * decrementing the ref count in its destructor, copy constructor and
- * assignment operator.  If the ref count is 0, the parent is then
+ * decrementing the ref count (via Acquire() & Release()) in its
+ * destructor, copy constructor and assignment operator.  If the ref count is 0, the parent is then
  * also responsible for destructing the Descriptor class (after
  * closing the descriptor!).  I repeat, it's the onus of the parent to
  * INCREMENT & DECREMENT Discriptor's ref count in the parent's copy
@@ -43,6 +43,12 @@
  * - If the descriptor is opened for streaming I/O, then fd_ remains
  * DESCRIPTOR_NULL and we use fp_.
  *
+ * - The ref count is updated atomically, so copies of the parent
+ * (e.g., a File or TCPSession) can be handed between threads without
+ * an external lock.  Note, this only protects the ref count, not the
+ * descriptor itself, i.e., two threads must still not do I/O on the
+ * same descriptor at the same time.
+ *
  * - We could either make the data members public in here, or we need
  * to declare the parent classes as friends to this class.  We chose
  * the latter, for the number of classes that would want to use this
@@ -78,6 +84,15 @@ class Descriptor {
    */
   const FILE* fp(void) const { return fp_; }
 
+  /** Routine to return the current reference count.
+   *
+   *  Note, by the time the caller looks at the value, another thread
+   *  may have changed it, so this is only useful for debugging.
+   *
+   *  @return an unsigned int specifying the reference count
+   */
+  unsigned int cnt(void) const { return __atomic_load_n(&cnt_, __ATOMIC_RELAXED); }
+
   // Mutators.
 
   // Note, all work on the data members will be done in the friend
@@ -85,6 +100,28 @@ class Descriptor {
 
   // Descriptor manipulation.
 
+  /** Routine to add a reference to the Descriptor.
+   *
+   *  The caller must already hold a reference (e.g., the src in a copy
+   *  constructor), so nothing can be ordered against the increment,
+   *  and a relaxed atomic add suffices.
+   */
+  void Acquire(void) { __atomic_fetch_add(&cnt_, 1, __ATOMIC_RELAXED); }
+
+  /** Routine to drop a reference to the Descriptor.
+   *
+   *  The decrement is acquire/release, so all the writes made through
+   *  other references are visible to whichever thread drops the last
+   *  one.  If this routine returns true, the caller owned the last
+   *  reference and is responsible for closing the descriptor and
+   *  deleting this object.
+   *
+   *  @return true if the reference count dropped to zero
+   */
+  bool Release(void) {
+    return (__atomic_sub_fetch(&cnt_, 1, __ATOMIC_ACQ_REL) == 0) ? true : false;
+  }
+
   // Boolean checks.
 
   // Flags.
@@ -101,7 +138,8 @@ class Descriptor {
   FILE* fp_;      // the file descriptor as a stream (currently only
                   // used in File Class)
 
-  unsigned int cnt_;   // reference count for this descriptor
+  unsigned int cnt_;   // reference count for this descriptor (only
+                       // modified via atomic builtins)
 
  private:
   // Dummy declarations for copy constructor and assignment & equality operator.
@@ -0,0 +1,362 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <set>
+
+#include "Logger.h"
+#include "DurabilitySyncer.h"
+
+#define DEBUG_CLASS 0
+
+#define SCRATCH_BUF_SIZE 256
+
+// Non-class specific defines & data structures.
+
+// Non-class specific utility functions.
+
+// Routine to fsync(2) a directory, so the names created in it are
+// durable.  Returns 0, or the errno.
+static int sync_dir(const string& dir) {
+  int fd = open(dir.c_str(), O_RDONLY);
+  if (fd < 0)
+    return errno;
+
+  int err = (fsync(fd) < 0) ? errno : 0;
+  close(fd);
+
+  return err;
+}
+
+// Routine to make every file in batch durable.  Note, we can't use
+// the ErrorHandler in here.
+static void sync_batch(const list<struct durability_op*>& batch,
+                       const size_t syncfs_min) {
+  // Start writeback of the whole batch before waiting on any of it,
+  // so the disk sees all of it at once.
+  map<dev_t, size_t> dev_cnt;
+  for (list<struct durability_op*>::const_iterator op = batch.begin();
+       op != batch.end(); op++) {
+    struct stat st;
+    (*op)->dev = (fstat((*op)->fd, &st) == 0) ? st.st_dev : 0;
+    dev_cnt[(*op)->dev]++;
+#if defined(__linux__)
+    sync_file_range((*op)->fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+  }
+
+  // File systems with enough of the batch get one syncfs(2), which
+  // covers their directories, too.
+  set<dev_t> synced_devs;
+#if defined(__linux__)
+  if (syncfs_min > 0) {
+    for (list<struct durability_op*>::const_iterator op = batch.begin();
+         op != batch.end(); op++) {
+      if (dev_cnt[(*op)->dev] < syncfs_min ||
+          synced_devs.count((*op)->dev) > 0)
+        continue;
+
+      int err = (syncfs((*op)->fd) < 0) ? errno : 0;
+      synced_devs.insert((*op)->dev);
+      for (list<struct durability_op*>::const_iterator other = batch.begin();
+           other != batch.end(); other++) {
+        if ((*other)->dev != (*op)->dev)
+          continue;
+        (*other)->ret = (err != 0) ? -1 : 0;
+        (*other)->err = err;
+      }
+    }
+  }
+#endif
+
+  // Everyone else is fdatasync(2)'d, then each distinct directory is
+  // fsync(2)'d once.
+  map<string, int> dirs;
+  for (list<struct durability_op*>::const_iterator op = batch.begin();
+       op != batch.end(); op++) {
+    if (synced_devs.count((*op)->dev) > 0)
+      continue;
+
+    if (fdatasync((*op)->fd) < 0) {
+      (*op)->ret = -1;
+      (*op)->err = errno;
+    }
+    if ((*op)->dir.size() > 0)
+      dirs[(*op)->dir] = 0;
+  }
+  for (map<string, int>::iterator dir = dirs.begin(); dir != dirs.end(); dir++)
+    dir->second = sync_dir(dir->first);
+
+  for (list<struct durability_op*>::const_iterator op = batch.begin();
+       op != batch.end(); op++) {
+    if (synced_devs.count((*op)->dev) == 0 && (*op)->ret == 0 &&
+        (*op)->dir.size() > 0 && dirs[(*op)->dir] != 0) {
+      (*op)->ret = -1;
+      (*op)->err = dirs[(*op)->dir];
+    }
+    close((*op)->fd);
+    (*op)->fd = -1;
+  }
+}
+
+// Routine run by our thread: take whatever has been queued (up to
+// max_batch_), sync it and tell the event-loop about it.
+void* durability_syncer_thread(void* arg) {
+  DurabilitySyncer* syncer = (DurabilitySyncer*)arg;
+
+  pthread_mutex_lock(&syncer->mtx_);
+  while (1) {
+    while (syncer->running_ && syncer->queue_.empty())
+      pthread_cond_wait(&syncer->cond_, &syncer->mtx_);
+    if (syncer->queue_.empty())
+      break;  // shutting down, and the queue is drained
+
+    // If asked to, give a small batch a chance to grow.
+    if (syncer->max_delay_ > 0 && syncer->running_ &&
+        syncer->queue_.size() < syncer->max_batch_) {
+      struct timeval now;
+      gettimeofday(&now, NULL);
+      long usecs = now.tv_usec + syncer->max_delay_;
+      struct timespec deadline;
+      deadline.tv_sec = now.tv_sec + usecs / 1000000;
+      deadline.tv_nsec = (usecs % 1000000) * 1000;
+      while (syncer->running_ &&
+             syncer->queue_.size() < syncer->max_batch_ &&
+             pthread_cond_timedwait(&syncer->cond_, &syncer->mtx_,
+                                    &deadline) == 0)
+        ;
+    }
+
+    list<struct durability_op*> batch;
+    while (!syncer->queue_.empty() && batch.size() < syncer->max_batch_) {
+      batch.push_back(syncer->queue_.front());
+      syncer->queue_.pop_front();
+    }
+    size_t syncfs_min = syncer->syncfs_min_;
+    pthread_mutex_unlock(&syncer->mtx_);
+
+    sync_batch(batch, syncfs_min);
+
+    pthread_mutex_lock(&syncer->mtx_);
+    syncer->batches_++;
+    syncer->files_synced_ += batch.size();
+    syncer->done_.splice(syncer->done_.end(), batch);
+    pthread_mutex_unlock(&syncer->mtx_);
+
+    // If the pipe is full, the event-loop already has plenty to look
+    // at, so we don't care about EAGAIN.
+
+    char c = 0;
+    if (write(syncer->notify_fds_[1], &c, 1) < 0 && errno != EAGAIN)
+      warn("durability_syncer_thread(): write(2) failed");
+
+    pthread_mutex_lock(&syncer->mtx_);
+  }
+  pthread_mutex_unlock(&syncer->mtx_);
+
+  return NULL;
+}
+
+
+// DurabilitySyncer Class.
+
+// Constructors and destructor.
+DurabilitySyncer::DurabilitySyncer(void) : queue_(), done_() {
+#if DEBUG_CLASS
+  warnx("DurabilitySyncer::DurabilitySyncer(void) called.");
+#endif
+
+  running_ = false;
+  max_batch_ = DURABILITYSYNCER_DEFAULT_MAX_BATCH;
+  max_delay_ = DURABILITYSYNCER_DEFAULT_MAX_DELAY;
+  syncfs_min_ = 0;
+  notify_fds_[0] = notify_fds_[1] = -1;
+  outstanding_ = 0;
+  batches_ = 0;
+  files_synced_ = 0;
+  pthread_mutex_init(&mtx_, NULL);
+  pthread_cond_init(&cond_, NULL);
+}
+
+DurabilitySyncer::~DurabilitySyncer(void) {
+#if DEBUG_CLASS
+  warnx("DurabilitySyncer::~DurabilitySyncer(void) called.");
+#endif
+
+  // Our callers' callbacks may hold references (e.g., TCPSession's
+  // durable messages), so run them, rather than just dropping the ops.
+
+  Shutdown();
+  Complete();
+
+  if (notify_fds_[0] >= 0)
+    close(notify_fds_[0]);
+  if (notify_fds_[1] >= 0)
+    close(notify_fds_[1]);
+
+  pthread_cond_destroy(&cond_);
+  pthread_mutex_destroy(&mtx_);
+}
+
+// Accessors.
+size_t DurabilitySyncer::outstanding(void) const {
+  pthread_mutex_lock(&mtx_);
+  size_t cnt = outstanding_;
+  pthread_mutex_unlock(&mtx_);
+
+  return cnt;
+}
+
+unsigned long DurabilitySyncer::batches(void) const {
+  pthread_mutex_lock(&mtx_);
+  unsigned long cnt = batches_;
+  pthread_mutex_unlock(&mtx_);
+
+  return cnt;
+}
+
+unsigned long DurabilitySyncer::files_synced(void) const {
+  pthread_mutex_lock(&mtx_);
+  unsigned long cnt = files_synced_;
+  pthread_mutex_unlock(&mtx_);
+
+  return cnt;
+}
+
+// Mutators.
+void DurabilitySyncer::set_syncfs_min(const size_t cnt) {
+  pthread_mutex_lock(&mtx_);
+  syncfs_min_ = cnt;
+  pthread_mutex_unlock(&mtx_);
+}
+
+// DurabilitySyncer manipulation.
+
+// Routine to start our thread.
+//
+// Note, this routine can set an ErrorHandler event.
+void DurabilitySyncer::Init(const size_t max_batch, const long max_delay) {
+  if (IsRunning()) {
+    error.Init(EX_SOFTWARE, "DurabilitySyncer::Init(): already running");
+    return;
+  }
+
+  max_batch_ = (max_batch > 0) ? max_batch : DURABILITYSYNCER_DEFAULT_MAX_BATCH;
+  max_delay_ = (max_delay > 0) ? max_delay : 0;
+
+  if (notify_fds_[0] < 0) {
+    if (pipe(notify_fds_) < 0) {
+      error.Init(EX_OSERR, "DurabilitySyncer::Init(): pipe(2) failed: %s",
+                 strerror(errno));
+      return;
+    }
+    for (int i = 0; i < 2; i++) {
+      fcntl(notify_fds_[i], F_SETFL,
+            fcntl(notify_fds_[i], F_GETFL, 0) | O_NONBLOCK);
+      fcntl(notify_fds_[i], F_SETFD, FD_CLOEXEC);
+    }
+  }
+
+  running_ = true;
+  int ret = pthread_create(&tid_, NULL, durability_syncer_thread, this);
+  if (ret != 0) {
+    running_ = false;
+    error.Init(EX_OSERR, "DurabilitySyncer::Init(): "
+               "pthread_create(3) failed: %s", strerror(ret));
+    return;
+  }
+
+  _LOGGER(LOG_INFO, "DurabilitySyncer::Init(): started, max batch: %lu, "
+          "max delay: %ldus.", (unsigned long)max_batch_, max_delay_);
+}
+
+// Routine to queue fd (and dir) for our next batch.
+bool DurabilitySyncer::Sync(const int fd, const char* dir,
+                            durability_done_fn done, void* arg) {
+  if (!IsRunning())
+    return false;
+
+  struct durability_op* op = new struct durability_op();
+  if ((op->fd = dup(fd)) < 0) {
+    delete op;
+    return false;
+  }
+  if (dir != NULL)
+    op->dir = dir;
+  op->dev = 0;
+  op->ret = 0;
+  op->err = 0;
+  op->done = done;
+  op->arg = arg;
+
+  pthread_mutex_lock(&mtx_);
+  if (!running_) {
+    pthread_mutex_unlock(&mtx_);
+    close(op->fd);
+    delete op;
+    return false;
+  }
+  queue_.push_back(op);
+  outstanding_++;
+  pthread_cond_signal(&cond_);
+  pthread_mutex_unlock(&mtx_);
+
+  return true;
+}
+
+// Routine to run the callbacks of our synced files.
+size_t DurabilitySyncer::Complete(void) {
+  if (notify_fds_[0] >= 0) {
+    char buf[SCRATCH_BUF_SIZE];
+    while (read(notify_fds_[0], buf, sizeof(buf)) > 0)
+      ;
+  }
+
+  list<struct durability_op*> done;
+  pthread_mutex_lock(&mtx_);
+  done.swap(done_);
+  outstanding_ -= done.size();
+  pthread_mutex_unlock(&mtx_);
+
+  // Callbacks may Sync() more files, so we no longer hold our lock.
+  for (list<struct durability_op*>::iterator op = done.begin();
+       op != done.end(); op++) {
+    if ((*op)->done != NULL)
+      (*op)->done(**op, (*op)->arg);
+    delete *op;
+  }
+
+  return done.size();
+}
+
+// Routine to stop (and join) our thread.
+void DurabilitySyncer::Shutdown(void) {
+  pthread_mutex_lock(&mtx_);
+  bool running = running_;
+  running_ = false;
+  pthread_cond_broadcast(&cond_);
+  pthread_mutex_unlock(&mtx_);
+
+  if (running)
+    pthread_join(tid_, NULL);
+}
+
+// Boolean checks.
+bool DurabilitySyncer::IsRunning(void) const {
+  pthread_mutex_lock(&mtx_);
+  bool running = running_;
+  pthread_mutex_unlock(&mtx_);
+
+  return running;
+}
+
+// Private member functions.
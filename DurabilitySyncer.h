@@ -0,0 +1,192 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+
+#ifndef _DURABILITYSYNCER_H_
+#define _DURABILITYSYNCER_H_
+
+#include <sys/types.h>
+
+#include <pthread.h>
+
+#include <list>
+#include <string>
+using namespace std;
+
+#include "ErrorHandler.h"
+
+
+// Forward declarations (used if only needed for member function parameters).
+
+// Non-class specific defines & data structures.
+#define DURABILITYSYNCER_DEFAULT_MAX_BATCH 256
+#define DURABILITYSYNCER_DEFAULT_MAX_DELAY 0   // usecs, i.e., don't wait
+
+struct durability_op;
+
+/** Callback run (by DurabilitySyncer::Complete()) once a file is
+ *  durable (or its sync failed).
+ *
+ *  op.ret is 0 on success, else -1 and op.err holds the errno.
+ */
+typedef void (*durability_done_fn)(const struct durability_op& op, void* arg);
+
+struct durability_op {
+  int fd;                       // our dup(2) of the caller's descriptor
+  string dir;                   // directory to sync as well, or empty
+  dev_t dev;                    // fd's file system
+
+  int ret;                      // 0, or -1 on error
+  int err;                      // errno, if ret is -1
+
+  durability_done_fn done;      // may be NULL
+  void* arg;                    // passed to done
+};
+
+// Non-class specific utilities.
+
+
+/** Class for making written files durable in batches (group commit).
+ *
+ *  fsync(2)ing each file as it's finished costs (at least) one disk
+ *  flush and journal commit per file, and doing it in the event-loop
+ *  stalls every connection for it.  Instead, callers hand finished
+ *  files to Sync(), and our thread syncs whatever has been queued
+ *  since its last batch: it starts writeback of every file in the
+ *  batch at once (sync_file_range(2) on Linux), then fdatasync(2)s
+ *  each, so the file system can fold the batch into one journal
+ *  commit, and then fsync(2)s each distinct directory once, so the
+ *  files' names are durable, too.  While a batch is being synced,
+ *  the next one queues up, so under load batches grow to match the
+ *  disk's latency, rather than ingest being limited to one sync per
+ *  file.
+ *
+ *  Alternatively, set_syncfs_min() has a batch with that many files
+ *  on one file system syncfs(2) it once instead (Linux only), which
+ *  is cheaper for many small files, but also flushes everyone
+ *  else's dirty data on that file system.
+ *
+ *  Like AsyncFileIO, when a batch is done, a byte is written to
+ *  notify_fd(); the event-loop should then call Complete(), which
+ *  runs each file's callback (in the event-loop's thread, so
+ *  callbacks may use the ErrorHandler).  Sync() works on a dup(2) of
+ *  the caller's descriptor, so the caller may close its own at once.
+ *
+ *  RCSID: $Id: $
+ *
+ *  @see TCPSession::set_durability()
+ *  @see AsyncFileIO::Sync()
+ *  @author Andrew K. Adams <akadams@psc.edu>
+ */
+class DurabilitySyncer {
+ public:
+  /** Constructor.
+   *
+   */
+  DurabilitySyncer(void);
+
+  /** Destructor.
+   *
+   *  Syncs everything queued, stops our thread, and then runs the
+   *  callbacks of files that haven't been through Complete(), so the
+   *  syncer should be destroyed in the event-loop's thread.
+   */
+  virtual ~DurabilitySyncer(void);
+
+  // Accessors.
+  int notify_fd(void) const { return notify_fds_[0]; }
+  size_t max_batch(void) const { return max_batch_; }
+  long max_delay(void) const { return max_delay_; }
+  size_t syncfs_min(void) const { return syncfs_min_; }
+  size_t outstanding(void) const;
+  unsigned long batches(void) const;
+  unsigned long files_synced(void) const;
+
+  // Mutators.
+
+  /** Routine to syncfs(2) a batch's file system rather than
+   *  fdatasync(2) its files, if the batch has at least cnt files on
+   *  it.
+   *
+   *  Ignored on systems without syncfs(2).
+   *
+   *  @param cnt a size_t of files, or 0 (the default) to never
+   *  syncfs(2)
+   */
+  void set_syncfs_min(const size_t cnt);
+
+  // DurabilitySyncer manipulation.
+
+  /** Routine to start our thread.
+   *
+   *  Note, this routine can set an ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   *  @param max_batch a size_t of files synced at once (0 uses
+   *  DURABILITYSYNCER_DEFAULT_MAX_BATCH)
+   *  @param max_delay a long of usecs to wait for more files before
+   *  syncing a batch smaller than max_batch, e.g., to trade latency
+   *  for fewer syncs when lightly loaded, or 0
+   */
+  void Init(const size_t max_batch, const long max_delay);
+
+  /** Routine to queue a file to be made durable.
+   *
+   *  @param fd an int descriptor of the (written) file
+   *  @param dir a char* of the file's directory, which is synced
+   *  too, or NULL
+   *  @param done a durability_done_fn, or NULL
+   *  @param arg a void* passed to done
+   *  @return false if we're not running (or fd can't be dup(2)'d), in
+   *  which case done will not be called
+   */
+  bool Sync(const int fd, const char* dir, durability_done_fn done,
+            void* arg);
+
+  /** Routine to empty notify_fd() and run the callbacks of files
+   *  that are now durable.
+   *
+   *  Should be called by the event-loop when notify_fd() is readable.
+   *
+   *  @return the number of files completed
+   */
+  size_t Complete(void);
+
+  /** Routine to stop our thread.
+   *
+   *  Lets the queued files be synced, then joins it.
+   */
+  void Shutdown(void);
+
+  // Boolean checks.
+  bool IsRunning(void) const;
+
+  // Flags.
+
+  friend void* durability_syncer_thread(void* arg);
+
+ protected:
+  // Data members.
+  pthread_t tid_;
+  bool running_;
+  size_t max_batch_;
+  long max_delay_;
+  size_t syncfs_min_;
+  int notify_fds_[2];           // pipe(2), [0] is polled by the event-loop
+  list<struct durability_op*> queue_;  // waiting for the next batch
+  list<struct durability_op*> done_;   // synced, awaiting Complete()
+  size_t outstanding_;          // Sync()'d, not yet through Complete()
+  unsigned long batches_;
+  unsigned long files_synced_;
+
+  mutable pthread_mutex_t mtx_;  // lock for all of the above
+  pthread_cond_t cond_;
+
+ private:
+  // Dummy declarations for copy constructor and assignment & equality operator.
+  DurabilitySyncer(const DurabilitySyncer& src);
+  DurabilitySyncer& operator =(const DurabilitySyncer& src);
+  int operator ==(const DurabilitySyncer& other) const;
+};
+
+
+#endif  /* #ifndef _DURABILITYSYNCER_H_ */
@@ -3,13 +3,20 @@
 // Copyright © 2010, Pittsburgh Supercomputing Center (PSC).  
 // See the file 'COPYRIGHT.txt' for any restrictions.
 
+#include <sys/ioctl.h>
 #include <sys/stat.h>
+#if defined(__linux__)
+#include <linux/fs.h>      // for FICLONE
+#include <sys/sendfile.h>
+#endif
 
 #include <err.h>
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>        // for random(3)
 
+#include <utility>       // for std::move
+
 #include "ErrorHandler.h"
 #include "File.h"
 
@@ -22,6 +29,109 @@ static int max_fd = 0;
 
 
 // Non-class specific utility functions.
+
+// Routine to copy the rest of in_fd to out_fd, from (and advancing)
+// their current offsets, using one of File's COPY_* methods; buf is
+// only needed by COPY_BUFFER.  Returns 1 when done, 0 if method isn't
+// supported by these files (as the offsets still mark how far we got,
+// the caller can simply try another method), or -1 on error (errno).
+static int copy_fd(const int method, const int in_fd, const int out_fd,
+                   char* buf) {
+  bool progress = false;
+  for (;;) {
+    ssize_t n = 0;
+    switch (method) {
+#if defined(__linux__)
+      case File::COPY_RANGE :
+        n = copy_file_range(in_fd, NULL, out_fd, NULL, FILE_COPY_MAX_LEN, 0);
+        break;
+
+      case File::COPY_SENDFILE :
+        n = sendfile(out_fd, in_fd, NULL, FILE_COPY_MAX_LEN);
+        break;
+#endif
+
+      case File::COPY_BUFFER :
+        n = read(in_fd, buf, FILE_COPY_BUF_SIZE);
+        for (ssize_t offset = 0; n > 0 && offset < n;) {
+          ssize_t m = write(out_fd, buf + offset, n - offset);
+          if (m < 0 && errno != EINTR)
+            return -1;
+          if (m == 0) {
+            errno = EIO;  // no progress, don't spin
+            return -1;
+          }
+          if (m > 0)
+            offset += m;
+        }
+        break;
+
+      default :
+        return 0;
+    }
+
+    if (n > 0) {
+      progress = true;
+    } else if (n == 0) {
+      // Some file systems (e.g., /proc) report nothing to the
+      // in-kernel copies, so unless we've seen data, let the next
+      // method confirm that we're at the end.
+
+      return (progress || method == File::COPY_BUFFER) ? 1 : 0;
+    } else if (errno != EINTR) {
+      if (method != File::COPY_BUFFER &&
+          (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+           errno == EOPNOTSUPP || errno == EBADF))
+        return 0;
+
+      return -1;
+    }
+  }
+}
+
+// Routine to copy the rest of in_fd to out_fd.
+//
+// Note, this routine does not use the ErrorHandler (see File.h).
+int copy_file_fd(const int in_fd, const int out_fd) {
+#if defined(__linux__)
+  // A reflink shares the original's blocks (until either is
+  // modified), so the copy is nearly free; but it always clones the
+  // whole file, so only if we'd be copying from the start.  Like the
+  // other methods, we leave the original at its end.
+
+  if (lseek(in_fd, 0, SEEK_CUR) == 0 && ioctl(out_fd, FICLONE, in_fd) == 0) {
+    lseek(in_fd, 0, SEEK_END);
+    return File::COPY_CLONE;
+  }
+#endif
+
+  // Otherwise, try each method in turn, until one finishes the copy.
+
+  char* buf = NULL;
+  int method = File::COPY_RANGE;
+  int ret = 0;
+  for (; method <= File::COPY_BUFFER; method++) {
+    if (method == File::COPY_BUFFER &&
+        (buf = (char*)malloc(FILE_COPY_BUF_SIZE)) == NULL) {
+      errno = ENOMEM;
+      return File::COPY_NONE;
+    }
+
+    if ((ret = copy_fd(method, in_fd, out_fd, buf)) != 0)
+      break;
+  }
+  const int copy_errno = errno;
+  if (buf != NULL)
+    free(buf);
+
+  if (ret < 0) {
+    errno = copy_errno;
+    return File::COPY_NONE;
+  }
+
+  return method;
+}
+
 bool is_path_tainted(const char* path) {
   if (path == NULL)
     return false;
@@ -80,10 +190,11 @@ File::File(void)
 File::~File(void) {
 #if DEBUG_CLASS
   warnx("File::~File(void) called, cnt: %d, fd: %d.", 
-        descriptor_->cnt_, descriptor_->fd_);
+        descriptor_->cnt(), descriptor_->fd_);
 #endif
 
-  if (!--descriptor_->cnt_) {
+  // Note, a moved-from File has no Descriptor.
+  if (descriptor_ != NULL && descriptor_->Release()) {
     if (descriptor_->fd_ != DESCRIPTOR_NULL) {
       Close();
     } else if (descriptor_->fp_ != NULL) {
@@ -99,14 +210,14 @@ File::File(const File& src)
     : name_(src.name_), dir_(src.dir_) {
 #if DEBUG_CLASS
   warnx("File::File(const File&) called, src cnt: %d, fd: %d.", 
-        src.descriptor_->cnt_, src.descriptor_->fd_);
+        src.descriptor_->cnt(), src.descriptor_->fd_);
 #endif
 
   // Since our Descriptor data member is just a pointer, we simply set
   // it to point to the source, then bump its reference count.
 
   descriptor_ = src.descriptor_;
-  descriptor_->cnt_++;
+  descriptor_->Acquire();
 
   //backup_mode_ = src.backup_mode_;
 }
@@ -115,18 +226,25 @@ File::File(const File& src)
 File& File::operator =(const File& src) {
 #if DEBUG_CLASS
   warnx("File::opertator =(const File&) called, cnt: %d, fd: %d, src cnt: %d, fd: %d.", 
-        descriptor_->cnt_, descriptor_->fd_, 
-        src.descriptor_->cnt_, src.descriptor_->fd_);
+        descriptor_->cnt(), descriptor_->fd_, 
+        src.descriptor_->cnt(), src.descriptor_->fd_);
 #endif 
 
   name_ = src.name_;
   dir_ = src.dir_;
   //backup_mode_ = src.backup_mode_;
 
+  // Grab our reference to the source's Descriptor first, so
+  // self-assignment (or src sharing our Descriptor) can't drop the
+  // count to zero underneath us.
+
+  Descriptor* descriptor = src.descriptor_;
+  descriptor->Acquire();
+
   // If we're about to remove our last instance of the Descriptor we
   // currently point to, clean it up first!
 
-  if (!--descriptor_->cnt_) {
+  if (descriptor_ != NULL && descriptor_->Release()) {
     if (descriptor_->fd_ != DESCRIPTOR_NULL) {
       Close();
     } else if (descriptor_->fp_ != NULL) {
@@ -136,10 +254,50 @@ File& File::operator =(const File& src) {
   }
 
   // Now, since our Descriptor data member is just a pointer, we can
-  // (re-)associate it to source's, then bump its reference count.
+  // (re-)associate it to source's (already bumped above).
+
+  descriptor_ = descriptor;
+
+  return *this;
+}
+
+// Move constructor and assignment.  We take over src's Descriptor
+// (and its reference), leaving src without one.
+File::File(File&& src) noexcept
+    : name_(std::move(src.name_)), dir_(std::move(src.dir_)) {
+#if DEBUG_CLASS
+  warnx("File::File(File&&) called.");
+#endif
+
+  descriptor_ = src.descriptor_;
+  src.descriptor_ = NULL;
+}
+
+File& File::operator =(File&& src) noexcept {
+#if DEBUG_CLASS
+  warnx("File::operator =(File&&) called.");
+#endif
+
+  if (this == &src)
+    return *this;
+
+  name_ = std::move(src.name_);
+  dir_ = std::move(src.dir_);
+
+  // Drop our current Descriptor (as in the assignment operator), then
+  // take over src's.
+
+  if (descriptor_ != NULL && descriptor_->Release()) {
+    if (descriptor_->fd_ != DESCRIPTOR_NULL) {
+      Close();
+    } else if (descriptor_->fp_ != NULL) {
+      Fclose();
+    }
+    delete descriptor_;
+  }
 
   descriptor_ = src.descriptor_;
-  descriptor_->cnt_++;
+  src.descriptor_ = NULL;
 
   return *this;
 }
@@ -279,7 +437,7 @@ void File::set_fp(FILE* fp) {
 void File::clear(void) {
 #if DEBUG_CLASS
   warnx("File::clear(void) called, cnt: %d, fd: %d.", 
-        descriptor_->cnt_, descriptor_->fd_);
+        descriptor_->cnt(), descriptor_->fd_);
 #endif 
 
   name_.clear();
@@ -289,7 +447,7 @@ void File::clear(void) {
   // If we're about to remove our last instance of the current
   // Descriptor, clean up the Descriptor object.
 
-  if (!--descriptor_->cnt_) {
+  if (descriptor_ != NULL && descriptor_->Release()) {
     if (descriptor_->fd_ != DESCRIPTOR_NULL) {
       Close();
     } else if (descriptor_->fp_ != NULL) {
@@ -413,6 +571,40 @@ void File::Open(const char* sandbox, const int flags, const mode_t mode) {
     max_fd = descriptor_->fd_;
 }
 
+// Routine to open(2) a low-level file descriptor for direct I/O,
+// falling back to Open() if the file system won't have it.
+//
+// Note, this routine can set an ErrorHandler event.
+void File::OpenDirect(const char* sandbox, const int flags,
+                      const mode_t mode) {
+#if defined(__linux__)
+  if (descriptor_->fp_ == NULL && descriptor_->fd_ == DESCRIPTOR_NULL &&
+      name_.size() > 0 && name_ != "stdin") {
+    int fd = open(path(sandbox).c_str(), flags | O_DIRECT, mode);
+    if (fd < 0 && errno != EINVAL) {
+      error.Init(EX_IOERR, "File::OpenDirect(%s, %d, %d) failed: %s", 
+                 path(sandbox).c_str(), flags, mode, strerror(errno));
+      return;
+    } else if (fd >= 0) {
+      descriptor_->fd_ = fd;
+      if (descriptor_->fd_ > max_fd)
+        max_fd = descriptor_->fd_;
+      return;
+    }
+
+    // EINVAL means the file system (e.g., an older tmpfs) doesn't do
+    // O_DIRECT, so we settle for the page cache.
+  }
+#endif
+
+  Open(sandbox, flags, mode);
+
+#if !defined(__linux__) && defined(F_NOCACHE)
+  if (!error.Event())
+    fcntl(descriptor_->fd_, F_NOCACHE, 1);
+#endif
+}
+
 // Routine to close(2) a low-level file descriptor.
 void File::Close(void) {
 #if DEBUG_CLASS
@@ -564,10 +756,12 @@ void File::Rename(const char* sandbox, const char* newname,
 }
 
 // Routine to make a low-level copy of the contents of a File object.
-void File::Copy(const char* sandbox, const char* newname, const char* newdir) {
+//
+// Note, this routine can set an ErrorHandler event.
+int File::Copy(const char* sandbox, const char* newname, const char* newdir) {
   if (descriptor_->fd_ == DESCRIPTOR_NULL) {
     error.Init(EX_SOFTWARE, "File::Copy(): fd is NULL");
-    return;
+    return COPY_NONE;
   }
 
   // Now, determine if we are changing the file or the dir; as this
@@ -584,34 +778,93 @@ void File::Copy(const char* sandbox, const char* newname, const char* newdir) {
     copy.Init(name_.c_str(), newdir);
   } else {
     error.Init(EX_SOFTWARE, "File::Copy(): newname and newdir were NULL.");
-    return;
+    return COPY_NONE;
   }
 
   // Open our new copy of the file.
   copy.Open(sandbox, O_WRONLY | O_CREAT | O_TRUNC, S_IRWXU | S_IRGRP | S_IROTH);
+  if (error.Event()) {
+    error.AppendMsg("File::Copy(): ");
+    return COPY_NONE;
+  }
 
-  // Loop over original file reading chunks and writing them to our
-  // new file ...
-
-  unsigned char tmp_buf[FILE_CHUNK_SIZE];
-  ssize_t n;
-  while ((n = read(descriptor_->fd_, tmp_buf, FILE_CHUNK_SIZE)) > 0) {
-    ssize_t m = 0;
-    while ((m = write(copy.descriptor_->fd_, tmp_buf + m, n - m)) > 0)
-      ;
-    if (m < 0) {
-      error.Init(EX_IOERR, "File::Copy(): write(%s,%ld) failed: %s", 
-                 copy.path(sandbox).c_str(), n, strerror(errno));
-      return;
-    }
+  int method = copy_file_fd(descriptor_->fd_, copy.descriptor_->fd_);
+  if (method == COPY_NONE) {
+    error.Init(EX_IOERR, "File::Copy(): copying %s to %s failed: %s", 
+               path(sandbox).c_str(), copy.path(sandbox).c_str(), 
+               strerror(errno));
+    return COPY_NONE;
   }
-  if (n < 0) {
-    error.Init(EX_IOERR, "File::Copy(): read(%s) failed: %s", 
-               path(sandbox).c_str(), strerror(errno));
+
+  copy.Close();
+  return method;
+}
+
+// Routine to preallocate (but not zero) len bytes of the file.
+//
+// Note, this routine can set an ErrorHandler event.
+void File::Allocate(const off_t len) {
+  if (descriptor_->fd_ == DESCRIPTOR_NULL) {
+    error.Init(EX_SOFTWARE, "File::Allocate(): fd is NULL");
     return;
   }
 
-  copy.Close();
+#if defined(__linux__)
+  if (len <= 0)
+    return;
+
+  int ret;
+  do {
+    ret = fallocate(descriptor_->fd_, FALLOC_FL_KEEP_SIZE, 0, len);
+  } while (ret < 0 && errno == EINTR);
+  if (ret < 0 && errno != EOPNOTSUPP && errno != ENOSYS)
+    error.Init(EX_IOERR, "File::Allocate(): fallocate(%s, %ld) failed: %s",
+               print().c_str(), (long)len, strerror(errno));
+#endif
+}
+
+// Routine to ftruncate(2) the file.
+//
+// Note, this routine can set an ErrorHandler event.
+void File::Truncate(const off_t len) {
+  if (descriptor_->fd_ == DESCRIPTOR_NULL) {
+    error.Init(EX_SOFTWARE, "File::Truncate(): fd is NULL");
+    return;
+  }
+
+  int ret;
+  do {
+    ret = ftruncate(descriptor_->fd_, len);
+  } while (ret < 0 && errno == EINTR);
+  if (ret < 0)
+    error.Init(EX_IOERR, "File::Truncate(): ftruncate(%s, %ld) failed: %s",
+               print().c_str(), (long)len, strerror(errno));
+}
+
+// Routine to free the disk space of part of the file.
+void File::PunchHole(const off_t offset, const off_t len) const {
+#if defined(__linux__)
+  if (descriptor_->fd_ != DESCRIPTOR_NULL && len > 0)
+    fallocate(descriptor_->fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+              offset, len);
+#endif
+}
+
+// Routine to pass advice about our use of the file to the kernel.
+void File::Advise(const off_t offset, const off_t len,
+                  const int advice) const {
+#if defined(__linux__)
+  if (descriptor_->fd_ != DESCRIPTOR_NULL)
+    posix_fadvise(descriptor_->fd_, offset, len, advice);
+#endif
+}
+
+// Routine to start (asynchronous) writeback of part of the file.
+void File::WriteBehind(const off_t offset, const off_t len) const {
+#if defined(__linux__)
+  if (descriptor_->fd_ != DESCRIPTOR_NULL)
+    sync_file_range(descriptor_->fd_, offset, len, SYNC_FILE_RANGE_WRITE);
+#endif
 }
 
 
@@ -623,6 +876,20 @@ bool File::IsOpen(void) const {
   return false;
 }
 
+// Routine to check if the file was opened for direct I/O.  Note,
+// macOS's F_NOCACHE can't be queried, so there it's always false.
+bool File::IsDirect(void) const {
+#if defined(__linux__)
+  if (descriptor_->fd_ == DESCRIPTOR_NULL)
+    return false;
+
+  int flags = fcntl(descriptor_->fd_, F_GETFL);
+  return (flags >= 0 && (flags & O_DIRECT)) ? true : false;
+#else
+  return false;
+#endif
+}
+
 bool File::IsStdin(void) const {
   if ((descriptor_->fp_ && descriptor_->fp_ == stdin) || descriptor_->fd_ == 0)
     return true;
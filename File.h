@@ -27,14 +27,34 @@ using namespace std;
 #define FILE_TMP_DIR "tmp/"		// used in Roll() with MOVE_FILE flag
 
 #define FILE_CHUNK_SIZE 1024 * 4
+#define FILE_COPY_BUF_SIZE (1024 * 1024)   // Copy()'s read(2)/write(2) loop
+#define FILE_COPY_MAX_LEN (1024 * 1024 * 1024)  // per in-kernel copy call
+#define FILE_DIRECT_IO_ALIGN 4096  // OpenDirect() buffers, offsets & lengths
 
 const int kFileChunkSize = FILE_CHUNK_SIZE;
 
+#if !defined(__linux__)
+#define POSIX_FADV_SEQUENTIAL 2   // for Advise(); not all OSes have them
+#define POSIX_FADV_DONTNEED 4
+#endif
+
 // Non-class specific utility functions.
 bool is_path_tainted(const char* path);
 bool is_path_slash_terminated(const char* path);
 string gen_random_string(size_t len);
 
+/** Routine to copy the rest of one open file to another.
+ *
+ *  The work behind File::Copy(), using the same methods (see there)
+ *  from in_fd's current offset.  It doesn't use the ErrorHandler, so
+ *  it's safe to call from any thread, e.g., by AsyncFileIO.
+ *
+ *  @param in_fd an int descriptor open for reading
+ *  @param out_fd an int descriptor open for writing
+ *  @return an int File::COPY_* method, or File::COPY_NONE (see errno)
+ */
+int copy_file_fd(const int in_fd, const int out_fd);
+
 /** Class for streaming & low-level file I/O.
  *
  *  The File class uses the Descriptor class to *safely* copy and
@@ -75,6 +95,20 @@ class File {
    */
   File& operator =(const File& src);
 
+  /** Move constructor.
+   *
+   *  Takes over src's Descriptor without touching its reference
+   *  count.  Note, the moved-from File has *no* Descriptor, so it may
+   *  only be destroyed, assigned to or clear()'d.
+   */
+  File(File&& src) noexcept;
+
+  /** Move assignment operator.
+   *
+   *  Same semantics as the move constructor.
+   */
+  File& operator =(File&& src) noexcept;
+
   /** Equality operator (needed for use with the STL).
    *
    */
@@ -88,7 +122,8 @@ class File {
    *
    *  @return int specifying the file descriptor within the Descriptor class
    */
-  const int fd(void) const { return descriptor_->fd_; }
+  const int fd(void) const { 
+    return (descriptor_ != NULL) ? descriptor_->fd_ : DESCRIPTOR_NULL; }
 
   /** Routine to return the streaming file descriptor in the File object.
    *
@@ -98,7 +133,8 @@ class File {
    *
    *  @return FILE* specifying the file descriptor within the Descriptor class
    */
-  FILE* fp(void) const { return descriptor_->fp_; }
+  FILE* fp(void) const { 
+    return (descriptor_ != NULL) ? descriptor_->fp_ : NULL; }
 
   /** Routine to return the full path to the File object.
    *
@@ -200,6 +236,27 @@ class File {
    */
   void Open(const char* sandbox, const int flags, mode_t mode);
 
+  /** Routine to open(2) a low-level File object for direct I/O.
+   *
+   *  Like Open(), but with O_DIRECT (F_NOCACHE on macOS), so reads
+   *  and writes go straight between our buffers and the disk,
+   *  bypassing (and not polluting) the page cache.  Every read(2) &
+   *  write(2) must then use a buffer, offset and length that are
+   *  multiples of FILE_DIRECT_IO_ALIGN (see AlignedBufPool); a read
+   *  may come up short at the end of the file, and a write's padding
+   *  past the end can be cut off with Truncate().  If the file system
+   *  can't do direct I/O, the file is simply Open()'d (see
+   *  IsDirect()).
+   *
+   *  Note, this routine can set an ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   *  @param sandbox char* specifying the root path to the File object (or NULL)
+   *  @param flags int specifying flags controling open operation
+   *  @param mode mode_t specifying permissions if flag O_CREAT is used
+   */
+  void OpenDirect(const char* sandbox, const int flags, const mode_t mode);
+
   /** Routine to close(2) a low-level File object.
    *
    */
@@ -242,6 +299,13 @@ class File {
   void Rename(const char* sandbox, const char* newname, const char* newdir);
 
   /** Routine to make an on-disk copy of a file.
+   *
+   *  Copies from the file's current offset to its end, preferring
+   *  to let the kernel do the work: a reflink (FICLONE) if the copy
+   *  starts at offset 0 and the file system shares blocks between
+   *  files, else copy_file_range(2), else sendfile(2), and only
+   *  then a read(2)/write(2) loop.  Each falls back to the next if
+   *  the file systems involved don't support it.
    *
    *  TOOD(aka) It's arguable that this routine should *open* the
    *  original, as we probably don't want to allow differnt
@@ -253,19 +317,81 @@ class File {
    *  @param sandbox char* specifying the root path to the File object (or NULL)
    *  @param newname char* specifying the new name (or path or NULL) 
    *  @param newdir char* specifying the new dir (or NULL)
+   *  @return an int of the COPY_* method that finished the copy (COPY_NONE on error)
+   */
+  int Copy(const char* sandbox, const char* newname, const char* newdir);
+
+  /** Routine to reserve disk space for the first len bytes of the file.
+   *
+   *  Uses fallocate(2), keeping the file's size, so a file we're
+   *  about to fill is laid out in as few extents as possible, and a
+   *  full disk fails now rather than part way through.  Does nothing
+   *  if the file system (or OS) can't preallocate.
+   *
+   *  Note, this routine can set an ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   *  @param len an off_t of the bytes we'll be writing
+   */
+  void Allocate(const off_t len);
+
+  /** Routine to set the file's size, i.e., ftruncate(2).
+   *
+   *  Note, this routine can set an ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   *  @param len an off_t of the new size
+   */
+  void Truncate(const off_t len);
+
+  /** Routine to give back the disk space of part of the file.
+   *
+   *  Uses fallocate(2)'s FALLOC_FL_PUNCH_HOLE, keeping the file's
+   *  size, i.e., the range then reads as zeros.  Errors are ignored,
+   *  and it does nothing on other OSes (or file systems without
+   *  holes).
+   *
+   *  @param offset an off_t of the start of the range
+   *  @param len an off_t of the length of the range
+   */
+  void PunchHole(const off_t offset, const off_t len) const;
+
+  /** Routine to tell the kernel how we'll use part of the file.
+   *
+   *  Only advice (see posix_fadvise(2)), so errors are ignored.
+   *
+   *  @param offset an off_t of the start of the range
+   *  @param len an off_t of the length of the range, 0 for the rest
+   *  @param advice an int, e.g., POSIX_FADV_SEQUENTIAL or
+   *  POSIX_FADV_DONTNEED
+   */
+  void Advise(const off_t offset, const off_t len, const int advice) const;
+
+  /** Routine to start writing part of the file back to disk.
+   *
+   *  Uses sync_file_range(2), which doesn't wait, so the dirty pages
+   *  of a large file are written as we go, rather than all at once
+   *  when the kernel gets around to it (and can then be dropped with
+   *  Advise(POSIX_FADV_DONTNEED)).  Errors are ignored, and it does
+   *  nothing on other OSes.
+   *
+   *  @param offset an off_t of the start of the range
+   *  @param len an off_t of the length of the range, 0 for the rest
    */
-  void Copy(const char* sandbox, const char* newname, const char* newdir);
+  void WriteBehind(const off_t offset, const off_t len) const;
 
   // XXX void Flock(int operation);  // apply lock to open file
 
   // Boolean checks.
   bool IsOpen(void) const;                       // true if file is open
+  bool IsDirect(void) const;                     // true if O_DIRECT
   bool IsStdin(void) const;                      // true if fd is 0
   bool IsExecutable(const char* sandbox) const;  // true if it's executable
   bool Exists(const char* sandbox) const;        // true 1 if file exists
 
   // Flags.
   // XXX enum { NO_BACKUP, ROLL_FILE, MOVE_FILE, };
+  enum { COPY_NONE, COPY_CLONE, COPY_RANGE, COPY_SENDFILE, COPY_BUFFER, };
 
   friend class TCPSession;  // so TCPSession can stream to/from files
 
@@ -0,0 +1,227 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Logger.h"
+#include "FileCache.h"
+
+#define DEBUG_CLASS 0
+
+FileCache file_cache;  // global definition, for all who serve files
+
+// Non-class specific defines & data structures.
+
+// Non-class specific utility functions.
+
+// Routine to check if two stat(2)s are of the same, unchanged file.
+static bool is_same_file(const struct stat& a, const struct stat& b) {
+  if (a.st_dev != b.st_dev || a.st_ino != b.st_ino ||
+      a.st_size != b.st_size || a.st_mtime != b.st_mtime)
+    return false;
+
+#if defined(__linux__)
+  if (a.st_mtim.tv_nsec != b.st_mtim.tv_nsec)
+    return false;
+#endif
+
+  return true;
+}
+
+// Routine to return the (unsandboxed) path of file, as our key.
+static string cache_key(const File& file) {
+  return file.dir() + file.name();
+}
+
+// Routine to set dst to the same file as src, but with its own
+// (new) Descriptor, as src may share its Descriptor with Files we
+// know nothing about (and which may get Close()'d).
+static void init_like(const File& src, File* dst) {
+  if (src.dir().size() > 0)
+    dst->set_dir(src.dir().c_str());
+  dst->set_name(src.name().c_str());
+}
+
+
+// FileCache Class.
+
+// Constructors and destructor.
+FileCache::FileCache(void) : lru_(), entries_() {
+#if DEBUG_CLASS
+  warnx("FileCache::FileCache(void) called.");
+#endif
+
+  max_files_ = FILECACHE_DEFAULT_MAX_FILES;
+  hits_ = 0;
+  misses_ = 0;
+  pthread_mutex_init(&mtx_, NULL);
+}
+
+FileCache::~FileCache(void) {
+#if DEBUG_CLASS
+  warnx("FileCache::~FileCache(void) called.");
+#endif
+
+  clear();
+  pthread_mutex_destroy(&mtx_);
+}
+
+// Accessors.
+size_t FileCache::max_files(void) const {
+  pthread_mutex_lock(&mtx_);
+  size_t max_files = max_files_;
+  pthread_mutex_unlock(&mtx_);
+
+  return max_files;
+}
+
+size_t FileCache::size(void) const {
+  pthread_mutex_lock(&mtx_);
+  size_t cnt = lru_.size();
+  pthread_mutex_unlock(&mtx_);
+
+  return cnt;
+}
+
+unsigned long FileCache::hits(void) const {
+  pthread_mutex_lock(&mtx_);
+  unsigned long cnt = hits_;
+  pthread_mutex_unlock(&mtx_);
+
+  return cnt;
+}
+
+unsigned long FileCache::misses(void) const {
+  pthread_mutex_lock(&mtx_);
+  unsigned long cnt = misses_;
+  pthread_mutex_unlock(&mtx_);
+
+  return cnt;
+}
+
+// Mutators.
+void FileCache::set_max_files(const size_t max_files) {
+  pthread_mutex_lock(&mtx_);
+  max_files_ = max_files;
+  Evict();
+  pthread_mutex_unlock(&mtx_);
+}
+
+// FileCache manipulation.
+
+// Routine to open file (read-only) through our cache.
+//
+// Note, this routine can set an ErrorHandler event.
+void FileCache::Open(File* file) {
+  if (!IsEnabled()) {
+    file->Open(NULL, O_RDONLY, 0);
+    return;
+  }
+
+  if (Find(file))
+    return;
+
+  File cached;
+  init_like(*file, &cached);
+  cached.Open(NULL, O_RDONLY, 0);
+  if (error.Event()) {
+    error.AppendMsg("FileCache::Open(): ");
+    return;
+  }
+
+  Insert(cached);
+  *file = cached;
+}
+
+// Routine to cache a descriptor opened elsewhere.
+void FileCache::Adopt(File* file, const int fd) {
+  if (!IsEnabled()) {
+    file->set_fd(fd);
+    return;
+  }
+
+  File cached;
+  init_like(*file, &cached);
+  cached.set_fd(fd);
+
+  Insert(cached);
+  *file = cached;
+}
+
+// Routine to share a cached descriptor with file, if the file
+// hasn't changed since we opened it.
+bool FileCache::Find(File* file) {
+  if (!IsEnabled())
+    return false;
+
+  const string path = cache_key(*file);
+  struct stat st;
+  if (stat(path.c_str(), &st) < 0)
+    return false;  // let our caller's open(2) report it
+
+  pthread_mutex_lock(&mtx_);
+  map<string, list<struct file_cache_entry>::iterator>::iterator itr =
+      entries_.find(path);
+  if (itr == entries_.end() || !is_same_file(itr->second->st, st)) {
+    misses_++;
+    pthread_mutex_unlock(&mtx_);
+    return false;
+  }
+
+  lru_.splice(lru_.begin(), lru_, itr->second);  // now most recent
+  *file = itr->second->file;
+  hits_++;
+  pthread_mutex_unlock(&mtx_);
+
+  return true;
+}
+
+// Routine to empty the cache.
+void FileCache::clear(void) {
+  pthread_mutex_lock(&mtx_);
+  entries_.clear();
+  lru_.clear();
+  pthread_mutex_unlock(&mtx_);
+}
+
+// Boolean checks.
+
+// Private member functions.
+
+// Routine to add (or replace) file's entry.  Note the file as we
+// opened it (even if its path has since been replaced, in which
+// case, the next Find() won't match).
+void FileCache::Insert(const File& file) {
+  struct file_cache_entry entry;
+  if (fstat(file.fd(), &entry.st) < 0) {
+    _LOGGER(LOG_WARNING, "FileCache::Insert(): fstat(%s) failed: %s",
+            file.print().c_str(), strerror(errno));
+    return;
+  }
+  entry.path = cache_key(file);
+  entry.file = file;
+
+  pthread_mutex_lock(&mtx_);
+  map<string, list<struct file_cache_entry>::iterator>::iterator itr =
+      entries_.find(entry.path);
+  if (itr != entries_.end())
+    lru_.erase(itr->second);
+
+  lru_.push_front(entry);
+  entries_[entry.path] = lru_.begin();
+  Evict();
+  pthread_mutex_unlock(&mtx_);
+}
+
+// Routine to drop the least recently used entries until we're within
+// max_files_.  Note, the caller must hold mtx_.
+void FileCache::Evict(void) {
+  while (lru_.size() > max_files_) {
+    entries_.erase(lru_.back().path);
+    lru_.pop_back();
+  }
+}
@@ -0,0 +1,158 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+
+#ifndef _FILECACHE_H_
+#define _FILECACHE_H_
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <pthread.h>
+
+#include <list>
+#include <map>
+#include <string>
+using namespace std;
+
+#include "ErrorHandler.h"
+#include "File.h"
+
+
+// Forward declarations (used if only needed for member function parameters).
+
+// Non-class specific defines & data structures.
+#define FILECACHE_DEFAULT_MAX_FILES 0   // i.e., disabled
+
+struct file_cache_entry {
+  string path;                  // key, i.e., dir + name
+  File file;                    // holds our reference to the descriptor
+  struct stat st;               // what the file was when we opened it
+};
+
+// Non-class specific utilities.
+
+
+/** Class for sharing open, read-only descriptors of files that are
+ *  served over and over.
+ *
+ *  Rather than every outgoing message open(2)ing (and closing) its
+ *  file-body, TCPSession asks the process-wide file_cache, which
+ *  hands back a File sharing the descriptor it opened the first
+ *  time, i.e., through the File's (reference counted) Descriptor.
+ *  As everyone reads with pread(2), any number of sessions (and
+ *  threads) can send from it at once.
+ *
+ *  Each lookup stat(2)s the path, and if the file was replaced
+ *  (device or inode) or changed (size or mtime) since we opened it,
+ *  opens it again.  At most max_files() descriptors are kept, and
+ *  the least recently used is dropped first; a dropped (or
+ *  replaced) descriptor is closed when the last File using it goes
+ *  away.  Note, a deleted file's space isn't freed until then, which
+ *  is why the cache is disabled (max_files() of 0) by default.
+ *
+ *  FileCache is thread-safe.
+ *
+ *  RCSID: $Id: $
+ *
+ *  @see File
+ *  @see TCPSession::AddMsgFile()
+ *  @author Andrew K. Adams <akadams@psc.edu>
+ */
+class FileCache {
+ public:
+  /** Constructor.
+   *
+   */
+  FileCache(void);
+
+  /** Destructor.
+   *
+   *  Drops our references; descriptors still in use stay open until
+   *  their Files are done with them.
+   */
+  virtual ~FileCache(void);
+
+  // Accessors.
+  size_t max_files(void) const;
+  size_t size(void) const;
+  unsigned long hits(void) const;
+  unsigned long misses(void) const;
+
+  // Mutators.
+
+  /** Routine to set how many descriptors we keep open.
+   *
+   *  0 disables the cache (and empties it).
+   */
+  void set_max_files(const size_t max_files);
+
+  // FileCache manipulation.
+
+  /** Routine to open(2) a file read-only, sharing a cached descriptor
+   *  if we have a good one.
+   *
+   *  On return, file has a new Descriptor, shared with the cache (and
+   *  anyone else reading the same file), i.e., it must only be read
+   *  with pread(2), and must not be Close()'d (just let it go out of
+   *  scope).  If the cache is disabled, this is simply
+   *  File::Open(NULL, O_RDONLY, 0).  Note, this routine can set an
+   *  ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   *  @param file a File* that has been Init()'d, but not opened
+   */
+  void Open(File* file);
+
+  /** Routine to look for a good cached descriptor of file.
+   *
+   *  Like Open(), but never open(2)s anything, e.g., for callers who
+   *  do their opens asynchronously (and then Adopt() the result).
+   *
+   *  @return true if file now shares a cached descriptor
+   */
+  bool Find(File* file);
+
+  /** Routine to set file's descriptor to fd (already open(2)'d
+   *  read-only), and cache it.
+   *
+   *  Replaces any entry for the same path.  As with Open(), file gets
+   *  a new Descriptor (shared with the cache), i.e., any Files that
+   *  shared its old one are left as they were.  If the cache is
+   *  disabled, this is simply File::set_fd().
+   */
+  void Adopt(File* file, const int fd);
+
+  /** Routine to drop everything we have cached.
+   *
+   */
+  void clear(void);
+
+  // Boolean checks.
+  bool IsEnabled(void) const { return (max_files() > 0) ? true : false; }
+
+  // Flags.
+
+ protected:
+  // Data members.
+  size_t max_files_;
+  list<struct file_cache_entry> lru_;  // most recently used first
+  map<string, list<struct file_cache_entry>::iterator> entries_;
+  unsigned long hits_;
+  unsigned long misses_;
+
+  mutable pthread_mutex_t mtx_;  // lock for all of the above
+
+ private:
+  void Insert(const File& file);
+  void Evict(void);
+
+  // Dummy declarations for copy constructor and assignment & equality operator.
+  FileCache(const FileCache& src);
+  FileCache& operator =(const FileCache& src);
+  int operator ==(const FileCache& other) const;
+};
+
+extern ::FileCache file_cache;  // declaration of the process-wide cache
+
+
+#endif  /* #ifndef _FILECACHE_H_ */
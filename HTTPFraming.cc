@@ -8,6 +8,7 @@
 #include <stdlib.h>
 
 #include <string>
+#include <utility>       // for std::move
 using namespace std;
 
 #include "ErrorHandler.h"
@@ -182,6 +183,36 @@ HTTPFraming& HTTPFraming::operator =(const HTTPFraming& src) {
   return *this;
 }
 
+// Move constructor & assignment.
+HTTPFraming::HTTPFraming(HTTPFraming&& src) noexcept
+    : uri_(std::move(src.uri_)), msg_hdrs_(std::move(src.msg_hdrs_)) {
+#if DEBUG_CLASS
+  warnx("HTTPFraming::HTTPFraming(HTTPFraming&& src) called.");
+#endif
+
+  major_ = src.major_;
+  minor_ = src.minor_;
+  msg_type_ = src.msg_type_;
+  method_ = src.method_;
+  status_code_ = src.status_code_;
+}
+
+HTTPFraming& HTTPFraming::operator =(HTTPFraming&& src) noexcept {
+#if DEBUG_CLASS
+  warnx("HTTPFraming::operator =(HTTPFraming&& src) called.");
+#endif
+
+  major_ = src.major_;
+  minor_ = src.minor_;
+  msg_type_ = src.msg_type_;
+  msg_hdrs_ = std::move(src.msg_hdrs_);
+  method_ = src.method_;
+  status_code_ = src.status_code_;
+  uri_ = std::move(src.uri_);
+
+  return *this;
+}
+
 #if 0
 // Overloaded operator: equality functions.
 int HTTPFraming::operator ==(const HTTPFraming& other)
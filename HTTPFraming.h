@@ -72,13 +72,24 @@ class HTTPFraming {
    *
    */
   HTTPFraming& operator =(const HTTPFraming& src);
+
+  /** Move constructor.
+   *
+   *  Steals src's URL & message-headers (src is left empty).
+   */
+  HTTPFraming(HTTPFraming&& src) noexcept;
+
+  /** Move assignment operator.
+   *
+   */
+  HTTPFraming& operator =(HTTPFraming&& src) noexcept;
   
   // Accessors.
   int msg_type(void) const { return msg_type_; }
   int method(void) const { return method_; }
-  URL uri(void) const { return uri_; }
+  const URL& uri(void) const { return uri_; }
   int status_code(void) const { return status_code_; }
-  vector<rfc822_msg_hdr> msg_hdrs(void) const { return msg_hdrs_; }
+  const vector<rfc822_msg_hdr>& msg_hdrs(void) const { return msg_hdrs_; }
   
   /** Routine to return the HTTP framing header length.
    *
@@ -0,0 +1,780 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#include "Logger.h"
+#include "IOUring.h"
+
+#define DEBUG_CLASS 0
+
+// Non-class specific defines & data structures.
+#define IOURING_RECV_GROUP 0    // buffer group of our receive buffers
+#define IOURING_MAX_RECV_BUFS 32768
+
+// Non-class specific utility functions.
+
+
+// IOUring Class.
+
+// Constructors and destructor.
+IOUring::IOUring(void) {
+#if DEBUG_CLASS
+  warnx("IOUring::IOUring(void) called.");
+#endif
+
+  ring_fd_ = -1;
+  notify_fd_ = -1;
+  sq_entries_ = 0;
+  sq_ring_ = NULL;
+  sq_ring_size_ = 0;
+  cq_ring_ = NULL;
+  cq_ring_size_ = 0;
+  sqes_ = NULL;
+  sqes_size_ = 0;
+  sq_head_ = sq_tail_ = NULL;
+  sq_mask_ = 0;
+  cq_head_ = cq_tail_ = NULL;
+  cq_mask_ = 0;
+  cqes_ = NULL;
+  sq_queued_ = 0;
+  slots_ = NULL;
+  slot_size_ = 0;
+  recv_ring_ = NULL;
+  recv_bufs_ = NULL;
+  recv_cnt_ = 0;
+  recv_buf_size_ = 0;
+  outstanding_ = 0;
+  reqs_ = NULL;
+  enters_ = 0;
+  ops_submitted_ = 0;
+  ops_completed_ = 0;
+}
+
+IOUring::~IOUring(void) {
+#if DEBUG_CLASS
+  warnx("IOUring::~IOUring(void) called.");
+#endif
+
+  Release();
+}
+
+#if defined(__linux__)
+
+// Accessors.
+char* IOUring::recv_buf(const struct io_uring_cqe& cqe) const {
+  if (recv_bufs_ == NULL || !(cqe.flags & IORING_CQE_F_BUFFER))
+    return NULL;
+
+  return recv_bufs_ +
+      (size_t)(cqe.flags >> IORING_CQE_BUFFER_SHIFT) * recv_buf_size_;
+}
+
+// Mutators.
+
+// IOUring manipulation.
+
+// Routine to set up our rings (and map them into our address space).
+//
+// Note, this routine can set an ErrorHandler event.
+void IOUring::Init(const unsigned entries) {
+  if (ring_fd_ >= 0) {
+    error.Init(EX_SOFTWARE, "IOUring::Init(): already initialized");
+    return;
+  }
+
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+  params.cq_entries = entries * 4;
+
+  ring_fd_ = syscall(__NR_io_uring_setup, entries, &params);
+  if (ring_fd_ < 0) {
+    error.Init(EX_OSERR, "IOUring::Init(): io_uring_setup(2) failed: %s",
+               strerror(errno));
+    return;
+  }
+  sq_entries_ = params.sq_entries;
+
+  // Newer kernels map both rings with one mmap(2).
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes +
+      params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (cq_ring_size_ > sq_ring_size_)
+      sq_ring_size_ = cq_ring_size_;
+    cq_ring_size_ = 0;
+  }
+
+  sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = NULL;
+    error.Init(EX_OSERR, "IOUring::Init(): mmap(sq) failed: %s",
+               strerror(errno));
+    Release();
+    return;
+  }
+  if (cq_ring_size_ == 0) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = NULL;
+      error.Init(EX_OSERR, "IOUring::Init(): mmap(cq) failed: %s",
+                 strerror(errno));
+      Release();
+      return;
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes_ == MAP_FAILED) {
+    sqes_ = NULL;
+    error.Init(EX_OSERR, "IOUring::Init(): mmap(sqes) failed: %s",
+               strerror(errno));
+    Release();
+    return;
+  }
+
+  char* sq = (char*)sq_ring_;
+  sq_head_ = (unsigned*)(sq + params.sq_off.head);
+  sq_tail_ = (unsigned*)(sq + params.sq_off.tail);
+  sq_mask_ = *(unsigned*)(sq + params.sq_off.ring_mask);
+  char* cq = (char*)cq_ring_;
+  cq_head_ = (unsigned*)(cq + params.cq_off.head);
+  cq_tail_ = (unsigned*)(cq + params.cq_off.tail);
+  cq_mask_ = *(unsigned*)(cq + params.cq_off.ring_mask);
+  cqes_ = cq + params.cq_off.cqes;
+
+  // SQE i always goes in slot i of the submission ring.
+  unsigned* array = (unsigned*)(sq + params.sq_off.array);
+  for (unsigned i = 0; i < params.sq_entries; i++)
+    array[i] = i;
+
+  // Have the kernel tell notify_fd_ about completions.
+  notify_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (notify_fd_ < 0 ||
+      syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_EVENTFD,
+              &notify_fd_, 1) < 0) {
+    error.Init(EX_OSERR, "IOUring::Init(): eventfd: %s", strerror(errno));
+    Release();
+    return;
+  }
+
+  _LOGGER(LOG_INFO, "IOUring::Init(): %u sq entries, %u cq entries, "
+          "features 0x%x.", params.sq_entries, params.cq_entries,
+          params.features);
+}
+
+// Routine to allocate & register our slots.
+//
+// Note, this routine can set an ErrorHandler event.
+void IOUring::RegisterBuffers(const unsigned cnt, const size_t size) {
+  if (ring_fd_ < 0 || slots_ != NULL || cnt == 0 || size == 0) {
+    error.Init(EX_SOFTWARE, "IOUring::RegisterBuffers(): "
+               "not initialized, already registered, or no slots");
+    return;
+  }
+
+  void* mem = NULL;
+  if (posix_memalign(&mem, sysconf(_SC_PAGESIZE), cnt * size) != 0) {
+    error.Init(EX_OSERR, "IOUring::RegisterBuffers(): "
+               "posix_memalign(%lu) failed", (unsigned long)(cnt * size));
+    return;
+  }
+
+  vector<struct iovec> iov(cnt);
+  for (unsigned i = 0; i < cnt; i++) {
+    iov[i].iov_base = (char*)mem + i * size;
+    iov[i].iov_len = size;
+  }
+  if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS,
+              &iov[0], cnt) < 0) {
+    error.Init(EX_OSERR, "IOUring::RegisterBuffers(): "
+               "io_uring_register(2) failed: %s", strerror(errno));
+    free(mem);
+    return;
+  }
+
+  slots_ = (char*)mem;
+  slot_size_ = size;
+  free_slots_.clear();
+  for (unsigned i = cnt; i > 0; i--)
+    free_slots_.push_back(i - 1);
+}
+
+// Routine to allocate & register our receive buffers, as a "provided
+// buffer ring", which we refill by simply advancing its tail.
+//
+// Note, this routine can set an ErrorHandler event.
+void IOUring::RegisterRecvBuffers(const unsigned cnt, const size_t size) {
+  if (ring_fd_ < 0 || recv_ring_ != NULL || cnt == 0 || size == 0) {
+    error.Init(EX_SOFTWARE, "IOUring::RegisterRecvBuffers(): "
+               "not initialized, already registered, or no buffers");
+    return;
+  }
+
+  unsigned ring_cnt = 1;
+  while (ring_cnt < cnt && ring_cnt < IOURING_MAX_RECV_BUFS)
+    ring_cnt <<= 1;
+
+  void* ring = NULL;
+  void* bufs = NULL;
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  if (posix_memalign(&ring, page_size,
+                     ring_cnt * sizeof(struct io_uring_buf)) != 0 ||
+      posix_memalign(&bufs, page_size, ring_cnt * size) != 0) {
+    error.Init(EX_OSERR, "IOUring::RegisterRecvBuffers(): "
+               "posix_memalign(%lu) failed",
+               (unsigned long)(ring_cnt * size));
+    free(ring);
+    return;
+  }
+  memset(ring, 0, ring_cnt * sizeof(struct io_uring_buf));
+
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (unsigned long)ring;
+  reg.ring_entries = ring_cnt;
+  reg.bgid = IOURING_RECV_GROUP;
+  if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING,
+              &reg, 1) < 0) {
+    error.Init(EX_OSERR, "IOUring::RegisterRecvBuffers(): "
+               "io_uring_register(2) failed: %s", strerror(errno));
+    free(ring);
+    free(bufs);
+    return;
+  }
+
+  recv_ring_ = ring;
+  recv_bufs_ = (char*)bufs;
+  recv_cnt_ = ring_cnt;
+  recv_buf_size_ = size;
+
+  // Hand the kernel all of them.  Note, we index the ring as an
+  // array of io_uring_buf, as in C++, io_uring_buf_ring's (flexible)
+  // bufs member isn't at offset 0.
+
+  struct io_uring_buf_ring* br = (struct io_uring_buf_ring*)recv_ring_;
+  struct io_uring_buf* ring_bufs = (struct io_uring_buf*)recv_ring_;
+  for (unsigned i = 0; i < ring_cnt; i++) {
+    ring_bufs[i].addr = (unsigned long)(recv_bufs_ + i * size);
+    ring_bufs[i].len = size;
+    ring_bufs[i].bid = i;
+  }
+  __atomic_store_n(&br->tail, (unsigned short)ring_cnt, __ATOMIC_RELEASE);
+}
+
+// Routine to take a free slot.
+int IOUring::GetSlot(void) {
+  if (free_slots_.empty())
+    return -1;
+
+  int index = free_slots_.back();
+  free_slots_.pop_back();
+
+  return index;
+}
+
+// Routine to give back a slot.
+void IOUring::PutSlot(const int index) {
+  if (index >= 0)
+    free_slots_.push_back(index);
+}
+
+// Routine to put a receive buffer back at the tail of our ring.
+void IOUring::ReturnRecvBuf(const struct io_uring_cqe& cqe) {
+  if (recv_ring_ == NULL || !(cqe.flags & IORING_CQE_F_BUFFER))
+    return;
+
+  const unsigned short bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+  struct io_uring_buf_ring* br = (struct io_uring_buf_ring*)recv_ring_;
+  unsigned short tail = br->tail;  // only we write it
+  struct io_uring_buf* buf =
+      (struct io_uring_buf*)recv_ring_ + (tail & (recv_cnt_ - 1));
+  buf->addr = (unsigned long)(recv_bufs_ + (size_t)bid * recv_buf_size_);
+  buf->len = recv_buf_size_;
+  buf->bid = bid;
+  __atomic_store_n(&br->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+struct io_uring_req* IOUring::Accept(const int fd, const bool multishot,
+                                     io_uring_done_fn done, void* arg) {
+  struct io_uring_sqe* sqe = (struct io_uring_sqe*)GetSqe(1);
+  if (sqe == NULL)
+    return NULL;
+
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = fd;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  if (multishot)
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+
+  return Queue(sqe, done, arg);
+}
+
+struct io_uring_req* IOUring::Recv(const int fd, io_uring_done_fn done,
+                                   void* arg) {
+  if (recv_ring_ == NULL)
+    return NULL;  // RegisterRecvBuffers() wasn't called
+
+  struct io_uring_sqe* sqe = (struct io_uring_sqe*)GetSqe(1);
+  if (sqe == NULL)
+    return NULL;
+
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = IOURING_RECV_GROUP;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+
+  return Queue(sqe, done, arg);
+}
+
+struct io_uring_req* IOUring::ReadFixed(const int fd, const int slot,
+                                        const size_t len, const off_t offset,
+                                        io_uring_done_fn done, void* arg,
+                                        const bool link) {
+  if (slot < 0 || len > slot_size_)
+    return NULL;
+
+  // A link must not be split across two submissions.
+  struct io_uring_sqe* sqe = (struct io_uring_sqe*)GetSqe(link ? 2 : 1);
+  if (sqe == NULL)
+    return NULL;
+
+  sqe->opcode = IORING_OP_READ_FIXED;
+  sqe->fd = fd;
+  sqe->addr = (unsigned long)this->slot(slot);
+  sqe->len = len;
+  sqe->off = offset;
+  sqe->buf_index = slot;
+  if (link)
+    sqe->flags = IOSQE_IO_LINK;
+
+  return Queue(sqe, done, arg);
+}
+
+struct io_uring_req* IOUring::WriteFixed(const int fd, const int slot,
+                                         const size_t len, const off_t offset,
+                                         io_uring_done_fn done, void* arg) {
+  if (slot < 0 || len > slot_size_)
+    return NULL;
+
+  struct io_uring_sqe* sqe = (struct io_uring_sqe*)GetSqe(1);
+  if (sqe == NULL)
+    return NULL;
+
+  sqe->opcode = IORING_OP_WRITE_FIXED;
+  sqe->fd = fd;
+  sqe->addr = (unsigned long)this->slot(slot);
+  sqe->len = len;
+  sqe->off = offset;
+  sqe->buf_index = slot;
+
+  return Queue(sqe, done, arg);
+}
+
+struct io_uring_req* IOUring::Read(const int fd, char* buf, const size_t len,
+                                   const off_t offset, io_uring_done_fn done,
+                                   void* arg) {
+  struct io_uring_sqe* sqe = (struct io_uring_sqe*)GetSqe(1);
+  if (sqe == NULL)
+    return NULL;
+
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (unsigned long)buf;
+  sqe->len = len;
+  sqe->off = offset;
+
+  return Queue(sqe, done, arg);
+}
+
+struct io_uring_req* IOUring::Write(const int fd, const char* buf,
+                                    const size_t len, const off_t offset,
+                                    io_uring_done_fn done, void* arg) {
+  struct io_uring_sqe* sqe = (struct io_uring_sqe*)GetSqe(1);
+  if (sqe == NULL)
+    return NULL;
+
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->addr = (unsigned long)buf;
+  sqe->len = len;
+  sqe->off = offset;
+
+  return Queue(sqe, done, arg);
+}
+
+struct io_uring_req* IOUring::Fsync(const int fd, const bool datasync,
+                                    io_uring_done_fn done, void* arg) {
+  struct io_uring_sqe* sqe = (struct io_uring_sqe*)GetSqe(1);
+  if (sqe == NULL)
+    return NULL;
+
+  sqe->opcode = IORING_OP_FSYNC;
+  sqe->fd = fd;
+  if (datasync)
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+
+  return Queue(sqe, done, arg);
+}
+
+struct io_uring_req* IOUring::Open(const char* path, const int flags,
+                                   const mode_t mode, io_uring_done_fn done,
+                                   void* arg) {
+  struct io_uring_sqe* sqe = (struct io_uring_sqe*)GetSqe(1);
+  if (sqe == NULL)
+    return NULL;
+
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (unsigned long)path;
+  sqe->len = mode;
+  sqe->open_flags = flags | O_CLOEXEC;
+
+  return Queue(sqe, done, arg);
+}
+
+struct io_uring_req* IOUring::Rename(const char* path, const char* new_path,
+                                     io_uring_done_fn done, void* arg) {
+  struct io_uring_sqe* sqe = (struct io_uring_sqe*)GetSqe(1);
+  if (sqe == NULL)
+    return NULL;
+
+  sqe->opcode = IORING_OP_RENAMEAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (unsigned long)path;
+  sqe->len = AT_FDCWD;  // new_path's directory descriptor
+  sqe->addr2 = (unsigned long)new_path;
+
+  return Queue(sqe, done, arg);
+}
+
+struct io_uring_req* IOUring::Unlink(const char* path, io_uring_done_fn done,
+                                     void* arg) {
+  struct io_uring_sqe* sqe = (struct io_uring_sqe*)GetSqe(1);
+  if (sqe == NULL)
+    return NULL;
+
+  sqe->opcode = IORING_OP_UNLINKAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (unsigned long)path;
+
+  return Queue(sqe, done, arg);
+}
+
+// Routine to cancel an operation.  The cancel itself has no
+// io_uring_req (its user_data is 0), so Complete() ignores it.
+bool IOUring::Cancel(struct io_uring_req* req) {
+  if (req == NULL)
+    return false;
+
+  struct io_uring_sqe* sqe = (struct io_uring_sqe*)GetSqe(1);
+  if (sqe == NULL)
+    return false;
+
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = (unsigned long)req;
+  sqe->user_data = 0;
+  __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+  sq_queued_++;
+
+  return true;
+}
+
+// Routine to submit our queued operations, and optionally wait for
+// completions.
+//
+// Note, this routine can set an ErrorHandler event.
+int IOUring::Submit(const unsigned wait_nr) {
+  if (ring_fd_ < 0) {
+    error.Init(EX_SOFTWARE, "IOUring::Submit(): not initialized");
+    return 0;
+  }
+
+  if (sq_queued_ == 0 && wait_nr == 0)
+    return 0;
+
+  const unsigned flags = (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0;
+  int ret;
+  do {
+    enters_++;
+    ret = syscall(__NR_io_uring_enter, ring_fd_, sq_queued_, wait_nr, flags,
+                  NULL, 0);
+  } while (ret < 0 && errno == EINTR);
+
+  if (ret < 0) {
+    // The completion ring is full (or the kernel is short on
+    // memory); our caller must run Complete() and try again.
+
+    if (errno == EBUSY || errno == EAGAIN)
+      return 0;
+
+    error.Init(EX_OSERR, "IOUring::Submit(): io_uring_enter(2) failed: %s",
+               strerror(errno));
+    return 0;
+  }
+
+  sq_queued_ -= ret;
+  ops_submitted_ += ret;
+
+  return ret;
+}
+
+// Routine to run the callbacks of all the completions in our ring.
+size_t IOUring::Complete(void) {
+  if (ring_fd_ < 0)
+    return 0;
+
+  uint64_t cnt = 0;
+  if (read(notify_fd_, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+    _LOGGER(LOG_WARNING, "IOUring::Complete(): read(eventfd) failed: %s",
+            strerror(errno));
+
+  size_t completed = 0;
+  unsigned head = *cq_head_;
+  while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+    // Copy the entry out and free it before calling anyone, so
+    // callbacks can queue (and submit) more.
+
+    struct io_uring_cqe cqe = ((struct io_uring_cqe*)cqes_)[head & cq_mask_];
+    __atomic_store_n(cq_head_, ++head, __ATOMIC_RELEASE);
+    completed++;
+
+    struct io_uring_req* req = (struct io_uring_req*)cqe.user_data;
+    if (req == NULL)
+      continue;  // a Cancel()
+
+    if (req->done != NULL)
+      req->done(cqe, req->arg);
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+      RemoveReq(req);
+      delete req;
+      outstanding_--;
+      ops_completed_++;
+    }
+  }
+
+  return completed;
+}
+
+// Boolean checks.
+
+// Private member functions.
+
+// Routine to close our ring & free our buffers.  Anything still
+// outstanding gets its callback (with -ECANCELED), as it may hold
+// references (e.g., to a TCPSession's state).
+void IOUring::Release(void) {
+  if (reqs_ != NULL && ring_fd_ >= 0)
+    Complete();  // let what's done report its real results
+
+  if (sqes_ != NULL)
+    munmap(sqes_, sqes_size_);
+  if (cq_ring_ != NULL && cq_ring_ != sq_ring_)
+    munmap(cq_ring_, cq_ring_size_);
+  if (sq_ring_ != NULL)
+    munmap(sq_ring_, sq_ring_size_);
+  sqes_ = sq_ring_ = cq_ring_ = NULL;
+  if (ring_fd_ >= 0)
+    close(ring_fd_);
+  ring_fd_ = -1;
+  if (notify_fd_ >= 0)
+    close(notify_fd_);
+  notify_fd_ = -1;
+
+  // With the ring closed, callbacks can't queue anything more.
+  while (reqs_ != NULL) {
+    struct io_uring_req* req = reqs_;
+    RemoveReq(req);
+
+    struct io_uring_cqe cqe;
+    memset(&cqe, 0, sizeof(cqe));
+    cqe.user_data = (unsigned long)req;
+    cqe.res = -ECANCELED;
+    if (req->done != NULL)
+      req->done(cqe, req->arg);
+    delete req;
+    outstanding_--;
+  }
+
+  // The kernel is done with our buffers once the ring is closed.
+  free(slots_);
+  slots_ = NULL;
+  free_slots_.clear();
+  free(recv_ring_);
+  recv_ring_ = NULL;
+  free(recv_bufs_);
+  recv_bufs_ = NULL;
+}
+
+// Routine to return the next free submission entry (zero'd), making
+// sure there are cnt free ones; if not, we first submit what's queued.
+void* IOUring::GetSqe(const unsigned cnt) {
+  if (ring_fd_ < 0)
+    return NULL;
+
+  unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+  if (sq_entries_ - (*sq_tail_ - head) < cnt) {
+    Submit(0);
+    if (error.Event()) {
+      error.AppendMsg("IOUring::GetSqe(): ");
+      return NULL;
+    }
+    head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sq_entries_ - (*sq_tail_ - head) < cnt)
+      return NULL;
+  }
+
+  struct io_uring_sqe* sqe =
+      &((struct io_uring_sqe*)sqes_)[*sq_tail_ & sq_mask_];
+  memset(sqe, 0, sizeof(*sqe));
+
+  return sqe;
+}
+
+// Routine to tag sqe with a new io_uring_req and add it to the ring.
+struct io_uring_req* IOUring::Queue(void* sqe, io_uring_done_fn done,
+                                    void* arg) {
+  struct io_uring_req* req = new struct io_uring_req();
+  req->done = done;
+  req->arg = arg;
+  req->prev = NULL;
+  req->next = reqs_;
+  if (reqs_ != NULL)
+    reqs_->prev = req;
+  reqs_ = req;
+  ((struct io_uring_sqe*)sqe)->user_data = (unsigned long)req;
+
+  __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+  sq_queued_++;
+  outstanding_++;
+
+  return req;
+}
+
+// Routine to take req off our list of outstanding reqs.
+void IOUring::RemoveReq(struct io_uring_req* req) {
+  if (req->prev != NULL)
+    req->prev->next = req->next;
+  else
+    reqs_ = req->next;
+  if (req->next != NULL)
+    req->next->prev = req->prev;
+  req->prev = req->next = NULL;
+}
+
+#else  // #if defined(__linux__)
+
+// Without io_uring, Init() fails, and nothing else does anything.
+
+char* IOUring::recv_buf(const struct io_uring_cqe& cqe) const { return NULL; }
+
+void IOUring::Init(const unsigned entries) {
+  error.Init(EX_SOFTWARE, "IOUring::Init(): io_uring requires Linux");
+}
+
+void IOUring::RegisterBuffers(const unsigned cnt, const size_t size) {
+  error.Init(EX_SOFTWARE, "IOUring::RegisterBuffers(): not initialized");
+}
+
+void IOUring::RegisterRecvBuffers(const unsigned cnt, const size_t size) {
+  error.Init(EX_SOFTWARE, "IOUring::RegisterRecvBuffers(): not initialized");
+}
+
+int IOUring::GetSlot(void) { return -1; }
+void IOUring::PutSlot(const int index) { }
+void IOUring::ReturnRecvBuf(const struct io_uring_cqe& cqe) { }
+
+struct io_uring_req* IOUring::Accept(const int fd, const bool multishot,
+                                     io_uring_done_fn done, void* arg) {
+  return NULL;
+}
+
+struct io_uring_req* IOUring::Recv(const int fd, io_uring_done_fn done,
+                                   void* arg) {
+  return NULL;
+}
+
+struct io_uring_req* IOUring::ReadFixed(const int fd, const int slot,
+                                        const size_t len, const off_t offset,
+                                        io_uring_done_fn done, void* arg,
+                                        const bool link) {
+  return NULL;
+}
+
+struct io_uring_req* IOUring::WriteFixed(const int fd, const int slot,
+                                         const size_t len, const off_t offset,
+                                         io_uring_done_fn done, void* arg) {
+  return NULL;
+}
+
+struct io_uring_req* IOUring::Read(const int fd, char* buf, const size_t len,
+                                   const off_t offset, io_uring_done_fn done,
+                                   void* arg) {
+  return NULL;
+}
+
+struct io_uring_req* IOUring::Write(const int fd, const char* buf,
+                                    const size_t len, const off_t offset,
+                                    io_uring_done_fn done, void* arg) {
+  return NULL;
+}
+
+struct io_uring_req* IOUring::Fsync(const int fd, const bool datasync,
+                                    io_uring_done_fn done, void* arg) {
+  return NULL;
+}
+
+struct io_uring_req* IOUring::Open(const char* path, const int flags,
+                                   const mode_t mode, io_uring_done_fn done,
+                                   void* arg) {
+  return NULL;
+}
+
+struct io_uring_req* IOUring::Rename(const char* path, const char* new_path,
+                                     io_uring_done_fn done, void* arg) {
+  return NULL;
+}
+
+struct io_uring_req* IOUring::Unlink(const char* path, io_uring_done_fn done,
+                                     void* arg) {
+  return NULL;
+}
+
+bool IOUring::Cancel(struct io_uring_req* req) { return false; }
+
+int IOUring::Submit(const unsigned wait_nr) {
+  error.Init(EX_SOFTWARE, "IOUring::Submit(): not initialized");
+  return 0;
+}
+
+size_t IOUring::Complete(void) { return 0; }
+
+void IOUring::Release(void) { }
+void* IOUring::GetSqe(const unsigned cnt) { return NULL; }
+struct io_uring_req* IOUring::Queue(void* sqe, io_uring_done_fn done,
+                                    void* arg) {
+  return NULL;
+}
+
+#endif  // #if defined(__linux__)
@@ -0,0 +1,313 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+
+#ifndef _IOURING_H_
+#define _IOURING_H_
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#else
+struct io_uring_cqe {           // all we use of Linux's
+  uint64_t user_data;
+  int32_t res;
+  uint32_t flags;
+};
+#endif
+
+#include <vector>
+using namespace std;
+
+#include "ErrorHandler.h"
+
+
+// Forward declarations (used if only needed for member function parameters).
+
+// Non-class specific defines & data structures.
+#define IOURING_DEFAULT_ENTRIES 256
+#define IOURING_DEFAULT_SLOTS 64
+#define IOURING_DEFAULT_SLOT_SIZE (64 * 1024)
+#define IOURING_DEFAULT_RECV_BUFS 256
+#define IOURING_DEFAULT_RECV_BUF_SIZE (16 * 1024)
+
+/** Callback run (by IOUring::Complete()) for each completion of an
+ *  operation.
+ *
+ *  cqe.res holds the result (or -errno).  If IORING_CQE_F_MORE is
+ *  set in cqe.flags, a multishot operation will complete again.
+ */
+typedef void (*io_uring_done_fn)(const struct io_uring_cqe& cqe, void* arg);
+
+struct io_uring_req {
+  io_uring_done_fn done;        // may be NULL
+  void* arg;                    // passed to done
+  struct io_uring_req* prev;    // IOUring's list of outstanding reqs
+  struct io_uring_req* next;
+};
+
+// Non-class specific utilities.
+
+
+/** Class for batching socket & file I/O through a Linux io_uring.
+ *
+ *  Rather than one system call per read(2), write(2) or accept(2),
+ *  operations are queued (in the submission ring we share with the
+ *  kernel) and handed over all at once by Submit(); their results
+ *  show up in the completion ring, and Complete() runs each
+ *  operation's callback.  Accept() and Recv() are multishot, i.e.,
+ *  queued once, they complete for every connection or every chunk
+ *  of data until they fail or are canceled.
+ *
+ *  Two kinds of buffers are registered with the kernel, so it needn't
+ *  map user memory for every operation: fixed-size "slots" (see
+ *  RegisterBuffers()), which callers fill for ReadFixed() or
+ *  WriteFixed(), and the receive buffers Recv() picks from (see
+ *  RegisterRecvBuffers()), which a callback must hand back with
+ *  ReturnRecvBuf() once it's copied the data out.
+ *
+ *  The system calls are made directly, i.e., we don't need liburing.
+ *  IOUring is *not* thread-safe; queue, submit and complete from
+ *  one (event-loop) thread.  An event-loop can either wait in
+ *  Submit(), or poll(2) notify_fd(), which becomes readable when
+ *  there are completions.  Anything using an IOUring (e.g., a
+ *  TCPSession) must not outlive it.
+ *
+ *  On anything but Linux, Init() sets an ErrorHandler event, and the
+ *  caller should stick with its synchronous I/O.
+ *
+ *  RCSID: $Id: $
+ *
+ *  @see TCPSession::set_io_uring()
+ *  @see AsyncFileIO::set_io_uring()
+ *  @author Andrew K. Adams <akadams@psc.edu>
+ */
+class IOUring {
+ public:
+  /** Constructor.
+   *
+   */
+  IOUring(void);
+
+  /** Destructor.
+   *
+   *  Runs the callbacks of what has already completed, then closes
+   *  the ring, which cancels anything outstanding, and runs their
+   *  callbacks with -ECANCELED (and no IORING_CQE_F_MORE), so their
+   *  state can be freed.
+   */
+  virtual ~IOUring(void);
+
+  // Accessors.
+  int fd(void) const { return ring_fd_; }
+  int notify_fd(void) const { return notify_fd_; }
+  unsigned entries(void) const { return sq_entries_; }
+  size_t slot_size(void) const { return slot_size_; }
+  size_t recv_buf_size(void) const { return recv_buf_size_; }
+  size_t outstanding(void) const { return outstanding_; }
+  unsigned long enters(void) const { return enters_; }
+  unsigned long ops_submitted(void) const { return ops_submitted_; }
+  unsigned long ops_completed(void) const { return ops_completed_; }
+
+  /** Routine to return a slot's memory (see GetSlot()).
+   *
+   */
+  char* slot(const int index) const {
+    return slots_ + (size_t)index * slot_size_; }
+
+  /** Routine to return the receive buffer a Recv() completion used.
+   *
+   *  @return a char* holding cqe.res bytes, or NULL
+   */
+  char* recv_buf(const struct io_uring_cqe& cqe) const;
+
+  // Mutators.
+
+  // IOUring manipulation.
+
+  /** Routine to set up our rings.
+   *
+   *  Note, this routine can set an ErrorHandler event, e.g., if the
+   *  kernel doesn't support io_uring (or won't let us use it).
+   *
+   *  @see ErrorHandler
+   *  @param entries an unsigned size of the submission ring (the
+   *  completion ring is four times that, for multishot operations)
+   */
+  void Init(const unsigned entries);
+
+  /** Routine to allocate & register cnt slots of size bytes.
+   *
+   *  Note, this routine can set an ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   */
+  void RegisterBuffers(const unsigned cnt, const size_t size);
+
+  /** Routine to allocate & register the buffers Recv() uses.
+   *
+   *  cnt is rounded up to a power of two.  Requires Linux 5.19.
+   *  Note, this routine can set an ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   */
+  void RegisterRecvBuffers(const unsigned cnt, const size_t size);
+
+  /** Routine to take a free slot.
+   *
+   *  @return an int index, or -1 if all are in use
+   */
+  int GetSlot(void);
+
+  /** Routine to give back a slot taken with GetSlot().
+   *
+   */
+  void PutSlot(const int index);
+
+  /** Routine to hand a Recv() completion's buffer back to the kernel.
+   *
+   */
+  void ReturnRecvBuf(const struct io_uring_cqe& cqe);
+
+  // Operations.  Each returns a handle (for Cancel()), which is only
+  // valid until the operation's last completion, or NULL if it
+  // couldn't be queued.  Buffers (and paths) must stay valid until
+  // then, too.
+
+  /** Routine to accept(2) connections on a listening socket.
+   *
+   *  cqe.res is the new descriptor, see TCPConn::Accept(TCPConn*, int).
+   *
+   *  @param multishot a bool, true to keep accepting until canceled
+   */
+  struct io_uring_req* Accept(const int fd, const bool multishot,
+                              io_uring_done_fn done, void* arg);
+
+  /** Routine to (multishot) recv(2) from a socket.
+   *
+   *  Each completion's data is in recv_buf(cqe), which must be handed
+   *  back with ReturnRecvBuf().  cqe.res of 0 means EOF.  If the
+   *  last completion (without IORING_CQE_F_MORE) isn't EOF or an
+   *  error, e.g., -ENOBUFS when all receive buffers are in use, call
+   *  Recv() again.
+   */
+  struct io_uring_req* Recv(const int fd, io_uring_done_fn done, void* arg);
+
+  /** Routine to read(2) len bytes at offset into a slot.
+   *
+   *  @param link a bool, true if the next operation queued (e.g., a
+   *  WriteFixed() of the same slot) should only run if this one
+   *  reads all len bytes
+   */
+  struct io_uring_req* ReadFixed(const int fd, const int slot,
+                                 const size_t len, const off_t offset,
+                                 io_uring_done_fn done, void* arg,
+                                 const bool link);
+
+  /** Routine to write(2) len bytes of a slot, at offset (-1 for
+   *  sockets).
+   *
+   */
+  struct io_uring_req* WriteFixed(const int fd, const int slot,
+                                  const size_t len, const off_t offset,
+                                  io_uring_done_fn done, void* arg);
+
+  struct io_uring_req* Read(const int fd, char* buf, const size_t len,
+                            const off_t offset, io_uring_done_fn done,
+                            void* arg);
+  struct io_uring_req* Write(const int fd, const char* buf, const size_t len,
+                             const off_t offset, io_uring_done_fn done,
+                             void* arg);
+  struct io_uring_req* Fsync(const int fd, const bool datasync,
+                             io_uring_done_fn done, void* arg);
+  struct io_uring_req* Open(const char* path, const int flags,
+                            const mode_t mode, io_uring_done_fn done,
+                            void* arg);
+  struct io_uring_req* Rename(const char* path, const char* new_path,
+                              io_uring_done_fn done, void* arg);
+  struct io_uring_req* Unlink(const char* path, io_uring_done_fn done,
+                              void* arg);
+
+  /** Routine to cancel an outstanding operation.
+   *
+   *  The operation still completes (usually with -ECANCELED).
+   *
+   *  @return false if the cancel couldn't be queued
+   */
+  bool Cancel(struct io_uring_req* req);
+
+  /** Routine to hand everything queued to the kernel.
+   *
+   *  Note, this routine can set an ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   *  @param wait_nr an unsigned number of completions to wait for
+   *  @return the number of operations submitted
+   */
+  int Submit(const unsigned wait_nr);
+
+  /** Routine to run the callbacks of all completions.
+   *
+   *  Callbacks may queue new operations.  Also empties notify_fd().
+   *
+   *  @return the number of completions
+   */
+  size_t Complete(void);
+
+  // Boolean checks.
+  bool IsInitialized(void) const { return (ring_fd_ >= 0) ? true : false; }
+  bool IsRecvEnabled(void) const { return (recv_ring_ != NULL) ? true : false; }
+
+  // Flags.
+
+ protected:
+  // Data members.
+  int ring_fd_;                 // from io_uring_setup(2), or -1
+  int notify_fd_;               // eventfd(2) the kernel signals
+  unsigned sq_entries_;
+
+  void* sq_ring_;               // mmap(2)'d rings, shared with the kernel
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  void* sqes_;
+  size_t sqes_size_;
+  unsigned* sq_head_;           // pointers into sq_ring_ ...
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned* cq_head_;           // ... & cq_ring_
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  void* cqes_;
+  unsigned sq_queued_;          // queued, but not yet submitted
+
+  char* slots_;                 // RegisterBuffers()
+  size_t slot_size_;
+  vector<int> free_slots_;
+
+  void* recv_ring_;             // RegisterRecvBuffers()
+  char* recv_bufs_;
+  unsigned recv_cnt_;
+  size_t recv_buf_size_;
+
+  size_t outstanding_;          // operations yet to complete (for good)
+  struct io_uring_req* reqs_;   // ... and their reqs
+  unsigned long enters_;        // io_uring_enter(2) calls
+  unsigned long ops_submitted_;
+  unsigned long ops_completed_;
+
+ private:
+  void Release(void);
+  void* GetSqe(const unsigned cnt);
+  struct io_uring_req* Queue(void* sqe, io_uring_done_fn done, void* arg);
+  void RemoveReq(struct io_uring_req* req);
+
+  // Dummy declarations for copy constructor and assignment & equality operator.
+  IOUring(const IOUring& src);
+  IOUring& operator =(const IOUring& src);
+  int operator ==(const IOUring& other) const;
+};
+
+
+#endif  /* #ifndef _IOURING_H_ */
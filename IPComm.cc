@@ -12,6 +12,8 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <utility>       // for std::move
+
 #include "ErrorHandler.h"
 #include "Logger.h"
 #include "IPComm.h"
@@ -179,9 +181,12 @@ IPComm::IPComm(const int address_family)
 IPComm::~IPComm(void) {
 #if DEBUG_CLASS
   warnx("IPComm::~IPComm(void) called, cnt: %d, fd: %d.", 
-        descriptor_->cnt_, descriptor_->fd_);
+        descriptor_->cnt(), descriptor_->fd_);
 #endif
-  if (!--descriptor_->cnt_) {
+  // Note, a derived class (e.g., SSLConn) may have already released
+  // our Descriptor, in which case it's NULL.
+
+  if (descriptor_ != NULL && descriptor_->Release()) {
     if (descriptor_->fd_ != DESCRIPTOR_NULL) {
       Close();
     }
@@ -195,7 +200,7 @@ IPComm::IPComm(const IPComm& src)
     : dns_names_(src.dns_names_) {
 #if DEBUG_CLASS
   warnx("IPComm::IPComm(const IPComm&) called, src cnt: %d, fd: %d.", 
-        src.descriptor_->cnt_, src.descriptor_->fd_);
+        src.descriptor_->cnt(), src.descriptor_->fd_);
 #endif
 
   blocking_flag_ = src.blocking_flag_;
@@ -221,15 +226,15 @@ IPComm::IPComm(const IPComm& src)
   // it to point to the source, then bump its reference count.
 
   descriptor_ = src.descriptor_;
-  descriptor_->cnt_++;
+  descriptor_->Acquire();
 }
 
 IPComm& IPComm::operator =(const IPComm& src) {
 #if DEBUG_CLASS
   warnx("IPComm::operator =(const IPComm&) called, "
         "cnt: %d, fd: %d, src cnt: %d, fd: %d.", 
-        descriptor_->cnt_, descriptor_->fd_, 
-        src.descriptor_->cnt_, src.descriptor_->fd_);
+        descriptor_->cnt(), descriptor_->fd_, 
+        src.descriptor_->cnt(), src.descriptor_->fd_);
 #endif
 
   blocking_flag_ = src.blocking_flag_;
@@ -252,10 +257,18 @@ IPComm& IPComm::operator =(const IPComm& src) {
 
   dns_names_ = src.dns_names_;
 
+  // Grab our reference to the source's Descriptor first, so
+  // self-assignment (or src sharing our Descriptor) can't drop the
+  // count to zero underneath us.
+
+  Descriptor* descriptor = src.descriptor_;
+  descriptor->Acquire();
+
   // If we're about to remove our last instance of the Descriptor we
-  // currently point to, clean it up first!
+  // currently point to, clean it up first!  Note, a derived class
+  // (e.g., SSLConn) may have already released it.
 
-  if (!--descriptor_->cnt_) {
+  if (descriptor_ != NULL && descriptor_->Release()) {
     if (descriptor_->fd_ != DESCRIPTOR_NULL) {
       Close();
     } 
@@ -263,10 +276,56 @@ IPComm& IPComm::operator =(const IPComm& src) {
   }
 
   // Now, since our Descriptor data member is just a pointer, we can
-  // (re-)associate it to source's, then bump its reference count.
+  // (re-)associate it to source's (already bumped above).
+
+  descriptor_ = descriptor;
+
+  return *this;
+}
+
+// Move constructor and assignment.  We take over src's Descriptor
+// (and its reference), leaving src without one.
+IPComm::IPComm(IPComm&& src) noexcept
+    : dns_names_(std::move(src.dns_names_)) {
+#if DEBUG_CLASS
+  warnx("IPComm::IPComm(IPComm&&) called.");
+#endif
+
+  blocking_flag_ = src.blocking_flag_;
+  exec_flag_ = src.exec_flag_;
+  address_family_ = src.address_family_;
+  memcpy(&sockaddr_, (void*)&src.sockaddr_, sizeof(sockaddr_));
+
+  descriptor_ = src.descriptor_;
+  src.descriptor_ = NULL;
+}
+
+IPComm& IPComm::operator =(IPComm&& src) noexcept {
+#if DEBUG_CLASS
+  warnx("IPComm::operator =(IPComm&&) called.");
+#endif
+
+  if (this == &src)
+    return *this;
+
+  blocking_flag_ = src.blocking_flag_;
+  exec_flag_ = src.exec_flag_;
+  address_family_ = src.address_family_;
+  memcpy(&sockaddr_, (void*)&src.sockaddr_, sizeof(sockaddr_));
+  dns_names_ = std::move(src.dns_names_);
+
+  // Drop our current Descriptor (as in the assignment operator), then
+  // take over src's.
+
+  if (descriptor_ != NULL && descriptor_->Release()) {
+    if (descriptor_->fd_ != DESCRIPTOR_NULL) {
+      Close();
+    } 
+    delete descriptor_;
+  }
 
   descriptor_ = src.descriptor_;
-  descriptor_->cnt_++;
+  src.descriptor_ = NULL;
 
   return *this;
 }
@@ -518,7 +577,7 @@ void IPComm::set_socket_close_on_exec(void) {
 void IPComm::clear(void) {
 #if DEBUG_CLASS
   warnx("IPComm::clear(void) called, cnt: %d, fd: %d.", 
-        descriptor_->cnt_, descriptor_->fd_);
+        descriptor_->cnt(), descriptor_->fd_);
 #endif
 
   blocking_flag_ = BLOCKING;
@@ -528,9 +587,10 @@ void IPComm::clear(void) {
   memset(&sockaddr_, 0, sizeof(sockaddr_));
 
   // If we're about to remove our last instance of the current
-  // Descriptor, clean up the Descriptor object.
+  // Descriptor, clean up the Descriptor object.  Note, a derived
+  // class (e.g., SSLConn) may have already released it.
 
-  if (!--descriptor_->cnt_) {
+  if (descriptor_ != NULL && descriptor_->Release()) {
     if (descriptor_->fd_ != DESCRIPTOR_NULL) {
       Close();
     } 
@@ -548,7 +608,7 @@ const string IPComm::print(void) const {
 
   // Print retuns the host & socket.
   snprintf((char*)tmp_str.c_str(), SCRATCH_BUF_SIZE, "%s:%d", 
-           hostname().c_str(), descriptor_->fd_);
+           hostname().c_str(), fd());
 
   return tmp_str;
 }
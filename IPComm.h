@@ -100,6 +100,20 @@ class IPComm {
    */
   IPComm& operator =(const IPComm& src);
 
+  /** Move Constructor.
+   *
+   *  Takes over src's Descriptor without touching its reference
+   *  count.  Note, the moved-from object has *no* Descriptor, so it
+   *  may only be destroyed, assigned to or clear()'d.
+   */
+  IPComm(IPComm&& src) noexcept;
+
+  /** Move Assignment Operator.
+   *
+   *  Same semantics as the move constructor.
+   */
+  IPComm& operator =(IPComm&& src) noexcept;
+
   /** Equality Operator.
    *
    *  The equality operator is needed for *some* data methods for
@@ -109,7 +123,7 @@ class IPComm {
 
   // Accessors.
   int address_family(void) const { return address_family_; }
-  list<string> dns_names(void) const { return dns_names_; }
+  const list<string>& dns_names(void) const { return dns_names_; }
 
   /** Routine to return the socket file descriptor.
    *
@@ -122,7 +136,8 @@ class IPComm {
    *  @see Descriptor
    *  @return an int which is the file descriptor
    */
-  int fd(void) const { return descriptor_->fd_; }
+  int fd(void) const { 
+    return (descriptor_ != NULL) ? descriptor_->fd_ : DESCRIPTOR_NULL; }
 
   /** Routine to return the sin_port within the sockaddr_ union.
    *
@@ -439,7 +454,7 @@ class IPComm {
    *
    */
   virtual bool IsConnected(void) const { 
-    return (descriptor_->fd_ != DESCRIPTOR_NULL) ? true : false; }
+    return (fd() != DESCRIPTOR_NULL) ? true : false; }
 
   // Flags.
   enum { BLOCKING, NON_BLOCKING };	// socket flags
@@ -3,9 +3,12 @@
 // Copyright (c) 2008, see the file 'COPYRIGHT.txt' for any restrictions.
 
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 #include <ctype.h>
 #include <err.h>
+#include <limits.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <strings.h>
@@ -21,8 +24,6 @@
 #define INITIAL_BUF_SIZE 1024
 #define MAX_BUF_SIZE (1024 * 100)
 #define MAX_PATH_SIZE PATH_MAX	     // defined in limits.h
-#define MAX_FILE_SIZE ((~(size_t)0) / 2)
-#define MAX_ROLL_FILES 5
 
 #define LOG_CONFIG_DIR "etc/"
 #define LOG_FILE_EXT ".log"
@@ -44,7 +45,7 @@ Logger logger;	// global definition, for all who use the logger
 // Non-member local functions.
 static void log_to_stderr(const char* msg);
 static void log_to_stdout(const char* msg);
-static void log_to_file(const char* msg, const char* path);
+static void* log_roll_files(void* arg);
 static void log_to_console(const char* msg);
 static void log_to_syslog(const char* msg);
 static pid_t log_to_script(const char* msg, const char* path);
@@ -172,6 +173,26 @@ void Logger::set_proc_name(const char* proc_name) {
   proc_name_ = proc_name;
 }
 
+// Routine to set the log file rotation policy.
+void Logger::set_log_rotation(const size_t max_file_size, 
+                              const time_t rotate_interval,
+                              const int max_roll_files, const bool compress) {
+  pthread_mutex_lock(&file_mtx_);
+  max_file_size_ = max_file_size;
+  rotate_interval_ = rotate_interval;
+  max_roll_files_ = (max_roll_files < 1) ? 1 : max_roll_files;
+  compress_rolls_ = compress;
+  pthread_mutex_unlock(&file_mtx_);
+}
+
+// Routine to set the per call-site token-bucket.
+void Logger::set_rate_limit(const double rate, const double burst) {
+  pthread_mutex_lock(&site_mtx_);
+  rate_ = rate;
+  burst_ = (burst < 1.0) ? 1.0 : burst;
+  pthread_mutex_unlock(&site_mtx_);
+}
+
 // TODO(aka) Not sure if we need this ...
 /*
 void Logger::set_log_filename(const char* arg_name, const char* arg_subdir) {
@@ -218,6 +239,7 @@ void Logger::set_mechanism_priority(char* optarg) {
       // It's a script, so set our script file.
       script_ = arg_ptr;
     } else if (get_log_mechanism_type(optarg) == LOG_TO_FILE) {
+      CloseLogFile();  // in case we were logging to a different path
       log_file_path_ = arg_ptr;  // it's for file logging, set our path
     } else {
       // Else, we ignore what's after the '=' sign ...
@@ -358,9 +380,20 @@ void Logger::InitLogFile(const char* sandbox, const char* subdir,
   }
   */
 
+  CloseLogFile();  // in case we were logging to a different path
   log_file_path_ = path;  // set our data member
 }
 
+// Routine to close our cached log file.
+void Logger::CloseLogFile(void) {
+  pthread_mutex_lock(&file_mtx_);
+  if (fp_ != NULL) {
+    fclose(fp_);
+    fp_ = NULL;
+  }
+  pthread_mutex_unlock(&file_mtx_);
+}
+
 // TODO(aka) I'm not ready to debug an script init() routine, yet.
 #if 0
 // Routine to initialize the 'logging script' for the execv() command.
@@ -389,14 +422,138 @@ void Logger::initScriptFile(const char* sandbox) {
 // message is built, we call log_output() for each mechanism that had
 // a priority >= the message priority.
 void Logger::Log(const int priority, const char* format, ...) {
-  int i;
-  for (i = 1; i < LOGGER_NUM_MECHANISMS; i++) {
+  if (!IsPriorityLogged(priority))
+    return;  // no mechanisms for this priority level
+
+  va_list ap;
+  va_start(ap, format);
+  VLog(priority, format, ap);
+  va_end(ap);
+}
+
+// Routine to log a message, unless its call-site has exceeded its
+// rate limit.  Each call-site (i.e., each expansion of
+// _LOGGER_LIMITED()) owns a token-bucket that is refilled at rate_
+// tokens per second, up to burst_ tokens.  A message that finds a
+// token is logged; otherwise, 1-in-sample_rate_ of the overflow is
+// still logged, and the rest are counted as suppressed.  Note, we
+// decide all of this *before* formatting the message, so the cost of
+// a flood is bounded by a lock and a clock read per message.
+void Logger::LogLimited(struct log_site* site, const int priority, 
+                        const char* format, ...) {
+  if (!IsPriorityLogged(priority))
+    return;  // no mechanisms for this priority level
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  long long now_ms = (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+  bool log_it = true;
+  pthread_mutex_lock(&site_mtx_);
+  if (rate_ > 0) {
+    if (site->tokens < 0) {
+      site->tokens = burst_;  // first time through
+    } else {
+      site->tokens += (now_ms - site->refill_ms) * rate_ / 1000.0;
+      if (site->tokens > burst_)
+        site->tokens = burst_;
+    }
+    site->refill_ms = now_ms;
+
+    if (site->tokens >= 1.0) {
+      site->tokens -= 1.0;
+    } else {
+      site->overflow++;
+      if (!sample_rate_ || (site->overflow % sample_rate_)) {
+        log_it = false;
+        if (!site->suppressed++)
+          site->report_ms = now_ms;  // start a new suppression period
+        if (!site->registered) {
+          site->next = suppressed_sites_;
+          suppressed_sites_ = site;
+          site->registered = 1;
+        }
+      }
+    }
+  }
+
+  // See if it's time to report on this site's suppressed messages.
+  if (site->suppressed && 
+      (now_ms - site->report_ms) >= (long long)report_interval_ * 1000)
+    ReportSite(site, priority, now_ms);
+  pthread_mutex_unlock(&site_mtx_);
+
+  if (!log_it)
+    return;
+
+  va_list ap;
+  va_start(ap, format);
+  VLog(priority, format, ap);
+  va_end(ap);
+}
+
+// Routine to report suppressed message counts for any call-sites
+// that have not been hit since their report interval elapsed.
+void Logger::ReportSuppressed(const bool force) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  long long now_ms = (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+  // Walk the list, and unlink any site that we report on.  Note, we
+  // don't know the priority the site originally used, so we use
+  // LOG_NOTICE.
+
+  pthread_mutex_lock(&site_mtx_);
+  struct log_site** prev = &suppressed_sites_;
+  while (*prev != NULL) {
+    struct log_site* site = *prev;
+    if (site->suppressed == 0) {
+      // Already reported by LogLimited(), just unlink it.
+      *prev = site->next;
+      site->next = NULL;
+      site->registered = 0;
+      continue;
+    }
+
+    if (!force && 
+        (now_ms - site->report_ms) < (long long)report_interval_ * 1000) {
+      prev = &site->next;
+      continue;
+    }
+
+    *prev = site->next;
+    site->next = NULL;
+    site->registered = 0;
+    ReportSite(site, LOG_NOTICE, now_ms);
+  }
+  pthread_mutex_unlock(&site_mtx_);
+}
+
+// Routine to log (and reset) a single site's suppressed count.
+// Note, this routine must be called with site_mtx_ held (which is
+// safe, as Log() never takes the lock).
+void Logger::ReportSite(struct log_site* site, const int priority,
+                        const long long now_ms) {
+  Log(priority, "Logger: suppressed %lu message(s) from %s:%d "
+      "in the last %lld second(s).", site->suppressed, site->file, 
+      site->line, (now_ms - site->report_ms) / 1000);
+  site->suppressed = 0;
+}
+
+// Routine to see if *any* mechanism will log the given priority.
+int Logger::IsPriorityLogged(const int priority) const {
+  for (int i = 1; i < LOGGER_NUM_MECHANISMS; i++) {
     if (mechanism_priority((log_mechanism_type)i) >= priority)
-      break;
+      return 1;
   }
-  if (i == LOGGER_NUM_MECHANISMS)
-    return;  // no mechanisms for this priority level
-			
+
+  return 0;
+}
+
+// Routine to build a log message and hand it to each mechanism
+// (helper function for Log() & LogLimited()).
+void Logger::VLog(const int priority, const char* format, va_list ap) {
+  int i;
   // get the current UTC time, convert it to an ASCII localtime.
   time_t now;
   if ((now = time(NULL)) == -1)
@@ -422,12 +579,8 @@ void Logger::Log(const int priority, const char* format, ...) {
 
   // Add the variable length stuff if we have any.
   size_t len = strlen(msg_buf);
-  if (format && strlen(format)) {
-    va_list ap;
-    va_start(ap, format);
+  if (format && strlen(format))
     vsnprintf(msg_buf + len, MAX_BUF_SIZE - len, format, ap);
-    va_end(ap);
-  }
 
   len = strlen(msg_buf);
   snprintf(msg_buf + len, MAX_BUF_SIZE - len, "\n");  // add a line feed
@@ -440,7 +593,7 @@ void Logger::Log(const int priority, const char* format, ...) {
       } else if (i == LOG_TO_STDOUT) {
         log_to_stdout(msg_buf);
       } else if (i == LOG_TO_FILE) {
-        log_to_file(msg_buf, log_file_path_.c_str());
+        LogToFile(msg_buf);
       } else if (i == LOG_TO_CONSOLE) {
         log_to_console(msg_buf);
       } else if (i == LOG_TO_SYSLOG) {
@@ -466,24 +619,26 @@ void log_to_stdout(const char* msg) {
   fprintf(stdout, "%s", msg);
 }
 
-// Routine to log a message to a file.
-void log_to_file(const char* msg, const char* path) {
-  // Get the file pointer to our log file.
-  FILE* fp = fopen(path, "a");
-  if (fp == NULL) {
-    // TODO(aka) Die horribly here for now ...
-    err(EXIT_FAILURE, "Logger::InitLogFile(): fopen(%s) failed", path);
-  }
+// Routine to log a message to our (cached) log file.  The file is
+// opened on the first message, and then kept open; each message is
+// flushed, so readers (e.g., tail -f) see it immediately.  If the
+// message pushes the file over its size (or age) limit, we rotate it.
+void Logger::LogToFile(const char* msg) {
+  pthread_mutex_lock(&file_mtx_);
+  if (fp_ == NULL) {
+    if ((fp_ = fopen(log_file_path_.c_str(), "a")) == NULL) {
+      // TODO(aka) Die horribly here for now ...
+      err(EXIT_FAILURE, "Logger::LogToFile(): fopen(%s) failed", 
+          log_file_path_.c_str());
+    }
 
-  // See if file needs rolled.
-  struct stat info;
-  int fd = fileno(fp);
-  fstat(fd, &info);
-  if (info.st_size >= (off_t)MAX_FILE_SIZE) {
-    // TODO(aka) Uh, I don't have time to finish this now ...
-    warnx("Logger::log_to_file(): "
-          "log file %luB > %luB, but file rolling is not implemented, yet.", 
-          (unsigned long)info.st_size, (unsigned long)MAX_FILE_SIZE);
+    // Pick up the size of any existing log.
+    struct stat info;
+    if (fstat(fileno(fp_), &info) == 0)
+      file_size_ = info.st_size;
+    else
+      file_size_ = 0;
+    file_opened_ = time(NULL);
   }
 
 #if HAVE_FLOCK
@@ -491,15 +646,124 @@ void log_to_file(const char* msg, const char* path) {
   // Lock the file.
 #endif
 #endif
-  fputs(msg, fp);
+  fputs(msg, fp_);
+  fflush(fp_);
 #if HAVE_FLOCK
 #if LOG_FILE_LOCKING
   // Unlock the file.
 #endif
 #endif
 
-  // Close the file.
-  fclose(fp);
+  file_size_ += strlen(msg);
+
+  // See if file needs rolled.
+  time_t now = time(NULL);
+  if ((max_file_size_ && file_size_ >= max_file_size_) ||
+      (rotate_interval_ && (now - file_opened_) >= rotate_interval_))
+    RotateLogFile(now);
+
+  pthread_mutex_unlock(&file_mtx_);
+}
+
+// Data passed to our (detached) log rolling thread.
+struct log_roll_info {
+  string path;          // path of active log file
+  string staged;        // name the just rotated file was renamed to
+  int max_roll_files;   // number of rotated files to keep
+  bool compress;        // flag to gzip the rotated file
+};
+
+// Routine to rotate the log file.  Only the rename(2) of the active
+// log (to a unique *staging* name) and the re-open are done here, as
+// both are cheap.  Shifting the older logs down (path.1 -> path.2,
+// ...) and compressing is left to a detached thread, so logging
+// threads never wait on it.
+//
+// Note, this routine must be called with file_mtx_ held.
+void Logger::RotateLogFile(const time_t now) {
+  char staged[MAX_PATH_SIZE];
+  snprintf(staged, MAX_PATH_SIZE, "%s.rolling.%d.%u", log_file_path_.c_str(),
+           (int)getpid(), file_rolls_++);
+
+  fclose(fp_);
+  fp_ = NULL;
+  if (rename(log_file_path_.c_str(), staged) != 0) {
+    warnx("Logger::RotateLogFile(): rename(%s, %s) failed: %s",
+          log_file_path_.c_str(), staged, strerror(errno));
+  } else {
+    struct log_roll_info* info = new struct log_roll_info;
+    info->path = log_file_path_;
+    info->staged = staged;
+    info->max_roll_files = max_roll_files_;
+    info->compress = compress_rolls_;
+
+    pthread_t tid;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&tid, &attr, log_roll_files, info) != 0) {
+      warnx("Logger::RotateLogFile(): pthread_create() failed, "
+            "rolling files in-line");
+      log_roll_files(info);
+    }
+    pthread_attr_destroy(&attr);
+  }
+
+  if ((fp_ = fopen(log_file_path_.c_str(), "a")) == NULL) {
+    // TODO(aka) Die horribly here for now ...
+    err(EXIT_FAILURE, "Logger::RotateLogFile(): fopen(%s) failed", 
+        log_file_path_.c_str());
+  }
+  file_size_ = 0;
+  file_opened_ = now;
+}
+
+// Thread routine to shift the older log files down one slot, move the
+// staged file into path.1 and (optionally) compress it.  Rolls are
+// serialized, so back-to-back rotations can not interleave.
+void* log_roll_files(void* arg) {
+  static pthread_mutex_t roll_mtx = PTHREAD_MUTEX_INITIALIZER;
+  struct log_roll_info* info = (struct log_roll_info*)arg;
+  const char* ext = info->compress ? ".gz" : "";
+  char from[MAX_PATH_SIZE];
+  char to[MAX_PATH_SIZE];
+
+  pthread_mutex_lock(&roll_mtx);
+
+  // Shift path.N-1 -> path.N, ..., path.1 -> path.2 (rename(2)
+  // replaces path.N, i.e., the oldest log falls off the end).
+  for (int i = info->max_roll_files - 1; i >= 1; i--) {
+    snprintf(from, MAX_PATH_SIZE, "%s.%d%s", info->path.c_str(), i, ext);
+    snprintf(to, MAX_PATH_SIZE, "%s.%d%s", info->path.c_str(), i + 1, ext);
+    if (rename(from, to) != 0 && errno != ENOENT)
+      warnx("log_roll_files(): rename(%s, %s) failed: %s", 
+            from, to, strerror(errno));
+  }
+
+  snprintf(to, MAX_PATH_SIZE, "%s.1", info->path.c_str());
+  if (rename(info->staged.c_str(), to) != 0) {
+    warnx("log_roll_files(): rename(%s, %s) failed: %s", 
+          info->staged.c_str(), to, strerror(errno));
+  } else if (info->compress) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      execlp("gzip", "gzip", "-f", to, (char*)NULL);
+      _exit(EXIT_FAILURE);
+    } else if (pid > 0) {
+      int status = 0;
+      while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        warnx("log_roll_files(): gzip %s failed", to);
+    } else {
+      warnx("log_roll_files(): fork() failed: %s", strerror(errno));
+    }
+  }
+
+  pthread_mutex_unlock(&roll_mtx);
+  delete info;
+
+  return NULL;
 }
 
 // Routine to log a message to CONSOLE.
@@ -11,23 +11,63 @@
 #include <sys/syslog.h>     // for SYSLOG priority levels
 
 #include <ctype.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
 #include <syslog.h>
+#include <time.h>
 
 #include <string>
 using namespace std;
 
+// Per call-site state for rate limited log messages (@see
+// _LOGGER_LIMITED).  Each expansion of _LOGGER_LIMITED() gets its own
+// static instance, so a flood from one call-site can not starve
+// another.  Note, all fields (other than file & line) are owned by
+// the Logger, and are only modified while holding its site lock.
+struct log_site {
+  const char* file;             // __FILE__ of call-site
+  int line;                     // __LINE__ of call-site
+  double tokens;                // token bucket (< 0 until first use)
+  long long refill_ms;          // last time tokens were added
+  unsigned long overflow;       // messages seen while bucket was empty
+  unsigned long suppressed;     // messages dropped since last summary
+  long long report_ms;          // start of current suppression period
+  struct log_site* next;        // link in Logger's suppressed list
+  int registered;               // flag to show we're on above list
+};
+
+#define LOG_SITE_INITIALIZER(file, line) \
+  { file, line, -1.0, 0, 0, 0, 0, NULL, 0 }
+
 #ifdef USE_LOGGER
 #define _LOGGER(priority, ...) logger.Log(priority, __VA_ARGS__)
+#define _LOGGER_LIMITED(priority, ...)                                  \
+  do {                                                                  \
+    static struct log_site _log_site =                                  \
+        LOG_SITE_INITIALIZER(__FILE__, __LINE__);                       \
+    logger.LogLimited(&_log_site, priority, __VA_ARGS__);               \
+  } while (0)
 #else
 #pragma GCC diagnostic push  // TODO(aka) Alas, looks like we can't diag ignored a single #define!
 #pragma GCC diagnostic ignored "-Wvariadic-macros"
 #define _LOGGER(priority, ...)
+#define _LOGGER_LIMITED(priority, ...)
 #pragma GCC diagnostic pop
 #endif
 
+// Default rate limiting parameters (@see Logger::LogLimited()).
+#define LOGGER_DEFAULT_RATE 10.0           // messages per second per site
+#define LOGGER_DEFAULT_BURST 20.0          // maximum bucket depth
+#define LOGGER_DEFAULT_SAMPLE_RATE 0       // 1-in-N of overflow, 0 disables
+#define LOGGER_DEFAULT_REPORT_INTERVAL 60  // seconds between summaries
+
+// Default log file rotation parameters (@see Logger::set_log_rotation()).
+#define LOGGER_DEFAULT_MAX_FILE_SIZE ((~(size_t)0) / 2)
+#define LOGGER_DEFAULT_ROTATE_INTERVAL 0   // seconds, 0 disables
+#define LOGGER_DEFAULT_MAX_ROLL_FILES 5
+
 // TODO(aka) Temporary support for deprecated Logger levels.
 #define LOG_FATAL     LOG_EMERG
 #define LOG_ERROR     LOG_ERR
@@ -90,9 +130,26 @@ class Logger {
     debugging_ = 0;
     debug_mechanism_ = LOG_TO_STDERR;
     errors_fatal_ = 0;
+    rate_ = LOGGER_DEFAULT_RATE;
+    burst_ = LOGGER_DEFAULT_BURST;
+    sample_rate_ = LOGGER_DEFAULT_SAMPLE_RATE;
+    report_interval_ = LOGGER_DEFAULT_REPORT_INTERVAL;
+    suppressed_sites_ = NULL;
+    pthread_mutex_init(&site_mtx_, NULL);
+    fp_ = NULL;
+    file_size_ = 0;
+    file_opened_ = 0;
+    file_rolls_ = 0;
+    max_file_size_ = LOGGER_DEFAULT_MAX_FILE_SIZE;
+    rotate_interval_ = LOGGER_DEFAULT_ROTATE_INTERVAL;
+    max_roll_files_ = LOGGER_DEFAULT_MAX_ROLL_FILES;
+    compress_rolls_ = false;
+    pthread_mutex_init(&file_mtx_, NULL);
   }
 
   // Using implicit destructor, copy constructor & assignment operator.
+  // Note, copies share nothing but the (static) call-site state, and
+  // since only the global logger is ever used, that's okay.
 
   // Accessors & mutators.
   string proc_name(void) const { return proc_name_; }
@@ -120,15 +177,100 @@ class Logger {
       mechanisms_[mechanism] = LOG_NONE;
   }
 
+  /** Routine to set the token-bucket used by _LOGGER_LIMITED().
+   *
+   *  Each call-site may log rate messages per second on average, and
+   *  up to burst messages back-to-back.  A rate <= 0 disables rate
+   *  limiting, i.e., _LOGGER_LIMITED() behaves just like _LOGGER().
+   *
+   *  @param rate is a double specifying messages per second
+   *  @param burst is a double specifying the bucket depth
+   */
+  void set_rate_limit(const double rate, const double burst);
+
+  /** Routine to set the sampling rate used by _LOGGER_LIMITED().
+   *
+   *  Once a call-site's bucket is empty, 1-in-N of the remaining
+   *  messages are still logged (so an operator can see what the flood
+   *  looks like).  A sample_rate of 0 suppresses all of them.
+   *
+   *  @param sample_rate is an unsigned int specifying N
+   */
+  void set_sample_rate(const unsigned int sample_rate) {
+    sample_rate_ = sample_rate;
+  }
+
+  /** Routine to set when LOG_TO_FILE rotates its log file.
+   *
+   *  The log file is rotated when it reaches max_file_size bytes, or
+   *  when it has been open for rotate_interval seconds, whichever
+   *  comes first.  Rotated files are kept as path.1 (most recent)
+   *  through path.max_roll_files, and are optionally gzip(1)'d.
+   *
+   *  @param max_file_size is a size_t specifying the size limit (0 disables)
+   *  @param rotate_interval is a time_t specifying the age limit (0 disables)
+   *  @param max_roll_files is an int specifying how many old logs to keep
+   *  @param compress is a bool, if true, gzip rotated files
+   */
+  void set_log_rotation(const size_t max_file_size, 
+                        const time_t rotate_interval,
+                        const int max_roll_files, const bool compress);
+
+  /** Routine to set how often "suppressed N messages" summaries are logged.
+   *
+   *  @param report_interval is a time_t specifying seconds between summaries
+   */
+  void set_report_interval(const time_t report_interval) {
+    report_interval_ = report_interval;
+  }
+
   void DecrementMechanismPriority(void);
   void IncrementMechanismPriority(void);
 
   // Logger manipulation.
   void InitLogFile(const char* sandbox, const char* subdir, 
                    const char* name, const char* ext);
+
+  /** Routine to close our cached log file.
+   *
+   *  LOG_TO_FILE keeps the log file open between messages; this
+   *  routine closes it (e.g., before a fork(2), or after an external
+   *  tool has moved the file), and the next message will re-open it.
+   */
+  void CloseLogFile(void);
   // void InitLogScript(const char* sandbox);
 
   void Log(const int priority, const char* format, ...); 
+
+  /** Routine to log a message subject to per call-site rate limiting.
+   *
+   *  This routine is not usually called directly, but via the
+   *  _LOGGER_LIMITED() macro, which supplies the static call-site
+   *  state.  The priority is checked first, then the call-site's token
+   *  bucket (and sampling counter), and only if the message survives
+   *  is it formatted and dispatched, i.e., a suppressed message costs
+   *  us a lock and a clock read.  Suppressed messages are counted, and
+   *  a summary is logged (at the original priority) once the report
+   *  interval has elapsed and the call-site fires again.
+   *
+   *  @see ReportSuppressed()
+   *  @param site is a struct log_site* holding the call-site's state
+   *  @param priority is an int specifying the message's priority
+   *  @param format is a char* holding the printf(3) format
+   */
+  void LogLimited(struct log_site* site, const int priority, 
+                  const char* format, ...);
+
+  /** Routine to log summaries for all call-sites with suppressed messages.
+   *
+   *  _LOGGER_LIMITED() only reports suppressed messages when the
+   *  call-site is hit again, so a site that goes quiet after a flood
+   *  would never report.  Applications can call this from their
+   *  main-loop (or a timer) to flush those counts.
+   *
+   *  @param force is a bool, if true, report regardless of the interval
+   */
+  void ReportSuppressed(const bool force);
 	
   // Boolean checks.
   const int AreErrorsFatal(void) const { return errors_fatal_; }  // TODO(aka) Deprecated
@@ -142,6 +284,14 @@ class Logger {
   string log_file_path_;	// path to log file
   // string sandbox_;	        // cache for sandbox (for File class)
   FILE* fp_;                    // cache for file pointer of above log file
+  size_t file_size_;            // bytes currently in above log file
+  time_t file_opened_;          // when we opened (or rotated) above log file
+  unsigned int file_rolls_;     // number of rotations (for staging names)
+  size_t max_file_size_;        // rotate when file_size_ reaches this
+  time_t rotate_interval_;      // rotate when file is this old (0 = never)
+  int max_roll_files_;          // number of rotated files to keep
+  bool compress_rolls_;         // flag to gzip rotated files
+  pthread_mutex_t file_mtx_;    // lock for fp_ & friends
 
   // TODO(aka) I should probably make this script_file_path to match the log file.
   string script_;		// name of 'logging script'
@@ -158,7 +308,20 @@ class Logger {
   int debugging_;	// flag to mark a debugging run (1 = enabled)
   log_mechanism_type debug_mechanism_;	// where to log debug messages
 
+  double rate_;                 // per-site token refill (msgs/sec)
+  double burst_;                // per-site token bucket depth
+  unsigned int sample_rate_;    // log 1-in-N of overflow (0 = none)
+  time_t report_interval_;      // seconds between suppression summaries
+  struct log_site* suppressed_sites_;  // sites with pending summaries
+  pthread_mutex_t site_mtx_;    // lock for all struct log_site state
+
  private:
+  int IsPriorityLogged(const int priority) const;
+  void VLog(const int priority, const char* format, va_list ap);
+  void ReportSite(struct log_site* site, const int priority,
+                  const long long now_ms);
+  void LogToFile(const char* msg);
+  void RotateLogFile(const time_t now);
 };
 
 extern ::Logger logger;  // declaration of global logger object
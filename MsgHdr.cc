@@ -7,6 +7,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <utility>       // for std::move
+
 #include "Logger.h"
 #include "IPComm.h"        // for IPCOMM_PORT_NULL
 #include "MsgHdr.h"
@@ -55,6 +57,27 @@ HdrStorage& HdrStorage::operator =(const HdrStorage& src) {
   return *this;
 }
 
+// Move constructor & assignment.
+HdrStorage::HdrStorage(HdrStorage&& src) noexcept
+    : http_(std::move(src.http_)) {
+#if DEBUG_CLASS
+  warnx("HdrStorage::HdrStorage(HdrStorage&& src) called.");
+#endif
+
+  memcpy(&basic_, &src.basic_, sizeof(basic_));
+}
+
+HdrStorage& HdrStorage::operator =(HdrStorage&& src) noexcept {
+#if DEBUG_CLASS
+  warnx("HdrStorage::operator =(HdrStorage&& src) called.");
+#endif
+
+  memcpy(&basic_, &src.basic_, sizeof(basic_));
+  http_ = std::move(src.http_);
+  
+  return *this;
+}
+
 // Mutators.
 void HdrStorage::set_basic(const struct BasicFramingHdr& basic) {
   memcpy(&basic_, &basic, sizeof(basic_));
@@ -124,6 +147,29 @@ MsgHdr& MsgHdr::operator =(const MsgHdr& src) {
   return *this;
 }
 
+// Move constructor & assignment.
+MsgHdr::MsgHdr(MsgHdr&& src) noexcept
+    : hdr_(std::move(src.hdr_)) {
+#if DEBUG_CLASS
+  warnx("MsgHdr::MsgHdr(MsgHdr&& src) called.");
+#endif
+
+  msg_id_ = src.msg_id_;
+  type_ = src.type_;
+}
+
+MsgHdr& MsgHdr::operator =(MsgHdr&& src) noexcept {
+#if DEBUG_CLASS
+  warnx("MsgHdr::operator =(MsgHdr&& src) called.");
+#endif
+
+  msg_id_ = src.msg_id_;
+  type_ = src.type_;
+  hdr_ = std::move(src.hdr_);
+
+  return *this;
+}
+
 // Accessors.
 size_t MsgHdr::hdr_len(void) const {
   size_t len = 0;
@@ -161,21 +207,20 @@ size_t MsgHdr::body_len(void) const {
   return len;
 }
 
-struct BasicFramingHdr MsgHdr::basic_hdr(void) const { 
-  if (type_ != TYPE_BASIC) {
-    struct BasicFramingHdr empty;
-    memset(&empty, 0, sizeof(empty));
+const struct BasicFramingHdr& MsgHdr::basic_hdr(void) const { 
+  static const struct BasicFramingHdr empty = BasicFramingHdr();
+
+  if (type_ != TYPE_BASIC)
     return empty;
-  }
 
   return hdr_.basic_; 
 }
 
-HTTPFraming MsgHdr::http_hdr(void) const { 
-  if (type_ != TYPE_HTTP) {
-    HTTPFraming empty;
+const HTTPFraming& MsgHdr::http_hdr(void) const { 
+  static const HTTPFraming empty;
+
+  if (type_ != TYPE_HTTP)
     return empty;
-  }
 
   return hdr_.http_;
 }
@@ -197,8 +242,8 @@ string MsgHdr::GetMediaTypeExt(void) {
       {
         // TOOD(aka) Arguably, this should be done in HTTPFraming!
 
-        // Get copy of vector, cause we're going to use iterators.
-        vector<rfc822_msg_hdr> mime_hdrs = hdr_.http_.msg_hdrs();
+        // Iterate over our message-headers in place (no copy needed).
+        const vector<rfc822_msg_hdr>& mime_hdrs = hdr_.http_.msg_hdrs();
         vector<rfc822_msg_hdr>::const_iterator mime_hdr = mime_hdrs.begin();
         string media_type;
         while (mime_hdr != mime_hdrs.end()) {
@@ -431,6 +476,32 @@ bool MsgHdr::InitFromBuf(const char* buf, const size_t len, size_t* bytes_used,
 
 // Boolean checks.
 
+// Routine to see if a REQUEST is idempotent (and therefore safe to
+// send as TLS early data).
+bool MsgHdr::IsMsgIdempotent(void) const {
+  bool status = false;
+  switch (type_) {
+    case TYPE_BASIC :
+      // BASIC headers carry no method, so we can't tell.
+      break;
+
+    case TYPE_HTTP :
+      if (hdr_.http_.msg_type() == HTTPFraming::REQUEST &&
+          (hdr_.http_.method() == HTTPFraming::GET ||
+           hdr_.http_.method() == HTTPFraming::HEAD ||
+           hdr_.http_.method() == HTTPFraming::OPTIONS))
+        status = true;
+      break;
+
+    default :
+      _LOGGER(LOG_ERR, "MsgHdr::IsMsgIdempotent(): "
+                 "unknown type: %d", type_);
+      // Fall-through to return what we have so far.
+  }
+
+  return status;
+}
+
 bool MsgHdr::IsMsgRequest(void) const {
   bool status = false;
   switch (type_) {
@@ -56,6 +56,16 @@ class HdrStorage {
    */
   HdrStorage& operator =(const HdrStorage& src);
 
+  /** Move constructor.
+   *
+   */
+  HdrStorage(HdrStorage&& src) noexcept;
+
+  /** Move assignment operator.
+   *
+   */
+  HdrStorage& operator =(HdrStorage&& src) noexcept;
+
   // Mutators.
   void set_basic(const struct BasicFramingHdr& basic);
   void set_http(const HTTPFraming& http);
@@ -102,15 +112,12 @@ class HdrStorage {
  *  operation mode in IsClassBased().
  *
  *  TODO(aka) At some point we should chnage struct framing_hdr into a
- *  Class.  Additionally, it would probably be nice to be able to
- *  return whatever framing header we had via a void* in the getter
- *  funtion(s), so that code use higher layer classes, e.g.,
- *  TCPSession, could actually use the header directly
- *  "tcp_session.hdr().print_status()".  Currently, the higher-layer
- *  codes has to get a copy of the struct, e.g., "HTTPFraming http_hdr
- *  = tcp_session.hdr();" and then access the HTTP information.
- *  Moreover, if you want to change any information within the struct
- *  via TCPSession, you need to overwrite the entire struct in MsgHdr.
+ *  Class.  Note, the getters return const references, so higher-layer
+ *  code can use the header directly, e.g.,
+ *  "tcp_session.rhdr().http_hdr().print_hdr(0, false)", without
+ *  copying it.  However, if you want to change any information
+ *  within the struct via TCPSession, you need to overwrite the entire
+ *  struct in MsgHdr.
  *
  *  If this was a Java class, as opposed to a C++ class, it would
  *  probably be called FramingWrapper or some such ... it's arguable
@@ -153,10 +160,22 @@ class MsgHdr {
    */
   MsgHdr& operator =(const MsgHdr& src);
 
+  /** Move constructor.
+   *
+   *  Avoids copying the HTTP header (URL & message-headers) when a
+   *  MsgHdr is handed off, e.g., from TCPSession's whdrs_ list.
+   */
+  MsgHdr(MsgHdr&& src) noexcept;
+
+  /** Move assignment operator.
+   *
+   */
+  MsgHdr& operator =(MsgHdr&& src) noexcept;
+
   // Accessors.
   uint8_t type(void) const { return type_; }
   uint16_t msg_id(void) const { return msg_id_; }
-  HdrStorage hdr(void) const { return hdr_; }
+  const HdrStorage& hdr(void) const { return hdr_; }
 
   /** Routine to get the framing header length.
    *
@@ -175,16 +194,24 @@ class MsgHdr {
 
   /** Routine to return the basic framing header.
    *
+   *  Note, if we're not TYPE_BASIC, a reference to an empty header
+   *  is returned.
    *
-   *  @return a struct BasicFramingHdr copy of the header
+   *  @return a const reference to the struct BasicFramingHdr header
    */
-  struct BasicFramingHdr basic_hdr(void) const;
+  const struct BasicFramingHdr& basic_hdr(void) const;
 
   /** Routine to return the HTTP framing header.
    *
-   *  @return a HTTPFraming class copy of the header
+   *  The header is returned by reference, so callers that only need
+   *  to look at it, e.g., "rhdr().http_hdr().msg_hdrs()", don't pay
+   *  for copying the URL and message-headers.  Callers that want to
+   *  keep it around must make their own copy.  Note, if we're not
+   *  TYPE_HTTP, a reference to an empty header is returned.
+   *
+   *  @return a const reference to the HTTPFraming header
    */
-  HTTPFraming http_hdr(void) const;
+  const HTTPFraming& http_hdr(void) const;
 
   /** Routine to return the *extension* of the media type.
    *
@@ -283,6 +310,14 @@ class MsgHdr {
    */
   bool IsMsgStatusNormal(void) const;
 
+  /** Routine to see if a REQUEST can safely be repeated.
+   *
+   *  TLS 1.3 early data (0-RTT) can be replayed by an attacker, so
+   *  we only send a request that way if it is safe (RFC 8470), i.e.,
+   *  an HTTP GET, HEAD or OPTIONS.
+   */
+  bool IsMsgIdempotent(void) const;
+
   // Flags.
   enum { TYPE_NONE, TYPE_BASIC, TYPE_HTTP };
 
@@ -39,6 +39,11 @@ struct MsgInfo {
                              // sent/received so far
   ssize_t file_offset;       // offset in file to what has been sent or
                              // received so far
+  ssize_t file_start;        // (outgoing) where the body starts in its
+                             // file, i.e., 0 unless it was spooled
+  bool idempotent;           // (outgoing) may be sent as TLS early data
+  bool early_data;           // (incoming) arrived as TLS early data,
+                             // i.e., may be a replay
 };
 
 // Session (TCP, TLS) defines.
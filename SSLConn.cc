@@ -4,13 +4,18 @@
 
 #include <sys/stat.h>
 
+#include <arpa/inet.h>
+
 #include <openssl/err.h>
 
 #include <err.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <utility>       // for std::move
+
 #include "Logger.h"
 #include "SSLConn.h"
 
@@ -21,8 +26,135 @@
 #define DEBUG_CLASS 0
 #define DEBUG_INCOMING_DATA 0
 
+// A SSL_do_handshake(3) step run on a WorkerPool thread.  Note, the
+// job holds its own reference to the Descriptor (and thus the SSL*
+// and socket), and is itself reference counted (by the pool thread
+// and every SSLConn copy waiting on it), so the SSLConn that started
+// it can be moved, copied or destroyed while the step runs.
+struct ssl_handshake_job {
+  SSL* ssl;
+  BIO* net_bio;           // see SSLConn::net_bio_
+  Descriptor* descriptor; // our reference
+  int refs;               // (atomic) pool thread + SSLConn copies
+  bool early_pending;     // see SSLConn::early_pending_
+  string early_data;      // see SSLConn::early_data_
+  size_t early_data_sent; // see SSLConn::early_data_sent_
+  int ret;                // SSL_do_handshake(3) return value
+  int ssl_error;          // SSL_get_error(3), if ret != 1
+  int sys_errno;          // errno, if ret != 1
+  string ssl_errors;      // the (per-thread) OpenSSL error queue
+  bool done;              // set (atomically) once the step finished
+};
+
 // Non-class specific utility functions.
 
+// Routine to return seconds on a clock that does not jump, for our
+// handshake deadlines.
+static time_t monotonic_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec;
+}
+
+// Routine to return milliseconds on the same clock, for spotting
+// idle connections.
+static long monotonic_msec(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+// Routine to return the CPU time used by the calling thread.
+static long thread_cpu_nsec(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+// Routine to run one handshake step, i.e., SSL_do_handshake(3), but
+// first, on a server, read any TLS 1.3 early data into early_data,
+// or, on a client, write early_data as early data.  Returns what
+// SSL_do_handshake(3) would.
+static int ssl_handshake_step(SSL* ssl, bool* early_pending,
+                              string* early_data, size_t* early_data_sent) {
+  if (SSL_is_server(ssl)) {
+    char buf[SCRATCH_BUF_SIZE];
+    while (*early_pending) {
+      size_t len = 0;
+      int ret = SSL_read_early_data(ssl, buf, sizeof(buf), &len);
+      if (ret == SSL_READ_EARLY_DATA_ERROR)
+        return -1;  // e.g., SSL_ERROR_WANT_READ
+
+      early_data->append(buf, len);
+      if (ret == SSL_READ_EARLY_DATA_FINISH)
+        *early_pending = false;
+    }
+  } else {
+    while (early_data->size() > 0) {
+      size_t len = 0;
+      if (!SSL_write_early_data(ssl, early_data->data(), early_data->size(),
+                                &len))
+        return 0;  // e.g., SSL_ERROR_WANT_WRITE
+
+      *early_data_sent += len;
+      early_data->erase(0, len);
+    }
+  }
+
+  return SSL_do_handshake(ssl);
+}
+
+// Routine to drop a reference to a handshake job.  Whoever drops the
+// last one drops the job's reference to the Descriptor, and if that
+// was the Descriptor's last, frees the SSL* and closes the socket (as
+// SSLConn::ReleaseDescriptor() would).
+//
+// Note, this may be run on a WorkerPool thread, so we must not touch
+// the ErrorHandler.
+static void ssl_handshake_job_unref(struct ssl_handshake_job* job) {
+  if (__atomic_sub_fetch(&job->refs, 1, __ATOMIC_ACQ_REL) > 0)
+    return;
+
+  if (job->descriptor->Release()) {
+    SSL_free(job->ssl);
+    if (job->net_bio != NULL)
+      BIO_free(job->net_bio);
+    if (job->descriptor->fd() != DESCRIPTOR_NULL)
+      close(job->descriptor->fd());
+    delete job->descriptor;
+  }
+  delete job;
+}
+
+// Routine to run one SSL_do_handshake(3) step on a WorkerPool thread.
+//
+// Note, as we're not on the event-loop's thread, we must not touch
+// the (global) ErrorHandler or the SSLConn; everything we learn goes
+// into the job.
+static void ssl_handshake_job_run(void* arg) {
+  struct ssl_handshake_job* job = (struct ssl_handshake_job*)arg;
+  SSLContext* ctx = 
+      (SSLContext*)SSL_CTX_get_app_data(SSL_get_SSL_CTX(job->ssl));
+
+  ERR_clear_error();
+  long start = thread_cpu_nsec();
+  ssl_mem_charge(job->ssl);
+  job->ret = ssl_handshake_step(job->ssl, &job->early_pending,
+                                &job->early_data, &job->early_data_sent);
+  job->sys_errno = errno;
+  ssl_mem_charge(NULL);
+  if (ctx != NULL)
+    ctx->AddHandshakeTime(thread_cpu_nsec() - start);
+
+  if (job->ret != 1) {
+    job->ssl_error = SSL_get_error(job->ssl, job->ret);
+    job->ssl_errors = ssl_err_str().c_str();
+  }
+
+  __atomic_store_n(&job->done, true, __ATOMIC_RELEASE);
+  ssl_handshake_job_unref(job);  // the pool's reference
+}
+
 
 // Constructors & destructors functions.
 SSLConn::SSLConn(void) {
@@ -32,6 +164,19 @@ SSLConn::SSLConn(void) {
 
   ssl_ = NULL;
   peer_certificate_ = NULL;
+  net_bio_ = NULL;
+  handshake_state_ = HANDSHAKE_NONE;
+  handshake_timeout_ = SSLCONN_DEFAULT_HANDSHAKE_TIMEOUT;
+  handshake_deadline_ = 0;
+  handshake_job_ = NULL;
+  memset(&record_sizing_, 0, sizeof(record_sizing_));
+  record_len_ = 0;
+  record_bytes_ = 0;
+  record_last_msec_ = 0;
+  record_retry_len_ = 0;
+  early_pending_ = false;
+  early_data_sent_ = 0;
+  early_data_read_ = 0;
 }
 
 SSLConn::~SSLConn(void) {
@@ -44,11 +189,11 @@ SSLConn::~SSLConn(void) {
     peer_certificate_ = NULL;
   }
 
-  // If IPComm's destructor (via TCPConn) is about to close the socket, free our SSL*.
-  if (ssl_ != NULL && descriptor_->cnt_ == 1) {
-    SSL_free(ssl_); 
-    ssl_ = NULL;
-  }
+  // Drop our reference to the Descriptor (and SSL*) here, rather than
+  // in IPComm's destructor, as the SSL* must be freed by whichever
+  // copy drops the last reference.
+
+  ReleaseDescriptor();
 
   // Rest of work is done in IPComm (via TCPConn).
 }
@@ -62,6 +207,22 @@ SSLConn::SSLConn(const SSLConn& src)
 
   ssl_ = src.ssl_;  // note, ref count in Descriptor is bumped in
                     // IPComm copy constructor
+  net_bio_ = src.net_bio_;  // as is net_bio_'s (see ReleaseDescriptor())
+  handshake_state_ = src.handshake_state_;
+  handshake_timeout_ = src.handshake_timeout_;
+  handshake_deadline_ = src.handshake_deadline_;
+  record_sizing_ = src.record_sizing_;
+  record_len_ = src.record_len_;
+  record_bytes_ = src.record_bytes_;
+  record_last_msec_ = src.record_last_msec_;
+  record_retry_len_ = src.record_retry_len_;
+  early_data_ = src.early_data_;
+  early_pending_ = src.early_pending_;
+  early_data_sent_ = src.early_data_sent_;
+  early_data_read_ = src.early_data_read_;
+  handshake_job_ = src.handshake_job_;  // we collect its result, too
+  if (handshake_job_ != NULL)
+    __atomic_fetch_add(&handshake_job_->refs, 1, __ATOMIC_RELAXED);
 
   if (ssl_ != NULL)
     peer_certificate_ = SSL_get_peer_certificate(ssl_);  // SSL_get_peer_cerfificate() ref counts
@@ -74,12 +235,32 @@ SSLConn& SSLConn::operator =(const SSLConn& src) {
   warnx("SSLConn::operator =(const SSLConn&) called.");
 #endif
 
+  if (this == &src)
+    return *this;
+
   // If we're about to blow away our IPComm -> Descriptor, then we
-  // need to blow away our SSL* object before setting it to the new one.
+  // need to blow away our SSL* object before setting it to the new
+  // one.  Note, src holds its own reference, so even if src shares our
+  // Descriptor, this can not drop the count to zero.
 
-  if (ssl_ != NULL && descriptor_->cnt_ == 1)
-    SSL_free(ssl_);
+  ReleaseDescriptor();
   ssl_ = src.ssl_;
+  net_bio_ = src.net_bio_;
+  handshake_state_ = src.handshake_state_;
+  handshake_timeout_ = src.handshake_timeout_;
+  handshake_deadline_ = src.handshake_deadline_;
+  record_sizing_ = src.record_sizing_;
+  record_len_ = src.record_len_;
+  record_bytes_ = src.record_bytes_;
+  record_last_msec_ = src.record_last_msec_;
+  record_retry_len_ = src.record_retry_len_;
+  early_data_ = src.early_data_;
+  early_pending_ = src.early_pending_;
+  early_data_sent_ = src.early_data_sent_;
+  early_data_read_ = src.early_data_read_;
+  handshake_job_ = src.handshake_job_;  // see copy constructor
+  if (handshake_job_ != NULL)
+    __atomic_fetch_add(&handshake_job_->refs, 1, __ATOMIC_RELAXED);
 
   // peer_certificate may or may not have already been alocated ...
   if (peer_certificate_ != NULL)
@@ -96,6 +277,75 @@ SSLConn& SSLConn::operator =(const SSLConn& src) {
   return *this;
 }
 
+// Move constructor and assignment.  Since the SSL* (and peer
+// certificate) are tied to the Descriptor, we take them over along
+// with it.
+SSLConn::SSLConn(SSLConn&& src) noexcept
+    : TCPConn(std::move(src)) {
+#if DEBUG_CLASS
+  warnx("SSLConn::SSLConn(SSLConn&&) called.");
+#endif
+
+  ssl_ = src.ssl_;
+  peer_certificate_ = src.peer_certificate_;
+  src.ssl_ = NULL;
+  src.peer_certificate_ = NULL;
+  net_bio_ = src.net_bio_;
+  src.net_bio_ = NULL;
+  handshake_state_ = src.handshake_state_;
+  handshake_timeout_ = src.handshake_timeout_;
+  handshake_deadline_ = src.handshake_deadline_;
+  handshake_job_ = src.handshake_job_;
+  src.handshake_job_ = NULL;
+  record_sizing_ = src.record_sizing_;
+  record_len_ = src.record_len_;
+  record_bytes_ = src.record_bytes_;
+  record_last_msec_ = src.record_last_msec_;
+  record_retry_len_ = src.record_retry_len_;
+  early_data_ = std::move(src.early_data_);
+  early_pending_ = src.early_pending_;
+  early_data_sent_ = src.early_data_sent_;
+  early_data_read_ = src.early_data_read_;
+}
+
+SSLConn& SSLConn::operator =(SSLConn&& src) noexcept {
+#if DEBUG_CLASS
+  warnx("SSLConn::operator =(SSLConn&&) called.");
+#endif
+
+  if (this == &src)
+    return *this;
+
+  ReleaseDescriptor();
+  if (peer_certificate_ != NULL)
+    X509_free(peer_certificate_);
+
+  ssl_ = src.ssl_;
+  peer_certificate_ = src.peer_certificate_;
+  src.ssl_ = NULL;
+  src.peer_certificate_ = NULL;
+  net_bio_ = src.net_bio_;
+  src.net_bio_ = NULL;
+  handshake_state_ = src.handshake_state_;
+  handshake_timeout_ = src.handshake_timeout_;
+  handshake_deadline_ = src.handshake_deadline_;
+  handshake_job_ = src.handshake_job_;
+  src.handshake_job_ = NULL;
+  record_sizing_ = src.record_sizing_;
+  record_len_ = src.record_len_;
+  record_bytes_ = src.record_bytes_;
+  record_last_msec_ = src.record_last_msec_;
+  record_retry_len_ = src.record_retry_len_;
+  early_data_ = std::move(src.early_data_);
+  early_pending_ = src.early_pending_;
+  early_data_sent_ = src.early_data_sent_;
+  early_data_read_ = src.early_data_read_;
+
+  TCPConn::operator =(std::move(src));
+
+  return *this;
+}
+
 // Overloaded operator: equality functions.
 int SSLConn::operator ==(const SSLConn& other) const {
 #if DEBUG_CLASS
@@ -109,13 +359,30 @@ int SSLConn::operator ==(const SSLConn& other) const {
 // Accessors.
 
 // Mutators.
+void SSLConn::set_handshake_timeout(const time_t timeout) {
+  handshake_timeout_ = timeout;
+}
+
+void SSLConn::set_record_sizing(const size_t small_len,
+                                const size_t boost_len,
+                                const long idle_msec, const bool per_msg) {
+  record_sizing_.small_len = small_len;
+  record_sizing_.boost_len = boost_len;
+  record_sizing_.idle_msec = idle_msec;
+  record_sizing_.per_msg = per_msg;
+  record_bytes_ = 0;
+}
+
+void SSLConn::set_early_data(const char* buf, const size_t len) {
+  early_data_.assign(buf, len);
+  early_data_sent_ = 0;
+}
+
 void SSLConn::clear(void) {
   // If we're about to blow away our IPComm -> Descriptor, then we
   // need to blow away our SSL* object before setting it to the new one.
 
-  if (ssl_ != NULL && descriptor_->cnt_ == 1)
-    SSL_free(ssl_);
-  ssl_ = NULL;
+  ReleaseDescriptor();
 
   // peer_certificate may or may not have already been alocated ...
   if (peer_certificate_ != NULL) {
@@ -123,10 +390,54 @@ void SSLConn::clear(void) {
     peer_certificate_ = NULL;
   }
 
+  handshake_state_ = HANDSHAKE_NONE;
+  handshake_deadline_ = 0;
+  record_len_ = 0;
+  record_bytes_ = 0;
+  record_last_msec_ = 0;
+  record_retry_len_ = 0;
+  early_data_.clear();
+  early_pending_ = false;
+  early_data_sent_ = 0;
+  early_data_read_ = 0;
+
   TCPConn::clear();  // get the rest of the work done
 }
 
 
+// Routine to drop our reference to the shared Descriptor (and SSL*).
+// The SSL* lives exactly as long as the Descriptor, so the copy that
+// drops the last reference frees both.  Checking the count and then
+// decrementing it (as we used to) races when copies are destroyed
+// in different threads, hence we let Release() decide.
+//
+// Note, afterwards descriptor_ is NULL, which IPComm's destructor,
+// assignment operator and clear() all expect.
+void SSLConn::ReleaseDescriptor(void) {
+  // A WorkerPool thread may still be using ssl_, but its job holds
+  // its own reference to the Descriptor, so we just let go of it.
+
+  if (handshake_job_ != NULL) {
+    ssl_handshake_job_unref(handshake_job_);
+    handshake_job_ = NULL;
+  }
+
+  if (descriptor_ != NULL && descriptor_->Release()) {
+    if (ssl_ != NULL)
+      SSL_free(ssl_);  // frees our half of any BIO pair ...
+    if (net_bio_ != NULL)
+      BIO_free(net_bio_);  // ... but not the other
+    if (descriptor_->fd_ != DESCRIPTOR_NULL)
+      IPComm::Close();
+    delete descriptor_;
+  }
+
+  descriptor_ = NULL;
+  ssl_ = NULL;
+  net_bio_ = NULL;
+}
+
+
 // Network manipulation functions.
 
 // Routine to *pretty* print object.
@@ -181,11 +492,19 @@ void SSLConn::Socket(const int domain, const int type, const int protocol,
   // desciptor, simply get a SSL* object (which we reference count via
   // the Descriptor ojbect).
 
-  if ((ssl_ = SSL_new(ctx->ctx_)) == NULL) {
+  ssl_mem_charge_new();
+  ssl_ = SSL_new(ctx->ctx_);
+  ssl_mem_charge_done(ssl_);
+  if (ssl_ == NULL) {
     error.Init(EX_SOFTWARE, "SSLConn::Socket(): SSL_new(3) failed: %s", 
                ssl_err_str().c_str());
     return;
   }
+
+  record_sizing_ = ctx->record_sizing();
+  record_len_ = 0;
+  record_bytes_ = 0;
+  record_retry_len_ = 0;
 }
 
 // Routine to issue a connect(2) on our socket.
@@ -204,169 +523,56 @@ void SSLConn::Connect(void) {
   // If we made it here, associate the TCP file descriptor to our SSL*
   // object.
 
-  if (!SSL_set_fd(ssl_, fd())) {
-    error.Init(EX_SOFTWARE, "SSLConn::Connect(): SSL_set_fd(3) failed: %s", 
-               ssl_err_str().c_str());
+  SSLContext* ctx = (SSLContext*)SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl_));
+  if (!InitBIO(ctx != NULL && ctx->memory_bio())) {
+    error.AppendMsg("SSLConn::Connect(): ");
     return;
   }
 
-  // NONBLOCKING: We may need to account for EALREADY in here, or at
-  // least see what's going on in TCPConnect() (and possibly in
-  // main.cc).
-
-  int ret = SSL_connect(ssl_);
-  if (ret == 0) {
-    // Check the SSL ERROR condition ...
-    switch(SSL_get_error(ssl_, ret)) {
-      case SSL_ERROR_ZERO_RETURN :  // the connection is closed?
-        {
-          error.Init(EX_SOFTWARE, "SSLConn::Connect(): %s terminated connection",
-                     hostname().c_str());
-          return;
-        }
-        break;
-
-      case SSL_ERROR_SYSCALL :
-        // From SSL_get_error(3): Some I/O error occurred.  The
-        // OpenSSL error queue may contain more information on the
-        // error.  If the error queue is empty (i.e. ERR_get_error()
-        // returns 0), ret can be used to find out more about the
-        // error: If ret == 0, an EOF was observed that violates the
-        // protocol.  If ret == -1, the underlying BIO reported an I/O
-        // error (for socket I/O on Unix systems, consult errno for
-        // details).
-
-        if (!ERR_peek_error()) {
-          // EOF, remote end closed abruptly ...
-          error.Init(EX_SOFTWARE, "SSLConn::Connect(): "
-                     "Recevied EOF while trying to SSL_connect() to %s on %d",
-                     hostname().c_str(), fd());
-          return;
-        } else {
-          error.Init(EX_SOFTWARE, "SSLConn::Connect(): SSL_ERROR_SYSCALL: "
-                     "SSL_connect() to %s failed: %s",
-                     hostname().c_str(), ssl_err_str().c_str());
-          return;
-        }
-        break;
-
-      case SSL_ERROR_SSL :
-        {
-          error.Init(EX_SOFTWARE, "SSLConn::Connect(): "
-                     "Shutdown: SSL_ERROR_SSL: %s", ssl_err_str().c_str());
-          return;
-        }
-        break;
-
-      default:
-        error.Init(EX_SOFTWARE, "SSLConn::Connect(): unknown ERROR: %s",
-                   ssl_err_str().c_str());
-        return;
-    }  // switch(SSL_get_error(ssl_, ret)) {
-  } else if (ret < 0) {
-    // Check the SSL ERROR condition ...
-    switch(SSL_get_error(ssl_, ret)) {
-      case SSL_ERROR_WANT_READ :
-        // Fall-through.
-
-      case SSL_ERROR_WANT_WRITE :
-        if (IsBlocking()) {
-          // WTF!?!
-          error.Init(EX_SOFTWARE, "SSLConn::Connect(): "
-                     "SSL_ERROR_WANT_READ/SSL_ERROR_WANT_WRITE: "
-                     "on blocking connection to %s (fd %d)",
-                     hostname().c_str(), fd());
-          return;
-        } else {
-          _LOGGER(LOG_INFO, "SSLConn::Connect(): "
-                  "received SSL_ERROR_WANT_READ/WRITE, returning.");
-          return;
-        }
-        break;
-
-#if defined SSL_ERROR_WANT_ACCEPT  // 0.9.6g does not have WANT_ACCEPT
-      case SSL_ERROR_WANT_ACCEPT :
-        // Fall-through.
-#endif
-
-      case SSL_ERROR_WANT_CONNECT :
-        if (IsBlocking()) {
-          // WTF!?!
-          error.Init(EX_SOFTWARE, "SSLConn::Connect(): "
-                     "SSL_ERROR_WANT_ACCEPT/SSL_ERROR_WANT_CONNECT :"
-                     "on blocking connection to %s (fd %d)",
-                     hostname().c_str(), fd());
-          return;
-        } else {
-          _LOGGER(LOG_INFO, "SSLConn::Connect(): "
-                  "Received SSL_ERROR_WANT_ACCEPT/CONNECT: returning.");
-          return;
-        }
-        break;
-
-      case SSL_ERROR_WANT_X509_LOOKUP :  // something's up with SSL_CTX_set_client_cert_cb()
-        {
-          error.Init(EX_SOFTWARE, "SSLConn::Connect(): "
-                     "SSL_ERROR_WANT_X509_LOOKUP: with host %s (fd %d)",
-                     hostname().c_str(), fd());
-          return;
-        }
-        break;
-
-      case SSL_ERROR_SYSCALL :
-        // From SSL_get_error(3): Some I/O error occurred.  The
-        // OpenSSL error queue may contain more information on the
-        // error.  If the error queue is empty (i.e. ERR_get_error()
-        // returns 0), ret can be used to find out more about the
-        // error: If ret == 0, an EOF was observed that violates the
-        // protocol.  If ret == -1, the underlying BIO reported an I/O
-        // error (for socket I/O on Unix systems, consult errno for
-        // details).
-
-        if (!ERR_peek_error()) {
-          // I/O error, check errno.
-          error.Init(EX_SOFTWARE, "SSLConn::Connect(): SSL_ERROR_SYSCALL: "
-                     "I/O error with %s on fd %d: %s",
-                     hostname().c_str(), fd(), strerror(errno));
-          return;
-        } else {
-          error.Init(EX_SOFTWARE, "SSLConn::Connect(): SSL_ERROR_SYSCALL: %s", 
-                     ssl_err_str().c_str());
-          return;
-        }
-        break;
+  // Tell the server which of its names we want (SNI), so a server
+  // hosting several names can pick the right certificate, unless the
+  // caller already set one on our SSL*.  Note, SNI does not allow
+  // literal addresses.
+
+  struct in6_addr addr;
+  if (SSL_get_servername(ssl_, TLSEXT_NAMETYPE_host_name) == NULL &&
+      hostname().size() > 0 && 
+      inet_pton(AF_INET, hostname().c_str(), &addr) != 1 &&
+      inet_pton(AF_INET6, hostname().c_str(), &addr) != 1 &&
+      !SSL_set_tlsext_host_name(ssl_, hostname().c_str()))
+    _LOGGER(LOG_WARNING, "SSLConn::Connect(): "
+            "SSL_set_tlsext_host_name(%s) failed: %s",
+            hostname().c_str(), ssl_err_str().c_str());
+
+  // If we've talked to this host:port before, try to resume that
+  // session (and have any new session filed under host:port).
+
+  if (ctx != NULL) {
+    char peer[SCRATCH_BUF_SIZE];
+    snprintf(peer, SCRATCH_BUF_SIZE, "%s:%hu", hostname().c_str(), port());
+    ctx->ResumeClientSession(ssl_, peer);
+  }
 
-      case SSL_ERROR_SSL :
-        {
-          error.Init(EX_SOFTWARE, "SSLConn::Connect(): SSL_ERROR_SSL: %s", ssl_err_str().c_str());
-          return;
-        }
-        break;
+  // We can only send early data (see set_early_data()) on a resumed
+  // session, and only as much as the server said it would take.
 
-      default:
-        {
-          error.Init(EX_SOFTWARE, "SSLConn::Connect(): unknown ERROR: %s", ssl_err_str().c_str());
-          return;
-        }
-    }  // switch(SSL_get_error(ssl_, ret)) {
-  }  // else if (ret < 0) {
+  SSL_SESSION* session = SSL_get0_session(ssl_);
+  if (early_data_.size() > 0 &&
+      (session == NULL ||
+       early_data_.size() > SSL_SESSION_get_max_early_data(session)))
+    early_data_.clear();
+  early_data_sent_ = 0;
 
-  peer_certificate_ = SSL_get_peer_certificate(ssl_);  // if exists,
-                                                       // get cert
-                                                       // from peer
+  // Start the handshake; if we're NON-BLOCKING, it will most likely
+  // not complete here, in which case the caller must continue it via
+  // Handshake() once our descriptor is ready.
 
-  if (peer_certificate_ != NULL) {
-    char cn[SCRATCH_BUF_SIZE];
-    X509_NAME* subject = X509_get_subject_name(peer_certificate_);
-    X509_NAME_get_text_by_NID(subject, NID_commonName, cn,
-                              SSL_X509_MAX_FIELD_SIZE - 1);
-    _LOGGER(LOG_NOTICE, "SSL (%s) connection to: %s, received cert: %s.", 
-            SSL_CIPHER_get_name(SSL_get_current_cipher(ssl_)),
-            hostname().c_str(), cn);
-  } else  {
-    _LOGGER(LOG_NOTICE, "SSL (%s) connection to: %s.",
-            SSL_CIPHER_get_name(SSL_get_current_cipher(ssl_)),
-            hostname().c_str());
+  SSL_set_connect_state(ssl_);
+  StartHandshake();
+  Handshake();
+  if (error.Event()) {
+    error.AppendMsg("SSLConn::Connect(): ");
+    return;
   }
 }
 
@@ -381,6 +587,32 @@ void SSLConn::Accept(SSLConn* peer, SSLContext* ctx) const {
     return;
   }
 
+  AcceptSSL(peer, ctx);
+  if (error.Event())
+    error.AppendMsg("SSLConn::Accept(): ");
+}
+
+// Routine to take over a connection that was accept(2)ed for us on
+// our socket (e.g., by IOUring::Accept()).
+//
+// Note, this routine can set an ErrorHandler event.
+void SSLConn::Accept(SSLConn* peer, const int peer_fd,
+                     SSLContext* ctx) const {
+  TCPConn::Accept(peer, peer_fd);
+  if (error.Event()) {
+    error.AppendMsg("SSLConn::Accept(): ");
+    return;
+  }
+
+  AcceptSSL(peer, ctx);
+  if (error.Event())
+    error.AppendMsg("SSLConn::Accept(): ");
+}
+
+// Routine to set up the SSL/TLS side of a newly accept(2)ed peer.
+//
+// Note, this routine can set an ErrorHandler event.
+void SSLConn::AcceptSSL(SSLConn* peer, SSLContext* ctx) const {
   // NONBLOCKING: To avoid the dreaded SSL 'deadlock', let's set a
   // timeout on the TCP socket.
 
@@ -396,187 +628,402 @@ void SSLConn::Accept(SSLConn* peer, SSLContext* ctx) const {
   // a SSL* object (which we reference count via the Descriptor
   // ojbect), then associate our TCP file descriptor to it.
 
-  if ((peer->ssl_ = SSL_new(ctx->ctx_)) == NULL) {
-    error.Init(EX_SOFTWARE, "SSLConn::Accept(): SSL_new(3) failed: %s",
+  ssl_mem_charge_new();
+  peer->ssl_ = SSL_new(ctx->ctx_);
+  ssl_mem_charge_done(peer->ssl_);
+  if (peer->ssl_ == NULL) {
+    error.Init(EX_SOFTWARE, "SSLConn::AcceptSSL(): SSL_new(3) failed: %s",
                ssl_err_str().c_str());
     return;
   }
-  if (!SSL_set_fd(peer->ssl_, peer->fd())) {
-    error.Init(EX_SOFTWARE, "SSLConn::Accept(): SSL_set_fd(3) failed: %s",
-               ssl_err_str().c_str());
+  if (!peer->InitBIO(ctx->memory_bio())) {
+    error.AppendMsg("SSLConn::AcceptSSL(): ");
     return;
   }
 
-  // NONBLOCKING: We may need to account for EALREADY in here, or at
-  // least see what's going on in TCPConnect() (and possibly in
-  // main.cc).
+  // Start the handshake, see Connect() above.  Note, our peers
+  // inherit our (listening socket's) handshake timeout.
+
+  SSL_set_accept_state(peer->ssl_);
+  peer->handshake_timeout_ = handshake_timeout_;
+  peer->record_sizing_ = ctx->record_sizing();
+  peer->record_len_ = 0;
+  peer->record_bytes_ = 0;
+  peer->record_retry_len_ = 0;
+  peer->early_data_.clear();
+  peer->early_pending_ = (SSL_get_max_early_data(peer->ssl_) > 0);
+  peer->early_data_sent_ = 0;
+  peer->early_data_read_ = 0;
+  peer->StartHandshake();
+  peer->Handshake();
+  if (error.Event())
+    error.AppendMsg("SSLConn::AcceptSSL(): ");
+}
 
-  int ret = SSL_accept(peer->ssl_);
-  if (ret == 0) {
-    // Check the SSL ERROR condition ...
-    switch(SSL_get_error(ssl_, ret)) {
-      case SSL_ERROR_ZERO_RETURN :  // the connection is closed?
-        {
-          error.Init(EX_SOFTWARE, "SSLConn::Accept: %s terminated connection",
-                     peer->hostname().c_str());
-          return;
-        }
-        break;
+// Routine to accept(2) a connection on a socket. This routined
+// provides the peer's SSLConn object.
+//
+// Note, this routine can set an ErrorHandler event.
+SSLConn SSLConn::Accept(SSLContext* ctx) const {
+  SSLConn peer;  // XXX TODO(aka) We need framing type here!
 
-      case SSL_ERROR_SYSCALL :
-        // From SSL_get_error(3): Some I/O error occurred.  The
-        // OpenSSL error queue may contain more information on the
-        // error.  If the error queue is empty (i.e. ERR_get_error()
-        // returns 0), ret can be used to find out more about the
-        // error: If ret == 0, an EOF was observed that violates the
-        // protocol.  If ret == -1, the underlying BIO reported an I/O
-        // error (for socket I/O on Unix systems, consult errno for
-        // details).
+  // Call SSLConn::Accept(SSLConn*) to get the work done.
+  Accept(&peer, ctx);
 
-        if (!ERR_peek_error()) {
-          // EOF, remote end closed abruptly ...
-          error.Init(EX_SOFTWARE, "SSLConn::Accept: "
-                     "Recevied EOF while trying to SSL_connect() to %s on %d",
-                     peer->hostname().c_str(), fd());
-          return;
-        } else {
-          error.Init(EX_SOFTWARE, "SSLConn::Accept: SSL_ERROR_SYSCALL: "
-                     "SSL_connect() to %s failed: %s",
-                     peer->hostname().c_str(), ssl_err_str().c_str());
-          return;
-        }
-        break;
+  return peer;
+}
 
-      case SSL_ERROR_SSL :
-        {
-          error.Init(EX_SOFTWARE, "SSLConn::Accept: Shutdown: SSL_ERROR_SSL: %s",
-                     ssl_err_str().c_str());
-          return;
-        }
-        break;
+// Routine to start (or continue) a SSL/TLS handshake.
+//
+// Note, this routine can set an ErrorHandler event.
+int SSLConn::Handshake(void) {
+  if (ssl_ == NULL) {
+    error.Init(EX_SOFTWARE, "SSLConn::Handshake(): SSL* is NULL");
+    return HANDSHAKE_FAILED;
+  }
 
-      default:
-        error.Init(EX_SOFTWARE, "SSLConn::Accept: unknown ERROR: %s",
-                   ssl_err_str().c_str());
-        return;
-    }  // switch(SSL_get_error(ssl_, ret)) {
-  } else if (ret < 0) {
-    // Check the SSL ERROR condition ...
-    switch(SSL_get_error(ssl_, ret)) {
-      case SSL_ERROR_WANT_READ :
-        // Fall-through.
+  if (handshake_job_ != NULL) {
+    // Our last step was run on a WorkerPool, see if it's done.
+    if (!__atomic_load_n(&handshake_job_->done, __ATOMIC_ACQUIRE))
+      return HANDSHAKE_BUSY;
+
+    struct ssl_handshake_job* job = handshake_job_;
+    handshake_job_ = NULL;
+    early_pending_ = job->early_pending;
+    early_data_ = job->early_data;  // copies of us may share the job
+    early_data_sent_ = job->early_data_sent;
+    if (job->ret == 1) {
+      handshake_state_ = HANDSHAKE_COMPLETE;
+      HandshakeComplete();
+    } else {
+      handshake_state_ = HandshakeError(job->ret, job->ssl_error,
+                                        job->sys_errno, job->ssl_errors);
+    }
+    ssl_handshake_job_unref(job);
+    FlushHandshake();
 
-      case SSL_ERROR_WANT_WRITE :
-        if (IsBlocking()) {
-          // WTF!?!
-          error.Init(EX_SOFTWARE, "SSLConn::Accept: "
-                     "SSL_ERROR_WANT_READ/SSL_ERROR_WANT_WRITE: "
-                     "on blocking connection to %s (fd %d)",
-                     peer->hostname().c_str(), fd());
-          return;
-        } else {
-          _LOGGER(LOG_INFO, "SSLConn::Accept: "
-                  "received SSL_ERROR_WANT_READ/WRITE, returning.");
-          return;
-        }
-        break;
+    return handshake_state_;
+  }
 
-#if defined SSL_ERROR_WANT_ACCEPT  // 0.9.6g does not have WANT_ACCEPT
-      case SSL_ERROR_WANT_ACCEPT :
-        // Fall-through.
-#endif
+  if (handshake_state_ == HANDSHAKE_COMPLETE)
+    return handshake_state_;
 
-      case SSL_ERROR_WANT_CONNECT :
-        if (IsBlocking()) {
-          // WTF!?!
-          error.Init(EX_SOFTWARE, "SSLConn::Accept: "
-                     "SSL_ERROR_WANT_ACCEPT/SSL_ERROR_WANT_CONNECT :"
-                     "on blocking connection to %s (fd %d)",
-                     peer->hostname().c_str(), fd());
-          return;
-        } else {
-          _LOGGER(LOG_INFO, "SSLConn::Accept: "
-                  "Received SSL_ERROR_WANT_ACCEPT/CONNECT: returning.");
-          return;
-        }
-        break;
+  if (handshake_state_ == HANDSHAKE_FAILED) {
+    error.Init(EX_SOFTWARE, "SSLConn::Handshake(): "
+               "handshake with %s (fd %d) already failed",
+               hostname().c_str(), fd());
+    return handshake_state_;
+  }
 
-      case SSL_ERROR_WANT_X509_LOOKUP :  // something's up with SSL_CTX_set_client_cert_cb()
-        {
-          error.Init(EX_SOFTWARE, "SSLConn::Accept: SSL_ERROR_WANT_X509_LOOKUP: "
-                     "with host %s (fd %d)", peer->hostname().c_str(), fd());
-          return;
-        }
-        break;
+  if (IsHandshakeExpired()) {
+    handshake_state_ = HANDSHAKE_FAILED;
+    error.Init(EX_IOERR, "SSLConn::Handshake(): handshake with %s (fd %d) "
+               "did not complete within %lds", hostname().c_str(), fd(),
+               (long)handshake_timeout_);
+    return handshake_state_;
+  }
 
-      case SSL_ERROR_SYSCALL :
-        // From SSL_get_error(3): Some I/O error occurred.  The
-        // OpenSSL error queue may contain more information on the
-        // error.  If the error queue is empty (i.e. ERR_get_error()
-        // returns 0), ret can be used to find out more about the
-        // error: If ret == 0, an EOF was observed that violates the
-        // protocol.  If ret == -1, the underlying BIO reported an I/O
-        // error (for socket I/O on Unix systems, consult errno for
-        // details).
+  // In memory BIO mode, if OpenSSL was waiting on our peer, hand it
+  // whatever has arrived.
 
-        if (!ERR_peek_error()) {
-          // I/O error, check errno.
-          error.Init(EX_SOFTWARE, "SSLConn::Accept: SSL_ERROR_SYSCALL: "
-                     "I/O error with %s on fd %d: %s",
-                     peer->hostname().c_str(), fd(), strerror(errno));
-          return;
-        } else {
-          error.Init(EX_SOFTWARE, "SSLConn::Accept: SSL_ERROR_SYSCALL: %s", 
-                     ssl_err_str().c_str());
-          return;
-        }
-        break;
+  if (net_bio_ != NULL && handshake_state_ == HANDSHAKE_WANT_READ &&
+      FillCiphertext() < 0) {
+    handshake_state_ = HANDSHAKE_FAILED;
+    error.AppendMsg("SSLConn::Handshake(): ");
+    return handshake_state_;
+  }
 
-      case SSL_ERROR_SSL :
-        {
-          error.Init(EX_SOFTWARE, "SSLConn::Accept: SSL_ERROR_SSL: %s",
-                     ssl_err_str().c_str());
-          return;
-        }
-        break;
+  // If our SSLContext has a WorkerPool (and we're NON-BLOCKING, i.e.,
+  // the step can't stall a pool thread), let the pool do the work.
+
+  SSLContext* ctx = (SSLContext*)SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl_));
+  if (ctx != NULL && ctx->handshake_pool() != NULL && !IsBlocking()) {
+    struct ssl_handshake_job* job = new struct ssl_handshake_job;
+    job->ssl = ssl_;
+    job->net_bio = net_bio_;
+    job->descriptor = descriptor_;
+    job->refs = 2;  // ours & the pool's
+    job->ret = 0;
+    job->ssl_error = SSL_ERROR_NONE;
+    job->sys_errno = 0;
+    job->early_pending = early_pending_;
+    job->early_data.swap(early_data_);
+    job->early_data_sent = early_data_sent_;
+    job->done = false;
+    descriptor_->Acquire();
+    if (ctx->handshake_pool()->Submit(ssl_handshake_job_run, job)) {
+      handshake_job_ = job;
+      handshake_state_ = HANDSHAKE_BUSY;
+      return handshake_state_;
+    }
 
-      default:
-        {
-          error.Init(EX_SOFTWARE, "SSLConn::Accept: unknown ERROR: %s",
-                     ssl_err_str().c_str());
-          return;
-        }
-    }  // switch(SSL_get_error(ssl_, ret)) {
-  }  // else if (ret < 0) {
+    early_data_.swap(job->early_data);
+    descriptor_->Release();  // can't be the last, we hold one
+    delete job;  // the pool is full, do it ourselves
+  }
 
-  peer->peer_certificate_ = SSL_get_peer_certificate(ssl_);  // if peer has a cert, get it
+  for (;;) {
+    // SSL_get_error() operates reliably only if the error queue is empty.
+    ERR_clear_error();
+
+    long start = thread_cpu_nsec();
+    ssl_mem_charge(ssl_);
+    int ret = ssl_handshake_step(ssl_, &early_pending_, &early_data_,
+                                 &early_data_sent_);
+    int sys_errno = errno;
+    ssl_mem_charge(NULL);
+    if (ctx != NULL)
+      ctx->AddHandshakeTime(thread_cpu_nsec() - start);
+
+    if (ret == 1) {
+      handshake_state_ = HANDSHAKE_COMPLETE;
+      HandshakeComplete();
+      break;
+    }
+
+    int ssl_error = SSL_get_error(ssl_, ret);
+
+    // Over memory BIOs, OpenSSL can't block waiting for our peer, so
+    // if we're BLOCKING, we send what it has, wait for the answer,
+    // and take another step.
+
+    if (net_bio_ != NULL && IsBlocking() && ssl_error == SSL_ERROR_WANT_READ) {
+      int filled = 0;
+      if (SendCiphertext() < 0)
+        error.Init(EX_IOERR, "SSLConn::Handshake(): write(fd: %d) failed: %s",
+                   fd(), strerror(errno));
+      else
+        filled = FillCiphertext();
+      if (error.Event()) {
+        handshake_state_ = HANDSHAKE_FAILED;
+        error.AppendMsg("SSLConn::Handshake(): ");
+        return handshake_state_;
+      }
+      if (filled > 0)
+        continue;  // else, our SO_RCVTIMEO fired
+    }
+
+    handshake_state_ = HandshakeError(ret, ssl_error, sys_errno,
+                                      ssl_err_str().c_str());
+    break;
+  }
+
+  FlushHandshake();
+
+  return handshake_state_;
+}
+
+// Routine to send what a handshake step left in net_bio_ (in memory
+// BIO mode).  If our socket fills up first, we need to know when it's
+// writable again, i.e., HANDSHAKE_WANT_WRITE.
+//
+// Note, this routine can set an ErrorHandler event.
+void SSLConn::FlushHandshake(void) {
+  if (net_bio_ == NULL)
+    return;
+
+  if (handshake_state_ == HANDSHAKE_FAILED) {
+    SendCiphertext();  // our alert, if we can
+    return;
+  }
+
+  if (SendCiphertext() < 0) {
+    handshake_state_ = HANDSHAKE_FAILED;
+    error.Init(EX_IOERR, "SSLConn::Handshake(): write(fd: %d) failed: %s",
+               fd(), strerror(errno));
+    return;
+  }
 
-  if (peer->peer_certificate_ != NULL) {
+  if (handshake_state_ != HANDSHAKE_COMPLETE && IsCiphertextPending())
+    handshake_state_ = HANDSHAKE_WANT_WRITE;
+}
+
+// Routine to return (once) how much of our early data was accepted.
+size_t SSLConn::TakeEarlyDataSent(void) {
+  if (handshake_state_ != HANDSHAKE_COMPLETE)
+    return 0;
+
+  size_t sent = early_data_sent_;
+  early_data_sent_ = 0;
+
+  return sent;
+}
+
+// Routine to note when our handshake started (for its deadline).
+void SSLConn::StartHandshake(void) {
+  handshake_state_ = HANDSHAKE_WANT_WRITE;  // until we know better
+  handshake_deadline_ = (handshake_timeout_ > 0) ?
+      monotonic_time() + handshake_timeout_ : 0;
+}
+
+// Routine to finish up after a successful handshake: grab the peer's
+// certificate, update our SSLContext's counters and log it.
+void SSLConn::HandshakeComplete(void) {
+  SSLContext* ctx = (SSLContext*)SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl_));
+  if (ctx != NULL)
+    ctx->CountHandshake(ssl_);
+
+  // If the server turned down our early data, it must be sent again.
+
+  if (!SSL_is_server(ssl_)) {
+    if (early_data_sent_ > 0 &&
+        SSL_get_early_data_status(ssl_) != SSL_EARLY_DATA_ACCEPTED) {
+      _LOGGER(LOG_INFO, "SSLConn::HandshakeComplete(): "
+              "%s rejected our early data (%lub).", hostname().c_str(),
+              (unsigned long)early_data_sent_);
+      early_data_sent_ = 0;
+    }
+    early_data_.clear();
+  }
+
+  if (peer_certificate_ != NULL)
+    X509_free(peer_certificate_);
+  peer_certificate_ = SSL_get_peer_certificate(ssl_);  // if exists,
+                                                       // get cert
+                                                       // from peer
+
+  const char* direction = SSL_is_server(ssl_) ? "from" : "to";
+  const char* resumed = SSL_session_reused(ssl_) ? ", resumed" : "";
+  if (peer_certificate_ != NULL) {
     char cn[SCRATCH_BUF_SIZE];
-    X509_NAME* subject = X509_get_subject_name(peer->peer_certificate_);
+    X509_NAME* subject = X509_get_subject_name(peer_certificate_);
     X509_NAME_get_text_by_NID(subject, NID_commonName, cn,
                               SSL_X509_MAX_FIELD_SIZE - 1);
-    _LOGGER(LOG_NOTICE, "SSL (%s) connection from: %s, received cert: %s.", 
-            SSL_CIPHER_get_name(SSL_get_current_cipher(peer->ssl_)), 
-            peer->hostname().c_str(), cn);
-  } else {
-    _LOGGER(LOG_NOTICE, "SSL (%s) connection from: %s.",
-            SSL_CIPHER_get_name(SSL_get_current_cipher(peer->ssl_)), 
-            peer->hostname().c_str());
+    _LOGGER(LOG_NOTICE, "SSL (%s%s) connection %s: %s, received cert: %s.", 
+            SSL_CIPHER_get_name(SSL_get_current_cipher(ssl_)), resumed,
+            direction, hostname().c_str(), cn);
+  } else  {
+    _LOGGER(LOG_NOTICE, "SSL (%s%s) connection %s: %s.",
+            SSL_CIPHER_get_name(SSL_get_current_cipher(ssl_)), resumed,
+            direction, hostname().c_str());
   }
 }
 
-// Routine to accept(2) a connection on a socket. This routined
-// provides the peer's SSLConn object.
+// Routine to set our max send fragment for the next SSL_write(3).
+ssize_t SSLConn::SizeRecords(const ssize_t buf_len) {
+  // A retried SSL_write(3) must not be given less than last time.
+  if (record_retry_len_ > 0)
+    return (record_retry_len_ < buf_len) ? record_retry_len_ : buf_len;
+
+  long now = monotonic_msec();
+  if (record_sizing_.idle_msec > 0 && record_last_msec_ > 0 &&
+      now - record_last_msec_ >= record_sizing_.idle_msec)
+    record_bytes_ = 0;  // the congestion window has likely collapsed
+  record_last_msec_ = now;
+
+  size_t len = SSL3_RT_MAX_PLAIN_LENGTH;
+  ssize_t write_len = buf_len;
+  if (record_bytes_ < record_sizing_.boost_len) {
+    len = record_sizing_.small_len;
+    if (len < 512)
+      len = 512;  // smallest fragment OpenSSL allows
+    else if (len > SSL3_RT_MAX_PLAIN_LENGTH)
+      len = SSL3_RT_MAX_PLAIN_LENGTH;
+
+    // Stop at the end of the small records, so the rest of buf goes
+    // out in full records on our next call.
+
+    size_t left = record_sizing_.boost_len - record_bytes_;
+    if ((size_t)write_len > left)
+      write_len = left;
+  }
+
+  // Note, shrinking the max send fragment also shrinks the split
+  // send fragment, which is not restored when the max grows again.
+
+  if (len != record_len_) {
+    if (SSL_set_max_send_fragment(ssl_, len) &&
+        SSL_set_split_send_fragment(ssl_, len))
+      record_len_ = len;
+    else
+      _LOGGER_LIMITED(LOG_WARNING, "SSLConn::SizeRecords(): "
+                      "SSL_set_max_send_fragment(%lu) failed: %s",
+                      (unsigned long)len, ssl_err_str().c_str());
+  }
+
+  return write_len;
+}
+
+// Routine to map a failed SSL_do_handshake(3) to our handshake state.
+// As the step may have been run on a WorkerPool thread, everything we
+// need to know about the failure is passed in.
 //
 // Note, this routine can set an ErrorHandler event.
-SSLConn SSLConn::Accept(SSLContext* ctx) const {
-  SSLConn peer;  // XXX TODO(aka) We need framing type here!
+int SSLConn::HandshakeError(const int ret, const int ssl_error,
+                            const int sys_errno, const string& ssl_errors) {
+  switch (ssl_error) {
+    case SSL_ERROR_WANT_READ :
+      if (IsBlocking()) {
+        // Our SO_RCVTIMEO must have fired.
+        error.Init(EX_IOERR, "SSLConn::Handshake(): SSL_ERROR_WANT_READ: "
+                   "on blocking connection to %s (fd %d)",
+                   hostname().c_str(), fd());
+        return HANDSHAKE_FAILED;
+      }
+      return HANDSHAKE_WANT_READ;
 
-  // Call SSLConn::Accept(SSLConn*) to get the work done.
-  Accept(&peer, ctx);
+#if defined SSL_ERROR_WANT_ACCEPT  // 0.9.6g does not have WANT_ACCEPT
+    case SSL_ERROR_WANT_ACCEPT :
+      // Fall-through.
+#endif
 
-  return peer;
+    case SSL_ERROR_WANT_CONNECT :
+      // Fall-through.
+
+    case SSL_ERROR_WANT_WRITE :
+      if (IsBlocking()) {
+        error.Init(EX_IOERR, "SSLConn::Handshake(): SSL_ERROR_WANT_WRITE: "
+                   "on blocking connection to %s (fd %d)",
+                   hostname().c_str(), fd());
+        return HANDSHAKE_FAILED;
+      }
+      return HANDSHAKE_WANT_WRITE;
+
+    case SSL_ERROR_ZERO_RETURN :  // the connection is closed?
+      error.Init(EX_IOERR, "SSLConn::Handshake(): %s terminated connection",
+                 hostname().c_str());
+      return HANDSHAKE_FAILED;
+
+    case SSL_ERROR_WANT_X509_LOOKUP :  // something's up with SSL_CTX_set_client_cert_cb()
+      error.Init(EX_SOFTWARE, "SSLConn::Handshake(): "
+                 "SSL_ERROR_WANT_X509_LOOKUP: with host %s (fd %d)",
+                 hostname().c_str(), fd());
+      return HANDSHAKE_FAILED;
+
+    case SSL_ERROR_SYSCALL :
+      // From SSL_get_error(3): Some I/O error occurred.  The OpenSSL
+      // error queue may contain more information on the error.  If
+      // the error queue is empty (i.e. ERR_get_error() returns 0),
+      // ret can be used to find out more about the error: If ret ==
+      // 0, an EOF was observed that violates the protocol.  If ret ==
+      // -1, the underlying BIO reported an I/O error (for socket I/O
+      // on Unix systems, consult errno for details).
+
+      if (strlen(ssl_errors.c_str()) > 0) {
+        error.Init(EX_IOERR, "SSLConn::Handshake(): SSL_ERROR_SYSCALL: "
+                   "with %s: %s", hostname().c_str(), ssl_errors.c_str());
+      } else if (ret == 0 || sys_errno == 0) {
+        // EOF, remote end closed abruptly ...
+        error.Init(EX_IOERR, "SSLConn::Handshake(): "
+                   "Received EOF during handshake with %s on fd %d",
+                   hostname().c_str(), fd());
+      } else {
+        error.Init(EX_IOERR, "SSLConn::Handshake(): SSL_ERROR_SYSCALL: "
+                   "I/O error with %s on fd %d: %s",
+                   hostname().c_str(), fd(), strerror(sys_errno));
+      }
+      return HANDSHAKE_FAILED;
+
+    case SSL_ERROR_SSL :
+      error.Init(EX_SOFTWARE, "SSLConn::Handshake(): SSL_ERROR_SSL: "
+                 "with %s: %s", hostname().c_str(), ssl_errors.c_str());
+      return HANDSHAKE_FAILED;
+
+    default :
+      error.Init(EX_SOFTWARE, "SSLConn::Handshake(): unknown ERROR: %s",
+                 ssl_errors.c_str());
+      return HANDSHAKE_FAILED;
+  }
 }
 
 // This routine is either called to *initiate* a shutdown, or to
@@ -634,9 +1081,18 @@ void SSLConn::Shutdown(const int unidirectional)
     // SSLv2 protocol, SSL_shutdown() will succeed on the first call.
 
     // Send our 'close notify' and check the return code ...
+    ssl_mem_charge(ssl_);
     int ret = SSL_shutdown(ssl_);
-    if (!ret && !unidirectional)
+    if (net_bio_ != NULL)
+      SendCiphertext();  // our close notify, if our peer's still there
+    if (!ret && !unidirectional) {
       ret = SSL_shutdown(ssl_);  // wait for their 'close notify'
+      while (net_bio_ != NULL && ret < 0 && 
+             SSL_get_error(ssl_, ret) == SSL_ERROR_WANT_READ &&
+             FillCiphertext() > 0)
+        ret = SSL_shutdown(ssl_);
+    }
+    ssl_mem_charge(NULL);
 
     // TODO(aka): If we want ever want a "to" or "from", we need to
     // set the TCPConn::server flag!  (which should be called *direction* flag!
@@ -690,6 +1146,15 @@ ssize_t SSLConn::Write(const char* buf, const ssize_t buf_len) {
   if (ssl_ == NULL)
     return TCPConn::Write(buf, buf_len);
 
+  // If our handshake is still in progress, finish it first.
+  if (handshake_state_ != HANDSHAKE_NONE && 
+      handshake_state_ != HANDSHAKE_COMPLETE && 
+      Handshake() != HANDSHAKE_COMPLETE) {
+    if (error.Event())
+      error.AppendMsg("SSLConn::Write(): ");
+    return 0;
+  }
+
   // SSL_write(3) will write *at most* buf_len into a SSL connection.  
   //
   // BLOCKING: SSL_write() will only return upon error, or completion 
@@ -713,8 +1178,8 @@ ssize_t SSLConn::Write(const char* buf, const ssize_t buf_len) {
 
   // Debugging:
   if (ERR_peek_error()) {
-    _LOGGER(LOG_WARNING, "SSLConn::Write(): SSL error queue is non-empty: %s!",
-            ssl_err_str().c_str());
+    _LOGGER_LIMITED(LOG_WARNING, "SSLConn::Write(): SSL error queue is non-empty: %s!",
+                    ssl_err_str().c_str());
 
     // Unfortunately, SSL_get_error() operates reliably only if the
     // error queue is empty.
@@ -722,7 +1187,35 @@ ssize_t SSLConn::Write(const char* buf, const ssize_t buf_len) {
     ERR_clear_error();
   }
 
-  int bytes_wrote = SSL_write(ssl_, buf, buf_len);
+  // Size our records (see SSLContext::set_record_sizing()), which
+  // may mean we only write the first part of buf.
+
+  ssize_t write_len = buf_len;
+  if (record_sizing_.small_len > 0)
+    write_len = SizeRecords(buf_len);
+
+  ssl_mem_charge(ssl_);
+  int bytes_wrote = SSL_write(ssl_, buf, write_len);
+  ssl_mem_charge(NULL);
+
+  // In memory BIO mode, send the records OpenSSL just made in one go,
+  // and if none fit in net_bio_, try again once we've made room.
+
+  while (net_bio_ != NULL) {
+    ssize_t n = SendCiphertext();
+    if (n < 0) {
+      error.Init(EX_IOERR, "SSLConn::Write(): write(fd: %d) failed: %s",
+                 fd(), strerror(errno));
+      return 0;
+    }
+    if (bytes_wrote > 0 || n == 0 ||
+        SSL_get_error(ssl_, bytes_wrote) != SSL_ERROR_WANT_WRITE)
+      break;
+
+    ssl_mem_charge(ssl_);
+    bytes_wrote = SSL_write(ssl_, buf, write_len);
+    ssl_mem_charge(NULL);
+  }
   if (bytes_wrote == 0) {
     // From SSL_write(3): The write operation was not
     // successful. Probably the underlying connection was closed. Call
@@ -733,9 +1226,9 @@ ssize_t SSLConn::Write(const char* buf, const ssize_t buf_len) {
     switch(SSL_get_error(ssl_, bytes_wrote)) {
       case SSL_ERROR_ZERO_RETURN :
         {
-          _LOGGER(LOG_WARNING, "SSLConn::Write(): "
-                  "%s unexpectedly sent \'close notify\' from %s.",
-                  hostname().c_str());
+          _LOGGER_LIMITED(LOG_WARNING, "SSLConn::Write(): "
+                          "%s unexpectedly sent \'close notify\' from %s.",
+                          hostname().c_str());
           Shutdown(0);  // send our close notify
         }
         break;
@@ -751,7 +1244,7 @@ ssize_t SSLConn::Write(const char* buf, const ssize_t buf_len) {
         // details).
 
         if (!ERR_peek_error()) {
-          _LOGGER(LOG_WARNING, "Received EOF from %s.", hostname().c_str());
+          _LOGGER_LIMITED(LOG_WARNING, "Received EOF from %s.", hostname().c_str());
           SSL_set_shutdown(ssl_, SSL_SENT_SHUTDOWN);  // mark the SSL
                                                       // connection as
                                                       // closed
@@ -765,9 +1258,9 @@ ssize_t SSLConn::Write(const char* buf, const ssize_t buf_len) {
         break;
 
       case SSL_ERROR_SSL :
-        _LOGGER(LOG_WARNING, "SSLConn::Write(): Received SSL_ERROR_SSL: "
-                "%s terminated connection: %s", 
-                hostname().c_str(), ssl_err_str().c_str());
+        _LOGGER_LIMITED(LOG_WARNING, "SSLConn::Write(): Received SSL_ERROR_SSL: "
+                        "%s terminated connection: %s", 
+                        hostname().c_str(), ssl_err_str().c_str());
         break;
 
       default:
@@ -791,13 +1284,13 @@ ssize_t SSLConn::Write(const char* buf, const ssize_t buf_len) {
       case SSL_ERROR_WANT_READ :
         if (IsBlocking()) {
           // See SSL_MODE_AUTO_RETRY in SSL_CTX_set_mode(3) for suggestions.
-          _LOGGER(LOG_WARNING, "SSLConn::Write() received SSL_ERROR_WANT_READ "
-                  "on blocking connection to %s (fd %d)",
-                  hostname().c_str(), fd());
+          _LOGGER_LIMITED(LOG_WARNING, "SSLConn::Write() received SSL_ERROR_WANT_READ "
+                          "on blocking connection to %s (fd %d)",
+                          hostname().c_str(), fd());
         } else {
-          _LOGGER(LOG_INFO, "SSLConn::Write() received SSL_ERROR_WANT_READ "
-                  "on non-blocking connection to %s on fd %d.",
-                  hostname().c_str(), fd());
+          _LOGGER_LIMITED(LOG_INFO, "SSLConn::Write() received SSL_ERROR_WANT_READ "
+                          "on non-blocking connection to %s on fd %d.",
+                          hostname().c_str(), fd());
         }
         break;
 
@@ -809,8 +1302,8 @@ ssize_t SSLConn::Write(const char* buf, const ssize_t buf_len) {
           return bytes_wrote;
         } else {
           // See SSL_MODE_AUTO_RETRY in SSL_CTX_set_mode(3) for suggestions.
-          _LOGGER(LOG_INFO, "SSLConn::Write(): "
-                  "Received SSL_ERROR_WANT_WRITE, returning.");
+          _LOGGER_LIMITED(LOG_INFO, "SSLConn::Write(): "
+                          "Received SSL_ERROR_WANT_WRITE, returning.");
         }
         break;
 
@@ -853,6 +1346,13 @@ ssize_t SSLConn::Write(const char* buf, const ssize_t buf_len) {
     }  // switch(SSL_get_error(ssl_, ret)) {
   }  // else if (bytes_wrote < 0)
 
+  // If we're to be called again with the same arguments (i.e.,
+  // SSL_ERROR_WANT_READ or WANT_WRITE), we must write as much again.
+
+  record_retry_len_ = (bytes_wrote < 0) ? write_len : 0;
+  if (bytes_wrote > 0)
+    record_bytes_ += bytes_wrote;
+
   _LOGGER(LOG_DEBUG, "SSLConn::Write(): Wrote %d byte(s) to: %s.", 
           bytes_wrote, print().c_str());
 
@@ -871,6 +1371,38 @@ ssize_t SSLConn::Read(const ssize_t buf_len, char* buf, bool* eof) {
   if (ssl_ == NULL)
     return TCPConn::Read(buf_len, buf, eof);
 
+  // If our handshake is still in progress, finish it first, unless
+  // (as a server) we've received early data, which we return even
+  // before the handshake completes, so our caller can get started on
+  // the request.
+
+  if (handshake_state_ != HANDSHAKE_NONE && 
+      handshake_state_ != HANDSHAKE_COMPLETE && 
+      early_data_pending() == 0) {
+    Handshake();
+    if (error.Event()) {
+      *eof = false;
+      error.AppendMsg("SSLConn::Read(): ");
+      return 0;
+    }
+    if (handshake_state_ != HANDSHAKE_COMPLETE && early_data_pending() == 0) {
+      *eof = false;
+      return 0;
+    }
+  }
+
+  if (early_data_pending() > 0) {
+    size_t len = early_data_.size();
+    if (buf_len >= 0 && len > (size_t)buf_len)
+      len = buf_len;
+    memcpy(buf, early_data_.data(), len);
+    early_data_.erase(0, len);
+    early_data_read_ += len;
+    *eof = false;
+
+    return len;
+  }
+
   // SSL_read(3) will read *at most* one SSL record.  
   //
   // Blocking: SSL_read() will only return upon error, or completion
@@ -900,8 +1432,8 @@ ssize_t SSLConn::Read(const ssize_t buf_len, char* buf, bool* eof) {
     // ERR_get_error_line(3), or ERR_get_line_data(3) to see exactly
     // where these (missed?) errors are being generated!
 
-    _LOGGER(LOG_WARNING, "SSLConn::Read(): SSL error queue is non-empty: %s.",
-            ssl_err_str().c_str());
+    _LOGGER_LIMITED(LOG_WARNING, "SSLConn::Read(): SSL error queue is non-empty: %s.",
+                    ssl_err_str().c_str());
 
     // SSL_get_error() operates reliably only if the error queue 
     // is empty.
@@ -910,7 +1442,36 @@ ssize_t SSLConn::Read(const ssize_t buf_len, char* buf, bool* eof) {
   }
 
   *eof = false;
+  ssl_mem_charge(ssl_);
   int bytes_read = SSL_read(ssl_, buf, buf_len);
+  ssl_mem_charge(NULL);
+
+  // In memory BIO mode, if OpenSSL ran out of ciphertext, give it what
+  // is waiting on our socket, and try again.  Afterwards, send
+  // anything OpenSSL had to say (e.g., an alert or a key update).
+
+  if (net_bio_ != NULL) {
+    while (bytes_read < 0 && 
+           SSL_get_error(ssl_, bytes_read) == SSL_ERROR_WANT_READ) {
+      int filled = FillCiphertext();
+      if (filled < 0) {
+        error.AppendMsg("SSLConn::Read(): ");
+        return 0;
+      }
+      if (filled == 0)
+        break;
+
+      ssl_mem_charge(ssl_);
+      bytes_read = SSL_read(ssl_, buf, buf_len);
+      ssl_mem_charge(NULL);
+    }
+
+    if (SendCiphertext() < 0) {
+      error.Init(EX_IOERR, "SSLConn::Read(): write(fd: %d) failed: %s",
+                 fd(), strerror(errno));
+      return 0;
+    }
+  }
 
 #if DEBUG_INCOMING_DATA
   _LOGGER(LOG_NOTICE, "DEBUG: SSLConn::Read(): SSL_read() returned %db.", 
@@ -949,8 +1510,8 @@ ssize_t SSLConn::Read(const ssize_t buf_len, char* buf, bool* eof) {
 
         if (!ERR_peek_error()) {
           *eof = true;  // we got EOF
-          _LOGGER(LOG_WARNING, "SSLConn::Read(): Received EOF from %s.",
-                  hostname().c_str());
+          _LOGGER_LIMITED(LOG_WARNING, "SSLConn::Read(): Received EOF from %s.",
+                          hostname().c_str());
           SSL_set_shutdown(ssl_, SSL_SENT_SHUTDOWN);  // mark the SSL
                                                       // connection as
                                                       // closed
@@ -963,9 +1524,9 @@ ssize_t SSLConn::Read(const ssize_t buf_len, char* buf, bool* eof) {
         break;  // not reached
 
       case SSL_ERROR_SSL :
-        _LOGGER(LOG_WARNING, "SSLConn::Read(): Received SSL_ERROR_SSL: "
-                "%s terminated connection: %s",
-                hostname().c_str(), ssl_err_str().c_str());
+        _LOGGER_LIMITED(LOG_WARNING, "SSLConn::Read(): Received SSL_ERROR_SSL: "
+                        "%s terminated connection: %s",
+                        hostname().c_str(), ssl_err_str().c_str());
         break;
 
       default:
@@ -989,13 +1550,13 @@ ssize_t SSLConn::Read(const ssize_t buf_len, char* buf, bool* eof) {
       case SSL_ERROR_WANT_READ :
         if (IsBlocking()) {
           // See SSL_MODE_AUTO_RETRY in SSL_CTX_set_mode(3) for suggestions.
-          _LOGGER(LOG_WARNING, "SSLConn::Read(): received SSL_ERROR_WANT_READ "
-                  "on blocking connection to %s (fd %d)",
-                  hostname().c_str(), fd());
+          _LOGGER_LIMITED(LOG_WARNING, "SSLConn::Read(): received SSL_ERROR_WANT_READ "
+                          "on blocking connection to %s (fd %d)",
+                          hostname().c_str(), fd());
         } else {
-          _LOGGER(LOG_INFO, "SSLConn::Read(): received SSL_ERROR_WANT_READ "
-                  "on non-blocking connection to %s on fd %d.",
-                  hostname().c_str(), fd());
+          _LOGGER_LIMITED(LOG_INFO, "SSLConn::Read(): received SSL_ERROR_WANT_READ "
+                          "on non-blocking connection to %s on fd %d.",
+                          hostname().c_str(), fd());
         }
         break;
 
@@ -1007,8 +1568,8 @@ ssize_t SSLConn::Read(const ssize_t buf_len, char* buf, bool* eof) {
           return bytes_read;
         } else {
           // See SSL_MODE_AUTO_RETRY in SSL_CTX_set_mode(3) for suggestions.
-          _LOGGER(LOG_INFO, "SSLConn::Read(): "
-                  "Received SSL_ERROR_WANT_WRITE, returning.");
+          _LOGGER_LIMITED(LOG_INFO, "SSLConn::Read(): "
+                          "Received SSL_ERROR_WANT_WRITE, returning.");
         }
         break;
 
@@ -1071,6 +1632,24 @@ ssize_t SSLConn::Read(const ssize_t buf_len, char* buf, bool* eof) {
   return bytes_read;
 }
 
+// Routine to write any ciphertext waiting in our BIO pair (memory BIO
+// mode), e.g., once our (NON-BLOCKING) socket is writable again.
+//
+// Note, this routine can set an ErrorHandler event.
+ssize_t SSLConn::FlushCiphertext(void) {
+  if (net_bio_ == NULL)
+    return 0;
+
+  ssize_t bytes_wrote = SendCiphertext();
+  if (bytes_wrote < 0) {
+    error.Init(EX_IOERR, "SSLConn::FlushCiphertext(): "
+               "write(fd: %d) failed: %s", fd(), strerror(errno));
+    return 0;
+  }
+
+  return bytes_wrote;
+}
+
 #if 0  // TODO(aka) The following two calls are deprecated.
 
 // This routine calls read(2) on an ready socket, until it either
@@ -1271,6 +1850,117 @@ ssize_t SSLConn::ReadLine(const char delimiter, const ssize_t buf_len,
 
 // Boolean functions.
 
+// Routine to attach ssl_ to our socket, either directly, or (in
+// memory BIO mode) through a BIO pair.
+//
+// Note, this routine can set an ErrorHandler event.
+bool SSLConn::InitBIO(const bool memory_bio) {
+  ssl_mem_charge(ssl_);
+  if (!memory_bio) {
+    int set_fd = SSL_set_fd(ssl_, fd());  // allocates our socket BIO
+    ssl_mem_charge(NULL);
+    if (!set_fd) {
+      error.Init(EX_SOFTWARE, "SSLConn::InitBIO(): SSL_set_fd(3) failed: %s",
+                 ssl_err_str().c_str());
+      return false;
+    }
+
+    return true;
+  }
+
+  BIO* ssl_bio = NULL;
+  int new_pair = BIO_new_bio_pair(&ssl_bio, SSLCONN_MEMORY_BIO_SIZE,
+                                  &net_bio_, SSLCONN_MEMORY_BIO_SIZE);
+  ssl_mem_charge(NULL);
+  if (!new_pair) {
+    net_bio_ = NULL;
+    error.Init(EX_SOFTWARE, "SSLConn::InitBIO(): "
+               "BIO_new_bio_pair(3) failed: %s", ssl_err_str().c_str());
+    return false;
+  }
+
+  SSL_set_bio(ssl_, ssl_bio, ssl_bio);  // ssl_ now owns ssl_bio
+
+  return true;
+}
+
+// Routine to read the ciphertext waiting on our socket into net_bio_,
+// i.e., as much as either holds, in as few read(2)s as the BIO pair's
+// ring buffer allows.  On EOF, we close net_bio_, so OpenSSL sees the
+// EOF once it has consumed the rest.
+//
+// Note, this routine can set an ErrorHandler event.
+int SSLConn::FillCiphertext(void) {
+  int filled = 0;
+  for (;;) {
+    char* buf = NULL;
+    int room = BIO_nwrite0(net_bio_, &buf);
+    if (room <= 0)
+      break;  // OpenSSL hasn't consumed what we gave it (or EOF)
+
+    ssize_t n = read(fd(), buf, room);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+
+      error.Init(EX_IOERR, "SSLConn::FillCiphertext(): "
+                 "read(fd: %d) failed: %s", fd(), strerror(errno));
+      return -1;
+    } else if (n == 0) {
+      BIO_shutdown_wr(net_bio_);
+      filled = 1;
+      break;
+    }
+
+    BIO_nwrite(net_bio_, &buf, n);
+    filled = 1;
+
+    // Unless we filled all the room we had (i.e., there may be more),
+    // we've drained the socket.  If we're BLOCKING, we must not wait
+    // for more, either.
+
+    if (n < room || IsBlocking())
+      break;
+  }
+
+  return filled;
+}
+
+// Routine to write what OpenSSL left in net_bio_ to our socket, until
+// either is empty (or full).  Note, we do not set an ErrorHandler
+// event, as Shutdown() doesn't care if this fails.
+ssize_t SSLConn::SendCiphertext(void) {
+  ssize_t bytes_wrote = 0;
+  char* buf = NULL;
+  int len = 0;
+  while ((len = BIO_nread0(net_bio_, &buf)) > 0) {
+    ssize_t n = write(fd(), buf, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+
+      return -1;
+    }
+
+    BIO_nread(net_bio_, &buf, n);
+    bytes_wrote += n;
+  }
+
+  return bytes_wrote;
+}
+
+// Routine to see if our handshake is past its deadline.
+bool SSLConn::IsHandshakeExpired(void) const {
+  if (handshake_state_ == HANDSHAKE_COMPLETE || handshake_deadline_ == 0)
+    return false;
+
+  return (monotonic_time() >= handshake_deadline_) ? true : false;
+}
+
 // Routine to see if someone has attempted to shudown the SSL connection.
 const int SSLConn::IsShutdownInitiated(void) const {
   int state = SSL_get_shutdown(ssl_);
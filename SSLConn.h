@@ -19,6 +19,12 @@ using namespace std;
 #define SSLCONN_VERSION_MAJOR 1
 #define SSLCONN_VERSION_MINOR 0
 
+#define SSLCONN_DEFAULT_HANDSHAKE_TIMEOUT 60  // seconds, 0 is no deadline
+#define SSLCONN_MEMORY_BIO_SIZE (64 * 1024)  // bytes buffered each way
+
+
+// Forward declarations (used if only needed for member function parameters).
+struct ssl_handshake_job;
 
 // Non-class specific utilities.
 
@@ -69,6 +75,21 @@ class SSLConn : public TCPConn {
    */
   SSLConn& operator =(const SSLConn& src);
 
+  /** Move Constructor.
+   *
+   *  Takes over src's Descriptor, SSL* and peer certificate, i.e., no
+   *  reference counts are touched.
+   *
+   *  @see IPComm(IPComm&&)
+   */
+  SSLConn(SSLConn&& src) noexcept;
+
+  /** Move Assignment Operator.
+   *
+   *  @see SSLConn(SSLConn&&)
+   */
+  SSLConn& operator =(SSLConn&& src) noexcept;
+
   /** Equality Operator.
    *
    *  The equality operator is needed for *some* data methods for
@@ -79,10 +100,99 @@ class SSLConn : public TCPConn {
   // Accessors.
   const SSL* ssl(void) const { return ssl_; }
   const X509* peer_certificate(void) const { return peer_certificate_; }
+  int handshake_state(void) const { return handshake_state_; }
+  time_t handshake_timeout(void) const { return handshake_timeout_; }
+  const struct ssl_record_sizing& record_sizing(void) const {
+    return record_sizing_; }
+
+  /** Routine to return the memory OpenSSL holds for this connection.
+   *
+   *  Only available if ssl_mem_track() was called at start-up.
+   *
+   *  @see ssl_mem_track()
+   *  @return a size_t of bytes (0 if not tracking or not SSL/TLS)
+   */
+  size_t ssl_memory(void) const { return ssl_mem_used(ssl_); }
+
+  /** Routine to return how much early data we hold for Read().
+   *
+   *  I.e., (server) data that arrived as TLS 1.3 early data, and so
+   *  may be a replay, which Read() returns before anything else.
+   *
+   *  @return a size_t of bytes (always 0 on a client)
+   */
+  size_t early_data_pending(void) const {
+    return (ssl_ != NULL && SSL_is_server(ssl_)) ? early_data_.size() : 0; }
+
+  /** Routine to return how much early data Read() has returned.
+   *
+   *  Lets a caller tell which of the bytes it read were early data,
+   *  as early data always precedes anything else Read() returns.
+   *
+   *  @return a size_t of bytes (always 0 on a client)
+   */
+  size_t early_data_read(void) const { return early_data_read_; }
 
   // Mutators.
+
+  /** Routine to set how long a handshake may take.
+   *
+   *  The deadline is set when Connect() or Accept() starts the
+   *  handshake, so this must be called before then.  Note, peers
+   *  returned by Accept() inherit the listening socket's timeout.
+   *
+   *  @param timeout a time_t of seconds (0 disables the deadline)
+   */
+  void set_handshake_timeout(const time_t timeout);
+
+  /** Routine to override our SSLContext's record sizing policy.
+   *
+   *  E.g., to use small records on an interactive session, but not
+   *  on a bulk transfer made from the same SSLContext.  Note,
+   *  Socket() and Accept() set the policy from the SSLContext, so
+   *  this must be called afterwards.
+   *
+   *  @see SSLContext::set_record_sizing()
+   */
+  void set_record_sizing(const size_t small_len, const size_t boost_len,
+                         const long idle_msec, const bool per_msg);
+
+  /** Routine to send data in our ClientHello (TLS 1.3 early data).
+   *
+   *  If Connect() resumes a session whose server accepts early data
+   *  (and buf fits within the server's limit), buf is sent along
+   *  with the ClientHello, saving the caller a round-trip.  As early
+   *  data can be replayed by an attacker, buf must be safe to repeat,
+   *  e.g., an idempotent request.  Must be called before Connect();
+   *  afterwards, TakeEarlyDataSent() reports how much of buf the
+   *  server accepted, the rest must be sent with Write() as usual.
+   *
+   *  @see SSLContext::set_max_early_data()
+   *  @param buf a char* holding the data to send
+   *  @param len a size_t of the amount of data in buf
+   */
+  void set_early_data(const char* buf, const size_t len);
+
   void clear(void);
 
+  /** Routine to collect how much of our early data the server accepted.
+   *
+   *  Returns 0 until the handshake completes, or if the server
+   *  rejected our early data, and (as the data must then not be
+   *  written again) only returns the count once.
+   *
+   *  @see set_early_data()
+   *  @return a size_t of bytes (from the start of set_early_data()'s buf)
+   */
+  size_t TakeEarlyDataSent(void);
+
+  /** Routine to start sending small records again.
+   *
+   *  Called by TCPSession before it writes a new message, if our
+   *  policy's per_msg is set.
+   */
+  void ResetRecordSize(void) { record_bytes_ = 0; }
+
   // Network manipulation.
 
   /** Routine to *pretty-print* an object (usually for debugging).
@@ -150,11 +260,22 @@ class SSLConn : public TCPConn {
    *  This routine attempts to connect(2) *to* the destinatino
    *  specified in the information within this SSLConn object, i.e.,
    *  the information stored within the TCPConn & IPCommm base
-   *  classes.  Note, this routine will set an ErrorHandler event if
-   *  it encounters an unrecoverable error.
+   *  classes.  If our SSLContext holds a session from an earlier
+   *  connection to the same host:port, we offer it to the server
+   *  (i.e., attempt an abbreviated handshake).
+   *
+   *  If we are NON-BLOCKING, the SSL/TLS handshake will most likely
+   *  not complete before we return, i.e., handshake_state() is
+   *  HANDSHAKE_WANT_READ or HANDSHAKE_WANT_WRITE, and the caller must
+   *  continue it by calling Handshake() when our descriptor is ready.
+   *
+   *  Note, this routine will set an ErrorHandler event if it
+   *  encounters an unrecoverable error.
    *
    *  @see ErrorHandler
    *  @see TCPConn
+   *  @see Handshake()
+   *  @see SSLContext::ResumeClientSession()
    */
   void Connect(void);
 
@@ -168,15 +289,32 @@ class SSLConn : public TCPConn {
    *  Note, this routine will set an ErrorHandler event if it
    *  encounters an unrecoverable error.
    *
+   *  If we (i.e., the listening socket) are NON-BLOCKING, so is peer,
+   *  and as in Connect(), peer's handshake must be continued via
+   *  peer->Handshake() until it completes.
+   *
    *  TODO(aka) Can an IPv6 *listening* socket accept(2) an IPv4
    *  connection?  If so, then we'll need to change this routine to
    *  check for this!
    *
    *  @see ErrorHandler
+   *  @see Handshake()
    *  @param peer a SSLConn* to hold the new socket
    */
   void Accept(SSLConn* peer, SSLContext* ctx) const;
 
+  /** Routine to set up a SSLConn object from a connection that was
+   *  accept(2)ed for us on our socket, e.g., by IOUring::Accept().
+   *
+   *  As Accept(SSLConn*, SSLContext*), but see
+   *  TCPConn::Accept(TCPConn*, int).
+   *
+   *  @see ErrorHandler
+   *  @param peer a SSLConn* to hold the new socket
+   *  @param peer_fd an int descriptor (or -errno, if the accept failed)
+   */
+  void Accept(SSLConn* peer, const int peer_fd, SSLContext* ctx) const;
+
   /** Routine to create a new SSLConn object from a completed connection.
    *
    *  This routine uses accept(2) to initialize a SSLConn object from
@@ -195,6 +333,31 @@ class SSLConn : public TCPConn {
    */
   SSLConn Accept(SSLContext* ctx) const;
 
+  /** Routine to start or continue the SSL/TLS handshake.
+   *
+   *  Called by Connect() and Accept(), and afterwards, by the
+   *  event-loop whenever our descriptor becomes ready, i.e., readable
+   *  if the last call returned HANDSHAKE_WANT_READ, or writable if it
+   *  returned HANDSHAKE_WANT_WRITE, until HANDSHAKE_COMPLETE is
+   *  returned.  If the handshake does not complete within
+   *  handshake_timeout() seconds, it fails.  Note, Read() and Write()
+   *  will also continue an incomplete handshake.
+   *
+   *  If our SSLContext has a handshake WorkerPool, the step is run on
+   *  the pool and HANDSHAKE_BUSY is returned; call Handshake() again
+   *  after the pool's notify_fd() becomes readable to get the result
+   *  (HANDSHAKE_BUSY is returned until the step is done).
+   *
+   *  Note, this routine will set an ErrorHandler event (and return
+   *  HANDSHAKE_FAILED) if it encounters an unrecoverable error.
+   *
+   *  @see ErrorHandler
+   *  @see IsHandshakeExpired()
+   *  @see SSLContext::set_handshake_pool()
+   *  @return an int specifying our handshake state
+   */
+  int Handshake(void);
+
   /** Routine to gracefully close an SSL connection.
    *
    * We initiate a SSL close by calling this routine, i.e., send our
@@ -240,6 +403,9 @@ class SSLConn : public TCPConn {
    *  const, as Shutdown() (which calls IPComm::Close(), which is not
    *  a const member function).
    *
+   *  On a server, any TLS 1.3 early data is returned first, possibly
+   *  before our handshake completes (see early_data_read()).
+   *
    *  @see ErrorHandler
    *  @param len a ssize_t showing the amount of data in buf
    *  @param buf a char* to hold the data read
@@ -248,6 +414,22 @@ class SSLConn : public TCPConn {
    */
   ssize_t Read(const ssize_t len, char* buf, bool* eof);
 
+  /** Routine to write the ciphertext waiting in our memory BIO.
+   *
+   *  In memory BIO mode (see SSLContext::set_memory_bio()), Write(),
+   *  Read(), Handshake() and Shutdown() write what OpenSSL produced
+   *  until our socket is full.  A NON-BLOCKING caller must then call
+   *  this routine once our socket becomes writable (as long as
+   *  IsCiphertextPending()).
+   *
+   *  Note, this routine will set an ErrorHandler event if it
+   *  encounters an unrecoverable error.
+   *
+   *  @see ErrorHandler
+   *  @return a ssize_t showing the amount of ciphertext written
+   */
+  ssize_t FlushCiphertext(void);
+
 #if 0  // TODO(aka)
   /** Routine to read a (perhaps multiple) chunk(s) of data from our socket.
    *
@@ -290,6 +472,20 @@ class SSLConn : public TCPConn {
 #endif
 
   // Boolean checks.
+  bool IsHandshakeComplete(void) const {
+    return (handshake_state_ == HANDSHAKE_COMPLETE) ? true : false; }
+  bool IsMemoryBIO(void) const { return (net_bio_ != NULL) ? true : false; }
+  bool IsCiphertextPending(void) const {
+    return (net_bio_ != NULL && BIO_ctrl_pending(net_bio_) > 0) ? 
+        true : false; }
+
+  /** Routine to see if our (incomplete) handshake is past its deadline.
+   *
+   *  Allows the event-loop to reap stalled handshakes, i.e., ones
+   *  whose descriptors never become ready.
+   */
+  bool IsHandshakeExpired(void) const;
+
   const int IsShutdownInitiated(void) const;
   const int IsShutdownComplete(void) const;
 
@@ -303,6 +499,8 @@ class SSLConn : public TCPConn {
 #endif
 
   // Flags.
+  enum { HANDSHAKE_NONE, HANDSHAKE_WANT_READ, HANDSHAKE_WANT_WRITE, 
+         HANDSHAKE_COMPLETE, HANDSHAKE_FAILED, HANDSHAKE_BUSY };
 
  protected:
   // Data members.
@@ -319,7 +517,63 @@ class SSLConn : public TCPConn {
 
   X509* peer_certificate_;  // certificate of peer
 
+  BIO* net_bio_;            // (memory BIO mode) our end of ssl_'s BIO
+                            // pair, shared and freed along with ssl_
+
+  int handshake_state_;         // HANDSHAKE_NONE until Connect()/Accept()
+  time_t handshake_timeout_;    // seconds allowed for a handshake
+  time_t handshake_deadline_;   // CLOCK_MONOTONIC secs, 0 if none
+  struct ssl_handshake_job* handshake_job_;  // step running on a WorkerPool
+
+  struct ssl_record_sizing record_sizing_;  // from our SSLContext
+  size_t record_len_;           // max send fragment set on ssl_, 0 if unset
+  size_t record_bytes_;         // bytes written since we last started small
+  long record_last_msec_;       // CLOCK_MONOTONIC msecs of our last write
+  ssize_t record_retry_len_;    // length a SSL_write(3) retry must use
+
+  string early_data_;           // client: to send in our ClientHello,
+                                // server: received, but not yet Read()
+  bool early_pending_;          // server: still reading early data
+  size_t early_data_sent_;      // client: bytes of early data written
+  size_t early_data_read_;      // server: bytes of early data Read()
+
  private:
+  void AcceptSSL(SSLConn* peer, SSLContext* ctx) const;
+  void ReleaseDescriptor(void);
+  void StartHandshake(void);
+  void HandshakeComplete(void);
+  int HandshakeError(const int ret, const int ssl_error,
+                     const int sys_errno, const string& ssl_errors);
+  void FlushHandshake(void);
+
+  /** Routine to hook ssl_ up to our socket.
+   *
+   *  Either directly (SSL_set_fd(3)), or, in memory BIO mode, via a
+   *  BIO pair whose other end (net_bio_) we feed from the socket.
+   */
+  bool InitBIO(const bool memory_bio);
+
+  /** Routine to move ciphertext from our socket into net_bio_.
+   *
+   *  Returns 1 if OpenSSL has something new to read (data or EOF), 0
+   *  if nothing was waiting, or -1 (and sets an ErrorHandler event).
+   */
+  int FillCiphertext(void);
+
+  /** Routine to move ciphertext from net_bio_ to our socket.
+   *
+   *  Returns the bytes written, or -1 (with errno set).
+   */
+  ssize_t SendCiphertext(void);
+
+  /** Routine to pick the record size for our next SSL_write(3).
+   *
+   *  Sets ssl_'s max send fragment per our record sizing policy, and
+   *  returns how much of buf_len to write, as we don't want a large
+   *  write to go out entirely in small records.
+   */
+  ssize_t SizeRecords(const ssize_t buf_len);
+
   // Dummy declarations for copy constructor and assignment & equality operator.
 
   // Since we're dervied from TCPConn, we need to prevent someone from
@@ -3,9 +3,19 @@
 // Copyright © 2010, Pittsburgh Supercomputing Center (PSC).  
 // See the file 'COPYRIGHT.txt' for any restrictions.
 
+#include <sys/stat.h>
+
+#include <openssl/crypto.h>
 #include <openssl/err.h>
 
+#include <ctype.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <string>
+#include <vector>
 using namespace std;
 
 #include "Logger.h"
@@ -13,6 +23,35 @@ using namespace std;
 
 // Non-class specific defines & data structures.
 
+// SSL* ex_data index used to tag client SSL* objects with the
+// "host:port" their sessions should be stored under.
+static int ssl_peer_idx = -1;
+static pthread_once_t ssl_peer_idx_once = PTHREAD_ONCE_INIT;
+
+// OpenSSL memory accounting (see ssl_mem_track()).  An account holds
+// the bytes charged to one SSL*.  It is referenced by its SSL* (via
+// ex_data) and by each allocation charged to it, as some of those,
+// e.g., sessions, outlive the connection.
+struct ssl_mem_account {
+  size_t bytes;                 // updated atomically
+  long refs;                    // updated atomically
+};
+
+// Header in front of every allocation made while accounting.
+union ssl_mem_hdr {
+  struct {
+    size_t size;
+    struct ssl_mem_account* account;
+  } info;
+  max_align_t align;            // keep the caller's memory aligned
+};
+
+static bool ssl_mem_tracking = false;
+static size_t ssl_mem_total = 0;  // updated atomically
+static int ssl_mem_idx = -1;      // SSL* ex_data index of its account
+static __thread struct ssl_mem_account* ssl_mem_current = NULL;
+static __thread bool ssl_mem_current_new = false;
+
 // Non-class specific utility functions.
 #if 0
 const int ssl_check_version(void)
@@ -44,6 +83,219 @@ string ssl_err_str(void) {
   return tmp_str;
 }
 
+// Routine to free the "host:port" tag when its SSL* is freed.
+static void ssl_peer_free(void* parent, void* ptr, CRYPTO_EX_DATA* ad,
+                          int idx, long argl, void* argp) {
+  free(ptr);
+}
+
+static void ssl_peer_idx_init(void) {
+  ssl_peer_idx = SSL_get_ex_new_index(0, NULL, NULL, NULL, ssl_peer_free);
+}
+
+// Routine to drop a reference to an account.
+static void ssl_mem_release(struct ssl_mem_account* account) {
+  if (account != NULL && __atomic_sub_fetch(&account->refs, 1,
+                                            __ATOMIC_ACQ_REL) == 0)
+    free(account);
+}
+
+// Routine to adjust the totals when an allocation changes size.
+static void ssl_mem_adjust(struct ssl_mem_account* account,
+                           const size_t add, const size_t sub) {
+  __atomic_add_fetch(&ssl_mem_total, add - sub, __ATOMIC_RELAXED);
+  if (account != NULL)
+    __atomic_add_fetch(&account->bytes, add - sub, __ATOMIC_RELAXED);
+}
+
+// Our OpenSSL allocator hooks (see CRYPTO_set_mem_functions(3)).
+static void* ssl_mem_malloc(size_t num, const char* file, int line) {
+  union ssl_mem_hdr* hdr = (union ssl_mem_hdr*)malloc(sizeof(*hdr) + num);
+  if (hdr == NULL)
+    return NULL;
+
+  hdr->info.size = num;
+  hdr->info.account = ssl_mem_current;
+  if (hdr->info.account != NULL)
+    __atomic_add_fetch(&hdr->info.account->refs, 1, __ATOMIC_RELAXED);
+  ssl_mem_adjust(hdr->info.account, num, 0);
+
+  return hdr + 1;
+}
+
+static void ssl_mem_free(void* ptr, const char* file, int line) {
+  if (ptr == NULL)
+    return;
+
+  union ssl_mem_hdr* hdr = (union ssl_mem_hdr*)ptr - 1;
+  ssl_mem_adjust(hdr->info.account, 0, hdr->info.size);
+  ssl_mem_release(hdr->info.account);
+  free(hdr);
+}
+
+static void* ssl_mem_realloc(void* ptr, size_t num, const char* file,
+                             int line) {
+  if (ptr == NULL)
+    return ssl_mem_malloc(num, file, line);
+  if (num == 0) {
+    ssl_mem_free(ptr, file, line);
+    return NULL;
+  }
+
+  // The memory stays charged to whoever allocated it.
+  union ssl_mem_hdr* hdr = (union ssl_mem_hdr*)ptr - 1;
+  size_t old_size = hdr->info.size;
+  union ssl_mem_hdr* tmp =
+      (union ssl_mem_hdr*)realloc(hdr, sizeof(*hdr) + num);
+  if (tmp == NULL)
+    return NULL;
+
+  tmp->info.size = num;
+  ssl_mem_adjust(tmp->info.account, num, old_size);
+
+  return tmp + 1;
+}
+
+// Routine to drop the SSL*'s reference to its account when it is freed.
+static void ssl_mem_account_free(void* parent, void* ptr, CRYPTO_EX_DATA* ad,
+                                 int idx, long argl, void* argp) {
+  ssl_mem_release((struct ssl_mem_account*)ptr);
+}
+
+// Routine to turn on OpenSSL memory accounting.
+bool ssl_mem_track(void) {
+  if (ssl_mem_tracking)
+    return true;
+
+  if (!CRYPTO_set_mem_functions(ssl_mem_malloc, ssl_mem_realloc,
+                                ssl_mem_free)) {
+    _LOGGER(LOG_WARNING, "ssl_mem_track(): too late, "
+            "OpenSSL has already allocated memory.");
+    return false;
+  }
+
+  ssl_mem_idx = SSL_get_ex_new_index(0, NULL, NULL, NULL,
+                                     ssl_mem_account_free);
+  ssl_mem_tracking = (ssl_mem_idx >= 0);
+
+  return ssl_mem_tracking;
+}
+
+size_t ssl_mem_in_use(void) {
+  return __atomic_load_n(&ssl_mem_total, __ATOMIC_RELAXED);
+}
+
+size_t ssl_mem_used(const SSL* ssl) {
+  if (!ssl_mem_tracking || ssl == NULL)
+    return 0;
+
+  struct ssl_mem_account* account =
+      (struct ssl_mem_account*)SSL_get_ex_data(ssl, ssl_mem_idx);
+  return (account != NULL) ? 
+      __atomic_load_n(&account->bytes, __ATOMIC_RELAXED) : 0;
+}
+
+// Routines to charge the calling thread's allocations to a SSL*.
+void ssl_mem_charge(const SSL* ssl) {
+  if (!ssl_mem_tracking)
+    return;
+
+  ssl_mem_current = (ssl != NULL) ?
+      (struct ssl_mem_account*)SSL_get_ex_data(ssl, ssl_mem_idx) : NULL;
+}
+
+void ssl_mem_charge_new(void) {
+  if (!ssl_mem_tracking)
+    return;
+
+  // Note, we use malloc(3) directly, as our account is not OpenSSL's.
+  ssl_mem_current = 
+      (struct ssl_mem_account*)malloc(sizeof(struct ssl_mem_account));
+  if (ssl_mem_current == NULL)
+    return;  // the connection just won't be accounted for
+
+  ssl_mem_current->bytes = 0;
+  ssl_mem_current->refs = 1;  // the SSL*'s reference
+  ssl_mem_current_new = true;
+}
+
+void ssl_mem_charge_done(SSL* ssl) {
+  if (!ssl_mem_tracking)
+    return;
+
+  struct ssl_mem_account* account = ssl_mem_current;
+  if (ssl_mem_current_new && account != NULL &&
+      (ssl == NULL || !SSL_set_ex_data(ssl, ssl_mem_idx, account)))
+    ssl_mem_release(account);
+
+  ssl_mem_current = NULL;
+  ssl_mem_current_new = false;
+}
+
+// Routine to save a session (or TLSv1.3 ticket) received by a client.
+int ssl_new_session_cb(SSL* ssl, SSL_SESSION* session) {
+  SSLContext* ctx = (SSLContext*)SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+  const char* peer = (ssl_peer_idx < 0) ? 
+      NULL : (const char*)SSL_get_ex_data(ssl, ssl_peer_idx);
+  if (ctx == NULL || peer == NULL)
+    return 0;  // not one of our client connections, let OpenSSL free it
+
+  return ctx->StoreClientSession(peer, session) ? 1 : 0;
+}
+
+// Routine to encrypt/decrypt session tickets with our shared keys.
+int ssl_ticket_key_cb(SSL* ssl, unsigned char* key_name, unsigned char* iv,
+                      EVP_CIPHER_CTX* cipher_ctx, EVP_MAC_CTX* mac_ctx,
+                      int enc) {
+  SSLContext* ctx = (SSLContext*)SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+  if (ctx == NULL || ctx->ticket_keys_ == NULL)
+    return 0;  // no ticket (or a full handshake)
+
+  return ctx->ticket_keys_->TicketKeyCallback(key_name, iv, cipher_ctx,
+                                              mac_ctx, enc);
+}
+
+// Routine to switch a connection to the certificate for its server name.
+int ssl_servername_cb(SSL* ssl, int* al, void* arg) {
+  SSLContext* ctx = (SSLContext*)arg;
+  const char* server_name = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+  if (ctx == NULL || server_name == NULL)
+    return SSL_TLSEXT_ERR_OK;  // use our default certificate
+
+  // Note, SSL_set_SSL_CTX(3) takes its own reference, so a reload can
+  // free the SSL_CTX as soon as we drop the lock.
+
+  pthread_rwlock_rdlock(&ctx->server_names_lock_);
+  SSL_CTX* name_ctx = ctx->LookupServerName(server_name);
+  if (name_ctx != NULL)
+    SSL_set_SSL_CTX(ssl, name_ctx);
+  pthread_rwlock_unlock(&ctx->server_names_lock_);
+
+  return SSL_TLSEXT_ERR_OK;
+}
+
+// Routine to periodically reload our server name certificates.
+void* ssl_reload_thread(void* arg) {
+  SSLContext* ctx = (SSLContext*)arg;
+
+  pthread_mutex_lock(&ctx->reload_mtx_);
+  while (ctx->reload_running_) {
+    struct timespec wakeup;
+    clock_gettime(CLOCK_REALTIME, &wakeup);
+    wakeup.tv_sec += ctx->reload_interval_;
+    if (pthread_cond_timedwait(&ctx->reload_cond_, &ctx->reload_mtx_,
+                               &wakeup) != ETIMEDOUT)
+      continue;  // woken up, i.e., stopping (or a new interval)
+
+    pthread_mutex_unlock(&ctx->reload_mtx_);
+    ctx->ReloadServerNames();
+    pthread_mutex_lock(&ctx->reload_mtx_);
+  }
+  pthread_mutex_unlock(&ctx->reload_mtx_);
+
+  return NULL;
+}
+
 static int pem_passwd_cb(char* buf, int size, int rwflag, void* userdata) {
   // Default Routine called when loading/storing a PEM certificate 
   // with encryption.
@@ -72,12 +324,38 @@ SSLContext::SSLContext(void) {
   //  mode_ = 0;
   //  depth_ = 0;
   cnt_ = 1;
+  client_max_sessions_ = SSLCONTEXT_DEFAULT_CLIENT_SESSIONS;
+  pthread_mutex_init(&client_sessions_mtx_, NULL);
+  ticket_keys_ = NULL;
+  handshakes_full_ = 0;
+  handshakes_resumed_ = 0;
+  handshake_cpu_nsec_ = 0;
+  handshake_pool_ = NULL;
+  memset(&record_sizing_, 0, sizeof(record_sizing_));
+  memory_bio_ = false;
+  pthread_rwlock_init(&server_names_lock_, NULL);
+  reload_running_ = false;
+  reload_interval_ = 0;
+  pthread_mutex_init(&reload_mtx_, NULL);
+  pthread_cond_init(&reload_cond_, NULL);
 }
 
 SSLContext::~SSLContext(void) {
   ERR_free_strings();	// SSL_load_error_strings(3)
   EVP_cleanup();		// SSL_add_all_ciphers|digests(3)
 
+  ClearClientSessions();
+  pthread_mutex_destroy(&client_sessions_mtx_);
+
+  StopReload();
+  for (unordered_map<string, struct ssl_server_name>::iterator itr =
+           server_names_.begin(); itr != server_names_.end(); itr++)
+    SSL_CTX_free(itr->second.ctx);
+  server_names_.clear();
+  pthread_rwlock_destroy(&server_names_lock_);
+  pthread_cond_destroy(&reload_cond_);
+  pthread_mutex_destroy(&reload_mtx_);
+
   if (ctx_ != NULL) {
     SSL_CTX_free(ctx_);
     ctx_ = NULL;
@@ -89,8 +367,194 @@ SSLContext::~SSLContext(void) {
 // Copy constructor, assignment and equality operator, needed for STL.
 
 // Accessors.
+size_t SSLContext::client_sessions(void) const {
+  pthread_mutex_lock(&client_sessions_mtx_);
+  size_t cnt = client_sessions_.size();
+  pthread_mutex_unlock(&client_sessions_mtx_);
+
+  return cnt;
+}
+
+size_t SSLContext::server_names(void) const {
+  pthread_rwlock_rdlock(&server_names_lock_);
+  size_t cnt = server_names_.size();
+  pthread_rwlock_unlock(&server_names_lock_);
+
+  return cnt;
+}
+
+double SSLContext::handshakes_per_cpu_second(void) const {
+  unsigned long nsec = __atomic_load_n(&handshake_cpu_nsec_, __ATOMIC_RELAXED);
+  if (nsec == 0)
+    return 0.0;
+
+  return (double)(handshakes_full() + handshakes_resumed()) * 1e9 / nsec;
+}
 
 // Mutators.
+void SSLContext::set_client_session_cache(const size_t max_sessions) {
+  pthread_mutex_lock(&client_sessions_mtx_);
+  client_max_sessions_ = max_sessions;
+
+  // Trim the store if it shrunk.
+  while (client_lru_.size() > client_max_sessions_) {
+    client_sessions_.erase(client_lru_.back().first);
+    SSL_SESSION_free(client_lru_.back().second);
+    client_lru_.pop_back();
+  }
+  pthread_mutex_unlock(&client_sessions_mtx_);
+}
+
+// Routine to size the server's session cache & tickets.
+//
+// Note, this routine can set an ErrorHandler event.
+void SSLContext::set_server_session_cache(const long max_sessions,
+                                          const long timeout,
+                                          const size_t num_tickets) {
+  if (ctx_ == NULL) {
+    error.Init(EX_SOFTWARE, "SSLContext::set_server_session_cache(): "
+               "SSL_CTX* is NULL");
+    return;
+  }
+
+  SSL_CTX_sess_set_cache_size(ctx_, max_sessions);
+  if (timeout > 0)
+    SSL_CTX_set_timeout(ctx_, timeout);
+
+  if (num_tickets > 0)
+    SSL_CTX_clear_options(ctx_, SSL_OP_NO_TICKET);
+  else
+    SSL_CTX_set_options(ctx_, SSL_OP_NO_TICKET);
+  if (!SSL_CTX_set_num_tickets(ctx_, num_tickets)) {
+    error.Init(EX_SOFTWARE, "SSLContext::set_server_session_cache(): "
+               "SSL_CTX_set_num_tickets() failed: %s", ssl_err_str().c_str());
+    return;
+  }
+
+  _LOGGER(LOG_INFO, "SSLContext::set_server_session_cache(): "
+          "cache size: %ld, timeout: %lds, tickets: %lu.", max_sessions,
+          SSL_CTX_get_timeout(ctx_), (unsigned long)num_tickets);
+}
+
+// Routine to use shared session-ticket keys.
+//
+// Note, this routine can set an ErrorHandler event.
+void SSLContext::set_ticket_keys(SSLTicketKeys* keys) {
+  if (ctx_ == NULL) {
+    error.Init(EX_SOFTWARE, "SSLContext::set_ticket_keys(): SSL_CTX* is NULL");
+    return;
+  }
+
+  ticket_keys_ = keys;
+  if (!SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx_, (keys != NULL) ? 
+                                            ssl_ticket_key_cb : NULL)) {
+    error.Init(EX_SOFTWARE, "SSLContext::set_ticket_keys(): "
+               "SSL_CTX_set_tlsext_ticket_key_evp_cb() failed: %s",
+               ssl_err_str().c_str());
+    return;
+  }
+}
+
+// Routine to free record buffers while connections are idle.
+//
+// Note, this routine can set an ErrorHandler event.
+void SSLContext::set_release_buffers(const bool release) {
+  if (ctx_ == NULL) {
+    error.Init(EX_SOFTWARE, "SSLContext::set_release_buffers(): "
+               "SSL_CTX* is NULL");
+    return;
+  }
+
+  if (release)
+    SSL_CTX_set_mode(ctx_, SSL_MODE_RELEASE_BUFFERS);
+  else
+    SSL_CTX_clear_mode(ctx_, SSL_MODE_RELEASE_BUFFERS);
+}
+
+// Routine to set the ciphers (TLS 1.2) and suites (TLS 1.3) our
+// connections can use.
+//
+// Note, this routine can set an ErrorHandler event.
+void SSLContext::set_cipher_list(const char* cipher_list,
+                                 const char* ciphersuites) {
+  if (ctx_ == NULL) {
+    error.Init(EX_SOFTWARE, "SSLContext::set_cipher_list(): "
+               "SSL_CTX* is NULL");
+    return;
+  }
+
+  if (cipher_list != NULL && !SSL_CTX_set_cipher_list(ctx_, cipher_list)) {
+    error.Init(EX_SOFTWARE, "SSLContext::set_cipher_list(): "
+               "unable to set cipher list to: %s", cipher_list);
+    return;
+  }
+
+  if (ciphersuites != NULL && !SSL_CTX_set_ciphersuites(ctx_, ciphersuites)) {
+    error.Init(EX_SOFTWARE, "SSLContext::set_cipher_list(): "
+               "unable to set TLS 1.3 ciphersuites to: %s", ciphersuites);
+    return;
+  }
+}
+
+void SSLContext::set_max_early_data(const uint32_t max_len) {
+  if (ctx_ == NULL) {
+    error.Init(EX_SOFTWARE, "SSLContext::set_max_early_data(): "
+               "SSL_CTX* is NULL");
+    return;
+  }
+
+  // What we advertise in our tickets is what we accept, however, if
+  // we reject a client's early data (e.g., the session was already
+  // used), we must still skip over it, and OpenSSL won't skip more
+  // than its receive limit; so we never set that below its default.
+
+  uint32_t recv_len = (max_len > SSL3_RT_MAX_PLAIN_LENGTH) ?
+      max_len : SSL3_RT_MAX_PLAIN_LENGTH;
+  if (!SSL_CTX_set_max_early_data(ctx_, max_len) ||
+      !SSL_CTX_set_recv_max_early_data(ctx_, recv_len)) {
+    error.Init(EX_SOFTWARE, "SSLContext::set_max_early_data(): "
+               "unable to set early data limit to %u", max_len);
+    return;
+  }
+}
+
+void SSLContext::set_record_sizing(const size_t small_len,
+                                   const size_t boost_len,
+                                   const long idle_msec, const bool per_msg) {
+  record_sizing_.small_len = small_len;
+  record_sizing_.boost_len = boost_len;
+  record_sizing_.idle_msec = idle_msec;
+  record_sizing_.per_msg = per_msg;
+}
+
+// Routine to start (or stop) the certificate reload thread.
+//
+// Note, this routine can set an ErrorHandler event.
+void SSLContext::set_server_name_reload(const time_t interval) {
+  if (interval <= 0) {
+    StopReload();
+    return;
+  }
+
+  pthread_mutex_lock(&reload_mtx_);
+  reload_interval_ = interval;
+  if (reload_running_) {
+    pthread_cond_signal(&reload_cond_);  // pick up the new interval
+    pthread_mutex_unlock(&reload_mtx_);
+    return;
+  }
+
+  reload_running_ = true;
+  int ret = pthread_create(&reload_tid_, NULL, ssl_reload_thread, this);
+  if (ret != 0) {
+    reload_running_ = false;
+    pthread_mutex_unlock(&reload_mtx_);
+    error.Init(EX_OSERR, "SSLContext::set_server_name_reload(): "
+               "pthread_create(3) failed: %s", strerror(ret));
+    return;
+  }
+  pthread_mutex_unlock(&reload_mtx_);
+}
 
 // SSLContext manipulation.
 void SSLContext::Init(const SSL_METHOD* method, const char* session_id, 
@@ -119,12 +583,17 @@ void SSLContext::Init(const SSL_METHOD* method, const char* session_id,
     return;
   }
 
-  // TODO(aka): Figure out how to get the ASCII version of a method
-  // from a SSL_METHOD* ... might have to query Eric Rescorla on this
-  // one.
+  // Note, SSL_METHOD is opaque as of OpenSSL 1.1.0, so we can no
+  // longer report method->version; report the library instead.
 
   _LOGGER(LOG_INFO, "SSLContext::Init(): "
-          "Started new SSL context with method: %#x.", method->version);
+          "Started new SSL context using: %s.", OpenSSL_version(OPENSSL_VERSION));
+
+  // Let our callbacks find us (and the client-side session tag) from
+  // any SSL* made from this context.
+
+  SSL_CTX_set_app_data(ctx_, this);
+  pthread_once(&ssl_peer_idx_once, ssl_peer_idx_init);
 
   // Set how this SSL context will behave.  Choices are:
   //
@@ -260,14 +729,275 @@ void SSLContext::Init(const SSL_METHOD* method, const char* session_id,
   //  verify_depth_ = verify_depth;
   SSL_CTX_set_verify_depth(ctx_, verify_depth);
 
-  // Set how we want to handle reusable sessions (see SSL_CTX_set_session_cache_mode(3)).
-  SSL_CTX_set_session_cache_mode(ctx_, cache_mode);
+  // Set how we want to handle reusable sessions (see
+  // SSL_CTX_set_session_cache_mode(3)).  We always turn on the
+  // client-side cache, so that ssl_new_session_cb() sees the
+  // sessions we receive, but we keep them in our own (host:port
+  // keyed) store, so unless we're also a server, OpenSSL's internal
+  // store would just be a second copy.
+
+  long mode = cache_mode | SSL_SESS_CACHE_CLIENT;
+  if (!(cache_mode & SSL_SESS_CACHE_SERVER))
+    mode |= SSL_SESS_CACHE_NO_INTERNAL_STORE;
+  SSL_CTX_set_session_cache_mode(ctx_, mode);
+  SSL_CTX_sess_set_new_cb(ctx_, ssl_new_session_cb);
 
   // Set any options (a bitmask, see SSL_CTX_set_options(3)).
   if (options > 0)
     SSL_CTX_set_options(ctx_, options);  // TODO(aka) if we care, new options are returned ...
 }
 
+// Routine to expire timed out sessions from both caches.
+void SSLContext::FlushSessions(void) {
+  time_t now = time(NULL);
+
+  pthread_mutex_lock(&client_sessions_mtx_);
+  list<pair<string, SSL_SESSION*> >::iterator itr = client_lru_.begin();
+  while (itr != client_lru_.end()) {
+    if (SSL_SESSION_get_time(itr->second) + 
+        SSL_SESSION_get_timeout(itr->second) < now) {
+      client_sessions_.erase(itr->first);
+      SSL_SESSION_free(itr->second);
+      itr = client_lru_.erase(itr);
+    } else {
+      itr++;
+    }
+  }
+  pthread_mutex_unlock(&client_sessions_mtx_);
+
+  if (ctx_ != NULL)
+    SSL_CTX_flush_sessions(ctx_, now);
+}
+
+// Routine to tag a client SSL* with its peer and offer it a session.
+void SSLContext::ResumeClientSession(SSL* ssl, const string& peer) {
+  if (ssl == NULL || ssl_peer_idx < 0 || client_max_sessions_ == 0)
+    return;
+
+  char* tag = strdup(peer.c_str());
+  if (tag == NULL || !SSL_set_ex_data(ssl, ssl_peer_idx, tag)) {
+    free(tag);
+    return;  // we'll just do a full handshake
+  }
+
+  pthread_mutex_lock(&client_sessions_mtx_);
+  map<string, list<pair<string, SSL_SESSION*> >::iterator>::iterator itr =
+      client_sessions_.find(peer);
+  if (itr != client_sessions_.end()) {
+    SSL_SESSION* session = itr->second->second;
+    if (SSL_SESSION_is_resumable(session) &&
+        SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session) >=
+        time(NULL)) {
+      SSL_set_session(ssl, session);  // takes its own reference
+      client_lru_.splice(client_lru_.begin(), client_lru_, itr->second);
+    } else {
+      SSL_SESSION_free(session);
+      client_lru_.erase(itr->second);
+      client_sessions_.erase(itr);
+    }
+  }
+  pthread_mutex_unlock(&client_sessions_mtx_);
+}
+
+// Routine to count a completed handshake.
+void SSLContext::CountHandshake(const SSL* ssl) {
+  if (SSL_session_reused(ssl))
+    __atomic_fetch_add(&handshakes_resumed_, 1, __ATOMIC_RELAXED);
+  else
+    __atomic_fetch_add(&handshakes_full_, 1, __ATOMIC_RELAXED);
+}
+
+// Routine to add (or replace) a SNI server name.
+//
+// Note, this routine can set an ErrorHandler event.
+void SSLContext::AddServerName(const char* server_name,
+                               const char* keyfile_name,
+                               const char* keyfile_dir, 
+                               const int keyfile_type, const char* password, 
+                               const char* certfile_name,
+                               const char* certfile_dir, 
+                               const int certfile_type) {
+  if (ctx_ == NULL) {
+    error.Init(EX_SOFTWARE, "SSLContext::AddServerName(): SSL_CTX* is NULL");
+    return;
+  }
+  if (server_name == NULL || strlen(server_name) == 0 ||
+      certfile_name == NULL || keyfile_name == NULL) {
+    error.Init(EX_SOFTWARE, "SSLContext::AddServerName(): "
+               "server_name, certfile & keyfile are required");
+    return;
+  }
+
+  File certfile;
+  certfile.Init(certfile_name, certfile_dir);
+  File keyfile;
+  keyfile.Init(keyfile_name, keyfile_dir);
+
+  struct ssl_server_name entry;
+  entry.ctx = NULL;
+  entry.certfile = certfile.path(NULL);
+  entry.certfile_type = certfile_type;
+  entry.keyfile = keyfile.path(NULL);
+  entry.keyfile_type = keyfile_type;
+  entry.password = (password != NULL) ? password : "";
+
+  string err;
+  if (!LoadServerName(&entry, &err)) {
+    error.Init(EX_SOFTWARE, "SSLContext::AddServerName(): %s: %s",
+               server_name, err.c_str());
+    return;
+  }
+
+  // Names are case-insensitive, so we store them in lower-case.
+  string name = server_name;
+  for (size_t i = 0; i < name.size(); i++)
+    name[i] = tolower(name[i]);
+
+  SSL_CTX* old_ctx = NULL;
+  pthread_rwlock_wrlock(&server_names_lock_);
+  unordered_map<string, struct ssl_server_name>::iterator itr = 
+      server_names_.find(name);
+  if (itr != server_names_.end())
+    old_ctx = itr->second.ctx;
+  server_names_[name] = entry;
+  pthread_rwlock_unlock(&server_names_lock_);
+
+  if (old_ctx != NULL)
+    SSL_CTX_free(old_ctx);
+
+  SSL_CTX_set_tlsext_servername_callback(ctx_, ssl_servername_cb);
+  SSL_CTX_set_tlsext_servername_arg(ctx_, this);
+
+  _LOGGER(LOG_NOTICE, "Loaded certfile: %s, for server name: %s.", 
+          entry.certfile.c_str(), name.c_str());
+}
+
+// Routine to drop a SNI server name.
+void SSLContext::RemoveServerName(const char* server_name) {
+  if (server_name == NULL)
+    return;
+
+  string name = server_name;
+  for (size_t i = 0; i < name.size(); i++)
+    name[i] = tolower(name[i]);
+
+  SSL_CTX* old_ctx = NULL;
+  pthread_rwlock_wrlock(&server_names_lock_);
+  unordered_map<string, struct ssl_server_name>::iterator itr = 
+      server_names_.find(name);
+  if (itr != server_names_.end()) {
+    old_ctx = itr->second.ctx;
+    server_names_.erase(itr);
+  }
+  pthread_rwlock_unlock(&server_names_lock_);
+
+  if (old_ctx != NULL)
+    SSL_CTX_free(old_ctx);  // connections using it hold their own reference
+}
+
+// Routine to reload the certificates of server names whose files
+// have changed.
+size_t SSLContext::ReloadServerNames(void) {
+  // Take a snapshot of our entries, so we can load files without
+  // holding the lock.
+
+  vector<pair<string, struct ssl_server_name> > entries;
+  pthread_rwlock_rdlock(&server_names_lock_);
+  for (unordered_map<string, struct ssl_server_name>::const_iterator itr =
+           server_names_.begin(); itr != server_names_.end(); itr++)
+    entries.push_back(*itr);
+  pthread_rwlock_unlock(&server_names_lock_);
+
+  size_t cnt = 0;
+  for (size_t i = 0; i < entries.size(); i++) {
+    struct ssl_server_name& entry = entries[i].second;
+    struct stat cert_info, key_info;
+    if (stat(entry.certfile.c_str(), &cert_info) < 0 ||
+        stat(entry.keyfile.c_str(), &key_info) < 0)
+      continue;  // probably being replaced, try again next time
+    if (cert_info.st_mtime == entry.cert_mtime &&
+        key_info.st_mtime == entry.key_mtime)
+      continue;
+
+    string err;
+    if (!LoadServerName(&entry, &err)) {
+      _LOGGER(LOG_WARNING, "SSLContext::ReloadServerNames(): %s: %s, "
+              "keeping the old certificate.", entries[i].first.c_str(),
+              err.c_str());
+      continue;
+    }
+
+    // Swap in the new SSL_CTX, unless the name was removed (or
+    // replaced) while we were loading.
+
+    SSL_CTX* unused_ctx = entry.ctx;  // freed, unless we swap it in
+    pthread_rwlock_wrlock(&server_names_lock_);
+    unordered_map<string, struct ssl_server_name>::iterator itr = 
+        server_names_.find(entries[i].first);
+    if (itr != server_names_.end() && 
+        itr->second.certfile == entry.certfile &&
+        itr->second.keyfile == entry.keyfile) {
+      unused_ctx = itr->second.ctx;
+      itr->second = entry;
+      cnt++;
+    }
+    pthread_rwlock_unlock(&server_names_lock_);
+
+    SSL_CTX_free(unused_ctx);
+    if (unused_ctx != entry.ctx)
+      _LOGGER(LOG_NOTICE, "Reloaded certfile: %s, for server name: %s.", 
+              entry.certfile.c_str(), entries[i].first.c_str());
+  }
+
+  return cnt;
+}
+
+// Routine to file a client session under peer, replacing any older
+// session we held for it.  Note, under TLSv1.3 servers usually send
+// more than one ticket, we simply keep the most recent.
+bool SSLContext::StoreClientSession(const string& peer, SSL_SESSION* session) {
+  if (session == NULL || !SSL_SESSION_is_resumable(session))
+    return false;
+
+  pthread_mutex_lock(&client_sessions_mtx_);
+  if (client_max_sessions_ == 0) {
+    pthread_mutex_unlock(&client_sessions_mtx_);
+    return false;
+  }
+
+  map<string, list<pair<string, SSL_SESSION*> >::iterator>::iterator itr =
+      client_sessions_.find(peer);
+  if (itr != client_sessions_.end()) {
+    SSL_SESSION_free(itr->second->second);
+    itr->second->second = session;
+    client_lru_.splice(client_lru_.begin(), client_lru_, itr->second);
+  } else {
+    // Make room by evicting the least-recently used session(s).
+    while (client_lru_.size() >= client_max_sessions_) {
+      client_sessions_.erase(client_lru_.back().first);
+      SSL_SESSION_free(client_lru_.back().second);
+      client_lru_.pop_back();
+    }
+
+    client_lru_.push_front(make_pair(peer, session));
+    client_sessions_[peer] = client_lru_.begin();
+  }
+  pthread_mutex_unlock(&client_sessions_mtx_);
+
+  return true;
+}
+
+// Routine to empty the client-side session store.
+void SSLContext::ClearClientSessions(void) {
+  pthread_mutex_lock(&client_sessions_mtx_);
+  for (list<pair<string, SSL_SESSION*> >::iterator itr = client_lru_.begin();
+       itr != client_lru_.end(); itr++)
+    SSL_SESSION_free(itr->second);
+  client_lru_.clear();
+  client_sessions_.clear();
+  pthread_mutex_unlock(&client_sessions_mtx_);
+}
+
 // Boolean checks.
 
 // Non-class specific utility functions.
@@ -471,3 +1201,91 @@ void SSL_Context::Seed_PRNG(const char* egd_path,
 }
 
 #endif
+
+// Routine to load a server name's certificate & key into a new SSL_CTX.
+bool SSLContext::LoadServerName(struct ssl_server_name* entry,
+                                string* err) const {
+  struct stat cert_info, key_info;
+  if (stat(entry->certfile.c_str(), &cert_info) < 0 ||
+      stat(entry->keyfile.c_str(), &key_info) < 0) {
+    *err = "stat(" + entry->certfile + ", " + entry->keyfile + ") failed: " +
+        strerror(errno);
+    return false;
+  }
+
+  SSL_CTX* ctx = SSL_CTX_new(SSL_CTX_get_ssl_method(ctx_));
+  if (ctx == NULL) {
+    *err = "SSL_CTX_new() failed: " + ssl_err_str();
+    return false;
+  }
+
+  // Our callbacks find us via the SSL_CTX of a connection, which
+  // after SNI is this one.  The session id context must match our
+  // own, or OpenSSL won't switch it, and sessions wouldn't resume.
+
+  SSL_CTX_set_app_data(ctx, (void*)this);
+  SSL_CTX_set_session_id_context(ctx, (const unsigned char*)session_id_,
+                                 strlen(session_id_));
+  if (entry->password.size() > 0) {
+    SSL_CTX_set_default_passwd_cb(ctx, pem_passwd_cb);
+    SSL_CTX_set_default_passwd_cb_userdata(ctx,
+                                           (void*)entry->password.c_str());
+  }
+
+  bool ok = false;
+  if (!SSL_CTX_use_certificate_file(ctx, entry->certfile.c_str(),
+                                    entry->certfile_type))
+    *err = "SSL_CTX_use_certificate_file() failed: " + ssl_err_str();
+  else if (!SSL_CTX_use_PrivateKey_file(ctx, entry->keyfile.c_str(),
+                                        entry->keyfile_type))
+    *err = "SSL_CTX_use_PrivateKey_file() failed: " + ssl_err_str();
+  else if (!SSL_CTX_check_private_key(ctx))
+    *err = "SSL_CTX_check_private_key() failed: " + ssl_err_str();
+  else
+    ok = true;
+
+  SSL_CTX_set_default_passwd_cb_userdata(ctx, NULL);  // entry may move
+  if (!ok) {
+    SSL_CTX_free(ctx);
+    return false;
+  }
+
+  entry->ctx = ctx;
+  entry->cert_mtime = cert_info.st_mtime;
+  entry->key_mtime = key_info.st_mtime;
+
+  return true;
+}
+
+// Routine to stop our reload thread.
+void SSLContext::StopReload(void) {
+  pthread_mutex_lock(&reload_mtx_);
+  if (!reload_running_) {
+    pthread_mutex_unlock(&reload_mtx_);
+    return;
+  }
+  reload_running_ = false;
+  pthread_cond_signal(&reload_cond_);
+  pthread_mutex_unlock(&reload_mtx_);
+
+  pthread_join(reload_tid_, NULL);
+}
+
+// Routine to look up a server name, exactly, then as a wildcard.
+SSL_CTX* SSLContext::LookupServerName(const char* server_name) const {
+  string name = server_name;
+  for (size_t i = 0; i < name.size(); i++)
+    name[i] = tolower(name[i]);
+
+  unordered_map<string, struct ssl_server_name>::const_iterator itr =
+      server_names_.find(name);
+  if (itr != server_names_.end())
+    return itr->second.ctx;
+
+  size_t dot = name.find('.');
+  if (dot == string::npos || dot == 0)
+    return NULL;
+
+  itr = server_names_.find("*" + name.substr(dot));
+  return (itr != server_names_.end()) ? itr->second.ctx : NULL;
+}
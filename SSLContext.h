@@ -6,12 +6,20 @@
 #ifndef _SSLCONTEXT_H_
 #define _SSLCONTEXT_H_
 
+#include <pthread.h>
+#include <time.h>
+
 #include <openssl/ssl.h>
 
 #include <string>
+#include <list>
+#include <map>
+#include <unordered_map>
 using namespace std;
 
 #include "File.h"
+#include "SSLTicketKeys.h"
+#include "WorkerPool.h"
 
 
 // Forward declarations (used if only needed for member function parameters).
@@ -19,9 +27,118 @@ using namespace std;
 // Non-class specific defines & data structures.
 #define SSLCONTEXT_DEFAULT_VERIFY_DEPTH 2	   // 0:peer + 1:CA + 2:CA
 #define SSLCONTEXT_DEFAULT_RAND_MAX_BYTES -1
+#define SSLCONTEXT_DEFAULT_CLIENT_SESSIONS 1024   // 0 disables client store
+
+// Dynamic record sizing (see SSLContext::set_record_sizing()).  1369
+// bytes of plaintext plus the TLS record overhead fits within one
+// TCP segment on a 1500 byte MTU path, even with IPv6 & TCP options.
+#define SSLCONTEXT_RECORD_SMALL_LEN 1369
+#define SSLCONTEXT_RECORD_BOOST_LEN (64 * 1024)  // bytes before 16 KB records
+#define SSLCONTEXT_RECORD_IDLE_MSEC 1000
+
+struct ssl_record_sizing {
+  size_t small_len;             // record size to start with, 0 disables
+  size_t boost_len;             // bytes sent in small records
+  long idle_msec;               // idle time that starts us small again
+  bool per_msg;                 // start small on every message, too
+};
+
+#define SSLCONTEXT_DEFAULT_RELOAD_INTERVAL 60  // secs between cert checks
+
+// A certificate (and key) we serve for a SNI server name.
+struct ssl_server_name {
+  SSL_CTX* ctx;                 // holds the loaded certificate & key
+  string certfile;              // full paths, so we can reload them
+  int certfile_type;
+  string keyfile;
+  int keyfile_type;
+  string password;
+  time_t cert_mtime;            // st_mtime of the files when loaded
+  time_t key_mtime;
+};
 
 // Non-class specific utilities.
 string ssl_err_str(void);
+
+/** Routine to pick the certificate for the server name a client sent.
+ *
+ *  Installed via SSL_CTX_set_tlsext_servername_callback(3) in
+ *  SSLContext::AddServerName(); arg is the SSLContext.
+ *
+ *  @return SSL_TLSEXT_ERR_OK (unknown names get our default certificate)
+ */
+int ssl_servername_cb(SSL* ssl, int* al, void* arg);
+
+/** Routine run by the certificate reload thread.
+ *
+ *  @see SSLContext::set_server_name_reload()
+ */
+void* ssl_reload_thread(void* arg);
+
+/** Routine to receive new client sessions from OpenSSL.
+ *
+ *  Installed via SSL_CTX_sess_set_new_cb(3) in SSLContext::Init();
+ *  it files session in the client-side store of the SSLContext that
+ *  owns ssl.
+ *
+ *  @return 1 if we kept the reference to session, else 0
+ */
+int ssl_new_session_cb(SSL* ssl, SSL_SESSION* session);
+
+/** Routine to hand session-ticket encryption to our SSLTicketKeys.
+ *
+ *  Installed via SSL_CTX_set_tlsext_ticket_key_evp_cb(3) in
+ *  SSLContext::set_ticket_keys().
+ *
+ *  @see SSLTicketKeys::TicketKeyCallback()
+ */
+int ssl_ticket_key_cb(SSL* ssl, unsigned char* key_name, unsigned char* iv,
+                      EVP_CIPHER_CTX* cipher_ctx, EVP_MAC_CTX* mac_ctx,
+                      int enc);
+
+/** Routine to have OpenSSL allocate memory through our accounting hooks.
+ *
+ *  With accounting on, every OpenSSL allocation is tallied, both
+ *  process-wide (ssl_mem_in_use()) and against the SSL* it was made
+ *  for (ssl_mem_used()), which is how we measure what an (idle)
+ *  connection costs.  Each allocation carries a small header, so
+ *  this is meant for measurement rather than production use.
+ *
+ *  Note, OpenSSL only allows its allocator to be replaced before its
+ *  first allocation, i.e., call this first thing in main().
+ *
+ *  @return true if accounting is on, false if it is too late
+ */
+bool ssl_mem_track(void);
+
+/** Routine to return the bytes OpenSSL currently has allocated.
+ *
+ *  @return a size_t of bytes (0 if ssl_mem_track() was not called)
+ */
+size_t ssl_mem_in_use(void);
+
+/** Routine to return the bytes OpenSSL has allocated on behalf of ssl.
+ *
+ *  Includes the SSL* itself, its record buffers and handshake state,
+ *  as well as anything made during its handshake that is still
+ *  around (e.g., its session).
+ *
+ *  @param ssl a const SSL* made by SSLConn
+ *  @return a size_t of bytes (0 if ssl_mem_track() was not called)
+ */
+size_t ssl_mem_used(const SSL* ssl);
+
+/** Routine to charge this thread's OpenSSL allocations to ssl.
+ *
+ *  Called (by SSLConn) around each OpenSSL call made for a
+ *  connection; a NULL ssl stops charging.  ssl_mem_charge_new() is
+ *  used before SSL_new(3), as there is no SSL* to charge yet, and
+ *  ssl_mem_charge_done() then hands the new account to the SSL*
+ *  (or drops it if SSL_new(3) failed) and stops charging.
+ */
+void ssl_mem_charge(const SSL* ssl);
+void ssl_mem_charge_new(void);
+void ssl_mem_charge_done(SSL* ssl);
 //const int ssl_check_version(void);
 //int pem_passwd_cb(char* buf, int size, int rwflag, void* userdata);
 
@@ -51,9 +168,213 @@ class SSLContext {
   // Accessors.
   // XXX const SSL_CTX* ctx(void) const { return ctx_; }
   // XXX const SSL_METHOD* method(void) const { return method_; }
+  unsigned long handshakes_full(void) const {
+    return __atomic_load_n(&handshakes_full_, __ATOMIC_RELAXED); }
+  unsigned long handshakes_resumed(void) const {
+    return __atomic_load_n(&handshakes_resumed_, __ATOMIC_RELAXED); }
+  size_t client_sessions(void) const;
+  WorkerPool* handshake_pool(void) const { return handshake_pool_; }
+  bool memory_bio(void) const { return memory_bio_; }
+  const struct ssl_record_sizing& record_sizing(void) const {
+    return record_sizing_; }
+  size_t server_names(void) const;
+
+  /** Routine to return the CPU time spent in SSL_do_handshake(3).
+   *
+   *  This includes the time spent on WorkerPool threads.
+   *
+   *  @return an unsigned long of microseconds
+   */
+  unsigned long handshake_cpu_usec(void) const {
+    return __atomic_load_n(&handshake_cpu_nsec_, __ATOMIC_RELAXED) / 1000; }
+
+  /** Routine to return our completed handshakes per CPU-second.
+   *
+   *  I.e., the handshake throughput of a single core, which is how
+   *  much handshake capacity each core we give the server buys us.
+   *
+   *  @return a double of handshakes per second of CPU time (or 0.0)
+   */
+  double handshakes_per_cpu_second(void) const;
 
   // Mutators.
 
+  /** Routine to set the size of the client-side session store.
+   *
+   *  SSLConn::Connect() automatically offers the last session we
+   *  received from the same host:port, and saves any new session (or
+   *  TLSv1.3 ticket) the server hands us.  When the store is full,
+   *  the least-recently used session is evicted.  Note, OpenSSL
+   *  invalidates the session of a connection that is closed without
+   *  sending a close notify, i.e., use SSLConn::Shutdown().
+   *
+   *  @param max_sessions a size_t of sessions to keep, 0 disables the store
+   */
+  void set_client_session_cache(const size_t max_sessions);
+
+  /** Routine to size the server-side session cache and tickets.
+   *
+   *  Stateful sessions (session ids) are kept in OpenSSL's internal
+   *  cache, which holds at most max_sessions entries (0 is
+   *  unlimited) and evicts the oldest entries when full.  Stateless
+   *  resumption is done with session tickets; num_tickets is how many
+   *  tickets we issue per TLSv1.3 handshake (0 disables tickets).
+   *
+   *  Note, must be called after Init().
+   *
+   *  @param max_sessions a long of sessions to hold in the cache
+   *  @param timeout a long of seconds a session (or ticket) is valid
+   *  @param num_tickets a size_t of tickets to issue per handshake
+   */
+  void set_server_session_cache(const long max_sessions, const long timeout,
+                                const size_t num_tickets);
+
+  /** Routine to encrypt our session tickets with shared keys.
+   *
+   *  By default, OpenSSL protects tickets with keys that are private
+   *  to this process.  Using keys from a SSLTicketKeys object instead
+   *  lets any process sharing the key file (e.g., the other workers
+   *  behind our port, or our replacement after a restart) resume the
+   *  session.  Note, we do not take ownership of keys, and this must
+   *  be called after Init().  It can set an ErrorHandler event.
+   *
+   *  @see SSLTicketKeys
+   *  @see ErrorHandler
+   *  @param keys a SSLTicketKeys* (NULL reverts to OpenSSL's keys)
+   */
+  void set_ticket_keys(SSLTicketKeys* keys);
+
+  /** Routine to run our handshakes on a WorkerPool.
+   *
+   *  The expensive part of a handshake (the private-key signature,
+   *  and key exchange) happens within SSL_do_handshake(3).  With a
+   *  pool set, SSLConn::Handshake() on a NON-BLOCKING connection
+   *  made from this context runs each SSL_do_handshake(3) step on a
+   *  pool thread and returns SSLConn::HANDSHAKE_BUSY, so the event-loop
+   *  can keep serving other sessions.  Once the pool's notify_fd() is
+   *  readable, the event-loop calls Handshake() again on its busy
+   *  connections to collect the result.  If the pool's queue is full,
+   *  the step is simply run inline.
+   *
+   *  Note, we do not take ownership of pool.
+   *
+   *  @see WorkerPool
+   *  @see SSLConn::Handshake()
+   *  @param pool a WorkerPool* (NULL runs all handshakes inline)
+   */
+  void set_handshake_pool(WorkerPool* pool) { handshake_pool_ = pool; }
+
+  /** Routine to run our connections' OpenSSL over memory BIOs.
+   *
+   *  Normally, OpenSSL is handed the socket (SSL_set_fd(3)), and
+   *  issues its own read(2)s and write(2)s, e.g., two reads per
+   *  record (header, then body).  With memory BIOs, OpenSSL only
+   *  encrypts and decrypts buffers (a BIO pair, see
+   *  SSLCONN_MEMORY_BIO_SIZE), while SSLConn moves the ciphertext:
+   *  each read(2) takes as much as is waiting on the socket (i.e.,
+   *  possibly many records), and each SSL_write(3)'s records go out
+   *  in one write(2).  As the socket I/O is then ours, it can also be
+   *  replaced (e.g., with batched or asynchronous I/O) without
+   *  touching OpenSSL.
+   *
+   *  Connections made (via SSLConn::Connect() or SSLConn::Accept())
+   *  after the call inherit the mode.  Note, a NON-BLOCKING caller
+   *  must also poll for writability while
+   *  SSLConn::IsCiphertextPending(), and then call
+   *  SSLConn::FlushCiphertext().
+   *
+   *  @param memory_bio a bool, true to use memory BIOs
+   */
+  void set_memory_bio(const bool memory_bio) { memory_bio_ = memory_bio; }
+
+  /** Routine to free a connection's record buffers while it is idle.
+   *
+   *  Each SSL* otherwise holds on to its read and write record
+   *  buffers (roughly 34 KB together) for as long as it is open.
+   *  With SSL_MODE_RELEASE_BUFFERS set, OpenSSL frees them whenever
+   *  they are empty, and allocates them again on the next read or
+   *  write, which trades some malloc(3) traffic for a much smaller
+   *  idle connection.  Only affects connections made after the call.
+   *
+   *  Note, must be called after Init().  This routine can set an
+   *  ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   *  @param release a bool, true to free buffers while idle
+   */
+  void set_release_buffers(const bool release);
+
+  /** Routine to restrict the ciphers our connections may negotiate.
+   *
+   *  cipher_list (TLS 1.2 and earlier) uses the ciphers(1) syntax,
+   *  while ciphersuites (TLS 1.3) is a colon separated list of suite
+   *  names, e.g., "TLS_AES_128_GCM_SHA256"; either can be NULL to
+   *  leave that list alone.  Connections made after the call are
+   *  affected.  Note, must be called after Init().  This routine can
+   *  set an ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   *  @param cipher_list a char* of TLS 1.2 ciphers, or NULL
+   *  @param ciphersuites a char* of TLS 1.3 suites, or NULL
+   */
+  void set_cipher_list(const char* cipher_list, const char* ciphersuites);
+
+  /** Routine to accept TLS 1.3 early data (0-RTT) on resumed sessions.
+   *
+   *  A client resuming a session can send its first request in the
+   *  same flight as its ClientHello, saving a round-trip.  Early data
+   *  is not protected against replay, so SSLConn only sends messages
+   *  marked idempotent that way, and TCPSession marks incoming
+   *  messages that arrived as early data (see
+   *  TCPSession::IsIncomingMsgEarlyData()).  Sessions issued after
+   *  the call carry max_len to clients, who will send no more than
+   *  that; a server context should use SSL_SESS_CACHE_SERVER, so
+   *  OpenSSL can refuse early data on a session that was already used.
+   *
+   *  Note, must be called after Init().  This routine can set an
+   *  ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   *  @param max_len a uint32_t of bytes to accept, 0 disables early data
+   */
+  void set_max_early_data(const uint32_t max_len);
+
+  /** Routine to choose how our connections size their TLS records.
+   *
+   *  By default, SSLConn::Write() hands OpenSSL whatever it is given,
+   *  which is sent in full 16 KB records.  A record can't be
+   *  decrypted until all of it has arrived, so while TCP's congestion
+   *  window is still small (i.e., at the start of a connection, or
+   *  after it has been idle) a 16 KB record costs the peer extra
+   *  round-trips before it sees the first byte.  With dynamic sizing,
+   *  the first boost_len bytes are sent in small_len records (one TCP
+   *  segment each) and the rest in full records; the small records
+   *  start again after idle_msec without a write, or, if per_msg is
+   *  set, at every message TCPSession starts to send.
+   *
+   *  Connections made after the call inherit the policy, which each
+   *  can override with SSLConn::set_record_sizing().
+   *
+   *  @see SSLCONTEXT_RECORD_SMALL_LEN
+   *  @param small_len a size_t record size (512 - 16384), 0 disables
+   *  @param boost_len a size_t of bytes to send in small records
+   *  @param idle_msec a long of msecs idle before starting small (0 never)
+   *  @param per_msg a bool, true to start small at each message
+   */
+  void set_record_sizing(const size_t small_len, const size_t boost_len,
+                         const long idle_msec, const bool per_msg);
+
+  /** Routine to reload changed server name certificates periodically.
+   *
+   *  Starts (or with an interval of 0, stops) a thread that calls
+   *  ReloadServerNames() every interval seconds.  Note, this routine
+   *  can set an ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   *  @param interval a time_t of seconds between checks, 0 stops the thread
+   */
+  void set_server_name_reload(const time_t interval);
+
   // SSLContext manipulation.
 
   /** Routine to initialize a SSLContext object.
@@ -73,6 +394,82 @@ class SSLContext {
             const int verify_mode, const int verify_depth,
             const long cache_mode, const long options);
 
+  /** Routine to expire sessions that have timed out.
+   *
+   *  Sweeps both the client-side store and OpenSSL's server-side
+   *  cache.  OpenSSL also sweeps the latter every 255 handshakes, so
+   *  this only needs to be called if we want to give the memory back
+   *  sooner, e.g., from a timer in the event-loop.
+   */
+  void FlushSessions(void);
+
+  /** Routine to offer a cached session to a client SSL* object.
+   *
+   *  Tags ssl with peer, so any session received on it is stored
+   *  under peer, and if we have a (still valid) session for peer,
+   *  hand it to SSL_set_session(3).  Called by SSLConn::Connect()
+   *  before SSL_connect(3).
+   *
+   *  @param ssl a SSL* that has not yet started its handshake
+   *  @param peer a string of the form "host:port"
+   */
+  void ResumeClientSession(SSL* ssl, const string& peer);
+
+  /** Routine to tally a completed handshake as full or resumed.
+   *
+   */
+  void CountHandshake(const SSL* ssl);
+
+  /** Routine to serve another certificate on our listener.
+   *
+   *  Loads the certificate and key into their own SSL_CTX, which the
+   *  SNI callback switches a connection to if the client asks for
+   *  server_name.  server_name may be a wildcard, e.g.,
+   *  "*.example.com", which matches any single label under
+   *  example.com; an exact match wins.  Clients that send no name
+   *  (or one we don't have) get the certificate given to Init().
+   *  Adding a name we already have replaces its certificate.
+   *
+   *  Note, this must be called after Init().  It can set an
+   *  ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   *  @see ReloadServerNames()
+   */
+  void AddServerName(const char* server_name,
+                     const char* keyfile_name,  const char* keyfile_dir, 
+                     const int keyfile_type, const char* password, 
+                     const char* certfile_name, const char* certfile_dir, 
+                     const int certfile_type);
+
+  /** Routine to stop serving a server name.
+   *
+   *  Connections already using its certificate are unaffected.
+   */
+  void RemoveServerName(const char* server_name);
+
+  /** Routine to reload any server name whose files have changed.
+   *
+   *  The files are read (and the key checked) before any lock is
+   *  taken; only swapping in the new SSL_CTX is done under the write
+   *  lock, so handshakes are never held up by a reload.  If loading
+   *  fails, we log it and keep serving the old certificate.  Safe to
+   *  call from any thread, as it does not use the ErrorHandler.
+   *
+   *  @return the number of server names reloaded
+   */
+  size_t ReloadServerNames(void);
+
+  /** Routine to add to the CPU time spent on handshakes.
+   *
+   *  Note, may be called from any thread.
+   *
+   *  @param nsec a long of CPU nanoseconds spent in SSL_do_handshake(3)
+   */
+  void AddHandshakeTime(const long nsec) {
+    __atomic_fetch_add(&handshake_cpu_nsec_, (unsigned long)nsec,
+                       __ATOMIC_RELAXED); }
+
 #if 0  // TODO(aka)
   void Set_Cipher_List(const char* arg_cipherlist)
 #endif
@@ -101,6 +498,12 @@ class SSLContext {
   // Flags.
 
   friend class SSLConn;
+  friend int ssl_new_session_cb(SSL* ssl, SSL_SESSION* session);
+  friend int ssl_servername_cb(SSL* ssl, int* al, void* arg);
+  friend void* ssl_reload_thread(void* arg);
+  friend int ssl_ticket_key_cb(SSL* ssl, unsigned char* key_name,
+                               unsigned char* iv, EVP_CIPHER_CTX* cipher_ctx,
+                               EVP_MAC_CTX* mac_ctx, int enc);
 
  protected:
   // Data members.
@@ -121,7 +524,71 @@ class SSLContext {
 
   unsigned int cnt_;    // for reference counting this object (used by parent)
 
+  // Client-side session store, keyed by "host:port"; the list is
+  // kept in LRU order (most recent at the front).
+  size_t client_max_sessions_;
+  list<pair<string, SSL_SESSION*> > client_lru_;
+  map<string, list<pair<string, SSL_SESSION*> >::iterator> client_sessions_;
+  mutable pthread_mutex_t client_sessions_mtx_;
+
+  SSLTicketKeys* ticket_keys_;  // shared ticket keys (not owned), or NULL
+
+  unsigned long handshakes_full_;     // updated atomically
+  unsigned long handshakes_resumed_;  // updated atomically
+  unsigned long handshake_cpu_nsec_;  // updated atomically
+
+  WorkerPool* handshake_pool_;  // where handshakes are run (not owned), or NULL
+
+  struct ssl_record_sizing record_sizing_;  // inherited by our SSLConns
+  bool memory_bio_;             // our SSLConns use a BIO pair, not the fd
+
+  // SNI server names, and the thread that reloads their certificates.
+  unordered_map<string, struct ssl_server_name> server_names_;
+  mutable pthread_rwlock_t server_names_lock_;  // lock for server_names_
+  pthread_t reload_tid_;
+  bool reload_running_;
+  time_t reload_interval_;
+  pthread_mutex_t reload_mtx_;  // lock for reload_running_ & reload_interval_
+  pthread_cond_t reload_cond_;  // wakes the thread to stop (or re-time)
+
  private:
+  /** Routine to save a session received from peer.
+   *
+   *  @return true if we kept (i.e., now own the reference to) session
+   */
+  bool StoreClientSession(const string& peer, SSL_SESSION* session);
+
+  /** Routine to drop all sessions from the client-side store.
+   *
+   */
+  void ClearClientSessions(void);
+
+  /** Routine to build a SSL_CTX holding a server name's certificate.
+   *
+   *  Fills in entry's ctx and mtimes.  Note, does not use the
+   *  ErrorHandler, as it's also called from the reload thread.
+   *
+   *  @param entry a struct ssl_server_name* with its files set
+   *  @param err a string* to return the reason on failure
+   *  @return false on failure
+   */
+  bool LoadServerName(struct ssl_server_name* entry, string* err) const;
+
+  /** Routine to stop the reload thread (if it's running).
+   *
+   */
+  void StopReload(void);
+
+  /** Routine to find the SSL_CTX for a server name.
+   *
+   *  Used by ssl_servername_cb().  Note, expects server_names_lock_
+   *  to be (read) locked.
+   *
+   *  @param server_name a char* from the client's SNI extension
+   *  @return the SSL_CTX*, or NULL if we don't have server_name
+   */
+  SSL_CTX* LookupServerName(const char* server_name) const;
+
   // Dummy declarations for copy constructor and assignment & equality operator.
 
   /** Copy constructor.
@@ -0,0 +1,371 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#include <openssl/rand.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Logger.h"
+#include "SSLContext.h"
+#include "SSLTicketKeys.h"
+
+#define DEBUG_CLASS 0
+
+// Non-class specific defines & data structures.
+
+// Non-class specific utility functions.
+
+// Routine to (un)lock all of fd with a fcntl(2) record lock.  Unlike
+// flock(2) locks, which belong to the open file description (and
+// thus are shared by every process that inherited fd across
+// fork(2)), these belong to the process, so our workers exclude each
+// other even when sharing a memfd.
+static void lock_keys_file(const int fd, const short type) {
+  struct flock lock;
+  memset(&lock, 0, sizeof(lock));
+  lock.l_type = type;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = 0;
+  lock.l_len = 0;  // the whole file
+
+  while (fcntl(fd, F_SETLKW, &lock) < 0 && errno == EINTR)
+    ;
+}
+
+
+// SSLTicketKeys Class.
+
+// Constructors and destructor.
+SSLTicketKeys::SSLTicketKeys(void) {
+#if DEBUG_CLASS
+  warnx("SSLTicketKeys::SSLTicketKeys(void) called.");
+#endif
+
+  fd_ = -1;
+  own_fd_ = false;
+  rotate_interval_ = SSLTICKETKEYS_DEFAULT_ROTATE_INTERVAL;
+  grace_period_ = SSLTICKETKEYS_DEFAULT_GRACE_PERIOD;
+  memset(&info_, 0, sizeof(info_));
+  checked_ = 0;
+  pthread_mutex_init(&keys_mtx_, NULL);
+}
+
+SSLTicketKeys::~SSLTicketKeys(void) {
+#if DEBUG_CLASS
+  warnx("SSLTicketKeys::~SSLTicketKeys(void) called.");
+#endif
+
+  if (own_fd_ && fd_ >= 0)
+    close(fd_);
+
+  // Don't leave key material lying around in freed memory.
+  if (keys_.size() > 0)
+    OPENSSL_cleanse(&keys_[0], keys_.size() * sizeof(struct ssl_ticket_key));
+
+  pthread_mutex_destroy(&keys_mtx_);
+}
+
+// Accessors.
+size_t SSLTicketKeys::num_keys(void) const {
+  pthread_mutex_lock(&keys_mtx_);
+  size_t cnt = keys_.size();
+  pthread_mutex_unlock(&keys_mtx_);
+
+  return cnt;
+}
+
+time_t SSLTicketKeys::rotated(void) const {
+  pthread_mutex_lock(&keys_mtx_);
+  time_t mtime = info_.st_mtime;
+  pthread_mutex_unlock(&keys_mtx_);
+
+  return mtime;
+}
+
+// Mutators.
+
+// SSLTicketKeys manipulation.
+
+// Routine to open (or create) our key file.
+//
+// Note, this routine can set an ErrorHandler event.
+void SSLTicketKeys::Init(const char* path, const time_t rotate_interval,
+                         const time_t grace_period) {
+  if (path == NULL || strlen(path) == 0) {
+    error.Init(EX_SOFTWARE, "SSLTicketKeys::Init(): path is NULL");
+    return;
+  }
+
+  int fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    error.Init(EX_IOERR, "SSLTicketKeys::Init(): open(%s) failed: %s",
+               path, strerror(errno));
+    return;
+  }
+
+  Init(fd, rotate_interval, grace_period);
+  if (error.Event()) {
+    close(fd);
+    error.AppendMsg("SSLTicketKeys::Init(): ");
+    return;
+  }
+
+  pthread_mutex_lock(&keys_mtx_);
+  path_ = path;
+  own_fd_ = true;
+  pthread_mutex_unlock(&keys_mtx_);
+}
+
+// Routine to load our keys from a (shared) file descriptor.
+//
+// Note, this routine can set an ErrorHandler event.
+void SSLTicketKeys::Init(const int fd, const time_t rotate_interval,
+                         const time_t grace_period) {
+  if (fd < 0) {
+    error.Init(EX_SOFTWARE, "SSLTicketKeys::Init(): invalid fd: %d", fd);
+    return;
+  }
+
+  pthread_mutex_lock(&keys_mtx_);
+  if (own_fd_ && fd_ >= 0 && fd_ != fd)
+    close(fd_);
+  path_.clear();
+  fd_ = fd;
+  own_fd_ = false;
+  rotate_interval_ = rotate_interval;
+  grace_period_ = grace_period;
+
+  // Whoever gets here first with an empty file writes the first key.
+  lock_keys_file(fd_, F_WRLCK);
+  bool ok = ReadKeys();
+  if (!ok && info_.st_size == 0)
+    ok = WriteNewKey();
+  lock_keys_file(fd_, F_UNLCK);
+  checked_ = time(NULL);
+  pthread_mutex_unlock(&keys_mtx_);
+
+  if (!ok) {
+    error.Init(EX_DATAERR, "SSLTicketKeys::Init(): "
+               "unable to load keys from fd %d (size %ld, must be a multiple "
+               "of %d bytes)", fd, (long)info_.st_size, SSLTICKETKEYS_KEY_SIZE);
+    return;
+  }
+
+  _LOGGER(LOG_INFO, "SSLTicketKeys::Init(): loaded %lu key(s) from fd %d.",
+          (unsigned long)keys_.size(), fd);
+}
+
+// Routine to re-read the key file if it changed, and to rotate the
+// keys if the current key has expired.
+void SSLTicketKeys::Refresh(void) {
+  pthread_mutex_lock(&keys_mtx_);
+  if (fd_ < 0) {
+    pthread_mutex_unlock(&keys_mtx_);
+    return;
+  }
+
+  time_t now = time(NULL);
+  checked_ = now;
+  ReopenIfReplaced();
+
+  struct stat info;
+  if (fstat(fd_, &info) == 0 &&
+      (info.st_ino != info_.st_ino || info.st_size != info_.st_size ||
+       info.st_mtim.tv_sec != info_.st_mtim.tv_sec ||
+       info.st_mtim.tv_nsec != info_.st_mtim.tv_nsec)) {
+    lock_keys_file(fd_, F_RDLCK);
+    if (ReadKeys())
+      _LOGGER(LOG_INFO, "SSLTicketKeys::Refresh(): re-loaded %lu key(s).",
+              (unsigned long)keys_.size());
+    lock_keys_file(fd_, F_UNLCK);
+  }
+
+  if (rotate_interval_ > 0 && now >= info_.st_mtime + rotate_interval_) {
+    // Our key has expired, but another process may have beaten us to
+    // the rotation, so look again once we hold the lock.
+
+    lock_keys_file(fd_, F_WRLCK);
+    ReadKeys();
+    if (now >= info_.st_mtime + rotate_interval_) {
+      if (WriteNewKey())
+        _LOGGER(LOG_NOTICE, "SSLTicketKeys::Refresh(): rotated ticket keys.");
+      else
+        _LOGGER_LIMITED(LOG_ERR, "SSLTicketKeys::Refresh(): "
+                        "unable to rotate ticket keys: %s", strerror(errno));
+    }
+    lock_keys_file(fd_, F_UNLCK);
+  }
+  pthread_mutex_unlock(&keys_mtx_);
+}
+
+// Routine to force a key rotation.
+//
+// Note, this routine can set an ErrorHandler event.
+void SSLTicketKeys::Rotate(void) {
+  pthread_mutex_lock(&keys_mtx_);
+  if (fd_ < 0) {
+    pthread_mutex_unlock(&keys_mtx_);
+    error.Init(EX_SOFTWARE, "SSLTicketKeys::Rotate(): not initialized");
+    return;
+  }
+
+  lock_keys_file(fd_, F_WRLCK);
+  ReadKeys();  // make sure we retire the *current* key
+  bool ok = WriteNewKey();
+  lock_keys_file(fd_, F_UNLCK);
+  pthread_mutex_unlock(&keys_mtx_);
+
+  if (!ok) {
+    error.Init(EX_IOERR, "SSLTicketKeys::Rotate(): unable to write keys: %s",
+               strerror(errno));
+    return;
+  }
+}
+
+// Routine to set up the cipher & MAC for a session ticket (see
+// SSL_CTX_set_tlsext_ticket_key_evp_cb(3)).
+int SSLTicketKeys::TicketKeyCallback(unsigned char* key_name,
+                                     unsigned char* iv,
+                                     EVP_CIPHER_CTX* cipher_ctx,
+                                     EVP_MAC_CTX* mac_ctx, const int enc) {
+  pthread_mutex_lock(&keys_mtx_);
+  bool stale = (time(NULL) - checked_ >= SSLTICKETKEYS_CHECK_INTERVAL);
+  pthread_mutex_unlock(&keys_mtx_);
+  if (stale)
+    Refresh();
+
+  struct ssl_ticket_key key;
+  int ret = 1;
+
+  pthread_mutex_lock(&keys_mtx_);
+  if (enc) {
+    if (keys_.size() == 0) {
+      pthread_mutex_unlock(&keys_mtx_);
+      return 0;  // don't issue a ticket
+    }
+    key = keys_[0];
+  } else {
+    size_t i = 0;
+    for (; i < keys_.size(); i++)
+      if (!memcmp(key_name, keys_[i].name, SSLTICKETKEYS_NAME_SIZE))
+        break;
+
+    if (i == keys_.size() ||
+        (i > 0 && time(NULL) >= info_.st_mtime + grace_period_)) {
+      pthread_mutex_unlock(&keys_mtx_);
+      return 0;  // unknown (or retired) key, do a full handshake
+    }
+
+    // Always have OpenSSL issue a fresh ticket.  TLSv1.3 clients use
+    // a ticket only once, and after a resumption OpenSSL only sends
+    // a new one if we ask for it (this also moves tickets made with
+    // a retired key over to the current key).
+
+    key = keys_[i];
+    ret = 2;
+  }
+  pthread_mutex_unlock(&keys_mtx_);
+
+  OSSL_PARAM params[3];
+  params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+                                                key.hmac_key,
+                                                sizeof(key.hmac_key));
+  params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                               (char*)"SHA256", 0);
+  params[2] = OSSL_PARAM_construct_end();
+
+  if (enc) {
+    memcpy(key_name, key.name, SSLTICKETKEYS_NAME_SIZE);
+    if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) <= 0 ||
+        !EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL,
+                            key.aes_key, iv))
+      ret = -1;
+  } else {
+    if (!EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL,
+                            key.aes_key, iv))
+      ret = -1;
+  }
+  if (ret > 0 && !EVP_MAC_CTX_set_params(mac_ctx, params))
+    ret = -1;
+
+  OPENSSL_cleanse(&key, sizeof(key));
+
+  if (ret < 0)
+    _LOGGER_LIMITED(LOG_ERR, "SSLTicketKeys::TicketKeyCallback(): "
+                    "failed: %s", ssl_err_str().c_str());
+
+  return ret;
+}
+
+// Routine to read all the keys in our file.
+bool SSLTicketKeys::ReadKeys(void) {
+  if (fstat(fd_, &info_) != 0)
+    return false;
+
+  size_t len = (size_t)info_.st_size;
+  if (len == 0 || len % SSLTICKETKEYS_KEY_SIZE)
+    return false;
+  if (len > SSLTICKETKEYS_MAX_KEYS * SSLTICKETKEYS_KEY_SIZE)
+    len = SSLTICKETKEYS_MAX_KEYS * SSLTICKETKEYS_KEY_SIZE;
+
+  unsigned char buf[SSLTICKETKEYS_MAX_KEYS * SSLTICKETKEYS_KEY_SIZE];
+  if (pread(fd_, buf, len, 0) != (ssize_t)len) {
+    OPENSSL_cleanse(buf, sizeof(buf));
+    return false;
+  }
+
+  keys_.resize(len / SSLTICKETKEYS_KEY_SIZE);
+  memcpy(&keys_[0], buf, len);
+  OPENSSL_cleanse(buf, sizeof(buf));
+
+  return true;
+}
+
+// Routine to generate a new current key, retiring the old current key.
+bool SSLTicketKeys::WriteNewKey(void) {
+  struct ssl_ticket_key keys[2];
+  size_t num_keys = (keys_.size() > 0) ? 2 : 1;
+
+  if (RAND_bytes((unsigned char*)&keys[0], sizeof(keys[0])) <= 0)
+    return false;
+  if (num_keys > 1)
+    keys[1] = keys_[0];
+
+  // Overwrite the keys in place, then trim anything left over, so
+  // the file is never empty (or short) if we fail part way.
+  size_t len = num_keys * sizeof(struct ssl_ticket_key);
+  bool ok = (pwrite(fd_, keys, len, 0) == (ssize_t)len &&
+             ftruncate(fd_, len) == 0 &&
+             fstat(fd_, &info_) == 0);
+  if (ok)
+    keys_.assign(keys, keys + num_keys);
+  OPENSSL_cleanse(keys, sizeof(keys));
+
+  return ok;
+}
+
+// Routine to re-open our key file if it was rename(2)'d over.
+void SSLTicketKeys::ReopenIfReplaced(void) {
+  if (!own_fd_ || path_.size() == 0)
+    return;
+
+  struct stat info;
+  if (stat(path_.c_str(), &info) != 0 || info.st_ino == info_.st_ino)
+    return;
+
+  int fd = open(path_.c_str(), O_RDWR);
+  if (fd < 0)
+    return;  // stick with what we have
+
+  close(fd_);
+  fd_ = fd;
+  memset(&info_, 0, sizeof(info_));  // force a re-read
+}
+
+// Boolean checks.
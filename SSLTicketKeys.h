@@ -0,0 +1,205 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+
+#ifndef _SSLTICKETKEYS_H_
+#define _SSLTICKETKEYS_H_
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <pthread.h>
+#include <time.h>
+
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ErrorHandler.h"
+
+
+// Forward declarations (used if only needed for member function parameters).
+
+// Non-class specific defines & data structures.
+#define SSLTICKETKEYS_NAME_SIZE 16
+#define SSLTICKETKEYS_HMAC_KEY_SIZE 32
+#define SSLTICKETKEYS_AES_KEY_SIZE 32
+#define SSLTICKETKEYS_KEY_SIZE (SSLTICKETKEYS_NAME_SIZE + \
+                                SSLTICKETKEYS_HMAC_KEY_SIZE + \
+                                SSLTICKETKEYS_AES_KEY_SIZE)  // 80 bytes
+#define SSLTICKETKEYS_MAX_KEYS 16      // most keys we'll read from a file
+#define SSLTICKETKEYS_CHECK_INTERVAL 1  // secs between looks at the file
+
+#define SSLTICKETKEYS_DEFAULT_ROTATE_INTERVAL (60 * 60 * 12)  // 12 hours
+#define SSLTICKETKEYS_DEFAULT_GRACE_PERIOD (60 * 60 * 12)
+
+// A session-ticket key, laid out as it is stored on disk (this is
+// the same 80 byte format nginx's ssl_session_ticket_key uses).
+struct ssl_ticket_key {
+  unsigned char name[SSLTICKETKEYS_NAME_SIZE];
+  unsigned char hmac_key[SSLTICKETKEYS_HMAC_KEY_SIZE];
+  unsigned char aes_key[SSLTICKETKEYS_AES_KEY_SIZE];
+};
+
+// Non-class specific utilities.
+
+
+/** Class for sharing TLS session-ticket keys between processes.
+ *
+ *  A session ticket is encrypted with a key that only the issuing
+ *  server knows, so if we run multiple server processes behind one
+ *  port, each with OpenSSL's own (random) keys, a client will only
+ *  resume if it happens to hit the process that issued its ticket.
+ *  SSLTicketKeys keeps the keys in a file (or a memfd(2) inherited
+ *  across fork(2)), which all the processes read.
+ *
+ *  The file is a list of 80 byte keys.  The first key is the
+ *  *current* key, which is used to issue tickets, any remaining keys
+ *  are previous keys, which are still accepted for grace_period
+ *  seconds after the file was last written (i.e., after they were
+ *  retired).  Once the current key is older than rotate_interval,
+ *  the first process to notice generates a new key and rewrites the
+ *  file (while holding a fcntl(2) write lock), the rest simply
+ *  re-read it (under a read lock).  The locks are per-process, so
+ *  they work for workers sharing an inherited descriptor, too.  A
+ *  rotate_interval of 0 disables rotation, e.g., if the file is
+ *  managed by an external tool.
+ *
+ *  An SSLTicketKeys object can be shared by any number of SSLContext
+ *  objects (see SSLContext::set_ticket_keys()), and is thread-safe.
+ *
+ *  RCSID: $Id: $
+ *
+ *  @see SSLContext
+ *  @author Andrew K. Adams <akadams@psc.edu>
+ */
+class SSLTicketKeys {
+ public:
+  /** Constructor.
+   *
+   */
+  SSLTicketKeys(void);
+
+  /** Destructor.
+   *
+   */
+  virtual ~SSLTicketKeys(void);
+
+  // Accessors.
+  int fd(void) const { return fd_; }
+  size_t num_keys(void) const;
+  time_t rotated(void) const;
+
+  // Mutators.
+
+  // SSLTicketKeys manipulation.
+
+  /** Routine to initialize our keys from a (shared) file.
+   *
+   *  The file is created (with a fresh key) if it does not exist.
+   *  Note, if the file is replaced (i.e., rename(2)'d over) we will
+   *  notice and re-open it.  This routine can set an ErrorHandler
+   *  event if it encounters an unrecoverable error.
+   *
+   *  @see ErrorHandler
+   *  @param path a char* of the key file
+   *  @param rotate_interval a time_t of seconds between rotations
+   *  @param grace_period a time_t of seconds to accept retired keys
+   */
+  void Init(const char* path, const time_t rotate_interval,
+            const time_t grace_period);
+
+  /** Routine to initialize our keys from an open file descriptor.
+   *
+   *  Used with a descriptor that is shared between processes, e.g., a
+   *  memfd_create(2) made by a parent before it fork(2)s its workers.
+   *  If the file is empty, a fresh key is written to it.  Note, we do
+   *  not take ownership of fd.  This routine can set an ErrorHandler
+   *  event if it encounters an unrecoverable error.
+   *
+   *  @see ErrorHandler
+   *  @param fd an int of an open (read-write) file descriptor
+   *  @param rotate_interval a time_t of seconds between rotations
+   *  @param grace_period a time_t of seconds to accept retired keys
+   */
+  void Init(const int fd, const time_t rotate_interval,
+            const time_t grace_period);
+
+  /** Routine to pick up changes to the key file.
+   *
+   *  Re-reads the file if it has changed and rotates the keys if our
+   *  current key has expired.  This is called (at most every
+   *  SSLTICKETKEYS_CHECK_INTERVAL seconds) from TicketKeyCallback(),
+   *  but can also be called from a timer in the event-loop.
+   */
+  void Refresh(void);
+
+  /** Routine to replace the current key with a newly generated one.
+   *
+   *  The current key becomes the (only) previous key.  Note, this
+   *  routine can set an ErrorHandler event if it encounters an
+   *  unrecoverable error.
+   *
+   *  @see ErrorHandler
+   */
+  void Rotate(void);
+
+  /** Routine to set up a ticket's cipher and MAC.
+   *
+   *  Implements the SSL_CTX_set_tlsext_ticket_key_evp_cb(3) callback.
+   *  Tickets are always issued under the current key, and decrypting
+   *  one always asks OpenSSL to issue a fresh ticket.
+   *
+   *  @return 1 on (encrypt) success, 2 on (decrypt) success, 0 if we
+   *  have no key to use, or -1 on error
+   */
+  int TicketKeyCallback(unsigned char* key_name, unsigned char* iv,
+                        EVP_CIPHER_CTX* cipher_ctx, EVP_MAC_CTX* mac_ctx,
+                        const int enc);
+
+  // Boolean checks.
+
+  // Flags.
+
+ protected:
+  // Data members.
+  string path_;                 // key file, if we opened it
+  int fd_;                      // key file descriptor (may be shared)
+  bool own_fd_;                 // true if we opened fd_
+  time_t rotate_interval_;      // 0 disables rotation
+  time_t grace_period_;
+
+  vector<struct ssl_ticket_key> keys_;  // keys_[0] is the current key
+  struct stat info_;            // fstat(2) of the file when loaded
+  time_t checked_;              // last time we looked at the file
+  mutable pthread_mutex_t keys_mtx_;  // lock for all of the above
+
+ private:
+  /** Routine to (re-)load keys_ from the key file.
+   *
+   *  Note, expects keys_mtx_ to be held and the file to be locked.
+   */
+  bool ReadKeys(void);
+
+  /** Routine to write a new current key (followed by the old one).
+   *
+   *  Note, expects keys_mtx_ to be held and the file to be
+   *  write-locked.
+   */
+  bool WriteNewKey(void);
+
+  /** Routine to re-open path_ if it was replaced.
+   *
+   */
+  void ReopenIfReplaced(void);
+
+  // Dummy declarations for copy constructor and assignment & equality operator.
+  SSLTicketKeys(const SSLTicketKeys& src);
+  SSLTicketKeys& operator =(const SSLTicketKeys& src);
+  int operator ==(const SSLTicketKeys& other) const;
+};
+
+
+#endif  /* #ifndef _SSLTICKETKEYS_H_ */
@@ -8,6 +8,8 @@
 #include <errno.h>
 #include <unistd.h>
 
+#include <utility>       // for std::move
+
 #include "Logger.h"
 #include "TCPConn.h"
 
@@ -60,6 +62,35 @@ TCPConn& TCPConn::operator =(const TCPConn& src) {
   return *this;
 }
 
+// Move constructor and assignment.
+TCPConn::TCPConn(TCPConn&& src) noexcept
+    : IPComm(std::move(src)) {
+#if DEBUG_CLASS
+  warnx("TCPConn::TCPConn(TCPConn&&) called.");
+#endif
+  
+  connected_ = src.connected_;
+  listening_ = src.listening_;
+  src.connected_ = false;
+  src.listening_ = false;
+}
+
+TCPConn& TCPConn::operator =(TCPConn&& src) noexcept {
+#if DEBUG_CLASS
+  warnx("TCPConn::operator =(TCPConn&&) called.");
+#endif
+
+  connected_ = src.connected_;
+  listening_ = src.listening_;
+  IPComm::operator =(std::move(src));
+  if (this != &src) {
+    src.connected_ = false;
+    src.listening_ = false;
+  }
+
+  return *this;
+}
+
 // Overloaded operator: equality functions.
 int TCPConn::operator ==(const TCPConn& other) const {
 #if DEBUG_CLASS
@@ -376,11 +407,55 @@ void TCPConn::Accept(TCPConn* client) const {
       return;
   }
 
+  AcceptFinish(client, peer_fd);
+  if (error.Event())
+    error.AppendMsg("TCPConn::Accept(): ");
+}
+
+// Routine to take over a connection that was accept(2)ed for us on
+// our socket, e.g., by IOUring::Accept(), filling in the peer's
+// sockaddr via getpeername(2).
+//
+// Note, this routine can set an ErrorHandler event.
+void TCPConn::Accept(TCPConn* client, const int peer_fd) const {
+  if (peer_fd < 0) {
+    error.Init(EX_IOERR, "TCPConn::Accept(): accept(): %s",
+               strerror(-peer_fd));  // e.g., an IOUring cqe.res
+    return;
+  }
+
+  socklen_t len = sizeof(client->sockaddr_);
+  if (getpeername(peer_fd, (struct sockaddr*)&client->sockaddr_, &len) < 0) {
+    error.Init(EX_IOERR, "TCPConn::Accept(): getpeername(%d) failed: %s",
+               peer_fd, strerror(errno));
+    close(peer_fd);
+    return;
+  }
+  client->IPComm::set_address_family(client->sockaddr_.in_.sin_family);
+
+  AcceptFinish(client, peer_fd);
+  if (error.Event())
+    error.AppendMsg("TCPConn::Accept(): ");
+}
+
+// Routine to install peer_fd (and our blocking mode) in client, once
+// its sockaddr has been set.
+//
+// Note, this routine can set an ErrorHandler event.
+void TCPConn::AcceptFinish(TCPConn* client, const int peer_fd) const {
   client->set_fd(peer_fd);
   client->connected_ = true;
 
-  if (!IsBlocking())
-    client->set_nonblocking();
+  // Note, accept(2) does not pass O_NONBLOCK on to the new socket
+  // (on Linux), so setting the flag is not enough.
+
+  if (!IsBlocking()) {
+    client->set_socket_nonblocking();
+    if (error.Event()) {
+      error.AppendMsg("TCPConn::AcceptFinish(): ");
+      return;
+    }
+  }
 
   client->IPComm::ResolveDNSName(IPCOMM_DNS_RETRY_CNT);  // resolve peer's name
 
@@ -573,8 +648,8 @@ ssize_t TCPConn::ReadExhaustive(const ssize_t buf_len, char* buf,
 
   bytes_read = buf_len - bytes_left;
 
-  _LOGGER(LOG_INFO, "Read %d byte(s) from: %s.",
-          bytes_read, hostname().c_str());
+  _LOGGER_LIMITED(LOG_INFO, "Read %d byte(s) from: %s.",
+                  bytes_read, hostname().c_str());
 
   return bytes_read;
 }
@@ -637,8 +712,8 @@ ssize_t TCPConn::ReadLine(const char delimiter, const ssize_t buf_len,
   *ptr = '\0';
 
   if (bytes_read) {
-    _LOGGER(LOG_INFO, "Read %d byte(s) from: %s.",
-            bytes_read, hostname().c_str());
+    _LOGGER_LIMITED(LOG_INFO, "Read %d byte(s) from: %s.",
+                    bytes_read, hostname().c_str());
 
     _LOGGER(LOG_DEBUG, "TCPConn::ReadLine(): read: %s.", buf);
   }
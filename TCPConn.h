@@ -70,6 +70,18 @@ class TCPConn : public IPComm {
    */
   TCPConn& operator =(const TCPConn& src);
 
+  /** Move Constructor.
+   *
+   *  @see IPComm(IPComm&&)
+   */
+  TCPConn(TCPConn&& src) noexcept;
+
+  /** Move Assignment Operator.
+   *
+   *  @see IPComm::operator =(IPComm&&)
+   */
+  TCPConn& operator =(TCPConn&& src) noexcept;
+
   /** Equality Operator.
    *
    *  The equality operator is needed for *some* data methods for
@@ -250,6 +262,19 @@ class TCPConn : public IPComm {
    */
   TCPConn Accept(void) const;
 
+  /** Routine to set up a TCPConn object from a connection that was
+   *  accept(2)ed for us on our socket, e.g., by IOUring::Accept().
+   *
+   *  The peer's address is filled in via getpeername(2).  Note, this
+   *  routine will set an ErrorHandler event if it encounters an
+   *  unrecoverable error.
+   *
+   *  @see ErrorHandler
+   *  @param peer a TCPConn* to hold the new socket
+   *  @param peer_fd an int descriptor (or -errno, if the accept failed)
+   */
+  void Accept(TCPConn* peer, const int peer_fd) const;
+
   /** Routine to close(2) a connected socket.
    *
    *  We simply call IPComm::Close() to get the work done.
@@ -367,6 +392,8 @@ class TCPConn : public IPComm {
   bool listening_;       // flag to show that we are in a *listen* state
 
  private:
+  void AcceptFinish(TCPConn* client, const int peer_fd) const;
+
   // Dummy declarations for copy constructor and assignment & equality operator.
 
   // Since we're dervived from IPComm, we need to prevent someone from
@@ -4,12 +4,19 @@
 // See the file 'COPYRIGHT.txt' for any restrictions.
 
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>         // for splice(2)
+#include <sys/mman.h>      // for mmap(2)
+#include <sys/stat.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>        // for lseek(2)
+#include <unistd.h>        // for pread(2)
+
+#include <utility>       // for std::move
 
 #include "ErrorHandler.h"
 #include "Logger.h"
+#include "FileCache.h"
 
 #include "TCPSession.h"
 
@@ -26,6 +33,244 @@ uint16_t unique_session_id = 65;  // start at least 6 bits over
 
 // Non-class specific utilities.
 
+// Routine to drop a reference to a session_file_io, freeing it (and
+// anything its operations left behind) with the last one.
+static void session_file_io_unref(struct session_file_io* state) {
+  pthread_mutex_lock(&state->mtx);
+  bool last = (--state->refs == 0);
+  pthread_mutex_unlock(&state->mtx);
+  if (!last)
+    return;
+
+  if (state->open_fd >= 0)
+    close(state->open_fd);
+  if (state->buf != NULL)
+    free(state->buf);
+  for (list<struct session_direct_chunk>::iterator chunk =
+           state->chunks.begin(); chunk != state->chunks.end(); chunk++)
+    state->pool->Put(chunk->buf);
+  if (state->stage != NULL)
+    state->pool->Put(state->stage);
+  pthread_mutex_destroy(&state->mtx);
+  delete state;
+}
+
+// AsyncFileIO callback for a chunk of message-body written to rfile_.
+static void session_file_io_wrote(const struct file_io_op& op, void* arg) {
+  struct session_file_io* state = (struct session_file_io*)arg;
+  free(op.buf);
+
+  pthread_mutex_lock(&state->mtx);
+  state->writes--;
+  if (op.ret < 0 && state->write_err == 0)
+    state->write_err = op.err;
+  pthread_mutex_unlock(&state->mtx);
+
+  session_file_io_unref(state);
+}
+
+// AsyncFileIO callback for an outgoing message's file being opened.
+static void session_file_io_opened(const struct file_io_op& op, void* arg) {
+  struct session_file_io* state = (struct session_file_io*)arg;
+
+  pthread_mutex_lock(&state->mtx);
+  state->reading = false;
+  if (state->read_gen != state->gen) {
+    if (op.ret >= 0)
+      close(op.ret);  // that message is gone
+  } else if (op.ret < 0) {
+    state->read_err = op.err;
+  } else {
+    state->open_fd = op.ret;
+  }
+  pthread_mutex_unlock(&state->mtx);
+
+  session_file_io_unref(state);
+}
+
+// AsyncFileIO callback for a chunk of an outgoing message's file read.
+static void session_file_io_read(const struct file_io_op& op, void* arg) {
+  struct session_file_io* state = (struct session_file_io*)arg;
+
+  pthread_mutex_lock(&state->mtx);
+  state->reading = false;
+  if (state->read_gen == state->gen) {
+    if (op.ret <= 0)
+      state->read_err = (op.ret < 0) ? op.err : EIO;  // EOF is too early
+    else
+      state->buf_len = op.ret;
+  }
+  pthread_mutex_unlock(&state->mtx);
+
+  session_file_io_unref(state);
+}
+
+// AsyncFileIO callback for a (direct I/O) chunk of message-body
+// written to rfile_.
+static void session_file_io_direct_wrote(const struct file_io_op& op,
+                                         void* arg) {
+  struct session_file_io* state = (struct session_file_io*)arg;
+  state->pool->Put(op.buf);
+
+  pthread_mutex_lock(&state->mtx);
+  state->writes--;
+  if (op.ret < 0 && state->write_err == 0)
+    state->write_err = op.err;
+  pthread_mutex_unlock(&state->mtx);
+
+  session_file_io_unref(state);
+}
+
+// AsyncFileIO callback for a (direct I/O) chunk of an outgoing
+// message's file read.  If that message is gone, so is the chunk.
+static void session_file_io_direct_read(const struct file_io_op& op,
+                                        void* arg) {
+  struct session_file_io* state = (struct session_file_io*)arg;
+
+  pthread_mutex_lock(&state->mtx);
+  state->chunk_reads--;
+  for (list<struct session_direct_chunk>::iterator chunk =
+           state->chunks.begin(); chunk != state->chunks.end(); chunk++) {
+    if (chunk->buf != op.buf)
+      continue;
+
+    if (chunk->gen != state->gen) {
+      state->pool->Put(chunk->buf);
+      state->chunks.erase(chunk);
+    } else if (op.ret < 0) {
+      chunk->len = 0;
+      state->read_err = op.err;
+    } else {
+      chunk->len = op.ret;
+    }
+    break;
+  }
+  pthread_mutex_unlock(&state->mtx);
+
+  session_file_io_unref(state);
+}
+
+// Routine to drop a reference to a session_io_uring, freeing it with
+// the last one.
+static void session_io_uring_unref(struct session_io_uring* state) {
+  if (--state->refs > 0)
+    return;
+
+  if (state->slot >= 0)
+    state->ring->PutSlot(state->slot);
+  if (state->rdata != NULL)
+    free(state->rdata);
+  delete state;
+}
+
+// IOUring callback for each chunk our multishot recv receives.  We
+// copy it out, so the receive buffer can go straight back to the
+// kernel, and if we're holding more than Read() has been taking,
+// stop receiving for a while (see ReadIOUring()).
+static void session_io_uring_recv(const struct io_uring_cqe& cqe, void* arg) {
+  struct session_io_uring* state = (struct session_io_uring*)arg;
+
+  if (cqe.res > 0) {
+    const char* buf = state->ring->recv_buf(cqe);
+    size_t len = cqe.res;
+    if (state->rdata_len + len > state->rdata_size) {
+      size_t size = state->rdata_len + len;
+      char* p = (char*)realloc(state->rdata, size);
+      if (p == NULL) {
+        state->recv_err = ENOMEM;
+        len = 0;
+      } else {
+        state->rdata = p;
+        state->rdata_size = size;
+      }
+    }
+    if (buf != NULL && len > 0) {
+      memcpy(state->rdata + state->rdata_len, buf, len);
+      state->rdata_len += len;
+    }
+    state->ring->ReturnRecvBuf(cqe);
+
+    if (state->rdata_len >= TCPSESSION_IO_URING_MAX_RDATA &&
+        state->rdata_len - len < TCPSESSION_IO_URING_MAX_RDATA &&
+        (cqe.flags & IORING_CQE_F_MORE))
+      state->ring->Cancel(state->recv);
+  } else if (cqe.res == 0) {
+    state->eof = true;
+  } else if (cqe.res != -ECANCELED && cqe.res != -ENOBUFS) {
+    state->recv_err = -cqe.res;  // -ENOBUFS just needs requeueing
+  }
+
+  if (!(cqe.flags & IORING_CQE_F_MORE)) {
+    state->recv = NULL;
+    session_io_uring_unref(state);
+  }
+}
+
+// IOUring callback for the file read linked ahead of a write.  If it
+// comes up short, the kernel cancels the write.
+static void session_io_uring_read(const struct io_uring_cqe& cqe, void* arg) {
+  struct session_io_uring* state = (struct session_io_uring*)arg;
+
+  if (state->send_gen == state->gen && state->send_err == 0 &&
+      (cqe.res < 0 || (size_t)cqe.res < state->send_len))
+    state->send_err = (cqe.res < 0) ? -cqe.res : EIO;  // EOF is too early
+
+  if (--state->sends == 0 && state->slot >= 0) {
+    state->ring->PutSlot(state->slot);
+    state->slot = -1;
+  }
+  session_io_uring_unref(state);
+}
+
+// IOUring callback for a write of (some of) our outgoing message.
+static void session_io_uring_wrote(const struct io_uring_cqe& cqe,
+                                   void* arg) {
+  struct session_io_uring* state = (struct session_io_uring*)arg;
+
+  if (state->send_gen == state->gen) {
+    if (cqe.res >= 0)
+      state->sent = cqe.res;
+    else if (state->send_err == 0)
+      state->send_err = -cqe.res;
+  }
+
+  if (--state->sends == 0 && state->slot >= 0) {
+    state->ring->PutSlot(state->slot);
+    state->slot = -1;
+  }
+  session_io_uring_unref(state);
+}
+
+// Routine to drop a reference to a session_durability, freeing it
+// (and any messages the session never popped) with the last one.
+static void session_durability_unref(struct session_durability* state) {
+  pthread_mutex_lock(&state->mtx);
+  bool last = (--state->refs == 0);
+  pthread_mutex_unlock(&state->mtx);
+  if (!last)
+    return;
+
+  for (list<struct session_durable_msg*>::iterator msg = state->msgs.begin();
+       msg != state->msgs.end(); msg++)
+    delete *msg;
+  pthread_mutex_destroy(&state->mtx);
+  delete state;
+}
+
+// DurabilitySyncer callback for a received file-body being synced.
+static void session_durability_synced(const struct durability_op& op,
+                                      void* arg) {
+  struct session_durable_msg* msg = (struct session_durable_msg*)arg;
+  struct session_durability* state = msg->state;
+
+  pthread_mutex_lock(&state->mtx);
+  msg->synced = true;
+  msg->err = (op.ret < 0) ? op.err : 0;
+  pthread_mutex_unlock(&state->mtx);
+
+  session_durability_unref(state);
+}
+
 // Template Class.
 
 // Constructors and destructor.
@@ -43,8 +288,28 @@ TCPSession::TCPSession(const uint8_t framing_type)
   rbuf_ = NULL;
   rbuf_size_ = 0;
   rbuf_len_ = 0;
+  rbuf_early_len_ = 0;
   memset(&rpending_, 0, sizeof(rpending_));
   rpending_.storage_initialized = false;
+  splice_rfile_ = false;
+  splice_fds_[0] = splice_fds_[1] = -1;
+  mmap_wfile_ = false;
+  wmap_ = NULL;
+  wmap_offset_ = 0;
+  wmap_len_ = 0;
+  write_behind_ = 0;
+  rfile_behind_ = 0;
+  wfile_behind_ = -1;
+  file_io_ = NULL;
+  file_io_state_ = NULL;
+  io_uring_ = NULL;
+  io_uring_state_ = NULL;
+  direct_io_ = NULL;
+  durability_ = NULL;
+  durability_state_ = NULL;
+  spool_threshold_ = 0;
+  spool_dir_ = TCPSESSION_SPOOL_DIR;
+  spool_len_ = 0;
   rtid_ = TCPSESSION_THREAD_NULL;
   wbuf_ = NULL;
   wbuf_size_ = 0;
@@ -63,6 +328,18 @@ TCPSession::~TCPSession(void) {
     free((void*)rbuf_);
   if (wbuf_)
     free((void*)wbuf_);
+  CloseSplicePipe();
+  UnmapWfile();
+  if (file_io_state_ != NULL)
+    session_file_io_unref(file_io_state_);
+  if (io_uring_state_ != NULL) {
+    // Our recv holds on to the socket until it's canceled.
+    if (io_uring_state_->recv != NULL)
+      io_uring_state_->ring->Cancel(io_uring_state_->recv);
+    session_io_uring_unref(io_uring_state_);
+  }
+  if (durability_state_ != NULL)
+    session_durability_unref(durability_state_);
 
   pthread_mutex_destroy(&incoming_mtx);
   pthread_mutex_destroy(&outgoing_mtx);
@@ -79,6 +356,26 @@ TCPSession::TCPSession(const TCPSession& src)
   rbuf_ = NULL;
   rbuf_size_ = 0;
   rbuf_len_ = 0;
+  rbuf_early_len_ = 0;
+  splice_rfile_ = src.splice_rfile_;
+  splice_fds_[0] = splice_fds_[1] = -1;  // copies make their own pipe
+  mmap_wfile_ = src.mmap_wfile_;
+  wmap_ = NULL;  // ... and mapping
+  wmap_offset_ = 0;
+  wmap_len_ = 0;
+  write_behind_ = src.write_behind_;
+  rfile_behind_ = src.rfile_behind_;
+  wfile_behind_ = src.wfile_behind_;
+  file_io_ = src.file_io_;
+  file_io_state_ = NULL;  // ... and their own file I/O state
+  io_uring_ = src.io_uring_;
+  io_uring_state_ = NULL;  // ... and IOUring state
+  direct_io_ = src.direct_io_;
+  durability_ = src.durability_;
+  durability_state_ = NULL;  // ... and durable messages
+  spool_threshold_ = src.spool_threshold_;
+  spool_dir_ = src.spool_dir_;
+  spool_len_ = 0;  // ... and spool
   wbuf_ = NULL;
   wbuf_size_ = 0;
   wbuf_len_ = 0;
@@ -116,6 +413,7 @@ TCPSession::TCPSession(const TCPSession& src)
   if (src.rbuf_len_) {
     memcpy(rbuf_, src.rbuf_, src.rbuf_len_);
     rbuf_len_ = src.rbuf_len_;
+    rbuf_early_len_ = src.rbuf_early_len_;
   }
 
   memcpy(&rpending_, &src.rpending_, sizeof(rpending_));
@@ -129,11 +427,182 @@ TCPSession::TCPSession(const TCPSession& src)
     wbuf_len_ = src.wbuf_len_;
   }
 
+  // src punches holes in (and restarts) its spool as its messages are
+  // popped, so we can't send ours from it.
+  if (src.spool_.IsOpen())
+    CopySpooledMsgs(src);
+
   // Copies get their own MUTEXs.
   pthread_mutex_init(&incoming_mtx, NULL);
   pthread_mutex_init(&outgoing_mtx, NULL);
 }
 
+// Move constructor and assignment.  Rather than malloc(3) & copy our
+// buffers (as the copy constructor must), we take over src's buffers,
+// queues and connection.  src is left with no buffers.
+TCPSession::TCPSession(TCPSession&& src) noexcept
+    : SSLConn(std::move(src)), rfile_(std::move(src.rfile_)), 
+      rhdr_(std::move(src.rhdr_)), spool_(std::move(src.spool_)),
+      wfiles_(std::move(src.wfiles_)), wpending_(std::move(src.wpending_)),
+      whdrs_(std::move(src.whdrs_)) {
+#if DEBUG_CLASS
+  warnx("TCPSession::TCPSession(TCPSession&&) called.");
+#endif
+
+  framing_type_ = src.framing_type_;
+  handle_ = src.handle_;
+  timeout_ = src.timeout_;
+  synchronize_connection_ = src.synchronize_connection_;
+  synchronize_status_ = src.synchronize_status_;
+
+  rbuf_ = src.rbuf_;
+  rbuf_size_ = src.rbuf_size_;
+  rbuf_len_ = src.rbuf_len_;
+  rbuf_early_len_ = src.rbuf_early_len_;
+  memcpy(&rpending_, &src.rpending_, sizeof(rpending_));
+  rtid_ = src.rtid_;
+  splice_rfile_ = src.splice_rfile_;
+  splice_fds_[0] = src.splice_fds_[0];
+  splice_fds_[1] = src.splice_fds_[1];
+  mmap_wfile_ = src.mmap_wfile_;
+  wmap_ = src.wmap_;
+  wmap_offset_ = src.wmap_offset_;
+  wmap_len_ = src.wmap_len_;
+  write_behind_ = src.write_behind_;
+  rfile_behind_ = src.rfile_behind_;
+  wfile_behind_ = src.wfile_behind_;
+  file_io_ = src.file_io_;
+  file_io_state_ = src.file_io_state_;
+  io_uring_ = src.io_uring_;
+  io_uring_state_ = src.io_uring_state_;
+  direct_io_ = src.direct_io_;
+  durability_ = src.durability_;
+  durability_state_ = src.durability_state_;
+  spool_threshold_ = src.spool_threshold_;
+  spool_dir_ = src.spool_dir_;
+  spool_len_ = src.spool_len_;
+
+  wbuf_ = src.wbuf_;
+  wbuf_size_ = src.wbuf_size_;
+  wbuf_len_ = src.wbuf_len_;
+
+  src.rbuf_ = NULL;
+  src.rbuf_size_ = 0;
+  src.rbuf_len_ = 0;
+  src.rbuf_early_len_ = 0;
+  src.wbuf_ = NULL;
+  src.wbuf_size_ = 0;
+  src.wbuf_len_ = 0;
+  memset(&src.rpending_, 0, sizeof(src.rpending_));
+  src.splice_fds_[0] = src.splice_fds_[1] = -1;
+  src.wmap_ = NULL;
+  src.wmap_len_ = 0;
+  src.file_io_state_ = NULL;
+  src.io_uring_state_ = NULL;
+  src.durability_state_ = NULL;
+  src.spool_len_ = 0;
+
+  // MUTEXs can't be moved, we get our own.
+  pthread_mutex_init(&incoming_mtx, NULL);
+  pthread_mutex_init(&outgoing_mtx, NULL);
+}
+
+TCPSession& TCPSession::operator =(TCPSession&& src) noexcept {
+#if DEBUG_CLASS
+  warnx("TCPSession::operator =(TCPSession&&) called.");
+#endif
+
+  if (this == &src)
+    return *this;
+
+  SSLConn::operator =(std::move(src));
+
+  framing_type_ = src.framing_type_;
+  handle_ = src.handle_;
+  timeout_ = src.timeout_;
+  synchronize_connection_ = src.synchronize_connection_;
+  synchronize_status_ = src.synchronize_status_;
+
+  // Swap buffers with src, so our old ones get free(3)'d when src is
+  // destroyed.
+
+  char* tmp_buf = rbuf_;
+  ssize_t tmp_size = rbuf_size_;
+  rbuf_ = src.rbuf_;
+  rbuf_size_ = src.rbuf_size_;
+  rbuf_len_ = src.rbuf_len_;
+  rbuf_early_len_ = src.rbuf_early_len_;
+  src.rbuf_ = tmp_buf;
+  src.rbuf_size_ = tmp_size;
+  src.rbuf_len_ = 0;
+  src.rbuf_early_len_ = 0;
+
+  tmp_buf = wbuf_;
+  tmp_size = wbuf_size_;
+  wbuf_ = src.wbuf_;
+  wbuf_size_ = src.wbuf_size_;
+  wbuf_len_ = src.wbuf_len_;
+  src.wbuf_ = tmp_buf;
+  src.wbuf_size_ = tmp_size;
+  src.wbuf_len_ = 0;
+
+  // Likewise our splice(2) pipe.
+  splice_rfile_ = src.splice_rfile_;
+  for (int i = 0; i < 2; i++) {
+    int tmp_fd = splice_fds_[i];
+    splice_fds_[i] = src.splice_fds_[i];
+    src.splice_fds_[i] = tmp_fd;
+  }
+
+  // ... and our mapping of wfiles_.front().
+  mmap_wfile_ = src.mmap_wfile_;
+  char* tmp_map = wmap_;
+  off_t tmp_map_offset = wmap_offset_;
+  size_t tmp_map_len = wmap_len_;
+  wmap_ = src.wmap_;
+  wmap_offset_ = src.wmap_offset_;
+  wmap_len_ = src.wmap_len_;
+  src.wmap_ = tmp_map;
+  src.wmap_offset_ = tmp_map_offset;
+  src.wmap_len_ = tmp_map_len;
+
+  write_behind_ = src.write_behind_;
+  rfile_behind_ = src.rfile_behind_;
+  wfile_behind_ = src.wfile_behind_;
+  file_io_ = src.file_io_;
+  struct session_file_io* tmp_state = file_io_state_;
+  file_io_state_ = src.file_io_state_;
+  src.file_io_state_ = tmp_state;
+  io_uring_ = src.io_uring_;
+  struct session_io_uring* tmp_uring_state = io_uring_state_;
+  io_uring_state_ = src.io_uring_state_;
+  src.io_uring_state_ = tmp_uring_state;
+  direct_io_ = src.direct_io_;
+  durability_ = src.durability_;
+  struct session_durability* tmp_durability_state = durability_state_;
+  durability_state_ = src.durability_state_;
+  src.durability_state_ = tmp_durability_state;
+  spool_threshold_ = src.spool_threshold_;
+  spool_dir_ = src.spool_dir_;
+  File tmp_spool(std::move(spool_));
+  spool_ = std::move(src.spool_);
+  src.spool_ = std::move(tmp_spool);
+  off_t tmp_spool_len = spool_len_;
+  spool_len_ = src.spool_len_;
+  src.spool_len_ = tmp_spool_len;
+
+  rfile_ = std::move(src.rfile_);
+  memcpy(&rpending_, &src.rpending_, sizeof(rpending_));
+  memset(&src.rpending_, 0, sizeof(src.rpending_));
+  rhdr_ = std::move(src.rhdr_);
+  rtid_ = src.rtid_;
+  wfiles_ = std::move(src.wfiles_);
+  wpending_ = std::move(src.wpending_);
+  whdrs_ = std::move(src.whdrs_);
+
+  return *this;
+}
+
 #if 0  // XXX
 TCPSession::operator =(const TCPSession& src) {
 #if DEBUG_CLASS
@@ -227,13 +696,27 @@ void TCPSession::set_rfile(const char* path, const ssize_t len) {
   rpending_.file_offset = 0;
   rpending_.storage = SESSION_USE_DISC;
   rpending_.storage_initialized = true;
+  rfile_behind_ = 0;
 
   rfile_.InitFromBuf(path, len);
 
   // TOOD(aka) Do we want O_APPEND here?
-  rfile_.Open(NULL, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP);
-  if (error.Event())
+  if (direct_io_ != NULL)
+    rfile_.OpenDirect(NULL, O_WRONLY | O_CREAT | O_TRUNC,
+                      S_IRUSR | S_IWUSR | S_IRGRP);
+  else
+    rfile_.Open(NULL, O_WRONLY | O_CREAT | O_TRUNC,
+                S_IRUSR | S_IWUSR | S_IRGRP);
+  if (error.Event()) {
     error.AppendMsg("TCPSession::set_rfile(): ");
+  } else if (rpending_.initialized && rpending_.body_len > 0) {
+    // We know how big the file will be, so reserve its space now,
+    // rather than growing it write by write.
+
+    rfile_.Allocate(rpending_.body_len);
+    if (error.Event())
+      error.AppendMsg("TCPSession::set_rfile(): ");
+  }
 
 #if DEBUG_MUTEX_LOCK
   warnx("TCPSession::set_rfile(): releasing incoming lock.");
@@ -271,6 +754,169 @@ void TCPSession::set_storage(const int storage) {
   pthread_mutex_unlock(&incoming_mtx);
 }
 
+// Routine to enable (or disable) splicing message-bodies to rfile_.
+void TCPSession::set_splice_rfile(const bool splice) {
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_splice_rfile(): requesting incoming lock.");
+#endif
+  pthread_mutex_lock(&incoming_mtx);
+
+  splice_rfile_ = splice;
+  if (!splice_rfile_)
+    CloseSplicePipe();
+
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_splice_rfile(): releasing incoming lock.");
+#endif
+  pthread_mutex_unlock(&incoming_mtx);
+}
+
+// Routine to enable (or disable) sending file-bodies from a mmap(2).
+void TCPSession::set_mmap_wfile(const bool mmap) {
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_mmap_wfile(): requesting outgoing lock.");
+#endif
+  pthread_mutex_lock(&outgoing_mtx);
+
+  mmap_wfile_ = mmap;
+  if (!mmap_wfile_)
+    UnmapWfile();
+
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_mmap_wfile(): releasing outgoing lock.");
+#endif
+  pthread_mutex_unlock(&outgoing_mtx);
+}
+
+// Routine to set the window of our page cache management, or 0.
+void TCPSession::set_write_behind(const size_t window) {
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_write_behind(): requesting incoming lock.");
+#endif
+  pthread_mutex_lock(&incoming_mtx);
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_write_behind(): requesting outgoing lock.");
+#endif
+  pthread_mutex_lock(&outgoing_mtx);
+
+  write_behind_ = window;
+
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_write_behind(): releasing outgoing lock.");
+#endif
+  pthread_mutex_unlock(&outgoing_mtx);
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_write_behind(): releasing incoming lock.");
+#endif
+  pthread_mutex_unlock(&incoming_mtx);
+}
+
+// Routine to set (or clear) the AsyncFileIO used for our disk I/O.
+void TCPSession::set_file_io(AsyncFileIO* file_io) {
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_file_io(): requesting incoming lock.");
+#endif
+  pthread_mutex_lock(&incoming_mtx);
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_file_io(): requesting outgoing lock.");
+#endif
+  pthread_mutex_lock(&outgoing_mtx);
+
+  file_io_ = file_io;
+
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_file_io(): releasing outgoing lock.");
+#endif
+  pthread_mutex_unlock(&outgoing_mtx);
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_file_io(): releasing incoming lock.");
+#endif
+  pthread_mutex_unlock(&incoming_mtx);
+}
+
+// Routine to set (or clear) the IOUring used for our socket I/O.
+void TCPSession::set_io_uring(IOUring* io_uring) {
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_io_uring(): requesting incoming lock.");
+#endif
+  pthread_mutex_lock(&incoming_mtx);
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_io_uring(): requesting outgoing lock.");
+#endif
+  pthread_mutex_lock(&outgoing_mtx);
+
+  io_uring_ = io_uring;
+
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_io_uring(): releasing outgoing lock.");
+#endif
+  pthread_mutex_unlock(&outgoing_mtx);
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_io_uring(): releasing incoming lock.");
+#endif
+  pthread_mutex_unlock(&incoming_mtx);
+}
+
+// Routine to set (or clear) the AlignedBufPool used for direct I/O.
+void TCPSession::set_direct_io(AlignedBufPool* pool) {
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_direct_io(): requesting incoming lock.");
+#endif
+  pthread_mutex_lock(&incoming_mtx);
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_direct_io(): requesting outgoing lock.");
+#endif
+  pthread_mutex_lock(&outgoing_mtx);
+
+  direct_io_ = pool;
+  if (direct_io_ != NULL && file_io_state_ != NULL) {
+    pthread_mutex_lock(&file_io_state_->mtx);
+    file_io_state_->pool = direct_io_;
+    pthread_mutex_unlock(&file_io_state_->mtx);
+  }
+
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_direct_io(): releasing outgoing lock.");
+#endif
+  pthread_mutex_unlock(&outgoing_mtx);
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_direct_io(): releasing incoming lock.");
+#endif
+  pthread_mutex_unlock(&incoming_mtx);
+}
+
+// Routine to set (or clear) the DurabilitySyncer for our rfile_s.
+void TCPSession::set_durability(DurabilitySyncer* syncer) {
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_durability(): requesting incoming lock.");
+#endif
+  pthread_mutex_lock(&incoming_mtx);
+
+  durability_ = syncer;
+
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_durability(): releasing incoming lock.");
+#endif
+  pthread_mutex_unlock(&incoming_mtx);
+}
+
+// Routine to set (or clear) when AddMsgBuf() spools to disk.
+void TCPSession::set_spool(const size_t threshold, const char* dir) {
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_spool(): requesting outgoing lock.");
+#endif
+  pthread_mutex_lock(&outgoing_mtx);
+
+  spool_threshold_ = threshold;
+  if (dir != NULL && strlen(dir) > 0 && !spool_.IsOpen())
+    spool_dir_ = dir;
+
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::set_spool(): releasing outgoing lock.");
+#endif
+  pthread_mutex_unlock(&outgoing_mtx);
+}
+
 // Routine to *erase* a specific MsgHdr from our list (whdrs_).
 void TCPSession::delete_whdr(const uint16_t msg_id) {
 #if DEBUG_MUTEX_LOCK
@@ -336,6 +982,7 @@ void TCPSession::Init(void) {
 
   rbuf_size_ = kDefaultBufSize;
   rbuf_len_ = 0;
+  rbuf_early_len_ = 0;
 
   if ((wbuf_ = (char*)malloc(kDefaultBufSize)) == NULL) {
     error.Init(EX_OSERR, "TCPSession::Init(): wbuf malloc(%d) failed", 
@@ -392,8 +1039,14 @@ bool TCPSession::InitIncomingMsg(void) {
     return false;  // not enough data or ErrorHandler event
   }
 
-  // If we made it here, we parsed the framing header, so remove the
-  // framing header from our buffer.  First, check the null-terminated
+  // If we made it here, we parsed the framing header.  If it started
+  // out as TLS early data, the message may be a replay, so note that
+  // before we shift the header out of rbuf_.
+
+  const bool early_data = (rbuf_early_len_ > 0);
+
+  // Now remove the framing header from our buffer.  First, check the
+  // null-terminated
   // chunked_msg_body to see if we were forced to slurp up the
   // message-body during our header parse.
 
@@ -404,10 +1057,10 @@ bool TCPSession::InitIncomingMsg(void) {
     // rest of the TCPSession library wants to operate on rbuf_ using
     // body_len in MsgHdr (MsgInfo).
   
-    _LOGGER(LOG_INFO, "TCPSession::InitIncomingMsg(): "
-            "Moving chunked data back to rbuf_: "
-            "chunked msg-body (%ld), bytes_used (%ld), rbuf_len (%ld).",
-            chunked_msg_body_len, bytes_used, rbuf_len_);
+    _LOGGER_LIMITED(LOG_INFO, "TCPSession::InitIncomingMsg(): "
+                    "Moving chunked data back to rbuf_: "
+                    "chunked msg-body (%ld), bytes_used (%ld), rbuf_len (%ld).",
+                    chunked_msg_body_len, bytes_used, rbuf_len_);
 
     memcpy(rbuf_, chunked_msg_body, chunked_msg_body_len);
 
@@ -437,6 +1090,7 @@ bool TCPSession::InitIncomingMsg(void) {
   rpending_.buf_offset = 0;
   rpending_.file_offset = 0;
   rpending_.storage = SESSION_USE_MEM;  // default storage
+  rpending_.early_data = early_data;
 
   // Note, we do *not* mark the storage type as initialized, we just
   // set it to the default type!
@@ -480,11 +1134,27 @@ bool TCPSession::AddMsgBuf(const char* framing_hdr, const ssize_t hdr_len,
 #endif
   pthread_mutex_lock(&outgoing_mtx);
 
+  // If we're already holding too much, the body goes to our spool
+  // (see set_spool()), and only the header to wbuf_.
+  const bool spool = (spool_threshold_ > 0 && body_len > 0 &&
+                      (size_t)(hdr_len + body_len + wbuf_len_) >
+                      spool_threshold_) ? true : false;
+  const ssize_t buf_len = spool ? hdr_len : hdr_len + body_len;
+  const off_t file_start = spool_len_;
+  if (spool && !SpoolMsgBody(msg_body, body_len)) {
+    error.AppendMsg("TCPSession::AddMsgBuf(): ");
+#if DEBUG_MUTEX_LOCK
+    warnx("TCPSession::AddMsgBuf(): releasing outgoing lock (-1).");
+#endif
+    pthread_mutex_unlock(&outgoing_mtx);
+    return false;
+  }
+
   // Make sure we have enough room for the msg header & body
-  if ((hdr_len + body_len + wbuf_len_) > wbuf_size_) {
-    _LOGGER(LOG_DEBUG, "TCPSession::AddMsgBuf(): reallocing wbuf_, msg_len (%ld) + current wlen (%ld) is greater than wbuf_size (%ld).", hdr_len + body_len, wbuf_len_, wbuf_size_);
+  if ((buf_len + wbuf_len_) > wbuf_size_) {
+    _LOGGER(LOG_DEBUG, "TCPSession::AddMsgBuf(): reallocing wbuf_, msg_len (%ld) + current wlen (%ld) is greater than wbuf_size (%ld).", buf_len, wbuf_len_, wbuf_size_);
 
-    ssize_t new_wbuf_size = hdr_len + body_len + wbuf_len_ + kDefaultBufSize;
+    ssize_t new_wbuf_size = buf_len + wbuf_len_ + kDefaultBufSize;
     char* p = (char*)realloc(wbuf_, new_wbuf_size);
     if (p == NULL) {
       // Set an ErrorHandler event and return.
@@ -503,22 +1173,29 @@ bool TCPSession::AddMsgBuf(const char* framing_hdr, const ssize_t hdr_len,
 
   // Build our message's meta-data info and add to our queue (wpending_).
   struct MsgInfo msg_info;
-  msg_info.storage = SESSION_USE_MEM;
+  msg_info.storage = spool ? SESSION_USE_DISC : SESSION_USE_MEM;
   msg_info.storage_initialized = true;
   msg_info.msg_id = whdr.msg_id();  // give message unique id
   msg_info.hdr_len = hdr_len;  // mark the size of our message header
   msg_info.body_len = body_len;  // mark the size of our message body
   msg_info.buf_offset = 0;  // what we've sent so far
-  msg_info.file_offset = 0;  // not used for this message
+  msg_info.file_offset = 0;  // what we've sent of a spooled body
+  msg_info.file_start = spool ? file_start : 0;
+  msg_info.idempotent = spool ? false : whdr.IsMsgIdempotent();  // 0-RTT?
+  msg_info.early_data = false;
   wpending_.push_back(msg_info);
 
   // Install the message header and message body in our outgoing
-  // buffer (wbuf_)
+  // buffer (wbuf_), or the spool in wfiles_.
 
   memcpy(wbuf_ + wbuf_len_, framing_hdr, hdr_len);  // install the hdr
   wbuf_len_ += hdr_len;  // aggregate buffer length
-  memcpy(wbuf_ + wbuf_len_, msg_body, body_len);  // install the body
-  wbuf_len_ += body_len;  // aggregate buffer length
+  if (spool) {
+    wfiles_.push_back(spool_);
+  } else {
+    memcpy(wbuf_ + wbuf_len_, msg_body, body_len);  // install the body
+    wbuf_len_ += body_len;  // aggregate buffer length
+  }
 
   // Finally, add a copy of our outgoing msg's framing header to
   // whdrs_, in-case we need to deal with a RESPONSE, i.e., we can
@@ -592,7 +1269,10 @@ bool TCPSession::AddMsgFile(const char* framing_hdr, const ssize_t hdr_len,
   msg_info.hdr_len = hdr_len;  // mark the size of our message header
   msg_info.body_len = body_len;  // mark the size of our message body
   msg_info.buf_offset = 0;  // what we've sent so far
-  msg_info.file_offset = 0;  // not used for this message
+  msg_info.file_offset = 0;  // what we've sent so far
+  msg_info.file_start = 0;  // the body is all of msg_body
+  msg_info.idempotent = false;  // we only send early data from wbuf_
+  msg_info.early_data = false;
   wpending_.push_back(msg_info);
 
   // Install the message header in our outgoing buffer and the file in
@@ -622,6 +1302,34 @@ bool TCPSession::AddMsgFile(const char* framing_hdr, const ssize_t hdr_len,
   return true;
 }
 
+// Routine to connect(2) to our peer, sending our first message as
+// TLS early data if that's safe.
+//
+// Note, this routine can set an ErrorHandler event.
+void TCPSession::Connect(void) {
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::Connect(): requesting outgoing lock.");
+#endif
+  pthread_mutex_lock(&outgoing_mtx);
+
+  // Note, the first message in wpending_ always starts at wbuf_.
+
+  if (wbuf_ != NULL && wpending_.size() > 0 && 
+      wpending_.front().storage == SESSION_USE_MEM &&
+      wpending_.front().idempotent && wpending_.front().buf_offset == 0)
+    set_early_data(wbuf_, 
+                   wpending_.front().hdr_len + wpending_.front().body_len);
+
+#if DEBUG_MUTEX_LOCK
+  warnx("TCPSession::Connect(): releasing outgoing lock.");
+#endif
+  pthread_mutex_unlock(&outgoing_mtx);
+
+  SSLConn::Connect();
+  if (error.Event())
+    error.AppendMsg("TCPSession::Connect(): ");
+}
+
 // Routine to read, via SSLConn::Read(), any data on the socket and
 // store in our internal buffer (rbuf_).
 //
@@ -649,8 +1357,26 @@ ssize_t TCPSession::Read(bool* eof) {
           rpending_.file_offset);
 #endif
 
-  // Call SSLConn::Read() to get the work done.
-  ssize_t bytes_read = 
+  // If the rest of a message-body streaming to disk is still on the
+  // socket, move it there without copying it through rbuf_ (unless
+  // our IOUring is already receiving it).
+
+  const bool use_io_uring = (io_uring_ != NULL && InitIOUring());
+  if (!use_io_uring && IsSpliceable()) {
+    ssize_t bytes_spliced = SpliceRfile(eof);
+    if (error.Event())
+      error.AppendMsg("TCPSession::Read(): ");
+#if DEBUG_MUTEX_LOCK
+    warnx("TCPSession::Read(): releasing incoming lock (splice).");
+#endif
+    pthread_mutex_unlock(&incoming_mtx);
+    return bytes_spliced;
+  }
+
+  // Call SSLConn::Read() (or our IOUring) to get the work done.
+  size_t early_data_read = SSLConn::early_data_read();
+  ssize_t bytes_read = use_io_uring ?
+      ReadIOUring(rbuf_size_ - rbuf_len_, rbuf_ + rbuf_len_, eof) :
       SSLConn::Read(rbuf_size_ - rbuf_len_, rbuf_ + rbuf_len_, eof);
   if (error.Event()) {
     error.AppendMsg("TCPSession::Read(): "
@@ -666,6 +1392,8 @@ ssize_t TCPSession::Read(bool* eof) {
   }
 
   rbuf_len_ += bytes_read;
+  if (SSLConn::early_data_read() > early_data_read)
+    rbuf_early_len_ += bytes_read;  // early data precedes all else
 
   // Resize rbuf_ if we're out of room.
   if (rbuf_len_ == rbuf_size_) {
@@ -753,23 +1481,74 @@ ssize_t TCPSession::Write(void) {
             "Enter: pending msg NULL.");
 #endif
 
+  // If our handshake is still in progress, finish it, then skip
+  // whatever the server accepted as early data (see Connect()).
+
+  if (handshake_state() != HANDSHAKE_NONE &&
+      handshake_state() != HANDSHAKE_COMPLETE &&
+      Handshake() != HANDSHAKE_COMPLETE) {
+    if (error.Event()) {
+      error.AppendMsg("TCPSession::Write(): ");
+      ResetWbuf();
+    }
+#if DEBUG_MUTEX_LOCK
+    warnx("TCPSession::Write(): releasing outgoing lock (0).");
+#endif
+    pthread_mutex_unlock(&outgoing_mtx);
+    return 0;
+  }
+  wpending_.front().buf_offset += TakeEarlyDataSent();
+
   // For convenience, make copies of readonly variables.
   const ssize_t hdr_len = wpending_.front().hdr_len;
   const ssize_t body_len = wpending_.front().body_len;
 
   ssize_t bytes_sent = 0;
 
-  if (wpending_.front().storage == SESSION_USE_MEM) {
-    // Message in within the internal memory buffer (wbuf_).
+  // If this is the start of a message, our SSLConn may want to go
+  // back to small TLS records (see SSLContext::set_record_sizing()).
 
-    //_LOGGER(LOG_DEBUG, "TCPSession::Write(): lengths_ is of size %d.", lengths_.size());
+  if (wpending_.front().buf_offset == 0 && record_sizing().per_msg)
+    ResetRecordSize();
 
-    ssize_t msg_len = hdr_len + body_len;  // message is all within wbuf_
+  // Once our file-body is open, hint the kernel about how we read it.
+  if (wpending_.front().storage == SESSION_USE_DISC)
+    AdviseWfile(false);
 
-    // Send the message out (header & body) using SSLConn::Write().
-    bytes_sent = 
-        SSLConn::Write(wbuf_ + wpending_.front().buf_offset, 
-                       msg_len - wpending_.front().buf_offset);
+  // If we have an IOUring, queue the next chunk there.  If it can't
+  // take it (or it's a file-body we read with direct I/O), we send it
+  // ourselves, below.
+
+  if (io_uring_ != NULL &&
+      (direct_io_ == NULL ||
+       wpending_.front().storage != SESSION_USE_DISC) && InitIOUring()) {
+    bytes_sent = WriteIOUring(hdr_len, body_len);
+    if (bytes_sent >= 0 || error.Event()) {
+      if (error.Event()) {
+        error.AppendMsg("TCPSession::Write(): ");
+        ResetWbuf();
+        bytes_sent = 0;
+      }
+#if DEBUG_MUTEX_LOCK
+      warnx("TCPSession::Write(): releasing outgoing lock (io_uring).");
+#endif
+      pthread_mutex_unlock(&outgoing_mtx);
+      return bytes_sent;
+    }
+    bytes_sent = 0;
+  }
+
+  if (wpending_.front().storage == SESSION_USE_MEM) {
+    // Message in within the internal memory buffer (wbuf_).
+
+    //_LOGGER(LOG_DEBUG, "TCPSession::Write(): lengths_ is of size %d.", lengths_.size());
+
+    ssize_t msg_len = hdr_len + body_len;  // message is all within wbuf_
+
+    // Send the message out (header & body) using SSLConn::Write().
+    bytes_sent = 
+        SSLConn::Write(wbuf_ + wpending_.front().buf_offset, 
+                       msg_len - wpending_.front().buf_offset);
     if (error.Event()) {
       error.AppendMsg("TCPSession::Write(): "
                       "wbuf_ %p, wbuf_len_ %ld, wbuf_size_ %ld"
@@ -829,11 +1608,40 @@ ssize_t TCPSession::Write(void) {
     // Okay, if we made it here, we know the header was sent, so we
     // can send (some of) the File object out.
 
+    if (direct_io_ != NULL && !IsSpooled(wfiles_.front()) && InitFileIO()) {
+      bytes_sent = WriteDirect(body_len);
+      if (error.Event()) {
+        error.AppendMsg("TCPSession::Write(): ");
+        ResetWbuf();
+        bytes_sent = 0;
+      }
+#if DEBUG_MUTEX_LOCK
+      warnx("TCPSession::Write(): releasing outgoing lock (direct_io).");
+#endif
+      pthread_mutex_unlock(&outgoing_mtx);
+      return bytes_sent;
+    }
+
+    if (file_io_ != NULL && InitFileIO()) {
+      bytes_sent = WriteFileIO(body_len);
+      if (error.Event()) {
+        error.AppendMsg("TCPSession::Write(): ");
+        ResetWbuf();
+        bytes_sent = 0;
+      }
+#if DEBUG_MUTEX_LOCK
+      warnx("TCPSession::Write(): releasing outgoing lock (file_io).");
+#endif
+      pthread_mutex_unlock(&outgoing_mtx);
+      return bytes_sent;
+    }
+
     char tmp_buf[kFileChunkSize];  // setup copy buffer 
 
-    // If the file isn't open, open it (and seek).
+    // If the file isn't open, open it (or share the file_cache's
+    // descriptor, which is why we never seek).
     if (!wfiles_.front().IsOpen()) {
-      wfiles_.front().Open(NULL, O_RDONLY, 0);
+      file_cache.Open(&wfiles_.front());
       if (error.Event()) {
         error.AppendMsg("TCPSession::Write(): current offset %ld: ", 
                         wpending_.front().file_offset);
@@ -844,26 +1652,37 @@ ssize_t TCPSession::Write(void) {
         pthread_mutex_unlock(&outgoing_mtx);
         return 0;
       }
-      
-      // Since we needed to open it, let's jump to the offset.
-      if (lseek(wfiles_.front().fd(), wpending_.front().file_offset, 
-                SEEK_SET) < 0) {
-        error.Init(EX_IOERR, "TCPSession::Write(): lseek(%s) failed: %s",
-                   wfiles_.front().print().c_str(), strerror(errno));
-        ResetWbuf();
+    }
+
+    // If we're encrypting a large file-body, send it straight from a
+    // mapping of the file, if we can.
+    if (mmap_wfile_ && ssl() != NULL && body_len >= TCPSESSION_MMAP_MIN) {
+      bytes_sent = WriteMmap(body_len);
+      if (bytes_sent >= 0 || error.Event()) {
+        if (error.Event()) {
+          error.AppendMsg("TCPSession::Write(): ");
+          ResetWbuf();
+          bytes_sent = 0;
+        }
 #if DEBUG_MUTEX_LOCK
-        warnx("TCPSession::Write(): releasing outgoing lock (5).");
+        warnx("TCPSession::Write(): releasing outgoing lock (mmap).");
 #endif
         pthread_mutex_unlock(&outgoing_mtx);
-        return 0;
+        return bytes_sent;
       }
+      bytes_sent = 0;
     }
       
-    // Read the next chunk of data from the file ...
+    // Read the next chunk of data from the file (at file_offset, as
+    // our IOUring may have sent some of it, and other sessions may be
+    // reading the same descriptor, without moving the file's
+    // offset) ...
     size_t read_amount = (kFileChunkSize < 
                           (body_len - wpending_.front().file_offset)) ?
         kFileChunkSize : (body_len - wpending_.front().file_offset);
-    ssize_t n = read(wfiles_.front().fd(), tmp_buf, read_amount);
+    ssize_t n = pread(wfiles_.front().fd(), tmp_buf, read_amount,
+                      wpending_.front().file_start +
+                      wpending_.front().file_offset);
     if (n == 0) {
       // EOF
       error.Init(EX_IOERR, "TCPSession::Write(): TOOD(aka) "
@@ -982,14 +1801,50 @@ int TCPSession::StreamIncomingMsg(void) {
           rpending_.buf_offset, rpending_.file_offset);
 #endif
 
+  // If an earlier (asynchronous) write failed, the file is no good.
+  int write_err = 0;
+  int writes = 0;
+  if (file_io_state_ != NULL) {
+    pthread_mutex_lock(&file_io_state_->mtx);
+    write_err = file_io_state_->write_err;
+    file_io_state_->write_err = 0;
+    pthread_mutex_unlock(&file_io_state_->mtx);
+  }
+  if (write_err != 0) {
+    error.Init(EX_IOERR, "TCPSession::StreamIncomingMsg(): "
+               "write(%s) failed: %s", rfile_.print().c_str(),
+               strerror(write_err));
+    ResetRbuf();
+#if DEBUG_MUTEX_LOCK
+    warnx("TCPSession::StreamIncomingMsg(): releasing incoming lock (-2).");
+#endif
+    pthread_mutex_unlock(&incoming_mtx);
+    return 1;
+  }
+
   // See how much data we can move over.
   ssize_t n = (rpending_.body_len - rpending_.file_offset) < rbuf_len_ ?
       rpending_.body_len - rpending_.file_offset : rbuf_len_;
 
   //_LOGGER(LOG_DEBUG, "TCPSession::StreamIncomingMsg(): attempting to move %ld bytes in rbuf_ + %ld (%ld, %ld) to %s (%d, %ld).", n, rpending_.hdr_len, rbuf_len_, rbuf_size_, rfile_.path(NULL).c_str(), rfile_.fd(), rpending_.file_offset);
 
-  // Append all the data we can (or want?) into our file.
-  if ((n = write(rfile_.fd(), rbuf_, n)) < 0) {
+  // Append all the data we can (or want?) into our file, either via
+  // our AsyncFileIO, or ourselves.  Note, we write at file_offset
+  // (rather than rfile_'s offset), as our writes (and splices) can
+  // finish in any order.  With direct I/O, the data is staged in an
+  // aligned buffer (which may not take all of it, if enough writes
+  // are already outstanding).
+
+  if (n > 0 && direct_io_ != NULL && (n = StageRfileDirect(n)) < 0) {
+    error.AppendMsg("TCPSession::StreamIncomingMsg(): ");
+    ResetRbuf();
+#if DEBUG_MUTEX_LOCK
+    warnx("TCPSession::StreamIncomingMsg(): releasing incoming lock (-1).");
+#endif
+    pthread_mutex_unlock(&incoming_mtx);
+    return 1;
+  } else if (n > 0 && direct_io_ == NULL && !QueueRfileWrite(n) &&
+             (n = pwrite(rfile_.fd(), rbuf_, n, rpending_.file_offset)) < 0) {
     error.Init(EX_IOERR, "TCPSession::StreamIncomingMsg(): "
                "write(%s) failed, "
                "n %ld, rbuf len %ld, hdr len %ld: %s",
@@ -1004,15 +1859,38 @@ int TCPSession::StreamIncomingMsg(void) {
   }
    
   rpending_.file_offset += n;
+  AdviseRfile(false);
 
   //_LOGGER(LOG_DEBUG, "TCPSession::StreamIncomingMsg(): removing %ld bytes of data from rbuf_ (%ld, %ld), new offset (%ld).", n, rbuf_len_, rbuf_size_, rpending_.file_offset);
 
   ShiftRbuf(n, 0);  // remove the buffer data that we just shoved to disk
 
-  // See if we got all of the file.
-  if (rpending_.file_offset >= rpending_.body_len) {
+  // See if we got all of the file (and it's all been written).
+  if (file_io_state_ != NULL) {
+    pthread_mutex_lock(&file_io_state_->mtx);
+    writes = file_io_state_->writes;
+    pthread_mutex_unlock(&file_io_state_->mtx);
+  }
+  if (rpending_.file_offset >= rpending_.body_len && writes == 0) {
     //_LOGGER(LOG_DEBUG, "TCPSession::StreamIncomingMsg(): Closing %ld byte file %s (%ld).", rpending_.body_len, rfile_.path(NULL).c_str(), rpending_.file_offset);
 
+    AdviseRfile(true);
+
+    // Direct writes padded out the last block, so cut that off.
+    if (direct_io_ != NULL) {
+      rfile_.Truncate(rpending_.body_len);
+      if (error.Event()) {
+        error.AppendMsg("TCPSession::StreamIncomingMsg(): ");
+        ResetRbuf();
+#if DEBUG_MUTEX_LOCK
+        warnx("TCPSession::StreamIncomingMsg(): releasing incoming lock (0).");
+#endif
+        pthread_mutex_unlock(&incoming_mtx);
+        return 1;
+      }
+    }
+    if (durability_ != NULL)
+      SyncRfile();
     rfile_.Close();
 
 #if DEBUG_INCOMING_DATA
@@ -1066,9 +1944,11 @@ void TCPSession::ClearIncomingMsg(void) {
     // Perhaps a flag as the sole parameter to ClearIncomingMsg()?
 
     rfile_.clear();
+    DropRfileStage();  // if we're giving up on it part way through
   }
 
   rhdr_.clear();
+  rhdr_.set_type(framing_type_);  // so we can parse the next message
   memset(&rpending_, 0, sizeof(rpending_));
 
 #if DEBUG_MUTEX_LOCK
@@ -1144,10 +2024,15 @@ void TCPSession::PopOutgoingMsgQueue(void) {
     // TODO(aka) Need a flag to signify whether or not the physical
     // file that rfile_ associates with can be deleted when done!
 
+    UnmapWfile();
+    AdviseWfile(true);
+    FreeSpooledMsg();
     wfiles_.erase(wfiles_.begin());
   }
 
   wpending_.erase(wpending_.begin());  // pop wpending_[0]
+  ResetFileIO();  // any read-ahead was of the message we just popped
+  ResetIOUring();
 
 
 #if DEBUG_OUTGOING_DATA
@@ -1175,6 +2060,34 @@ void TCPSession::PopOutgoingMsgQueue(void) {
   pthread_mutex_unlock(&outgoing_mtx);
 }
 
+// Routine to take the oldest received message, if its file-body has
+// been synced.
+bool TCPSession::PopDurableMsg(MsgHdr* hdr, File* file, int* err) {
+  if (durability_state_ == NULL)
+    return false;
+
+  pthread_mutex_lock(&durability_state_->mtx);
+  if (durability_state_->msgs.empty() ||
+      !durability_state_->msgs.front()->synced) {
+    pthread_mutex_unlock(&durability_state_->mtx);
+    return false;
+  }
+
+  struct session_durable_msg* msg = durability_state_->msgs.front();
+  durability_state_->msgs.pop_front();
+  pthread_mutex_unlock(&durability_state_->mtx);
+
+  if (hdr != NULL)
+    *hdr = msg->hdr;
+  if (file != NULL)
+    *file = msg->file;
+  if (err != NULL)
+    *err = msg->err;
+  delete msg;
+
+  return true;
+}
+
 // Boolean functions.
 
 #if 0  // Decprecated.
@@ -1189,6 +2102,69 @@ bool TCPSession::IsIncomingMsgComplete(void) const {
 }
 #endif
 
+// Routine to see if we have all of our incoming message, including
+// (if it's streaming to rfile_) that it's all been written.
+bool TCPSession::IsIncomingMsgComplete(void) const {
+  if (rpending_.initialized != 1)
+    return false;
+
+  if (rpending_.file_offset < rpending_.body_len &&
+      rbuf_len_ < rpending_.body_len)
+    return false;
+
+  if (file_io_state_ == NULL)
+    return true;
+
+  pthread_mutex_lock(&file_io_state_->mtx);
+  bool writing = (file_io_state_->writes > 0 ||
+                  file_io_state_->stage != NULL);
+  pthread_mutex_unlock(&file_io_state_->mtx);
+
+  return !writing;
+}
+
+// Routine to check if an AsyncFileIO operation of ours is outstanding.
+bool TCPSession::IsFileIOPending(void) const {
+  if (file_io_state_ == NULL)
+    return false;
+
+  pthread_mutex_lock(&file_io_state_->mtx);
+  bool pending = (file_io_state_->reading || file_io_state_->writes > 0 ||
+                  file_io_state_->chunk_reads > 0);
+  pthread_mutex_unlock(&file_io_state_->mtx);
+
+  return pending;
+}
+
+// Routine to check if an IOUring operation of ours is outstanding.
+bool TCPSession::IsIOUringPending(void) const {
+  if (io_uring_state_ == NULL)
+    return false;
+
+  return (io_uring_state_->recv != NULL || io_uring_state_->sends > 0) ?
+      true : false;
+}
+
+// Routine to check if any of our received file-bodies are being synced.
+bool TCPSession::IsDurabilityPending(void) const {
+  if (durability_state_ == NULL)
+    return false;
+
+  bool pending = false;
+  pthread_mutex_lock(&durability_state_->mtx);
+  for (list<struct session_durable_msg*>::const_iterator msg =
+           durability_state_->msgs.begin();
+       msg != durability_state_->msgs.end(); msg++) {
+    if (!(*msg)->synced) {
+      pending = true;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&durability_state_->mtx);
+
+  return pending;
+}
+
 // Routine to check if we have any pending outgoing data sitting in
 // this TCPSession.
 bool TCPSession::IsOutgoingDataPending(void) const {
@@ -1223,6 +2199,7 @@ void TCPSession::ShiftRbuf(const ssize_t len, const ssize_t offset) {
     return;
   }
 
+  const ssize_t old_len = rbuf_len_;
   if ((len + offset) > rbuf_len_) {
     _LOGGER(LOG_DEBUG, "TCPSession::ShiftRbuf(): "
             "Len (%ld) + offset (%ld) > rbuf_len (%ld)!",
@@ -1235,6 +2212,15 @@ void TCPSession::ShiftRbuf(const ssize_t len, const ssize_t offset) {
     memmove(rbuf_ + offset, rbuf_ + offset + len, rbuf_len_ - (len + offset));
     rbuf_len_ -= len;
   }
+
+  // If we removed any of the early data at the front of rbuf_, it's
+  // no longer there to mark.
+
+  if (rbuf_early_len_ > offset) {
+    ssize_t end = offset + (old_len - rbuf_len_);
+    rbuf_early_len_ -= ((rbuf_early_len_ < end) ? rbuf_early_len_ : end) -
+        offset;
+  }
 }
 
 // Routine to clean up the buffers and meta-data associated with any
@@ -1247,11 +2233,15 @@ void TCPSession::ResetRbuf(void) {
 
   //ShiftRbuf(rbuf_len_, 0);  // clear *all* data from rbuf_
   rbuf_len_ = 0;
+  rbuf_early_len_ = 0;
 
   if (rpending_.storage == SESSION_USE_DISC)
     rfile_.clear();
+  CloseSplicePipe();  // may hold part of the message we're dropping
+  DropRfileStage();   // likewise
 
   rhdr_.clear();
+  rhdr_.set_type(framing_type_);  // so we can parse the next message
   memset(&rpending_, 0, sizeof(rpending_));
 }
 
@@ -1267,7 +2257,1079 @@ void TCPSession::ResetWbuf(void) {
   }
 
   wbuf_len_ = 0;
+  UnmapWfile();
   wfiles_.clear();
   wpending_.clear();
+  if (spool_.IsOpen()) {
+    spool_.PunchHole(0, spool_len_);  // nothing spooled is pending
+    spool_len_ = 0;
+  }
+  wfile_behind_ = -1;
+  ResetFileIO();
+  ResetIOUring();
+}
+
+// Routine to create our session_file_io, if we don't yet have one.
+bool TCPSession::InitFileIO(void) {
+  if (file_io_state_ != NULL)
+    return true;
+
+  struct session_file_io* state = new struct session_file_io();
+  pthread_mutex_init(&state->mtx, NULL);
+  state->refs = 1;  // ours
+  state->open_fd = -1;
+  state->buf = NULL;
+  state->pool = direct_io_;
+  state->read_offset = -1;
+  state->stage = NULL;
+  file_io_state_ = state;
+
+  return true;
+}
+
+// Routine to forget any read-ahead of our outgoing message (as it's
+// gone); an open or read still outstanding is ignored when it ends.
+void TCPSession::ResetFileIO(void) {
+  if (file_io_state_ == NULL)
+    return;
+
+  pthread_mutex_lock(&file_io_state_->mtx);
+  file_io_state_->gen++;
+  file_io_state_->read_err = 0;
+  file_io_state_->buf_len = 0;
+  file_io_state_->buf_sent = 0;
+  if (file_io_state_->open_fd >= 0)
+    close(file_io_state_->open_fd);
+  file_io_state_->open_fd = -1;
+
+  // Chunks still being read are dropped when their read finishes.
+  list<struct session_direct_chunk>::iterator chunk =
+      file_io_state_->chunks.begin();
+  while (chunk != file_io_state_->chunks.end()) {
+    if (chunk->len < 0) {
+      chunk++;
+      continue;
+    }
+    file_io_state_->pool->Put(chunk->buf);
+    chunk = file_io_state_->chunks.erase(chunk);
+  }
+  file_io_state_->read_offset = -1;
+  pthread_mutex_unlock(&file_io_state_->mtx);
+}
+
+// Routine to hand the first len bytes of rbuf_ to our AsyncFileIO, to
+// be written to rfile_ at rpending_.file_offset.  Returns false if
+// the write wasn't queued, in which case our caller must do it.
+bool TCPSession::QueueRfileWrite(const ssize_t len) {
+  if (file_io_ == NULL || !InitFileIO())
+    return false;
+
+  char* chunk = (char*)malloc(len);
+  if (chunk == NULL)
+    return false;
+  memcpy(chunk, rbuf_, len);
+
+  struct session_file_io* state = file_io_state_;
+  pthread_mutex_lock(&state->mtx);
+  state->refs++;
+  state->writes++;
+  pthread_mutex_unlock(&state->mtx);
+
+  if (file_io_->Write(rfile_.fd(), chunk, len, rpending_.file_offset,
+                      session_file_io_wrote, state))
+    return true;
+
+  pthread_mutex_lock(&state->mtx);
+  state->refs--;
+  state->writes--;
+  pthread_mutex_unlock(&state->mtx);
+  free(chunk);
+
+  return false;
+}
+
+// Routine to send (some of) the outgoing message's file, which our
+// AsyncFileIO opens and reads ahead of us.  Returns the bytes sent,
+// which is 0 while we wait on our AsyncFileIO.  If its queue is
+// full, we do the open or read ourselves.
+//
+// Note, this routine can set an ErrorHandler event.
+ssize_t TCPSession::WriteFileIO(const ssize_t body_len) {
+  struct session_file_io* state = file_io_state_;
+  File& file = wfiles_.front();
+
+  pthread_mutex_lock(&state->mtx);
+  if (state->reading) {
+    pthread_mutex_unlock(&state->mtx);
+    return 0;
+  }
+
+  if (state->read_err != 0) {
+    int read_err = state->read_err;
+    state->read_err = 0;
+    pthread_mutex_unlock(&state->mtx);
+    error.Init(EX_IOERR, "TCPSession::WriteFileIO(): %s, file_offset %ld: %s",
+               file.print().c_str(), wpending_.front().file_offset,
+               strerror(read_err));
+    return 0;
+  }
+
+  if (!file.IsOpen() && state->open_fd >= 0) {
+    file_cache.Adopt(&file, state->open_fd);
+    state->open_fd = -1;
+  } else if (!file.IsOpen() && !file_cache.Find(&file)) {
+    state->reading = true;
+    state->read_gen = state->gen;
+    state->refs++;
+    pthread_mutex_unlock(&state->mtx);
+
+    if (file_io_->Open(file.path(NULL).c_str(), O_RDONLY, 0,
+                       session_file_io_opened, state))
+      return 0;
+
+    pthread_mutex_lock(&state->mtx);
+    state->reading = false;
+    state->refs--;
+    pthread_mutex_unlock(&state->mtx);
+
+    file_cache.Open(&file);
+    if (error.Event()) {
+      error.AppendMsg("TCPSession::WriteFileIO(): ");
+      return 0;
+    }
+
+    pthread_mutex_lock(&state->mtx);
+  }
+
+  // If we've sent all we read, read the next chunk.
+  if (state->buf_sent >= state->buf_len) {
+    if (state->buf == NULL &&
+        (state->buf = (char*)malloc(TCPSESSION_FILE_IO_CHUNK)) == NULL) {
+      pthread_mutex_unlock(&state->mtx);
+      error.Init(EX_OSERR, "TCPSession::WriteFileIO(): malloc(%d) failed",
+                 TCPSESSION_FILE_IO_CHUNK);
+      return 0;
+    }
+
+    const off_t file_offset = wpending_.front().file_offset;
+    const off_t offset = wpending_.front().file_start + file_offset;
+    const size_t len = ((body_len - file_offset) < TCPSESSION_FILE_IO_CHUNK) ?
+        body_len - file_offset : TCPSESSION_FILE_IO_CHUNK;
+    state->buf_len = 0;
+    state->buf_sent = 0;
+    state->reading = true;
+    state->read_gen = state->gen;
+    state->refs++;
+    pthread_mutex_unlock(&state->mtx);
+
+    if (file_io_->Read(file.fd(), state->buf, len, offset,
+                       session_file_io_read, state))
+      return 0;
+
+    ssize_t n = pread(file.fd(), state->buf, len, offset);
+    pthread_mutex_lock(&state->mtx);
+    state->reading = false;
+    state->refs--;
+    if (n <= 0) {
+      pthread_mutex_unlock(&state->mtx);
+      error.Init(EX_IOERR, "TCPSession::WriteFileIO(): pread(%s) failed, "
+                 "file_offset %ld, size %ld: %s", file.print().c_str(),
+                 (long)file_offset, body_len, 
+                 (n < 0) ? strerror(errno) : "unexpected EOF");
+      return 0;
+    }
+    state->buf_len = n;
+  }
+
+  // No one else touches buf until we've sent it.
+  char* buf = state->buf + state->buf_sent;
+  ssize_t len = state->buf_len - state->buf_sent;
+  pthread_mutex_unlock(&state->mtx);
+
+  ssize_t bytes_sent = SSLConn::Write(buf, len);
+  if (error.Event()) {
+    error.AppendMsg("TCPSession::WriteFileIO(): file %s, body_len %ld, "
+                    "file_offset %ld: ", file.print().c_str(), body_len,
+                    wpending_.front().file_offset);
+    return 0;
+  }
+
+  pthread_mutex_lock(&state->mtx);
+  state->buf_sent += bytes_sent;
+  pthread_mutex_unlock(&state->mtx);
+  wpending_.front().file_offset += bytes_sent;
+
+  return bytes_sent;
+}
+
+// Routine to copy (up to) the first len bytes of rbuf_ into our
+// direct I/O stage, writing it to rfile_ each time it fills, or the
+// message-body is done.  Returns the bytes taken, which is less than
+// len if TCPSESSION_DIRECT_IO_DEPTH writes are already outstanding,
+// or -1 on error.
+//
+// Note, this routine can set an ErrorHandler event.
+ssize_t TCPSession::StageRfileDirect(const ssize_t len) {
+  InitFileIO();
+  struct session_file_io* state = file_io_state_;
+  const ssize_t buf_size = direct_io_->buf_size();
+
+  ssize_t staged = 0;
+  while (staged < len) {
+    if (state->stage == NULL) {
+      pthread_mutex_lock(&state->mtx);
+      int writes = state->writes;
+      pthread_mutex_unlock(&state->mtx);
+      if (writes >= TCPSESSION_DIRECT_IO_DEPTH)
+        break;  // wait for one to finish
+
+      if ((state->stage = direct_io_->Get()) == NULL) {
+        error.Init(EX_OSERR, "TCPSession::StageRfileDirect(): "
+                   "AlignedBufPool::Get() failed");
+        return -1;
+      }
+      state->stage_offset = rpending_.file_offset + staged;
+      state->stage_len = 0;
+    }
+
+    ssize_t n = ((len - staged) < (buf_size - state->stage_len)) ?
+        len - staged : buf_size - state->stage_len;
+    memcpy(state->stage + state->stage_len, rbuf_ + staged, n);
+    state->stage_len += n;
+    staged += n;
+
+    if ((state->stage_len == buf_size ||
+         state->stage_offset + state->stage_len >= rpending_.body_len) &&
+        !WriteRfileStage())
+      return -1;
+  }
+
+  return staged;
+}
+
+// Routine to write our direct I/O stage to rfile_, padded out to our
+// alignment (which StreamIncomingMsg() truncates when the body is
+// done), via our AsyncFileIO if we have one.  Returns false on error.
+//
+// Note, this routine can set an ErrorHandler event.
+bool TCPSession::WriteRfileStage(void) {
+  struct session_file_io* state = file_io_state_;
+  const size_t align = direct_io_->align();
+  const size_t len = (state->stage_len + align - 1) & ~(align - 1);
+  char* buf = state->stage;
+  const off_t offset = state->stage_offset;
+  memset(buf + state->stage_len, 0, len - state->stage_len);
+  state->stage = NULL;
+  state->stage_len = 0;
+
+  if (file_io_ != NULL) {
+    pthread_mutex_lock(&state->mtx);
+    state->refs++;
+    state->writes++;
+    pthread_mutex_unlock(&state->mtx);
+
+    if (file_io_->Write(rfile_.fd(), buf, len, offset,
+                        session_file_io_direct_wrote, state))
+      return true;
+
+    pthread_mutex_lock(&state->mtx);
+    state->refs--;
+    state->writes--;
+    pthread_mutex_unlock(&state->mtx);
+  }
+
+  ssize_t n = pwrite(rfile_.fd(), buf, len, offset);
+  int write_err = errno;
+  direct_io_->Put(buf);
+  if (n != (ssize_t)len) {
+    error.Init(EX_IOERR, "TCPSession::WriteRfileStage(): "
+               "pwrite(%s, %lu, %ld) failed: %s", rfile_.print().c_str(),
+               (unsigned long)len, (long)offset,
+               (n < 0) ? strerror(write_err) : "short write");
+    return false;
+  }
+
+  return true;
+}
+
+// Routine to give back our direct I/O stage (of a message we're
+// dropping), if we have one.
+void TCPSession::DropRfileStage(void) {
+  if (file_io_state_ == NULL || file_io_state_->stage == NULL)
+    return;
+
+  file_io_state_->pool->Put(file_io_state_->stage);
+  file_io_state_->stage = NULL;
+  file_io_state_->stage_len = 0;
+}
+
+// Routine to queue our (complete) rfile_ with our DurabilitySyncer,
+// and note its message, so PopDurableMsg() can return it once it's
+// synced.  If the syncer won't take it, we sync it ourselves.
+void TCPSession::SyncRfile(void) {
+  if (durability_state_ == NULL) {
+    durability_state_ = new struct session_durability();
+    pthread_mutex_init(&durability_state_->mtx, NULL);
+    durability_state_->refs = 1;
+  }
+
+  struct session_durable_msg* msg =
+      new session_durable_msg{durability_state_, rhdr_, File(),
+                              false, 0};
+  if (rfile_.dir().size() > 0)
+    msg->file.set_dir(rfile_.dir().c_str());
+  msg->file.set_name(rfile_.name().c_str());
+  const string dir = (rfile_.dir().size() > 0) ? rfile_.dir() : ".";
+
+  pthread_mutex_lock(&durability_state_->mtx);
+  durability_state_->msgs.push_back(msg);
+  durability_state_->refs++;
+  pthread_mutex_unlock(&durability_state_->mtx);
+
+  if (durability_->Sync(rfile_.fd(), dir.c_str(), session_durability_synced,
+                        msg))
+    return;
+
+  int err = (fdatasync(rfile_.fd()) < 0) ? errno : 0;
+  int dir_fd = open(dir.c_str(), O_RDONLY);
+  if (dir_fd < 0 || fsync(dir_fd) < 0) {
+    if (err == 0)
+      err = errno;
+  }
+  if (dir_fd >= 0)
+    close(dir_fd);
+
+  pthread_mutex_lock(&durability_state_->mtx);
+  msg->synced = true;
+  msg->err = err;
+  durability_state_->refs--;
+  pthread_mutex_unlock(&durability_state_->mtx);
+}
+
+// Routine to keep the outgoing message's file read ahead of us, one
+// aligned buffer at a time: up to TCPSESSION_DIRECT_IO_DEPTH via our
+// AsyncFileIO, otherwise just the chunk we're about to send, which we
+// read ourselves.  Returns false on error.  The caller must hold
+// file_io_state_'s lock (which we drop while reading).
+//
+// Note, this routine can set an ErrorHandler event.
+bool TCPSession::ReadAheadDirect(const ssize_t body_len) {
+  struct session_file_io* state = file_io_state_;
+  const File& file = wfiles_.front();
+  const off_t align = direct_io_->align();
+
+  if (state->read_offset < 0)
+    state->read_offset = wpending_.front().file_offset & ~(align - 1);
+
+  int chunks = 0;
+  for (list<struct session_direct_chunk>::iterator chunk =
+           state->chunks.begin(); chunk != state->chunks.end(); chunk++)
+    if (chunk->gen == state->gen)
+      chunks++;
+
+  while (chunks < TCPSESSION_DIRECT_IO_DEPTH &&
+         state->read_offset < body_len) {
+    if (file_io_ == NULL && chunks > 0)
+      break;  // we only read ahead asynchronously
+
+    char* buf = direct_io_->Get();
+    if (buf == NULL) {
+      error.Init(EX_OSERR, "TCPSession::ReadAheadDirect(): "
+                 "AlignedBufPool::Get() failed");
+      return false;
+    }
+
+    const off_t left = ((body_len - state->read_offset) + align - 1) &
+        ~(align - 1);
+    const size_t len = (left < (off_t)direct_io_->buf_size()) ?
+        left : direct_io_->buf_size();
+
+    struct session_direct_chunk new_chunk;
+    new_chunk.buf = buf;
+    new_chunk.offset = state->read_offset;
+    new_chunk.want = len;
+    new_chunk.len = -1;
+    new_chunk.gen = state->gen;
+    list<struct session_direct_chunk>::iterator chunk =
+        state->chunks.insert(state->chunks.end(), new_chunk);
+    state->read_offset += len;
+    chunks++;
+
+    if (file_io_ != NULL) {
+      state->refs++;
+      state->chunk_reads++;
+      if (file_io_->Read(file.fd(), buf, len, chunk->offset,
+                         session_file_io_direct_read, state))
+        continue;
+      state->refs--;
+      state->chunk_reads--;
+    }
+
+    // Like AsyncFileIO, keep reading until we have it all (or EOF).
+    pthread_mutex_unlock(&state->mtx);
+    ssize_t n = 0;
+    int read_err = 0;
+    while ((size_t)n < len) {
+      ssize_t bytes_read = pread(file.fd(), buf + n, len - n,
+                                 chunk->offset + n);
+      if (bytes_read == 0)
+        break;  // EOF
+      if (bytes_read < 0) {
+        if (errno == EINTR)
+          continue;
+        read_err = errno;
+        n = -1;
+        break;
+      }
+      n += bytes_read;
+    }
+    pthread_mutex_lock(&state->mtx);
+    if (n < 0) {
+      chunk->len = 0;
+      error.Init(EX_IOERR, "TCPSession::ReadAheadDirect(): "
+                 "pread(%s, %lu, %ld) failed: %s", file.print().c_str(),
+                 (unsigned long)len, (long)chunk->offset,
+                 strerror(read_err));
+      return false;
+    }
+    chunk->len = n;
+  }
+
+  return true;
+}
+
+// Routine to send (some of) the outgoing message's file, which we
+// read with direct I/O (see ReadAheadDirect()).  Returns the bytes
+// sent, which is 0 while we wait on our AsyncFileIO.
+//
+// Note, this routine can set an ErrorHandler event.
+ssize_t TCPSession::WriteDirect(const ssize_t body_len) {
+  struct session_file_io* state = file_io_state_;
+  File& file = wfiles_.front();
+
+  if (!file.IsOpen()) {
+    file.OpenDirect(NULL, O_RDONLY, 0);
+    if (error.Event()) {
+      error.AppendMsg("TCPSession::WriteDirect(): ");
+      return 0;
+    }
+  }
+
+  pthread_mutex_lock(&state->mtx);
+  if (state->read_err != 0) {
+    int read_err = state->read_err;
+    state->read_err = 0;
+    pthread_mutex_unlock(&state->mtx);
+    error.Init(EX_IOERR, "TCPSession::WriteDirect(): %s, file_offset %ld: %s",
+               file.print().c_str(), wpending_.front().file_offset,
+               strerror(read_err));
+    return 0;
+  }
+
+  if (!ReadAheadDirect(body_len)) {
+    pthread_mutex_unlock(&state->mtx);
+    return 0;
+  }
+
+  // Find the chunk we're sending from (the first of this message's).
+  list<struct session_direct_chunk>::iterator chunk = state->chunks.begin();
+  while (chunk != state->chunks.end() && chunk->gen != state->gen)
+    chunk++;
+  if (chunk == state->chunks.end() || chunk->len < 0) {
+    pthread_mutex_unlock(&state->mtx);
+    return 0;  // still being read
+  }
+
+  // A chunk cut short before body_len means the file ended early;
+  // the next chunk doesn't start where this one stops, so we can't
+  // just carry on.
+
+  const off_t file_offset = wpending_.front().file_offset;
+  const off_t end = (chunk->offset + chunk->len < body_len) ?
+      chunk->offset + chunk->len : body_len;
+  if (file_offset >= end ||
+      (chunk->len < chunk->want && end < body_len)) {
+    pthread_mutex_unlock(&state->mtx);
+    error.Init(EX_IOERR, "TCPSession::WriteDirect(): %s: unexpected EOF, "
+               "file_offset %ld, size %ld", file.print().c_str(),
+               (long)file_offset, body_len);
+    return 0;
+  }
+  char* buf = chunk->buf + (file_offset - chunk->offset);
+  pthread_mutex_unlock(&state->mtx);
+
+  // No one else touches our chunk until we're done with it.
+  ssize_t bytes_sent = SSLConn::Write(buf, end - file_offset);
+  if (error.Event()) {
+    error.AppendMsg("TCPSession::WriteDirect(): file %s, body_len %ld, "
+                    "file_offset %ld: ", file.print().c_str(), body_len,
+                    (long)file_offset);
+    return 0;
+  }
+  wpending_.front().file_offset += bytes_sent;
+
+  // If we're done with the chunk, it can go read more of the file.
+  pthread_mutex_lock(&state->mtx);
+  if (wpending_.front().file_offset >= end) {
+    direct_io_->Put(chunk->buf);
+    state->chunks.erase(chunk);
+    if (!ReadAheadDirect(body_len))
+      bytes_sent = 0;
+  }
+  pthread_mutex_unlock(&state->mtx);
+
+  return bytes_sent;
+}
+
+// Routine to create our session_io_uring, if we don't yet have one.
+// Returns false if we can't use our IOUring, i.e., we're encrypted,
+// or it lacks the buffers we need.
+bool TCPSession::InitIOUring(void) {
+  if (io_uring_state_ != NULL)
+    return true;
+
+  if (ssl() != NULL || !io_uring_->IsInitialized() ||
+      !io_uring_->IsRecvEnabled() || io_uring_->slot_size() == 0)
+    return false;
+
+  struct session_io_uring* state = new struct session_io_uring();
+  state->refs = 1;  // ours
+  state->ring = io_uring_;
+  state->recv = NULL;
+  state->rdata = NULL;
+  state->slot = -1;
+  state->sent = -1;
+  io_uring_state_ = state;
+
+  return true;
+}
+
+// Routine to forget the result of any write of our outgoing message
+// (as it's gone); a write still outstanding is ignored when it ends.
+void TCPSession::ResetIOUring(void) {
+  if (io_uring_state_ == NULL)
+    return;
+
+  io_uring_state_->gen++;
+  io_uring_state_->sent = -1;
+  io_uring_state_->send_err = 0;
+}
+
+// Routine to move up to buf_len bytes of what our IOUring has
+// received into buf, making sure our recv is queued.  Returns the
+// bytes moved, which is 0 until the recv completes.
+//
+// Note, this routine can set an ErrorHandler event.
+ssize_t TCPSession::ReadIOUring(const ssize_t buf_len, char* buf,
+                                bool* eof) {
+  struct session_io_uring* state = io_uring_state_;
+  *eof = false;
+
+  ssize_t n = ((size_t)buf_len < state->rdata_len) ?
+      buf_len : state->rdata_len;
+  if (n > 0) {
+    memcpy(buf, state->rdata, n);
+    memmove(state->rdata, state->rdata + n, state->rdata_len - n);
+    state->rdata_len -= n;
+  } else if (state->recv_err != 0) {
+    error.Init(EX_IOERR, "TCPSession::ReadIOUring(): recv(%d) failed: %s",
+               fd(), strerror(state->recv_err));
+    state->recv_err = 0;
+    return 0;
+  } else if (state->eof) {
+    *eof = true;
+    return 0;
+  }
+
+  // (Re)queue our recv if it stopped, e.g., the ring ran out of
+  // receive buffers, or we were holding too much.
+
+  if (state->recv == NULL && !state->eof && state->recv_err == 0 &&
+      state->rdata_len < TCPSESSION_IO_URING_MAX_RDATA) {
+    state->recv = io_uring_->Recv(fd(), session_io_uring_recv, state);
+    if (state->recv != NULL)
+      state->refs++;
+  }
+
+  return n;
+}
+
+// Routine to send the next chunk of our outgoing message through our
+// IOUring.  First, we pick up the result of our last write (and
+// return its bytes), then we copy the next chunk (from wbuf_, or have
+// the ring read it from the file) into a slot and queue its write.
+// Returns -1 if we couldn't queue it (and had nothing to report),
+// in which case our caller must send it.
+//
+// Note, this routine can set an ErrorHandler event.
+ssize_t TCPSession::WriteIOUring(const ssize_t hdr_len,
+                                 const ssize_t body_len) {
+  struct session_io_uring* state = io_uring_state_;
+  MsgInfo& msg = wpending_.front();
+
+  if (state->sends > 0)
+    return 0;  // still waiting on our last write
+
+  if (state->send_err != 0) {
+    error.Init(EX_IOERR, "TCPSession::WriteIOUring(): write(%d) failed, "
+               "buf_offset %ld, file_offset %ld: %s", fd(),
+               msg.buf_offset, msg.file_offset, strerror(state->send_err));
+    state->send_err = 0;
+    return 0;
+  }
+
+  // Note, a write is either all header (or in-memory message), or all
+  // file body.
+
+  ssize_t bytes_sent = 0;
+  if (state->sent >= 0) {
+    bytes_sent = state->sent;
+    state->sent = -1;
+    if (msg.storage == SESSION_USE_MEM || msg.buf_offset < hdr_len)
+      msg.buf_offset += bytes_sent;
+    else
+      msg.file_offset += bytes_sent;
+  }
+
+  if (IsOutgoingMsgSent())
+    return bytes_sent;
+
+  int slot = io_uring_->GetSlot();
+  if (slot < 0)
+    return (bytes_sent > 0) ? bytes_sent : -1;
+
+  size_t len = 0;
+  struct io_uring_req* req = NULL;
+  state->send_gen = state->gen;
+  if (msg.storage == SESSION_USE_MEM || msg.buf_offset < hdr_len) {
+    ssize_t end = (msg.storage == SESSION_USE_MEM) ?
+        hdr_len + body_len : hdr_len;
+    len = ((size_t)(end - msg.buf_offset) < io_uring_->slot_size()) ?
+        end - msg.buf_offset : io_uring_->slot_size();
+    memcpy(io_uring_->slot(slot), wbuf_ + msg.buf_offset, len);
+    req = io_uring_->WriteFixed(fd(), slot, len, -1,
+                                session_io_uring_wrote, state);
+    if (req != NULL)
+      state->sends = 1;
+  } else {
+    File& file = wfiles_.front();
+    if (!file.IsOpen()) {
+      file_cache.Open(&file);
+      if (error.Event()) {
+        error.AppendMsg("TCPSession::WriteIOUring(): ");
+        io_uring_->PutSlot(slot);
+        return 0;
+      }
+    }
+
+    len = ((size_t)(body_len - msg.file_offset) < io_uring_->slot_size()) ?
+        body_len - msg.file_offset : io_uring_->slot_size();
+    req = io_uring_->ReadFixed(file.fd(), slot, len,
+                               msg.file_start + msg.file_offset,
+                               session_io_uring_read, state, true);
+    if (req != NULL) {
+      // ReadFixed() made room for this, too.
+      io_uring_->WriteFixed(fd(), slot, len, -1,
+                            session_io_uring_wrote, state);
+      state->sends = 2;
+    }
+  }
+
+  if (req == NULL) {
+    io_uring_->PutSlot(slot);
+    if (error.Event())
+      error.AppendMsg("TCPSession::WriteIOUring(): ");
+    return (bytes_sent > 0 || error.Event()) ? bytes_sent : -1;
+  }
+
+  state->refs += state->sends;
+  state->slot = slot;
+  state->send_len = len;
+
+  return bytes_sent;
+}
+
+// Routine to move the next chunk of the pending message-body from our
+// socket to rfile_ with splice(2).  We splice no more than what's
+// left of the body into our pipe (so the next message stays on the
+// socket), and then drain the pipe into rfile_ before returning.
+//
+// Note, this routine can set an ErrorHandler event.
+ssize_t TCPSession::SpliceRfile(bool* eof) {
+  *eof = false;
+
+#if defined(__linux__)
+  if (splice_fds_[0] < 0) {
+    if (pipe(splice_fds_) < 0) {
+      error.Init(EX_OSERR, "TCPSession::SpliceRfile(): pipe(2) failed: %s",
+                 strerror(errno));
+      splice_fds_[0] = splice_fds_[1] = -1;
+      return 0;
+    }
+
+    // A bigger pipe means fewer trips through here; if the kernel
+    // won't give us one, the default (usually 64 KB) still works.
+
+    (void)fcntl(splice_fds_[1], F_SETPIPE_SZ, TCPSESSION_SPLICE_PIPE_SIZE);
+  }
+
+  size_t len = rpending_.body_len - rpending_.file_offset;
+  ssize_t n = splice(fd(), NULL, splice_fds_[1], NULL, len, SPLICE_F_MOVE);
+  if (n == 0) {
+    *eof = true;
+    return 0;
+  } else if (n < 0) {
+    if ((!IsBlocking() && errno == EAGAIN) || errno == EINTR)
+      return 0;  // socket no longer ready
+
+    error.Init(EX_IOERR, "TCPSession::SpliceRfile(): splice(%d) failed: %s",
+               fd(), strerror(errno));
+    return 0;
+  }
+
+  // Drain the pipe into rfile_.  If its file system can't take
+  // spliced data, copy what we already have in the pipe (using
+  // rbuf_, which holds nothing of the body) and stop splicing.
+
+  ssize_t drained = 0;
+  while (drained < n) {
+    ssize_t m = 0;
+    if (splice_rfile_) {
+      loff_t offset = rpending_.file_offset + drained;
+      m = splice(splice_fds_[0], NULL, rfile_.fd(), &offset, n - drained,
+                 SPLICE_F_MOVE);
+      if (m < 0 && errno == EINVAL) {
+        _LOGGER_LIMITED(LOG_INFO, "TCPSession::SpliceRfile(): "
+                        "%s does not support splice(2), copying instead",
+                        rfile_.print().c_str());
+        splice_rfile_ = false;
+        continue;
+      }
+    } else {
+      size_t chunk = ((n - drained) < rbuf_size_) ? n - drained : rbuf_size_;
+      m = read(splice_fds_[0], rbuf_, chunk);
+
+      // What we read is out of the pipe, so all of it must be written.
+      ssize_t written = 0;
+      while (m > 0 && written < m) {
+        ssize_t w = pwrite(rfile_.fd(), rbuf_ + written, m - written,
+                           rpending_.file_offset + drained + written);
+        if (w < 0 && errno == EINTR)
+          continue;
+        if (w <= 0) {
+          if (w == 0)
+            errno = EIO;
+          drained += written;
+          m = -1;
+          break;
+        }
+        written += w;
+      }
+    }
+
+    if (m < 0) {
+      if (errno == EINTR)
+        continue;
+
+      error.Init(EX_IOERR, "TCPSession::SpliceRfile(): "
+                 "unable to move %ld bytes to %s: %s", (long)(n - drained),
+                 rfile_.print().c_str(), strerror(errno));
+      CloseSplicePipe();
+      rpending_.file_offset += drained;
+      return drained;
+    }
+    drained += m;
+  }
+
+  rpending_.file_offset += n;
+  if (!splice_rfile_)
+    CloseSplicePipe();
+
+  return n;
+#else
+  error.Init(EX_SOFTWARE, "TCPSession::SpliceRfile(): "
+             "splice(2) not supported");
+  return 0;
+#endif
+}
+
+// Routine to close our splice(2) pipe, if we have one.
+void TCPSession::CloseSplicePipe(void) {
+  for (int i = 0; i < 2; i++) {
+    if (splice_fds_[i] >= 0)
+      close(splice_fds_[i]);
+    splice_fds_[i] = -1;
+  }
+}
+
+// Routine to manage the page cache behind rfile_ (see
+// set_write_behind()): for each full window written, start its
+// writeback, and drop the window before it, which should be clean by
+// now.  When the body is done (and we're about to close rfile_), do
+// the same with what's left.
+void TCPSession::AdviseRfile(const bool done) {
+  if (write_behind_ == 0)
+    return;
+
+  const off_t window = write_behind_;
+  while (rpending_.file_offset - rfile_behind_ >= window) {
+    rfile_.WriteBehind(rfile_behind_, window);
+    if (rfile_behind_ >= window)
+      rfile_.Advise(rfile_behind_ - window, window, POSIX_FADV_DONTNEED);
+    rfile_behind_ += window;
+  }
+
+  if (done) {
+    rfile_.WriteBehind(rfile_behind_, 0);
+    rfile_.Advise((rfile_behind_ >= window) ? rfile_behind_ - window : 0, 0,
+                  POSIX_FADV_DONTNEED);
+  }
+}
+
+// Routine to give the kernel hints about the file-body we're sending:
+// once it's open, that we read it sequentially (which doubles its
+// readahead), and if set_write_behind(), drop each window we've sent
+// from the page cache (and the rest of it, when done).
+void TCPSession::AdviseWfile(const bool done) {
+  File& file = wfiles_.front();
+  if (!file.IsOpen())
+    return;
+
+  if (wfile_behind_ < 0) {
+    file.Advise(0, 0, POSIX_FADV_SEQUENTIAL);
+    wfile_behind_ = 0;
+  }
+
+  // Note, a spooled body is only part of its file.
+  if (write_behind_ > 0) {
+    const off_t window = write_behind_;
+    const off_t start = wpending_.front().file_start;
+    while (wpending_.front().file_offset - wfile_behind_ >= window) {
+      file.Advise(start + wfile_behind_, window, POSIX_FADV_DONTNEED);
+      wfile_behind_ += window;
+    }
+    if (done && wpending_.front().body_len > wfile_behind_)
+      file.Advise(start + wfile_behind_,
+                  wpending_.front().body_len - wfile_behind_,
+                  POSIX_FADV_DONTNEED);
+  }
+
+  if (done)
+    wfile_behind_ = -1;  // for the next message's file
+}
+
+// Routine to send (some of) the outgoing message's file from our
+// mapping of it, mapping its next window if we've sent all of this
+// one.  Returns the bytes sent, or -1 if the file can't be mapped (in
+// which case, our caller copies it as usual).
+//
+// Note, a SSL_write(3) that must be retried is given the same slice,
+// as we only move the window once all of it is sent.  Also, note
+// that this routine can set an ErrorHandler event.
+ssize_t TCPSession::WriteMmap(const ssize_t body_len) {
+  File& file = wfiles_.front();
+  const off_t offset =
+      wpending_.front().file_start + wpending_.front().file_offset;
+  const off_t end = wpending_.front().file_start + body_len;
+
+  if (wmap_ == NULL || offset < wmap_offset_ ||
+      offset >= wmap_offset_ + (off_t)wmap_len_) {
+    UnmapWfile();
+
+    // Don't map past the end of the file, or touching it raises SIGBUS.
+    struct stat st;
+    if (fstat(file.fd(), &st) < 0 || st.st_size < end)
+      return -1;
+
+    const off_t page = sysconf(_SC_PAGESIZE);
+    const off_t start = offset & ~(page - 1);
+    const size_t len = (end - start < TCPSESSION_MMAP_WINDOW) ?
+        end - start : TCPSESSION_MMAP_WINDOW;
+    void* p = mmap(NULL, len, PROT_READ, MAP_SHARED, file.fd(), start);
+    if (p == MAP_FAILED)
+      return -1;
+
+    madvise(p, len, MADV_SEQUENTIAL);
+    madvise(p, len, MADV_WILLNEED);
+    wmap_ = (char*)p;
+    wmap_offset_ = start;
+    wmap_len_ = len;
+  }
+
+  const size_t left = wmap_offset_ + wmap_len_ - offset;
+  const size_t len = (left < TCPSESSION_MMAP_SLICE) ?
+      left : TCPSESSION_MMAP_SLICE;
+  ssize_t bytes_sent = SSLConn::Write(wmap_ + (offset - wmap_offset_), len);
+  if (error.Event()) {
+    error.AppendMsg("TCPSession::WriteMmap(): file %s, body_len %ld, "
+                    "file_offset %ld: ", file.print().c_str(), body_len,
+                    wpending_.front().file_offset);
+    return 0;
+  }
+  wpending_.front().file_offset += bytes_sent;
+
+  return bytes_sent;
+}
+
+// Routine to munmap(2) our window of the outgoing message's file, if
+// we have one.
+void TCPSession::UnmapWfile(void) {
+  if (wmap_ == NULL)
+    return;
+
+  munmap(wmap_, wmap_len_);
+  wmap_ = NULL;
+  wmap_offset_ = 0;
+  wmap_len_ = 0;
+}
+
+// Routine to append body_len bytes of msg_body to our spool (creating
+// it, if need be).  Returns false on error.
+//
+// Note, this routine can set an ErrorHandler event.
+bool TCPSession::SpoolMsgBody(const char* msg_body, const ssize_t body_len) {
+  if (!spool_.IsOpen()) {
+    string path = spool_dir_;
+    if (!is_path_slash_terminated(path.c_str()))
+      path += "/";
+    path += "tcpsession-spool.XXXXXX";
+    vector<char> tmp_path(path.begin(), path.end());
+    tmp_path.push_back('\0');
+
+    int fd = mkstemp(&tmp_path[0]);
+    if (fd < 0) {
+      error.Init(EX_IOERR, "TCPSession::SpoolMsgBody(): mkstemp(%s) failed: %s",
+                 path.c_str(), strerror(errno));
+      return false;
+    }
+    unlink(&tmp_path[0]);  // no one else needs to see it
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    spool_.set_name(&tmp_path[0]);
+    spool_.set_fd(fd);
+    spool_len_ = 0;
+  }
+
+  ssize_t written = 0;
+  while (written < body_len) {
+    ssize_t n = pwrite(spool_.fd(), msg_body + written, body_len - written,
+                       spool_len_ + written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      error.Init(EX_IOERR, "TCPSession::SpoolMsgBody(): "
+                 "write(%s, %ld) failed: %s", spool_.print().c_str(),
+                 body_len, (n < 0) ? strerror(errno) : "no progress");
+      return false;
+    }
+    written += n;
+  }
+  spool_len_ += body_len;
+
+  return true;
+}
+
+// Routine to copy src's pending spooled message-bodies to our own
+// spool, and point our (copied) outgoing messages at it.
+//
+// Note, as this is only used by the copy constructor, we can't leave
+// an ErrorHandler event; if we fail, we log it and drop our outgoing
+// messages, rather than send them from src's spool.  An event that was
+// already pending when we were called isn't ours to clear, though.
+void TCPSession::CopySpooledMsgs(const TCPSession& src) {
+  const bool had_event = error.Event();
+  char tmp_buf[kFileChunkSize];
+  size_t file_idx = 0;
+  for (vector<MsgInfo>::iterator msg = wpending_.begin();
+       msg != wpending_.end(); msg++) {
+    if (msg->storage != SESSION_USE_DISC)
+      continue;
+    File& file = wfiles_[file_idx++];
+    if (!src.IsSpooled(file))
+      continue;
+
+    const off_t file_start = spool_len_;
+    off_t offset = msg->file_start;
+    ssize_t left = msg->body_len;
+    bool failed = false;
+    while (left > 0) {
+      size_t len = (left < (ssize_t)sizeof(tmp_buf)) ? left : sizeof(tmp_buf);
+      ssize_t n = pread(src.spool_.fd(), tmp_buf, len, offset);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0) {
+        _LOGGER(LOG_ERR, "TCPSession(const TCPSession& src): "
+                "dropping outgoing messages: read(%s, %ld) failed: %s",
+                src.spool_.print().c_str(), (long)offset,
+                (n < 0) ? strerror(errno) : "EOF");
+        failed = true;
+        break;
+      }
+      if (!SpoolMsgBody(tmp_buf, n)) {
+        _LOGGER(LOG_ERR, "TCPSession(const TCPSession& src): "
+                "dropping outgoing messages: %s", error.print().c_str());
+        if (!had_event)
+          error.clear();  // only SpoolMsgBody()'s event
+        failed = true;
+        break;
+      }
+      offset += n;
+      left -= n;
+    }
+    if (failed) {
+      wbuf_len_ = 0;
+      wfiles_.clear();
+      wpending_.clear();
+      if (spool_.IsOpen()) {
+        spool_.PunchHole(0, spool_len_);
+        spool_len_ = 0;
+      }
+      return;
+    }
+
+    msg->file_start = file_start;
+    file = spool_;
+  }
+}
+
+// Routine to give back the spool space of the outgoing message we're
+// about to pop, if it was spooled.  Once nothing spooled is pending,
+// we start the spool over.
+void TCPSession::FreeSpooledMsg(void) {
+  if (!IsSpooled(wfiles_.front()))
+    return;
+
+  for (vector<File>::const_iterator file = wfiles_.begin() + 1;
+       file != wfiles_.end(); file++) {
+    if (IsSpooled(*file)) {
+      spool_.PunchHole(wpending_.front().file_start,
+                       wpending_.front().body_len);
+      return;
+    }
+  }
+
+  spool_.PunchHole(0, spool_len_);
+  spool_len_ = 0;
+}
+
+// Routine to check if file is our spool.
+bool TCPSession::IsSpooled(const File& file) const {
+  return (spool_.IsOpen() && file.IsOpen() && file.fd() == spool_.fd()) ?
+      true : false;
+}
+
+// Routine to check if Read() should splice(2) the rest of the pending
+// message-body to rfile_, i.e., splicing is enabled on an unencrypted
+// session, the message is streaming to an open rfile_, and none of
+// what remains of its body is already in rbuf_.
+bool TCPSession::IsSpliceable(void) const {
+#if defined(__linux__)
+  return (splice_rfile_ && direct_io_ == NULL && ssl() == NULL &&
+          rbuf_len_ == 0 && rpending_.initialized == 1 &&
+          rpending_.storage == SESSION_USE_DISC && rfile_.IsOpen() &&
+          rpending_.file_offset < rpending_.body_len) ? true : false;
+#else
+  return false;
+#endif
 }
 
@@ -8,12 +8,17 @@
 #include <stdint.h>
 #include <time.h>
 
+#include <list>
 #include <string>
 #include <queue>
 #include <vector>
 using namespace std;
 
+#include "AlignedBufPool.h"
+#include "AsyncFileIO.h"
+#include "DurabilitySyncer.h"
 #include "File.h"
+#include "IOUring.h"
 #include "SSLConn.h"
 #include "MsgHdr.h"      // type of framing used
 #include "MsgInfo.h"
@@ -21,6 +26,90 @@ using namespace std;
 // Forward declarations (used if only needed for member function parameters).
 
 // Non-class specific defines & data structures.
+#define TCPSESSION_SPLICE_PIPE_SIZE (1024 * 1024)  // requested, not guaranteed
+#define TCPSESSION_FILE_IO_CHUNK (64 * 1024)  // outgoing file read-ahead
+#define TCPSESSION_IO_URING_MAX_RDATA (1024 * 1024)  // received, not Read()
+#define TCPSESSION_DIRECT_IO_DEPTH 4  // direct reads (or writes) in flight
+#define TCPSESSION_SPOOL_DIR "/tmp"  // see set_spool()
+#define TCPSESSION_MMAP_WINDOW (8 * 1024 * 1024)  // see set_mmap_wfile()
+#define TCPSESSION_MMAP_MIN (64 * 1024)  // smaller file-bodies are copied
+#define TCPSESSION_MMAP_SLICE (16 * 1024)  // one full TLS record
+
+// A chunk of the outgoing file, read (or being read) with direct I/O
+// (see TCPSession::set_direct_io()).
+struct session_direct_chunk {
+  char* buf;                    // from the AlignedBufPool
+  off_t offset;                 // of buf[0] in the file (aligned)
+  ssize_t want;                 // bytes asked for
+  ssize_t len;                  // bytes read, or -1 while outstanding
+  unsigned long gen;            // session_file_io's gen when queued
+};
+
+// State shared by a TCPSession and its AsyncFileIO operations, which
+// can finish after the session is gone (see TCPSession::set_file_io()).
+struct session_file_io {
+  pthread_mutex_t mtx;
+  int refs;                     // the session + each operation
+  int writes;                   // rfile_ writes outstanding
+  int write_err;                // errno of a failed rfile_ write
+  bool reading;                 // wfiles_ open or read outstanding
+  int read_err;                 // errno of a failed open or read
+  unsigned long gen;            // bumped when the outgoing message changes
+  unsigned long read_gen;       // gen when the open or read started
+  int open_fd;                  // descriptor from an open, or -1
+  char* buf;                    // read-ahead of the outgoing file body
+  ssize_t buf_len;              // bytes in buf
+  ssize_t buf_sent;             // bytes of buf already sent
+
+  AlignedBufPool* pool;         // direct I/O buffers go back here
+  list<struct session_direct_chunk> chunks;  // outgoing, in file order
+  int chunk_reads;              // chunks being read
+  off_t read_offset;            // where the next chunk starts, or -1
+  char* stage;                  // incoming data not yet written, or NULL
+  off_t stage_offset;           // of stage[0] in rfile_ (aligned)
+  ssize_t stage_len;            // bytes in stage
+};
+
+// State shared by a TCPSession and its IOUring operations, which can
+// complete after the session is gone (see TCPSession::set_io_uring()).
+// Only touched by the IOUring's (event-loop) thread.
+struct session_io_uring {
+  int refs;                     // the session + each operation
+  IOUring* ring;
+  struct io_uring_req* recv;    // our multishot recv, or NULL
+  char* rdata;                  // received, but not yet moved to rbuf_
+  size_t rdata_len;
+  size_t rdata_size;
+  int recv_err;                 // errno of a failed recv
+  bool eof;
+  int sends;                    // write (& linked file read) operations out
+  int slot;                     // IOUring slot being sent, or -1
+  size_t send_len;              // bytes in slot
+  ssize_t sent;                 // result of our last write, or -1
+  int send_err;                 // errno of a failed write (or file read)
+  unsigned long gen;            // bumped when the outgoing message changes
+  unsigned long send_gen;       // gen when the write was queued
+};
+
+// A received message whose file-body is being made durable (see
+// TCPSession::set_durability()).
+struct session_durability;
+
+struct session_durable_msg {
+  struct session_durability* state;  // who we belong to
+  MsgHdr hdr;                   // rhdr_ when the body was complete
+  File file;                    // rfile_ (closed, not sharing its Descriptor)
+  bool synced;                  // our DurabilitySyncer is done with it
+  int err;                      // errno of a failed sync
+};
+
+// State shared by a TCPSession and its DurabilitySyncer operations,
+// which can finish after the session is gone.
+struct session_durability {
+  pthread_mutex_t mtx;
+  int refs;                     // the session + each operation
+  list<struct session_durable_msg*> msgs;  // in the order received
+};
 
 // Non-class specific utilities.
 
@@ -70,9 +159,30 @@ class TCPSession : public SSLConn {
 
   /** Copy constructor, needed for STL.
    *
+   *  Note, the copy gets its own spool (see set_spool()), i.e., src's
+   *  pending spooled message-bodies are copied to it.
    */
   TCPSession(const TCPSession& src);
 
+  /** Move constructor.
+   *
+   *  Unlike the copy constructor, this does not malloc(3) and copy
+   *  rbuf_ & wbuf_, but takes over src's buffers, queues and
+   *  connection.  The moved-from session has no buffers (or
+   *  Descriptor), so it must not be used until it's been assigned to,
+   *  or clear()'d and Init()'d.
+   *
+   *  Note, neither session's locks are taken, i.e., the caller must
+   *  ensure no other thread is using src.
+   */
+  TCPSession(TCPSession&& src) noexcept;
+
+  /** Move assignment operator.
+   *
+   *  @see TCPSession(TCPSession&&)
+   */
+  TCPSession& operator =(TCPSession&& src) noexcept;
+
 #if 0  // XXX
   /** Equality operator, needed for STL.
    *
@@ -80,7 +190,11 @@ class TCPSession : public SSLConn {
   int operator ==(const TCPSession& other) const;
 #endif
 
-  // Accessors.
+  // Accessors.  Note, the incoming (rfile_, rhdr_) and outgoing
+  // (whdrs_) members are returned by const reference, which is only
+  // valid until the next call that modifies them, e.g.,
+  // ClearIncomingMsg() or delete_whdr(); if you need to hold on to
+  // one across those calls (or across threads), copy it.
   uint8_t framing_type(void) const { return framing_type_; }
   uint16_t handle(void) const { return handle_; }
   time_t timeout(void) const {return timeout_; }
@@ -88,8 +202,8 @@ class TCPSession : public SSLConn {
   char* rbuf(void) const { return rbuf_; }
   ssize_t rbuf_size(void) const { return rbuf_size_; }
   ssize_t rbuf_len(void) const { return rbuf_len_; }
-  File rfile(void) const { return rfile_; }
-  MsgHdr rhdr(void) const { return rhdr_; }
+  const File& rfile(void) const { return rfile_; }
+  const MsgHdr& rhdr(void) const { return rhdr_; }
   const MsgInfo rpending(void) const { return rpending_; }
   pthread_t rtid(void) const { return rtid_; }
 
@@ -97,12 +211,45 @@ class TCPSession : public SSLConn {
   ssize_t wbuf_size(void) const { return wbuf_size_; }
   ssize_t wbuf_len(void) const { return wbuf_len_; }
   int wbuf_cnt(void) const { return wpending_.size(); }
-  list<MsgHdr> whdrs(void) const { return whdrs_; }
+  const list<MsgHdr>& whdrs(void) const { return whdrs_; }
+
+  /** Routine to report what this session costs us in memory.
+   *
+   *  Sums the object itself, our staging buffers (rbuf_ & wbuf_),
+   *  and, if ssl_mem_track() was called at start-up, what OpenSSL
+   *  holds for the connection (e.g., its record buffers, see
+   *  SSLContext::set_release_buffers()).  Queued message meta-data
+   *  and archived headers are not included.
+   *
+   *  @return a size_t of bytes
+   */
+  size_t memory_usage(void) const {
+    return sizeof(*this) + rbuf_size_ + wbuf_size_ + ssl_memory(); }
+  bool splice_rfile(void) const { return splice_rfile_; }
+  bool mmap_wfile(void) const { return mmap_wfile_; }
+  size_t write_behind(void) const { return write_behind_; }
+  AsyncFileIO* file_io(void) const { return file_io_; }
+  IOUring* io_uring(void) const { return io_uring_; }
+  AlignedBufPool* direct_io(void) const { return direct_io_; }
+  DurabilitySyncer* durability(void) const { return durability_; }
+  size_t spool_threshold(void) const { return spool_threshold_; }
 
   // Mutators.
   void set_handle(const uint16_t handle);
   void set_synchronize_status(const uint8_t synchronize_status);
+
+  /** Routine to open the file our incoming message-body streams to.
+   *
+   *  If InitIncomingMsg() has the body's length, its disk space is
+   *  reserved up front (see File::Allocate()).  Note, this routine
+   *  can set an ErrorHandler event.
+   *
+   *  @see ErrorHandler
+   *  @param path a char* of the file's path
+   *  @param len a ssize_t of path's length
+   */
   void set_rfile(const char* path, const ssize_t len);
+
   void set_rtid(const pthread_t rtid);
   void set_connected(const bool connected);
 
@@ -114,6 +261,179 @@ class TCPSession : public SSLConn {
    */
   void set_storage(const int storage);
 
+  /** Routine to splice(2) incoming message-bodies straight to disk.
+   *
+   *  Normally, a message streaming to rfile_ (see set_rfile()) is
+   *  read(2) into rbuf_, write(2)n to rfile_ by StreamIncomingMsg()
+   *  and then shifted out of rbuf_.  When enabled, once rbuf_ holds
+   *  none of the message-body, Read() instead moves the rest of it
+   *  from our socket, through a pipe, to rfile_ with splice(2), so
+   *  it never enters user space; StreamIncomingMsg() is still called
+   *  as before, and closes rfile_ when the body is complete.
+   *
+   *  Only unencrypted sessions on Linux can splice; for others the
+   *  flag is ignored, and if rfile_'s file system can't take spliced
+   *  data, it is cleared.
+   *
+   *  @param splice a bool, true to splice message-bodies to rfile_
+   */
+  void set_splice_rfile(const bool splice);
+
+  /** Routine to send outgoing file-bodies from a mmap(2) of the file.
+   *
+   *  sendfile(2) can't be used under SSL_write(3), so an encrypted
+   *  session normally pread(2)s its file-body kFileChunkSize bytes at
+   *  a time, and encrypts from that copy.  When set, Write() instead
+   *  maps the file TCPSESSION_MMAP_WINDOW bytes at a time (with
+   *  MADV_SEQUENTIAL & MADV_WILLNEED, so the kernel reads ahead of
+   *  us), and hands SSLConn::Write() the mapping itself, one
+   *  TCPSESSION_MMAP_SLICE (i.e., a full TLS record) at a time.
+   *
+   *  Only encrypted sessions sending file-bodies of at least
+   *  TCPSESSION_MMAP_MIN bytes themselves (i.e., not through
+   *  set_file_io() or set_direct_io()) use the mapping; if a file
+   *  can't be mapped, it is copied as before.  Note, a file that is
+   *  truncated while mapped raises SIGBUS, which is why this is off
+   *  by default.
+   *
+   *  @param mmap a bool, true to send file-bodies from a mapping
+   */
+  void set_mmap_wfile(const bool mmap);
+
+  /** Routine to keep large file transfers out of the page cache.
+   *
+   *  Each time another window bytes of an incoming message-body have
+   *  been written to rfile_, we start writing them back to disk
+   *  (File::WriteBehind()) and drop the window before them from the
+   *  page cache; likewise, an outgoing message's file is dropped
+   *  window by window as it's sent.  This keeps one big transfer
+   *  from pushing everything else out of memory (and a burst of
+   *  writeback when the kernel gets around to it), at the cost of
+   *  re-reading the files from disk if they're used again soon.
+   *  0 (the default) leaves the page cache alone.
+   *
+   *  Regardless, rfile_ is preallocated (see set_rfile()), and
+   *  outgoing files are read with POSIX_FADV_SEQUENTIAL.
+   *
+   *  @param window a size_t of bytes, e.g., 8 MB, or 0
+   */
+  void set_write_behind(const size_t window);
+
+  /** Routine to do our disk I/O through an AsyncFileIO.
+   *
+   *  StreamIncomingMsg() then hands each chunk of the message-body
+   *  to file_io to be written to rfile_, and keeps returning 1 until
+   *  all of those writes have finished.  Write() has file_io open
+   *  an outgoing message's file and read its body ahead of us, and
+   *  sends nothing while a read is outstanding.  Either way, the
+   *  event-loop should call us again after AsyncFileIO::Complete()
+   *  (see IsFileIOPending()).  If file_io's queue is full, we simply
+   *  do the work ourselves.  NULL (the default) goes back to
+   *  blocking I/O.
+   *
+   *  @param file_io an AsyncFileIO*, which must outlive us, or NULL
+   */
+  void set_file_io(AsyncFileIO* file_io);
+
+  /** Routine to do our socket I/O through an IOUring.
+   *
+   *  Read() then keeps a multishot recv queued on our socket, and
+   *  returns whatever it has received (which is copied out of the
+   *  ring's receive buffers as it completes).  Write() copies the
+   *  next chunk of the outgoing message into one of the ring's
+   *  slots and queues its write; a file body is read into the slot
+   *  by the ring, too (linked ahead of the write).  Neither makes a
+   *  system call, i.e., the event-loop hands everything queued to
+   *  the kernel at once with IOUring::Submit(), and after
+   *  IOUring::Complete() calls Read() & Write() again to pick up the
+   *  results.  While IsIOUringPending(), the ring, not poll(2),
+   *  tells the event-loop about our socket.
+   *
+   *  Only unencrypted sessions use the ring (OpenSSL does its own
+   *  socket I/O), and only if io_uring was set up with both
+   *  IOUring::RegisterBuffers() & IOUring::RegisterRecvBuffers();
+   *  otherwise, or if the ring has no free slot, we do blocking I/O
+   *  as usual.  Set it before our first Read().  NULL (the default)
+   *  is blocking I/O.
+   *
+   *  @param io_uring an IOUring*, which must outlive us, or NULL
+   */
+  void set_io_uring(IOUring* io_uring);
+
+  /** Routine to move file-bodies with direct I/O, i.e., around the
+   *  page cache.
+   *
+   *  For bulk transfers, e.g., replicating a data set many times the
+   *  size of memory, the page cache only gets in the way: the files
+   *  we send are read once, and the files we receive are written
+   *  once, yet both push everything else out of memory.  When set,
+   *  rfile_ and outgoing files are opened with File::OpenDirect(),
+   *  and all of their I/O is done in pool's (aligned) buffers:
+   *  StreamIncomingMsg() stages the message-body into one, writing
+   *  it out each time it fills (and the padded tail when the body is
+   *  done, after which rfile_ is truncated to the body's length);
+   *  Write() reads the file a buffer at a time (at aligned offsets)
+   *  and sends from there.  With set_file_io(), up to
+   *  TCPSESSION_DIRECT_IO_DEPTH reads are kept ahead of the socket
+   *  (or writes behind it), otherwise we do one at a time ourselves.
+   *
+   *  Direct I/O bypasses set_splice_rfile(), the file_cache (the
+   *  descriptors it shares aren't O_DIRECT) and set_io_uring()'s
+   *  file-body reads.  If a file system can't do direct I/O, the same
+   *  aligned I/O simply goes through the page cache.  Set it before
+   *  the first transfer.  NULL (the default) goes back to buffered
+   *  I/O.
+   *
+   *  @param pool an AlignedBufPool*, Init()'d with an alignment of
+   *  FILE_DIRECT_IO_ALIGN, which must outlive us (and our AsyncFileIO
+   *  operations), or NULL
+   */
+  void set_direct_io(AlignedBufPool* pool);
+
+  /** Routine to make received file-bodies durable before they're
+   *  acknowledged.
+   *
+   *  rfile_.Close() only guarantees the data is in the page cache,
+   *  and fsync(2)ing each file ourselves would hold up the session
+   *  (and limit us to one disk flush per message).  When set,
+   *  StreamIncomingMsg() hands each completed file-body (and its
+   *  directory) to syncer, which syncs it along with everyone
+   *  else's in its next batch, and records the message (its header
+   *  and file).  The body is complete as before, but the message
+   *  shouldn't be acknowledged (e.g., with a MSG_ACK_FILE) until
+   *  PopDurableMsg() returns it, which it will after the event-loop
+   *  calls DurabilitySyncer::Complete().  If syncer isn't running,
+   *  StreamIncomingMsg() syncs the file itself.  NULL (the default)
+   *  leaves durability to the kernel.
+   *
+   *  @param syncer a DurabilitySyncer*, which must outlive us, or NULL
+   */
+  void set_durability(DurabilitySyncer* syncer);
+
+  /** Routine to spool outgoing message-bodies to disk once too much
+   *  is queued in memory.
+   *
+   *  AddMsgBuf() copies each message into wbuf_, which, with a slow
+   *  peer, grows without bound.  When set, once wbuf_ holds more
+   *  than threshold bytes, AddMsgBuf() instead appends the body to
+   *  our spool, a (deleted) file in dir, and queues the message as
+   *  if it had been added with AddMsgFile(), i.e., only its header
+   *  stays in wbuf_, and Write() sends the body from the spool like
+   *  any other file-body (through our AsyncFileIO or IOUring, if
+   *  set).  Messages are still sent in the order they were added.
+   *  As spooled messages are popped, their disk space is freed, and
+   *  once none are left, the spool is emptied.  0 (the default)
+   *  never spools.
+   *
+   *  Note, spooled bodies are never sent with direct I/O, as they
+   *  were just written through the page cache.
+   *
+   *  @param threshold a size_t of bytes in wbuf_, e.g., 4 MB, or 0
+   *  @param dir a char* of where to create the spool, or NULL for
+   *  TCPSESSION_SPOOL_DIR
+   */
+  void set_spool(const size_t threshold, const char* dir);
+
   /** Routine to remove a MsgHdr from our write-headers (whdrs_).
    *
    */
@@ -195,16 +515,34 @@ class TCPSession : public SSLConn {
    *  We load the MsgHdr into our whdrs_ list, add the framing header
    *  (msg_hdr) to our wbuf_ buffer, update wbuf_'s control varibles,
    *  add the file (msg_body) to our wfiles_ list, and build our
-   *  outgoing message's meta-data (wpending_).
+   *  outgoing message's meta-data (wpending_).  The file is opened
+   *  (when we get to it) through the process-wide file_cache.
    *
    *  Note, this routine can set an ErrorHandler event.
    *
+   *  @see FileCache
    *  @param whdr is a MsgHdr representing framing header of the message
    */
   bool AddMsgFile(const char* framing_hdr, const ssize_t hdr_len, 
                   const File& msg_body, const ssize_t body_len, 
                   const MsgHdr& whdr);
 
+  /** Routine to connect(2) to our peer.
+   *
+   *  Calls SSLConn::Connect(), but first, if the first message in
+   *  our outgoing queue is in memory and idempotent (see
+   *  MsgHdr::IsMsgIdempotent()), offers it as TLS 1.3 early data,
+   *  which a server we've talked to before can accept along with our
+   *  ClientHello.  Write() skips whatever part of the message the
+   *  server accepted.
+   *
+   *  Note, this routine can set an ErrorHandler event.
+   *
+   *  @see SSLConn::set_early_data()
+   *  @see ErrorHandler
+   */
+  void Connect(void);
+
   ssize_t Read(bool* eof);  // ErrorHandler
   ssize_t Write(void);  // ErrorHandler
 
@@ -214,6 +552,20 @@ class TCPSession : public SSLConn {
   // void ShiftWpending(void);
   void PopOutgoingMsgQueue(void);
 
+  /** Routine to take the next received message whose file-body is
+   *  now durable (see set_durability()).
+   *
+   *  Messages are returned in the order they were received; one
+   *  still being synced holds up those after it.
+   *
+   *  @param hdr is set to the message's header
+   *  @param file is set to the (closed) file the body was written to
+   *  @param err is set to 0, or the errno if the file could not be
+   *  synced (i.e., it should not be acknowledged)
+   *  @return false if no message is ready
+   */
+  bool PopDurableMsg(MsgHdr* hdr, File* file, int* err);
+
   // Boolean checks.
   bool IsSynchroniationEnabled(void) const { return synchronize_connection_; }
   bool IsIncomingMsgInitialized(void) const {
@@ -222,14 +574,26 @@ class TCPSession : public SSLConn {
     return rpending_.storage_initialized; }
   bool IsIncomingDataStreaming(void) const { 
     return (rpending_.storage == SESSION_USE_DISC) ? true : false; }
-  bool IsIncomingMsgComplete(void) const {
-    return ((rpending_.initialized == 1) && 
-            ((rpending_.file_offset >= 
-              rpending_.body_len) ||
-             (rbuf_len_ >= rpending_.body_len))) ? true : false;
-  }
+
+  /** Routine to see if all of our incoming message has arrived.
+   *
+   *  A body streamed to rfile_ through our AsyncFileIO (or direct
+   *  I/O stage) isn't complete until those writes are done, i.e.,
+   *  until StreamIncomingMsg() returns 0.
+   */
+  bool IsIncomingMsgComplete(void) const;
   bool IsIncomingMsgBeingProcessed(void) const {
     return (rtid_ > 0) ? true : false; }
+
+  /** Routine to see if (some of) our incoming message was early data.
+   *
+   *  TLS 1.3 early data can be replayed by an attacker, so a message
+   *  that arrived (even partly) that way should only be acted upon if
+   *  it is idempotent.
+   *
+   *  @see SSLContext::set_max_early_data()
+   */
+  bool IsIncomingMsgEarlyData(void) const { return rpending_.early_data; }
   bool IsOutgoingMsgSent(void) const {
     return (wpending_.size() && 
             ((wpending_.front().buf_offset >=
@@ -241,6 +605,27 @@ class TCPSession : public SSLConn {
   }
   bool IsOutgoingDataPending(void) const;
 
+  /** Routine to see if we're waiting on our AsyncFileIO.
+   *
+   *  While true, Write() may have nothing to send and
+   *  StreamIncomingMsg() can't finish, so the event-loop needn't
+   *  poll(2) for us until AsyncFileIO::Complete() has run.
+   */
+  bool IsFileIOPending(void) const;
+
+  /** Routine to see if we're waiting on our IOUring.
+   *
+   *  While true, the event-loop should not poll(2) our socket; our
+   *  IOUring's completions will call for us.
+   */
+  bool IsIOUringPending(void) const;
+
+  /** Routine to see if a received file-body is still being synced
+   *  by our DurabilitySyncer.
+   *
+   */
+  bool IsDurabilityPending(void) const;
+
   // Flags.
 
  protected:
@@ -259,9 +644,32 @@ class TCPSession : public SSLConn {
   char* rbuf_;                  // incoming read buffer
   ssize_t rbuf_size_;           // maximum size of rbuf
   ssize_t rbuf_len_;            // marks end of data in rbuf
+  ssize_t rbuf_early_len_;      // data at the start of rbuf that
+                                // arrived as TLS early data
   File rfile_;                  // File object to stream incoming data to
   MsgInfo rpending_;            // message meta-data for pending read data
   MsgHdr rhdr_;                 // the parsed message-header of current msg
+  bool splice_rfile_;           // splice(2) message-bodies to rfile_
+  bool mmap_wfile_;             // send file-bodies from a mmap(2)
+  char* wmap_;                  // window of wfiles_.front(), or NULL
+  off_t wmap_offset_;           // of wmap_[0] in the file (page aligned)
+  size_t wmap_len_;             // bytes mapped
+  size_t write_behind_;         // see set_write_behind(), or 0
+  off_t rfile_behind_;          // rfile_ is written back up to here
+  off_t wfile_behind_;          // wfiles_.front() is dropped up to
+                                // here, or -1 until it's been advised
+  int splice_fds_[2];           // pipe(2) for splice(2), or -1 until used
+  AsyncFileIO* file_io_;        // where our disk I/O goes, or NULL
+  struct session_file_io* file_io_state_;  // created on first use
+  IOUring* io_uring_;           // where our socket I/O goes, or NULL
+  struct session_io_uring* io_uring_state_;  // created on first use
+  AlignedBufPool* direct_io_;   // buffers for direct I/O, or NULL
+  DurabilitySyncer* durability_;  // syncs completed rfile_s, or NULL
+  struct session_durability* durability_state_;  // created on first use
+  size_t spool_threshold_;      // see set_spool(), or 0
+  string spool_dir_;            // where our spool is created
+  File spool_;                  // spooled message-bodies, opened on first use
+  off_t spool_len_;             // where the next body is appended
   pthread_t rtid_;              // identifier of thread handeling the
                                 // next available incoming message (or
                                 // 0 if single-threaded)
@@ -288,6 +696,40 @@ class TCPSession : public SSLConn {
   void ResetRbuf(void);
   void ResetWbuf(void);
 
+  /** Routine to splice(2) message-body data from our socket to rfile_.
+   *
+   *  Called by Read() in place of SSLConn::Read() when IsSpliceable().
+   *  Note, this routine can set an ErrorHandler event.
+   *
+   *  @param eof is set to true if our peer closed the connection
+   *  @return a ssize_t of bytes moved to rfile_
+   */
+  ssize_t SpliceRfile(bool* eof);
+  bool InitFileIO(void);
+  void ResetFileIO(void);
+  bool QueueRfileWrite(const ssize_t len);
+  ssize_t WriteFileIO(const ssize_t body_len);
+  ssize_t StageRfileDirect(const ssize_t len);
+  bool WriteRfileStage(void);
+  void SyncRfile(void);
+  void DropRfileStage(void);
+  bool ReadAheadDirect(const ssize_t body_len);
+  ssize_t WriteDirect(const ssize_t body_len);
+  bool InitIOUring(void);
+  void ResetIOUring(void);
+  ssize_t ReadIOUring(const ssize_t buf_len, char* buf, bool* eof);
+  ssize_t WriteIOUring(const ssize_t hdr_len, const ssize_t body_len);
+  ssize_t WriteMmap(const ssize_t body_len);
+  void UnmapWfile(void);
+  bool SpoolMsgBody(const char* msg_body, const ssize_t body_len);
+  void CopySpooledMsgs(const TCPSession& src);
+  void FreeSpooledMsg(void);
+  bool IsSpooled(const File& file) const;
+  void CloseSplicePipe(void);
+  void AdviseRfile(const bool done);
+  void AdviseWfile(const bool done);
+  bool IsSpliceable(void) const;
+
   pthread_mutex_t incoming_mtx;  // lock for rbuf_ & friends
   pthread_mutex_t outgoing_mtx;  // lock for wbuf_ & friends
 
@@ -12,6 +12,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <utility>       // for std::move
+
 #include "Logger.h"
 #include "TCPConn.h"
 
@@ -80,6 +82,27 @@ URL& URL::operator =(const URL& src) {
   return *this;
 }
 
+// Move constructor & assignment.
+URL::URL(URL&& src) noexcept
+    : scheme_(std::move(src.scheme_)), host_(std::move(src.host_)), 
+      path_(std::move(src.path_)), query_(std::move(src.query_)), 
+      fragment_(std::move(src.fragment_)) {
+  port_ = src.port_;
+  src.port_ = URL_PORT_NULL;
+}
+
+URL& URL::operator =(URL&& src) noexcept {
+  scheme_ = std::move(src.scheme_);
+  host_ = std::move(src.host_);
+  port_ = src.port_;
+  path_ = std::move(src.path_);
+  query_ = std::move(src.query_);
+  fragment_ = std::move(src.fragment_);
+  src.port_ = URL_PORT_NULL;
+
+  return *this;
+}
+
 // Accessors & mutators.
 
 void URL::set_scheme(const char* scheme) {
@@ -67,12 +67,23 @@ class URL {
    */
   URL& operator =(const URL& src);
 
+  /** Move constructor.
+   *
+   *  Steals src's strings & query list (src is left empty).
+   */
+  URL(URL&& src) noexcept;
+
+  /** Move assignment operator.
+   *
+   */
+  URL& operator =(URL&& src) noexcept;
+
   // Accessors.
   string scheme(void) const { return scheme_; }
   string host(void) const { return host_; }
   in_port_t port(void) const { return port_; }
   string path(void) const { return path_; }
-  list<struct url_query_info> query(void) const { return query_; }
+  const list<struct url_query_info>& query(void) const { return query_; }
   string fragment(void) const { return fragment_; }
 
   // Mutators.
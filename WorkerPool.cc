@@ -0,0 +1,194 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Logger.h"
+#include "WorkerPool.h"
+
+#define DEBUG_CLASS 0
+
+#define SCRATCH_BUF_SIZE 256
+
+// Non-class specific defines & data structures.
+
+// Non-class specific utility functions.
+
+// Routine run by each of our threads: pull a job off the queue, run
+// it and tell the event-loop about it.
+void* worker_pool_thread(void* arg) {
+  WorkerPool* pool = (WorkerPool*)arg;
+
+  pthread_mutex_lock(&pool->jobs_mtx_);
+  while (1) {
+    while (pool->running_ && pool->jobs_.empty())
+      pthread_cond_wait(&pool->jobs_cond_, &pool->jobs_mtx_);
+    if (pool->jobs_.empty())
+      break;  // shutting down, and the queue is drained
+
+    struct worker_job job = pool->jobs_.front();
+    pool->jobs_.pop_front();
+    pthread_mutex_unlock(&pool->jobs_mtx_);
+
+    job.run(job.arg);
+    __atomic_fetch_add(&pool->jobs_completed_, 1, __ATOMIC_RELAXED);
+
+    // If the pipe is full, the event-loop already has plenty to look
+    // at, so we don't care about EAGAIN.
+
+    char c = 0;
+    if (write(pool->notify_fds_[1], &c, 1) < 0 && errno != EAGAIN)
+      warn("worker_pool_thread(): write(2) failed");
+
+    pthread_mutex_lock(&pool->jobs_mtx_);
+  }
+  pthread_mutex_unlock(&pool->jobs_mtx_);
+
+  return NULL;
+}
+
+
+// WorkerPool Class.
+
+// Constructors and destructor.
+WorkerPool::WorkerPool(void) {
+#if DEBUG_CLASS
+  warnx("WorkerPool::WorkerPool(void) called.");
+#endif
+
+  max_jobs_ = WORKERPOOL_DEFAULT_MAX_JOBS;
+  running_ = false;
+  notify_fds_[0] = notify_fds_[1] = -1;
+  jobs_completed_ = 0;
+  pthread_mutex_init(&jobs_mtx_, NULL);
+  pthread_cond_init(&jobs_cond_, NULL);
+}
+
+WorkerPool::~WorkerPool(void) {
+#if DEBUG_CLASS
+  warnx("WorkerPool::~WorkerPool(void) called.");
+#endif
+
+  Shutdown();
+
+  if (notify_fds_[0] >= 0)
+    close(notify_fds_[0]);
+  if (notify_fds_[1] >= 0)
+    close(notify_fds_[1]);
+
+  pthread_cond_destroy(&jobs_cond_);
+  pthread_mutex_destroy(&jobs_mtx_);
+}
+
+// Accessors.
+size_t WorkerPool::pending(void) const {
+  pthread_mutex_lock(&jobs_mtx_);
+  size_t cnt = jobs_.size();
+  pthread_mutex_unlock(&jobs_mtx_);
+
+  return cnt;
+}
+
+// Mutators.
+
+// WorkerPool manipulation.
+
+// Routine to start our threads.
+//
+// Note, this routine can set an ErrorHandler event.
+void WorkerPool::Init(const size_t num_threads, const size_t max_jobs) {
+  if (running_) {
+    error.Init(EX_SOFTWARE, "WorkerPool::Init(): already running");
+    return;
+  }
+
+  size_t cnt = num_threads;
+  if (cnt == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cnt = (cpus > 0) ? (size_t)cpus : 1;
+  }
+  max_jobs_ = (max_jobs > 0) ? max_jobs : WORKERPOOL_DEFAULT_MAX_JOBS;
+
+  if (notify_fds_[0] < 0) {
+    if (pipe(notify_fds_) < 0) {
+      error.Init(EX_OSERR, "WorkerPool::Init(): pipe(2) failed: %s",
+                 strerror(errno));
+      return;
+    }
+    for (int i = 0; i < 2; i++) {
+      fcntl(notify_fds_[i], F_SETFL,
+            fcntl(notify_fds_[i], F_GETFL, 0) | O_NONBLOCK);
+      fcntl(notify_fds_[i], F_SETFD, FD_CLOEXEC);
+    }
+  }
+
+  running_ = true;
+  for (size_t i = 0; i < cnt; i++) {
+    pthread_t tid;
+    int ret = pthread_create(&tid, NULL, worker_pool_thread, this);
+    if (ret != 0) {
+      error.Init(EX_OSERR, "WorkerPool::Init(): pthread_create(3) failed: %s",
+                 strerror(ret));
+      Shutdown();
+      return;
+    }
+    threads_.push_back(tid);
+  }
+
+  _LOGGER(LOG_INFO, "WorkerPool::Init(): started %lu thread(s), "
+          "queue size: %lu.", (unsigned long)threads_.size(),
+          (unsigned long)max_jobs_);
+}
+
+// Routine to queue a job.
+bool WorkerPool::Submit(worker_job_fn run, void* arg) {
+  if (run == NULL)
+    return false;
+
+  pthread_mutex_lock(&jobs_mtx_);
+  if (!running_ || jobs_.size() >= max_jobs_) {
+    pthread_mutex_unlock(&jobs_mtx_);
+    return false;
+  }
+
+  struct worker_job job;
+  job.run = run;
+  job.arg = arg;
+  jobs_.push_back(job);
+  pthread_cond_signal(&jobs_cond_);
+  pthread_mutex_unlock(&jobs_mtx_);
+
+  return true;
+}
+
+// Routine to read all pending notifications.
+size_t WorkerPool::Drain(void) {
+  if (notify_fds_[0] < 0)
+    return 0;
+
+  size_t cnt = 0;
+  char buf[SCRATCH_BUF_SIZE];
+  ssize_t n;
+  while ((n = read(notify_fds_[0], buf, sizeof(buf))) > 0)
+    cnt += n;
+
+  return cnt;
+}
+
+// Routine to stop (and join) our threads.
+void WorkerPool::Shutdown(void) {
+  pthread_mutex_lock(&jobs_mtx_);
+  running_ = false;
+  pthread_cond_broadcast(&jobs_cond_);
+  pthread_mutex_unlock(&jobs_mtx_);
+
+  for (size_t i = 0; i < threads_.size(); i++)
+    pthread_join(threads_[i], NULL);
+  threads_.clear();
+}
+
+// Boolean checks.
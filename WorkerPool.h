@@ -0,0 +1,135 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+
+#ifndef _WORKERPOOL_H_
+#define _WORKERPOOL_H_
+
+#include <sys/types.h>
+
+#include <pthread.h>
+
+#include <list>
+#include <vector>
+using namespace std;
+
+#include "ErrorHandler.h"
+
+
+// Forward declarations (used if only needed for member function parameters).
+
+// Non-class specific defines & data structures.
+#define WORKERPOOL_DEFAULT_MAX_JOBS 1024
+
+typedef void (*worker_job_fn)(void* arg);
+
+struct worker_job {
+  worker_job_fn run;
+  void* arg;
+};
+
+// Non-class specific utilities.
+
+
+/** Class for running CPU-bound work off of the event-loop thread.
+ *
+ *  WorkerPool is a fixed set of threads pulling jobs (a function
+ *  pointer and its argument) from a bounded queue.  Every time a job
+ *  finishes, a byte is written to notify_fd(), so an event-loop can
+ *  include it in its poll(2) set, and after calling Drain(), look at
+ *  the objects it handed off.  The pool knows nothing about the jobs
+ *  themselves, i.e., a job must record its own result (and must not
+ *  use the global ErrorHandler, which is not thread-safe).
+ *
+ *  Submit() never blocks; if the queue is full, it returns false and
+ *  the caller should simply do the work itself.
+ *
+ *  RCSID: $Id: $
+ *
+ *  @see SSLContext::set_handshake_pool()
+ *  @author Andrew K. Adams <akadams@psc.edu>
+ */
+class WorkerPool {
+ public:
+  /** Constructor.
+   *
+   */
+  WorkerPool(void);
+
+  /** Destructor.
+   *
+   *  Waits for all queued jobs to finish.
+   */
+  virtual ~WorkerPool(void);
+
+  // Accessors.
+  size_t num_threads(void) const { return threads_.size(); }
+  size_t max_jobs(void) const { return max_jobs_; }
+  int notify_fd(void) const { return notify_fds_[0]; }
+  size_t pending(void) const;
+  unsigned long jobs_completed(void) const {
+    return __atomic_load_n(&jobs_completed_, __ATOMIC_RELAXED); }
+
+  // Mutators.
+
+  // WorkerPool manipulation.
+
+  /** Routine to start the pool's threads.
+   *
+   *  Note, this routine can set an ErrorHandler event if it
+   *  encounters an unrecoverable error.
+   *
+   *  @see ErrorHandler
+   *  @param num_threads a size_t of threads (0 uses one per online CPU)
+   *  @param max_jobs a size_t of jobs that may be queued at once
+   */
+  void Init(const size_t num_threads, const size_t max_jobs);
+
+  /** Routine to queue a job.
+   *
+   *  @param run a worker_job_fn to call from one of our threads
+   *  @param arg a void* passed to run
+   *  @return false if the pool is not running or the queue is full
+   */
+  bool Submit(worker_job_fn run, void* arg);
+
+  /** Routine to empty notify_fd().
+   *
+   *  Should be called by the event-loop when notify_fd() is readable.
+   *
+   *  @return the number of completions we were notified of
+   */
+  size_t Drain(void);
+
+  /** Routine to stop the pool.
+   *
+   *  Lets the queued jobs finish, then joins all threads.
+   */
+  void Shutdown(void);
+
+  // Boolean checks.
+
+  // Flags.
+
+  friend void* worker_pool_thread(void* arg);
+
+ protected:
+  // Data members.
+  vector<pthread_t> threads_;
+  list<struct worker_job> jobs_;  // queued (not yet running) jobs
+  size_t max_jobs_;
+  bool running_;
+  int notify_fds_[2];           // pipe(2), [0] is polled by the event-loop
+  unsigned long jobs_completed_;  // updated atomically
+
+  mutable pthread_mutex_t jobs_mtx_;  // lock for jobs_ & running_
+  pthread_cond_t jobs_cond_;
+
+ private:
+  // Dummy declarations for copy constructor and assignment & equality operator.
+  WorkerPool(const WorkerPool& src);
+  WorkerPool& operator =(const WorkerPool& src);
+  int operator ==(const WorkerPool& other) const;
+};
+
+
+#endif  /* #ifndef _WORKERPOOL_H_ */
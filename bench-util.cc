@@ -0,0 +1,122 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ErrorHandler.h"
+#include "bench-util.h"
+
+const char* bench_name = "bench";
+const char* tmp_dir = NULL;
+pid_t client_pid = 0;
+
+static char tmp_dir_buf[PATH_MAX];
+
+
+// Non-class specific utility functions.
+
+// Routine to record our name, make tmp_dir & register its cleanup.
+void bench_init(const char* name, const char* parent, void (*cleanup)(void)) {
+  bench_name = name;
+
+  snprintf(tmp_dir_buf, sizeof(tmp_dir_buf), "%s/%s.XXXXXX", parent, name);
+  if ((tmp_dir = mkdtemp(tmp_dir_buf)) == NULL)
+    err(EX_CANTCREAT, "mkdtemp(%s)", tmp_dir_buf);
+  client_pid = getpid();
+  atexit(cleanup);
+}
+
+// Routine to return the current (monotonic) time in microseconds.
+double now_usec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+// Routine to return the user + system CPU we have used, in
+// microseconds, and (optionally) our voluntary context switches.
+unsigned long cpu_usec(unsigned long* ctx_switches) {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  if (ctx_switches != NULL)
+    *ctx_switches = ru.ru_nvcsw;
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000UL +
+      ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+// Routine to report an ErrorHandler event and exit.
+void exit_on_error(const char* who) {
+  if (!error.Event())
+    return;
+
+  fprintf(stderr, "%s: %s: %s\n", bench_name, who, error.print().c_str());
+  if (getpid() == client_pid)
+    exit(EX_SOFTWARE);  // remove tmp_dir
+  _exit(EX_SOFTWARE);
+}
+
+// Routine to fork(2) a server, which reports back over a pipe.
+pid_t fork_server_process(in_port_t* port, int* result_fd) {
+  int fds[2];
+  if (pipe(fds) < 0)
+    err(EX_OSERR, "pipe()");
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0)
+    err(EX_OSERR, "fork()");
+
+  if (pid > 0) {
+    close(fds[1]);
+    if (read(fds[0], port, sizeof(*port)) != sizeof(*port))
+      errx(EX_SOFTWARE, "server failed to start");
+    *result_fd = fds[0];
+    return pid;
+  }
+
+  close(fds[0]);
+  *result_fd = fds[1];
+  return 0;
+}
+
+// Routine to send the client the port listen_fd is bound to.
+void report_port(const int result_fd, const int listen_fd) {
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  if (getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len) < 0)
+    _exit(EX_OSERR);  // TCPConn::Getsockname() wants a connected socket
+  in_port_t listen_port = ntohs(addr.sin_port);
+  if (write(result_fd, &listen_port, sizeof(listen_port)) < 0)
+    _exit(EX_OSERR);
+}
+
+// Routine to send the client our stats and exit.
+void report_stats_and_exit(const int result_fd, const void* stats,
+                           const size_t len) {
+  if (write(result_fd, stats, len) < 0)
+    _exit(EX_OSERR);
+  _exit(0);
+}
+
+// Routine to collect the forked server's stats & exit status.
+bool wait_server(const pid_t pid, const int result_fd, void* stats,
+                 const size_t len) {
+  ssize_t n = read(result_fd, stats, len);
+  close(result_fd);
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return (n == (ssize_t)len && WIFEXITED(status) &&
+          WEXITSTATUS(status) == 0) ? true : false;
+}
@@ -0,0 +1,78 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+//
+// bench-util: the harness shared by our benchmarks (ssl-bench,
+// uring-bench & direct-bench).
+//
+// Each benchmark forks a server (ErrorHandler isn't thread-safe, so
+// the two ends can't share a process), which tells us the ephemeral
+// port it is listening on over a pipe, serves the run, and then
+// writes its stats back over the same pipe.  The benchmark's files
+// live in a temporary directory that only the client (not the
+// forked servers) removes at exit.
+
+#ifndef _BENCH_UTIL_H_
+#define _BENCH_UTIL_H_
+
+#include <sys/types.h>
+
+#include <netinet/in.h>
+
+#include <limits.h>
+
+
+// Non-class specific defines & data structures.
+
+extern const char* bench_name;       // prefix for our error messages
+extern const char* tmp_dir;          // set by bench_init()
+extern pid_t client_pid;             // forked servers must not run atexit(3)
+
+// Non-class specific utilities.
+
+/** Routine to record our name (for exit_on_error()), make tmp_dir
+ *  as name.XXXXXX in parent, and register cleanup (which should
+ *  remove tmp_dir & its contents) to be run when the client exits.
+ */
+void bench_init(const char* name, const char* parent, void (*cleanup)(void));
+
+/** Routine to return the current (monotonic) time in microseconds. */
+double now_usec(void);
+
+/** Routine to return the user + system CPU we have used, in
+ *  microseconds, and (optionally) our voluntary context switches.
+ */
+unsigned long cpu_usec(unsigned long* ctx_switches = NULL);
+
+/** Routine to report an ErrorHandler event and exit; used by both
+ *  the client & the forked server.
+ */
+void exit_on_error(const char* who);
+
+/** Routine to fork(2) a server.
+ *
+ *  In the parent, sets port to the one the server reports (see
+ *  report_port()) and result_fd to where it will write its stats,
+ *  and returns the server's pid.  In the child, sets result_fd to
+ *  our end of the pipe and returns 0.
+ */
+pid_t fork_server_process(in_port_t* port, int* result_fd);
+
+/** Routine (for the forked server) to tell the client the port that
+ *  listen_fd is bound to.
+ */
+void report_port(const int result_fd, const int listen_fd);
+
+/** Routine (for the forked server) to send the client len bytes of
+ *  stats and exit.
+ */
+void report_stats_and_exit(const int result_fd, const void* stats,
+                           const size_t len) __attribute__((noreturn));
+
+/** Routine to collect the forked server's len bytes of stats & exit
+ *  status; returns false if either is missing (or bad).
+ */
+bool wait_server(const pid_t pid, const int result_fd, void* stats,
+                 const size_t len);
+
+
+#endif  /* #ifndef _BENCH_UTIL_H_ */
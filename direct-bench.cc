@@ -0,0 +1,498 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+//
+// direct-bench: compares TCPSession's buffered file transfers with
+// its direct I/O mode (see TCPSession::set_direct_io()), over
+// loopback.
+//
+// Each run forks an HTTP server (ErrorHandler isn't thread-safe, so
+// the two ends can't share a process), which sends a large file as
+// the message-body of its response; we stream the body to a file of
+// our own.  Both ends use the same mode (buffered or direct) and
+// engine (blocking disk I/O, or an AsyncFileIO).  The source file is
+// dropped from the page cache before each run, and afterwards we
+// report how much of both files the page cache holds, i.e., what the
+// transfer pushed out of memory, then check the received file.
+// Each run is repeated with DIRECT_BENCH_TAIL_LEN more bytes, so the
+// (unaligned) tail of the file gets checked, too.
+// Results are written to stdout, one JSON object per line, so they
+// can be compared between builds.
+//
+// Note, the files are created in the current directory (or -d dir),
+// which should be on the file system being measured; /tmp may well be
+// a tmpfs.
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ErrorHandler.h"
+#include "Logger.h"
+#include "AlignedBufPool.h"
+#include "AsyncFileIO.h"
+#include "File.h"
+#include "HTTPFraming.h"
+#include "MsgHdr.h"
+#include "TCPConn.h"
+#include "TCPSession.h"
+#include "WorkerPool.h"
+#include "bench-util.h"
+
+#define DIRECT_BENCH_DEFAULT_MBYTES 256
+#define DIRECT_BENCH_THREADS 4             // for ENGINE_FILE_IO
+#define DIRECT_BENCH_CHUNK_LEN (64 * 1024)  // make_file() & check_file()
+#define DIRECT_BENCH_HOST "127.0.0.1"
+#define DIRECT_BENCH_FILE "direct-bench.dat"
+#define DIRECT_BENCH_OUT_FILE "direct-bench.out"
+#define DIRECT_BENCH_TAIL_LEN 12345         // bytes past the last block
+
+// Non-class specific defines & data structures.
+
+// How both ends move the file-body.
+enum { MODE_BUFFERED, MODE_DIRECT };
+static const char* mode_names[] = { "buffered", "direct" };
+
+// How both ends do their disk I/O.
+enum { ENGINE_SYNC, ENGINE_FILE_IO };
+static const char* engine_names[] = { "sync", "file_io" };
+
+struct bench_config {
+  int mode;                     // MODE_*
+  int engine;                   // ENGINE_*
+  size_t bytes;                 // size of the file
+};
+
+// An end's disk I/O machinery, set up for config.
+struct bench_io {
+  WorkerPool pool;
+  AsyncFileIO file_io;
+  AlignedBufPool bufs;
+};
+
+// What the server sends back when it is done.
+struct bench_server_stats {
+  unsigned long cpu_usec;       // user + sys while sending
+  int direct;                   // 1 if the file was O_DIRECT
+};
+
+static const char* dir = ".";
+
+// Non-class specific utility functions.
+
+// Routine to return the byte at offset in our file.
+static inline char file_byte(const size_t offset) {
+  return 'a' + (offset % 251) % 26;
+}
+
+// Routine to build the path of name in tmp_dir.
+static string tmp_path(const char* name) {
+  return string(tmp_dir) + "/" + name;
+}
+
+// Routine to create our file of bytes (on disk, not just in the page
+// cache).
+static bool make_file(const size_t bytes) {
+  string path = tmp_path(DIRECT_BENCH_FILE);
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    warn("make_file(): open(%s)", path.c_str());
+    return false;
+  }
+
+  char buf[DIRECT_BENCH_CHUNK_LEN];
+  for (size_t off = 0; off < bytes; off += sizeof(buf)) {
+    size_t len = min(sizeof(buf), bytes - off);
+    for (size_t i = 0; i < len; i++)
+      buf[i] = file_byte(off + i);
+    if (write(fd, buf, len) != (ssize_t)len) {
+      warn("make_file(): write(%s)", path.c_str());
+      close(fd);
+      return false;
+    }
+  }
+  if (fsync(fd) < 0)
+    warn("make_file(): fsync(%s)", path.c_str());
+  close(fd);
+
+  return true;
+}
+
+// Routine to drop (the clean pages of) name from the page cache.
+static void drop_file(const char* name) {
+  string path = tmp_path(name);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+// Routine to count the bytes of name in the page cache.
+static size_t cached_bytes(const char* name) {
+  string path = tmp_path(name);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return 0;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+
+  void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return 0;
+
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t pages = (st.st_size + page_size - 1) / page_size;
+  vector<unsigned char> resident(pages);
+  size_t cnt = 0;
+  if (mincore(addr, st.st_size, (unsigned char*)&resident[0]) == 0)
+    for (size_t i = 0; i < pages; i++)
+      if (resident[i] & 1)
+        cnt++;
+  munmap(addr, st.st_size);
+
+  return cnt * page_size;
+}
+
+// Routine to check the received file's size & bytes.
+static bool check_file(const size_t bytes) {
+  string path = tmp_path(DIRECT_BENCH_OUT_FILE);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    warn("check_file(): open(%s)", path.c_str());
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size != bytes) {
+    warnx("check_file(): %s is %ld bytes, not %lu", path.c_str(),
+          (long)st.st_size, (unsigned long)bytes);
+    close(fd);
+    return false;
+  }
+
+  char buf[DIRECT_BENCH_CHUNK_LEN];
+  for (size_t off = 0; off < bytes; off += sizeof(buf)) {
+    size_t len = min(sizeof(buf), bytes - off);
+    if (pread(fd, buf, len, off) != (ssize_t)len) {
+      warn("check_file(): pread(%s)", path.c_str());
+      close(fd);
+      return false;
+    }
+    for (size_t i = 0; i < len; i++)
+      if (buf[i] != file_byte(off + i)) {
+        warnx("check_file(): byte %lu is wrong", (unsigned long)(off + i));
+        close(fd);
+        return false;
+      }
+  }
+  close(fd);
+
+  return true;
+}
+
+// Routine to remove our files & tmp_dir.
+static void remove_files(void) {
+  if (tmp_dir == NULL)
+    return;
+
+  unlink(tmp_path(DIRECT_BENCH_FILE).c_str());
+  unlink(tmp_path(DIRECT_BENCH_OUT_FILE).c_str());
+  rmdir(tmp_dir);
+}
+
+// Routine to set up session's disk I/O for config.
+static void set_up_io(const bench_config& config, struct bench_io* io,
+                      TCPSession* session) {
+  if (config.engine == ENGINE_FILE_IO) {
+    io->pool.Init(DIRECT_BENCH_THREADS, WORKERPOOL_DEFAULT_MAX_JOBS);
+    io->file_io.Init(&io->pool);
+    exit_on_error("AsyncFileIO::Init()");
+    session->set_file_io(&io->file_io);
+  }
+
+  if (config.mode == MODE_DIRECT) {
+    io->bufs.Init(ALIGNEDBUFPOOL_DEFAULT_BUFS, ALIGNEDBUFPOOL_DEFAULT_BUF_SIZE,
+                  FILE_DIRECT_IO_ALIGN);
+    exit_on_error("AlignedBufPool::Init()");
+    session->set_direct_io(&io->bufs);
+  }
+}
+
+// Routine to wait for (and run) our AsyncFileIO's completions.
+static void wait_io(const bench_config& config, struct bench_io* io,
+                    const int timeout) {
+  if (config.engine != ENGINE_FILE_IO)
+    return;
+
+  struct pollfd pfd;
+  pfd.fd = io->pool.notify_fd();
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, timeout) > 0) {
+    io->pool.Drain();
+    io->file_io.Complete();
+  }
+}
+
+// Routine to serve one connection: read the request, then send our
+// file as the response's message-body.
+static void serve(const bench_config& config, TCPConn* listener,
+                  struct bench_io* io) {
+  TCPSession session(MsgHdr::TYPE_HTTP);
+  session.Init();
+  listener->Accept(&session);
+  exit_on_error("server: Accept()");
+  set_up_io(config, io, &session);
+
+  bool eof = false;
+  while (!session.IsIncomingMsgInitialized() && !eof) {
+    session.Read(&eof);
+    exit_on_error("server: Read()");
+    session.InitIncomingMsg();
+    exit_on_error("server: InitIncomingMsg()");
+  }
+  if (eof)
+    _exit(EX_PROTOCOL);
+
+  File file;
+  file.Init(DIRECT_BENCH_FILE, tmp_dir);
+  HTTPFraming http_hdr;
+  http_hdr.InitResponse(200, HTTPFraming::OPEN);
+  MsgHdr msg_hdr(MsgHdr::TYPE_HTTP);
+  msg_hdr.Init(1, http_hdr);
+  char hdr[256];
+  int hdr_len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n"
+                         "Content-Length: %lu\r\n\r\n",
+                         (unsigned long)config.bytes);
+  session.AddMsgFile(hdr, hdr_len, file, config.bytes, msg_hdr);
+  exit_on_error("server: AddMsgFile()");
+
+  // Send it all; Write() returns 0 while our AsyncFileIO reads.
+  while (!session.IsOutgoingMsgSent()) {
+    ssize_t n = session.Write();
+    exit_on_error("server: Write()");
+    if (n == 0 && session.IsFileIOPending())
+      wait_io(config, io, -1);
+  }
+
+  // Wait for our peer to close.
+  char c;
+  while (!eof) {
+    session.SSLConn::Read(1, &c, &eof);
+    if (error.Event())
+      break;
+  }
+}
+
+// Routine to fork(2) a server for config.  Sets port to the one it
+// is listening on, and result_fd to where it will write its
+// bench_server_stats when done.
+static pid_t fork_server(const bench_config& config, in_port_t* port,
+                         int* result_fd) {
+  pid_t pid = fork_server_process(port, result_fd);
+  if (pid > 0)
+    return pid;
+
+  // Child: set up our listening socket.
+  TCPConn listener;
+  listener.InitServer(AF_INET);
+  listener.Socket(PF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  listener.Setsockopt(SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  listener.Bind(0);
+  listener.Listen(1);
+  exit_on_error("server: Listen()");
+
+  report_port(*result_fd, listener.fd());
+
+  struct bench_io* io = new struct bench_io();
+  struct bench_server_stats stats;
+  memset(&stats, 0, sizeof(stats));
+  unsigned long start_cpu = cpu_usec();
+  serve(config, &listener, io);
+  stats.cpu_usec = cpu_usec() - start_cpu;
+
+  File file;
+  file.Init(DIRECT_BENCH_FILE, tmp_dir);
+  if (config.mode == MODE_DIRECT) {
+    file.OpenDirect(NULL, O_RDONLY, 0);
+    stats.direct = file.IsDirect() ? 1 : 0;
+  }
+
+  report_stats_and_exit(*result_fd, &stats, sizeof(stats));
+}
+
+// Routine to time fetching our file (to DIRECT_BENCH_OUT_FILE) over
+// one connection.
+static void bench_transfer(const bench_config& config) {
+  drop_file(DIRECT_BENCH_FILE);
+  unlink(tmp_path(DIRECT_BENCH_OUT_FILE).c_str());
+
+  in_port_t port = 0;
+  int result_fd = -1;
+  pid_t pid = fork_server(config, &port, &result_fd);
+
+  struct bench_io io;  // declared first, so it outlives session
+  TCPSession session(MsgHdr::TYPE_HTTP);
+  session.Init();
+  session.TCPConn::Init(DIRECT_BENCH_HOST, AF_INET, 1);
+  session.set_port(port);
+  session.Socket(PF_INET, SOCK_STREAM, 0, NULL);
+  session.Connect();
+  exit_on_error("client: Connect()");
+  set_up_io(config, &io, &session);
+
+  const char* req = "POST /bench HTTP/1.1\r\nHost: localhost\r\n"
+      "Content-Length: 1\r\n\r\nf";
+  const string out_path = tmp_path(DIRECT_BENCH_OUT_FILE);
+
+  double start = now_usec();
+  unsigned long start_cpu = cpu_usec();
+  session.SSLConn::Write(req, strlen(req));
+  exit_on_error("client: Write()");
+
+  // Read the response, streaming its body to our file, until all of
+  // it has been written (which, with our AsyncFileIO, can be after
+  // we've read the last of it).
+
+  bool eof = false;
+  for (;;) {
+    const MsgInfo rpending = session.rpending();
+    bool all_read = (session.IsIncomingMsgInitialized() &&
+                     rpending.file_offset + session.rbuf_len() >=
+                     rpending.body_len) ? true : false;
+    if (!all_read) {
+      session.Read(&eof);
+      exit_on_error("client: Read()");
+      if (eof)
+        errx(EX_PROTOCOL, "client: server closed early");
+    }
+
+    if (!session.IsIncomingMsgInitialized()) {
+      if (!session.InitIncomingMsg())
+        continue;
+      exit_on_error("client: InitIncomingMsg()");
+      session.set_rfile(out_path.c_str(), out_path.size());
+      exit_on_error("client: set_rfile()");
+    }
+
+    if (session.StreamIncomingMsg() == 0)
+      break;
+    exit_on_error("client: StreamIncomingMsg()");
+
+    if (session.IsFileIOPending())
+      wait_io(config, &io, all_read ? -1 : 0);
+  }
+  exit_on_error("client: StreamIncomingMsg()");
+  double elapsed = now_usec() - start;
+  unsigned long client_cpu = cpu_usec() - start_cpu;
+
+  session.Close();
+  error.clear();
+
+  struct bench_server_stats stats;
+  if (!wait_server(pid, result_fd, &stats, sizeof(stats)))
+    errx(EX_SOFTWARE, "server failed");
+
+  size_t cached = cached_bytes(DIRECT_BENCH_FILE) +
+      cached_bytes(DIRECT_BENCH_OUT_FILE);
+  if (!check_file(config.bytes))
+    errx(EX_DATAERR, "client: received file is wrong");
+
+  printf("{\"bench\":\"transfer\",\"mode\":\"%s\",\"engine\":\"%s\","
+         "\"direct\":%s,\"bytes\":%lu,\"mbytes_per_sec\":%.1f,"
+         "\"client_cpu_usec\":%lu,\"server_cpu_usec\":%lu,"
+         "\"page_cache_kbytes\":%lu}\n",
+         mode_names[config.mode], engine_names[config.engine],
+         stats.direct ? "true" : "false", (unsigned long)config.bytes,
+         (config.bytes / (1024.0 * 1024.0)) / (elapsed / 1000000.0),
+         client_cpu, stats.cpu_usec, (unsigned long)(cached / 1024));
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: direct-bench [-v] [-d dir] [-m mbytes]\n");
+  exit(EX_USAGE);
+}
+
+int main(int argc, char* argv[]) {
+  size_t mbytes = DIRECT_BENCH_DEFAULT_MBYTES;
+  bool verbose = false;
+
+  int ch;
+  while ((ch = getopt(argc, argv, "d:m:v")) != -1) {
+    switch (ch) {
+      case 'd' :
+        dir = optarg;
+        break;
+
+      case 'm' :
+        mbytes = strtoul(optarg, NULL, 10);
+        break;
+
+      case 'v' :
+        verbose = true;
+        break;
+
+      default :
+        usage();
+    }
+  }
+  if (mbytes == 0)
+    usage();
+
+  // Our results go to stdout; keep the library's chatter off stderr.
+  if (!verbose)
+    logger.set_mechanism_priority(LOG_TO_STDERR, LOG_WARNING);
+  signal(SIGPIPE, SIG_IGN);
+
+  bench_init("direct-bench", dir, remove_files);
+
+  const size_t sizes[] = {
+    mbytes * 1024 * 1024,  // a multiple of any block size
+    mbytes * 1024 * 1024 + DIRECT_BENCH_TAIL_LEN,
+  };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    if (!make_file(sizes[i]))
+      exit(EX_CANTCREAT);
+
+    for (int engine = ENGINE_SYNC; engine <= ENGINE_FILE_IO; engine++) {
+      for (int mode = MODE_BUFFERED; mode <= MODE_DIRECT; mode++) {
+        bench_config config;
+        memset(&config, 0, sizeof(config));
+        config.mode = mode;
+        config.engine = engine;
+        config.bytes = sizes[i];
+        bench_transfer(config);
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,664 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+//
+// ssl-bench: handshake & bulk-throughput benchmarks for SSLContext,
+// SSLConn and TCPSession over loopback.
+//
+// Each scenario forks a server (ErrorHandler isn't thread-safe, so
+// the two ends can't share a process), which listens on an ephemeral
+// port and serves a fixed number of connections, while we act as the
+// client.  The key & self-signed certificate are generated at start
+// up in a temporary directory.  Results are written to stdout, one
+// JSON object per line, so they can be compared between builds.
+
+#include <sys/types.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <err.h>
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ErrorHandler.h"
+#include "Logger.h"
+#include "HTTPFraming.h"
+#include "MsgHdr.h"
+#include "SSLContext.h"
+#include "SSLConn.h"
+#include "TCPSession.h"
+#include "URL.h"
+#include "bench-util.h"
+
+#define SSL_BENCH_DEFAULT_HANDSHAKES 200
+#define SSL_BENCH_DEFAULT_MBYTES 64
+#define SSL_BENCH_CHUNK_LEN (64 * 1024)   // SSLConn::Write() size & msg-body
+#define SSL_BENCH_HOST "127.0.0.1"
+#define SSL_BENCH_FILE "body.dat"
+#define SSL_BENCH_FILE_LEN (4 * 1024 * 1024)  // msg-body of BENCH_BULK_FILE
+
+// Non-class specific defines & data structures.
+
+// What the forked server does with each connection.
+enum { BENCH_HANDSHAKE, BENCH_BULK_SSLCONN, BENCH_BULK_SESSION,
+       BENCH_BULK_FILE };
+
+// Record sizing policies to compare (see SSLContext::set_record_sizing()).
+enum { RECORDS_FULL, RECORDS_DYNAMIC, RECORDS_SMALL };
+static const char* records_names[] = { "full", "dynamic", "small" };
+
+static const char* bench_suites[] = {
+  "TLS_AES_128_GCM_SHA256",
+  "TLS_AES_256_GCM_SHA384",
+  "TLS_CHACHA20_POLY1305_SHA256",
+};
+
+struct bench_config {
+  int type;                     // BENCH_HANDSHAKE | BENCH_BULK_*
+  const char* key_type;         // "rsa2048" | "p256"
+  bool resume;                  // allow session resumption
+  const char* suite;            // TLS 1.3 ciphersuite, or NULL
+  int records;                  // RECORDS_*, used by the (sending) client
+  bool memory_bio;              // run OpenSSL over a BIO pair
+  int conns;                    // connections the server accepts
+  size_t bytes;                 // bulk: bytes sent on each connection
+  bool mmap;                    // BENCH_BULK_FILE: TCPSession::set_mmap_wfile()
+};
+
+// What the server sends back when it is done.
+struct bench_server_stats {
+  unsigned long handshake_cpu_usec;  // from SSLContext::handshake_cpu_usec()
+  unsigned long cpu_usec;            // user + sys while serving
+};
+
+// Non-class specific utility functions.
+
+// Routine to return the p'th percentile of samples (which get sorted).
+static double percentile(vector<double>* samples, const double p) {
+  if (samples->empty())
+    return 0.0;
+
+  sort(samples->begin(), samples->end());
+  size_t i = (size_t)(p / 100.0 * (samples->size() - 1) + 0.5);
+  return (*samples)[i];
+}
+
+// Routine to generate a key & self-signed certificate for localhost
+// in tmp_dir, as <key_type>-key.pem & <key_type>-cert.pem.
+static bool make_cert(const char* key_type) {
+  EVP_PKEY* pkey = NULL;
+  if (!strcmp(key_type, "rsa2048"))
+    pkey = EVP_RSA_gen(2048);
+  else
+    pkey = EVP_EC_gen("P-256");
+  if (pkey == NULL) {
+    warnx("make_cert(): unable to generate %s key", key_type);
+    return false;
+  }
+
+  X509* cert = X509_new();
+  X509_set_version(cert, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 60 * 60);
+  X509_set_pubkey(cert, pkey);
+  X509_NAME* name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                             (const unsigned char*)"localhost", -1, -1, 0);
+  X509_set_issuer_name(cert, name);
+
+  bool ret = false;
+  char path[PATH_MAX];
+  FILE* fp = NULL;
+  if (!X509_sign(cert, pkey, EVP_sha256())) {
+    warnx("make_cert(): unable to sign %s certificate", key_type);
+    goto done;
+  }
+
+  snprintf(path, sizeof(path), "%s/%s-key.pem", tmp_dir, key_type);
+  if ((fp = fopen(path, "w")) == NULL) {
+    warn("make_cert(): fopen(%s)", path);
+    goto done;
+  }
+  PEM_write_PrivateKey(fp, pkey, NULL, NULL, 0, NULL, NULL);
+  fclose(fp);
+
+  snprintf(path, sizeof(path), "%s/%s-cert.pem", tmp_dir, key_type);
+  if ((fp = fopen(path, "w")) == NULL) {
+    warn("make_cert(): fopen(%s)", path);
+    goto done;
+  }
+  PEM_write_X509(fp, cert);
+  fclose(fp);
+  ret = true;
+
+done:
+  X509_free(cert);
+  EVP_PKEY_free(pkey);
+  return ret;
+}
+
+// Routine to remove tmp_dir and the certificates within it.
+static void remove_certs(void) {
+  if (tmp_dir == NULL)
+    return;
+
+  const char* key_types[] = { "rsa2048", "p256" };
+  char path[PATH_MAX];
+  for (size_t i = 0; i < sizeof(key_types) / sizeof(key_types[0]); i++) {
+    snprintf(path, sizeof(path), "%s/%s-key.pem", tmp_dir, key_types[i]);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/%s-cert.pem", tmp_dir, key_types[i]);
+    unlink(path);
+  }
+  snprintf(path, sizeof(path), "%s/%s", tmp_dir, SSL_BENCH_FILE);
+  unlink(path);
+  rmdir(tmp_dir);
+}
+
+// Routine to write the message-body sent by BENCH_BULK_FILE.
+static bool make_body_file(void) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", tmp_dir, SSL_BENCH_FILE);
+  FILE* fp = fopen(path, "w");
+  if (fp == NULL) {
+    warn("make_body_file(): fopen(%s)", path);
+    return false;
+  }
+
+  char buf[SSL_BENCH_CHUNK_LEN];
+  memset(buf, 'f', sizeof(buf));
+  for (size_t i = 0; i < SSL_BENCH_FILE_LEN; i += sizeof(buf)) {
+    if (fwrite(buf, sizeof(buf), 1, fp) != 1) {
+      warn("make_body_file(): fwrite(%s)", path);
+      fclose(fp);
+      return false;
+    }
+  }
+  fclose(fp);
+
+  return true;
+}
+
+// Routine to apply config's cipher suite & BIO mode to a context.
+static void configure_context(const bench_config& config, SSLContext* ctx) {
+  if (config.suite != NULL)
+    ctx->set_cipher_list(NULL, config.suite);
+  ctx->set_memory_bio(config.memory_bio);
+}
+
+// Routine to disable Nagle on conn.  Otherwise, the last small write
+// of a flight can wait on the peer's delayed ACK (40 ms on Linux),
+// which would swamp the handshake costs we're trying to measure.
+static void set_nodelay(SSLConn* conn) {
+  int on = 1;
+  conn->Setsockopt(IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+// Routine to serve one connection, reading until our peer closes.
+static void serve_handshake(SSLConn* peer) {
+  // Write one byte, which the client times as its first byte.
+  peer->Write("x", 1);
+  exit_on_error("server: Write()");
+
+  char buf[256];
+  bool eof = false;
+  while (!eof) {
+    if (peer->Read(sizeof(buf), buf, &eof) < 0 || error.Event()) {
+      error.clear();  // client's shutdown can race ours
+      break;
+    }
+  }
+}
+
+// Routine to read config.bytes through SSLConn::Read(), then ack.
+static void serve_bulk_sslconn(const bench_config& config, SSLConn* peer) {
+  char* buf = (char*)malloc(SSL_BENCH_CHUNK_LEN);
+  size_t total = 0;
+  bool eof = false;
+  while (total < config.bytes && !eof) {
+    ssize_t n = peer->Read(SSL_BENCH_CHUNK_LEN, buf, &eof);
+    exit_on_error("server: Read()");
+    if (n > 0)
+      total += n;
+  }
+  free(buf);
+
+  peer->Write("k", 1);
+  exit_on_error("server: Write()");
+}
+
+// Routine to read config.bytes worth of HTTP messages through
+// TCPSession, then ack.
+static void serve_bulk_session(const bench_config& config,
+                               TCPSession* peer) {
+  size_t total = 0;
+  bool eof = false;
+  while (total < config.bytes && !eof) {
+    if (peer->IsIncomingMsgInitialized() && peer->IsIncomingMsgComplete()) {
+      total += peer->rhdr().body_len();
+      peer->ClearIncomingMsg();
+      exit_on_error("server: ClearIncomingMsg()");
+      continue;
+    }
+
+    if (!peer->IsIncomingMsgInitialized() && peer->InitIncomingMsg())
+      continue;
+    exit_on_error("server: InitIncomingMsg()");
+
+    peer->Read(&eof);
+    exit_on_error("server: Read()");
+  }
+
+  peer->SSLConn::Write("k", 1);
+  exit_on_error("server: Write()");
+}
+
+// Routine to fork(2) a server for config.  Sets port to the one it
+// is listening on, and result_fd to where it will write its
+// bench_server_stats when done.
+static pid_t fork_server(const bench_config& config, in_port_t* port,
+                         int* result_fd) {
+  pid_t pid = fork_server_process(port, result_fd);
+  if (pid > 0)
+    return pid;
+
+  // Child: set up our context & listening socket.
+  string key_file = string(config.key_type) + "-key.pem";
+  string cert_file = string(config.key_type) + "-cert.pem";
+  SSLContext ctx;
+  ctx.Init(TLS_server_method(), "ssl-bench",
+           key_file.c_str(), tmp_dir, SSL_FILETYPE_PEM, NULL,
+           cert_file.c_str(), tmp_dir, SSL_FILETYPE_PEM, NULL,
+           NULL, SSL_VERIFY_NONE, SSLCONTEXT_DEFAULT_VERIFY_DEPTH,
+           config.resume ? SSL_SESS_CACHE_SERVER : SSL_SESS_CACHE_OFF,
+           config.resume ? 0 : SSL_OP_NO_TICKET);
+  exit_on_error("server: SSLContext::Init()");
+  configure_context(config, &ctx);
+  exit_on_error("server: configure_context()");
+
+  SSLConn server;
+  server.InitServer(AF_INET);
+  server.Socket(PF_INET, SOCK_STREAM, 0, &ctx);
+  int on = 1;
+  server.Setsockopt(SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  set_nodelay(&server);  // inherited by accepted sockets
+  server.Bind(0);
+  server.Listen(128);
+  exit_on_error("server: Listen()");
+
+  report_port(*result_fd, server.fd());
+
+  unsigned long start_cpu = cpu_usec();
+  for (int i = 0; i < config.conns; i++) {
+    if (config.type == BENCH_BULK_SESSION || config.type == BENCH_BULK_FILE) {
+      TCPSession peer(MsgHdr::TYPE_HTTP);
+      peer.Init();
+      server.Accept(&peer, &ctx);
+      exit_on_error("server: Accept()");
+      serve_bulk_session(config, &peer);
+      serve_handshake(&peer);  // wait for the client to close
+      peer.Shutdown(1);
+    } else {
+      SSLConn peer;
+      server.Accept(&peer, &ctx);
+      exit_on_error("server: Accept()");
+      if (config.type == BENCH_BULK_SSLCONN)
+        serve_bulk_sslconn(config, &peer);
+      serve_handshake(&peer);
+      peer.Shutdown(1);
+    }
+    error.clear();
+  }
+
+  struct bench_server_stats stats;
+  stats.handshake_cpu_usec = ctx.handshake_cpu_usec();
+  stats.cpu_usec = cpu_usec() - start_cpu;
+  report_stats_and_exit(*result_fd, &stats, sizeof(stats));
+}
+
+// Routine to build the client's context for config.
+static void init_client_context(const bench_config& config,
+                                SSLContext* ctx) {
+  ctx->Init(TLS_client_method(), "ssl-bench", NULL, NULL, 0, NULL,
+            NULL, NULL, 0, NULL, NULL, SSL_VERIFY_NONE,
+            SSLCONTEXT_DEFAULT_VERIFY_DEPTH,
+            config.resume ? SSL_SESS_CACHE_CLIENT : SSL_SESS_CACHE_OFF, 0);
+  exit_on_error("client: SSLContext::Init()");
+  ctx->set_client_session_cache(config.resume ?
+                                SSLCONTEXT_DEFAULT_CLIENT_SESSIONS : 0);
+  configure_context(config, ctx);
+  exit_on_error("client: configure_context()");
+
+  switch (config.records) {
+    case RECORDS_DYNAMIC :
+      ctx->set_record_sizing(SSLCONTEXT_RECORD_SMALL_LEN,
+                             SSLCONTEXT_RECORD_BOOST_LEN,
+                             SSLCONTEXT_RECORD_IDLE_MSEC, false);
+      break;
+
+    case RECORDS_SMALL :
+      ctx->set_record_sizing(SSLCONTEXT_RECORD_SMALL_LEN, config.bytes,
+                             0, false);
+      break;
+
+    default :
+      break;  // OpenSSL's full 16 KB records
+  }
+}
+
+// Routine to connect conn to port, using ctx.
+static void client_connect(SSLContext* ctx, const in_port_t port,
+                           SSLConn* conn) {
+  conn->Init(SSL_BENCH_HOST, AF_INET, 1);
+  conn->set_port(port);
+  conn->Socket(PF_INET, SOCK_STREAM, 0, ctx);
+  set_nodelay(conn);
+  conn->Connect();
+  exit_on_error("client: Connect()");
+}
+
+// Routine to wait for the server's single byte (first byte, or ack).
+static void client_wait_byte(SSLConn* conn) {
+  char c;
+  bool eof = false;
+  while (conn->Read(1, &c, &eof) == 0 && !eof)
+    exit_on_error("client: Read()");
+  exit_on_error("client: Read()");
+  if (eof)
+    errx(EX_PROTOCOL, "client: server closed early");
+}
+
+// Routine to time config.conns sequential connections, each from
+// connect(2) to the first byte of application data.
+static void bench_handshake(const bench_config& config) {
+  SSLContext ctx;
+  init_client_context(config, &ctx);
+
+  in_port_t port = 0;
+  int result_fd = -1;
+  pid_t pid = fork_server(config, &port, &result_fd);
+
+  vector<double> ttfb;
+  int resumed = 0;
+  double start = now_usec();
+  for (int i = 0; i < config.conns; i++) {
+    double t0 = now_usec();
+    SSLConn conn;
+    client_connect(&ctx, port, &conn);
+    client_wait_byte(&conn);
+    ttfb.push_back(now_usec() - t0);
+    if (SSL_session_reused((SSL*)conn.ssl()))
+      resumed++;
+    conn.Shutdown(1);
+    error.clear();
+  }
+  double elapsed = now_usec() - start;
+
+  struct bench_server_stats stats;
+  if (!wait_server(pid, result_fd, &stats, sizeof(stats)))
+    errx(EX_SOFTWARE, "handshake server failed");
+
+  printf("{\"bench\":\"handshake\",\"key\":\"%s\",\"mode\":\"%s\","
+         "\"bio\":\"%s\",\"count\":%d,\"resumed\":%d,"
+         "\"handshakes_per_sec\":%.1f,\"ttfb_usec_p50\":%.1f,"
+         "\"ttfb_usec_p99\":%.1f,\"server_handshake_cpu_usec\":%.1f}\n",
+         config.key_type, config.resume ? "resumed" : "full",
+         config.memory_bio ? "memory" : "socket", config.conns, resumed,
+         config.conns / (elapsed / 1000000.0),
+         percentile(&ttfb, 50.0), percentile(&ttfb, 99.0),
+         (double)stats.handshake_cpu_usec / config.conns);
+}
+
+// Routine to print a bulk result line.
+static void print_bulk(const bench_config& config, const char* api,
+                       const double elapsed, const unsigned long client_cpu,
+                       const struct bench_server_stats& stats) {
+  printf("{\"bench\":\"bulk\",\"api\":\"%s\",\"suite\":\"%s\","
+         "\"records\":\"%s\",\"bio\":\"%s\",\"bytes\":%lu,"
+         "\"mbytes_per_sec\":%.1f,\"client_cpu_usec\":%lu,"
+         "\"server_cpu_usec\":%lu}\n",
+         api, config.suite, records_names[config.records],
+         config.memory_bio ? "memory" : "socket",
+         (unsigned long)config.bytes,
+         (config.bytes / (1024.0 * 1024.0)) / (elapsed / 1000000.0),
+         client_cpu, stats.cpu_usec);
+}
+
+// Routine to time sending config.bytes through SSLConn::Write().
+static void bench_bulk_sslconn(const bench_config& config) {
+  SSLContext ctx;
+  init_client_context(config, &ctx);
+
+  in_port_t port = 0;
+  int result_fd = -1;
+  pid_t pid = fork_server(config, &port, &result_fd);
+
+  char* buf = (char*)malloc(SSL_BENCH_CHUNK_LEN);
+  memset(buf, 'b', SSL_BENCH_CHUNK_LEN);
+
+  SSLConn conn;
+  client_connect(&ctx, port, &conn);
+
+  double start = now_usec();
+  unsigned long start_cpu = cpu_usec();
+  size_t sent = 0;
+  while (sent < config.bytes) {
+    size_t len = min((size_t)SSL_BENCH_CHUNK_LEN, config.bytes - sent);
+    ssize_t n = conn.Write(buf, len);
+    exit_on_error("client: Write()");
+    if (n > 0)
+      sent += n;
+  }
+  client_wait_byte(&conn);
+  double elapsed = now_usec() - start;
+  unsigned long client_cpu = cpu_usec() - start_cpu;
+
+  conn.Shutdown(1);
+  error.clear();
+  free(buf);
+
+  struct bench_server_stats stats;
+  if (!wait_server(pid, result_fd, &stats, sizeof(stats)))
+    errx(EX_SOFTWARE, "bulk server failed");
+
+  print_bulk(config, "sslconn", elapsed, client_cpu, stats);
+}
+
+// Routine to time sending config.bytes as HTTP POSTs through
+// TCPSession, from memory or (BENCH_BULK_FILE) from SSL_BENCH_FILE.
+static void bench_bulk_session(const bench_config& config) {
+  SSLContext ctx;
+  init_client_context(config, &ctx);
+
+  in_port_t port = 0;
+  int result_fd = -1;
+  pid_t pid = fork_server(config, &port, &result_fd);
+
+  char* body = (char*)malloc(SSL_BENCH_CHUNK_LEN);
+  memset(body, 'b', SSL_BENCH_CHUNK_LEN);
+
+  TCPSession session(MsgHdr::TYPE_HTTP);
+  session.Init();
+  session.SSLConn::Init(SSL_BENCH_HOST, AF_INET, 1);
+  session.set_port(port);
+  session.Socket(PF_INET, SOCK_STREAM, 0, &ctx);
+  set_nodelay(&session);
+  session.Connect();
+  exit_on_error("client: Connect()");
+  session.set_connected(true);
+  session.set_mmap_wfile(config.mmap);
+
+  URL url;
+  url.set_host("localhost");
+  url.set_path("/bench", strlen("/bench"));
+  HTTPFraming http_hdr;
+  http_hdr.InitRequest(HTTPFraming::POST, url);
+
+  char hdr[256];
+  double start = now_usec();
+  unsigned long start_cpu = cpu_usec();
+  size_t sent = 0;
+  for (uint16_t msg_id = 1; sent < config.bytes; msg_id++) {
+    size_t len = (config.type == BENCH_BULK_FILE) ?
+        min((size_t)SSL_BENCH_FILE_LEN, config.bytes - sent) :
+        min((size_t)SSL_BENCH_CHUNK_LEN, config.bytes - sent);
+    int hdr_len = snprintf(hdr, sizeof(hdr), "POST /bench HTTP/1.1\r\n"
+                           "Host: localhost\r\nContent-Length: %lu\r\n\r\n",
+                           (unsigned long)len);
+    MsgHdr msg_hdr(MsgHdr::TYPE_HTTP);
+    msg_hdr.Init(msg_id, http_hdr);
+    if (config.type == BENCH_BULK_FILE) {
+      File file;
+      file.Init(SSL_BENCH_FILE, tmp_dir);
+      session.AddMsgFile(hdr, hdr_len, file, len, msg_hdr);
+    } else {
+      session.AddMsgBuf(hdr, hdr_len, body, len, msg_hdr);
+    }
+    exit_on_error("client: AddMsgBuf()");
+
+    while (!session.IsOutgoingMsgSent()) {
+      session.Write();
+      exit_on_error("client: Write()");
+    }
+    session.PopOutgoingMsgQueue();
+    session.delete_whdr(msg_id);
+    sent += len;
+  }
+  client_wait_byte(&session);
+  double elapsed = now_usec() - start;
+  unsigned long client_cpu = cpu_usec() - start_cpu;
+
+  session.Shutdown(1);
+  error.clear();
+  free(body);
+
+  struct bench_server_stats stats;
+  if (!wait_server(pid, result_fd, &stats, sizeof(stats)))
+    errx(EX_SOFTWARE, "session server failed");
+
+  const char* api = "tcpsession";
+  if (config.type == BENCH_BULK_FILE)
+    api = config.mmap ? "tcpsession-mmap" : "tcpsession-file";
+  print_bulk(config, api, elapsed, client_cpu, stats);
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: ssl-bench [-v] [-n handshakes] [-m mbytes]\n");
+  exit(EX_USAGE);
+}
+
+int main(int argc, char* argv[]) {
+  int handshakes = SSL_BENCH_DEFAULT_HANDSHAKES;
+  size_t mbytes = SSL_BENCH_DEFAULT_MBYTES;
+  bool verbose = false;
+
+  int ch;
+  while ((ch = getopt(argc, argv, "m:n:v")) != -1) {
+    switch (ch) {
+      case 'm' :
+        mbytes = strtoul(optarg, NULL, 10);
+        break;
+
+      case 'n' :
+        handshakes = atoi(optarg);
+        break;
+
+      case 'v' :
+        verbose = true;
+        break;
+
+      default :
+        usage();
+    }
+  }
+  if (handshakes <= 0 || mbytes == 0)
+    usage();
+
+  // Our results go to stdout; keep the library's chatter off stderr.
+  if (!verbose)
+    logger.set_mechanism_priority(LOG_TO_STDERR, LOG_WARNING);
+  signal(SIGPIPE, SIG_IGN);
+
+  bench_init("ssl-bench", "/tmp", remove_certs);
+
+  const char* key_types[] = { "rsa2048", "p256" };
+  for (size_t i = 0; i < sizeof(key_types) / sizeof(key_types[0]); i++)
+    if (!make_cert(key_types[i]))
+      exit(EX_SOFTWARE);
+  if (!make_body_file())
+    exit(EX_SOFTWARE);
+
+  // Handshakes: full & resumed, for each key type, plus memory BIOs.
+  for (size_t i = 0; i < sizeof(key_types) / sizeof(key_types[0]); i++) {
+    for (int resume = 0; resume <= 1; resume++) {
+      for (int memory_bio = 0; memory_bio <= 1; memory_bio++) {
+        bench_config config;
+        memset(&config, 0, sizeof(config));
+        config.type = BENCH_HANDSHAKE;
+        config.key_type = key_types[i];
+        config.resume = resume ? true : false;
+        config.memory_bio = memory_bio ? true : false;
+        config.conns = handshakes;
+        bench_handshake(config);
+      }
+    }
+  }
+
+  // Bulk: each suite with each record sizing policy, then memory
+  // BIOs and TCPSession (from memory, then from a file, copied &
+  // mapped) with the default suite & full records.
+  for (size_t i = 0; i < sizeof(bench_suites) / sizeof(bench_suites[0]);
+       i++) {
+    for (int records = RECORDS_FULL; records <= RECORDS_SMALL; records++) {
+      bench_config config;
+      memset(&config, 0, sizeof(config));
+      config.type = BENCH_BULK_SSLCONN;
+      config.key_type = "p256";
+      config.suite = bench_suites[i];
+      config.records = records;
+      config.conns = 1;
+      config.bytes = mbytes * 1024 * 1024;
+      bench_bulk_sslconn(config);
+    }
+  }
+
+  bench_config config;
+  memset(&config, 0, sizeof(config));
+  config.type = BENCH_BULK_SSLCONN;
+  config.key_type = "p256";
+  config.suite = bench_suites[0];
+  config.records = RECORDS_FULL;
+  config.memory_bio = true;
+  config.conns = 1;
+  config.bytes = mbytes * 1024 * 1024;
+  bench_bulk_sslconn(config);
+
+  config.type = BENCH_BULK_SESSION;
+  config.memory_bio = false;
+  bench_bulk_session(config);
+
+  config.type = BENCH_BULK_FILE;
+  for (int mmap = 0; mmap <= 1; mmap++) {
+    config.mmap = mmap ? true : false;
+    bench_bulk_session(config);
+  }
+
+  return 0;
+}
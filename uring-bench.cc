@@ -0,0 +1,580 @@
+// Copyright © 2010, Pittsburgh Supercomputing Center (PSC).
+// See the file 'COPYRIGHT.txt' for any restrictions.
+//
+// uring-bench: compares TCPSession's blocking I/O (driven by poll(2))
+// with its IOUring engine, over loopback.
+//
+// Each scenario forks an HTTP server (ErrorHandler isn't thread-safe,
+// so the two ends can't share a process), which serves a fixed number
+// of connections with either engine, while we act as the client(s).
+// The "rpc" scenario has many connections each doing small
+// request/response exchanges; the "file" scenario has the server send
+// a large file as the message-body (which we check).  Results are
+// written to stdout, one JSON object per line, so they can be compared
+// between builds.
+
+#include <sys/types.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ErrorHandler.h"
+#include "Logger.h"
+#include "File.h"
+#include "HTTPFraming.h"
+#include "IOUring.h"
+#include "MsgHdr.h"
+#include "TCPConn.h"
+#include "TCPSession.h"
+#include "bench-util.h"
+
+#define URING_BENCH_DEFAULT_CONNS 16
+#define URING_BENCH_DEFAULT_REQUESTS 2000   // per connection
+#define URING_BENCH_DEFAULT_MBYTES 64
+#define URING_BENCH_BODY_LEN 256           // rpc request & response bodies
+#define URING_BENCH_CHUNK_LEN (64 * 1024)  // client's read size
+#define URING_BENCH_HOST "127.0.0.1"
+#define URING_BENCH_FILE "uring-bench.dat"
+
+// Non-class specific defines & data structures.
+
+// What the forked server sends for each request.
+enum { BENCH_RPC, BENCH_FILE };
+
+// How the forked server does its I/O.
+enum { ENGINE_SYNC, ENGINE_IO_URING };
+static const char* engine_names[] = { "sync", "io_uring" };
+
+struct bench_config {
+  int type;                     // BENCH_*
+  int engine;                   // ENGINE_*
+  int conns;                    // connections the server accepts
+  int requests;                 // rpc: requests on each connection
+  size_t bytes;                 // file: size of the file
+};
+
+// What the server sends back when it is done.
+struct bench_server_stats {
+  unsigned long cpu_usec;       // user + sys while serving
+  unsigned long ctx_switches;   // voluntary, while serving
+  unsigned long enters;         // io_uring_enter(2) calls (ENGINE_IO_URING)
+  unsigned long ops;            // operations submitted (ENGINE_IO_URING)
+};
+
+// The forked server's state.
+struct bench_server {
+  const bench_config* config;
+  TCPConn listener;
+  IOUring ring;
+  vector<TCPSession*> sessions;
+  int accepted;
+  int closed;
+  uint16_t msg_id;
+  File file;
+  char body[URING_BENCH_BODY_LEN];
+};
+
+// Non-class specific utility functions.
+
+// Routine to return the byte at offset in our file (and responses).
+static inline char file_byte(const size_t offset) {
+  return 'a' + (offset % 251) % 26;
+}
+
+// Routine to create our file of bytes in tmp_dir.
+static bool make_file(const size_t bytes) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", tmp_dir, URING_BENCH_FILE);
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    warn("make_file(): open(%s)", path);
+    return false;
+  }
+
+  char buf[URING_BENCH_CHUNK_LEN];
+  for (size_t off = 0; off < bytes; off += sizeof(buf)) {
+    size_t len = min(sizeof(buf), bytes - off);
+    for (size_t i = 0; i < len; i++)
+      buf[i] = file_byte(off + i);
+    if (write(fd, buf, len) != (ssize_t)len) {
+      warn("make_file(): write(%s)", path);
+      close(fd);
+      return false;
+    }
+  }
+  close(fd);
+
+  return true;
+}
+
+// Routine to remove our file & tmp_dir.
+static void remove_file(void) {
+  if (tmp_dir == NULL)
+    return;
+
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", tmp_dir, URING_BENCH_FILE);
+  unlink(path);
+  rmdir(tmp_dir);
+}
+
+// Routine to disable Nagle on conn, so our small responses aren't
+// held for the peer's delayed ACK.
+static void set_nodelay(TCPConn* conn) {
+  int on = 1;
+  conn->Setsockopt(IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+// Routine to queue a response to the request just read by session.
+static void server_respond(struct bench_server* server, TCPSession* session) {
+  uint16_t msg_id = ++server->msg_id;
+  HTTPFraming http_hdr;
+  http_hdr.InitResponse(200, HTTPFraming::OPEN);
+  MsgHdr msg_hdr(MsgHdr::TYPE_HTTP);
+  msg_hdr.Init(msg_id, http_hdr);
+
+  char hdr[256];
+  size_t body_len = (server->config->type == BENCH_RPC) ?
+      URING_BENCH_BODY_LEN : server->config->bytes;
+  int hdr_len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n"
+                         "Content-Length: %lu\r\n\r\n",
+                         (unsigned long)body_len);
+  if (server->config->type == BENCH_RPC)
+    session->AddMsgBuf(hdr, hdr_len, server->body, body_len, msg_hdr);
+  else
+    session->AddMsgFile(hdr, hdr_len, server->file, body_len, msg_hdr);
+  exit_on_error("server: AddMsg*()");
+}
+
+// Routine to do whatever session can: read (if readable, as our
+// sockets block), respond to each complete request, and write.
+// Returns true once our peer has closed (and the session can be
+// deleted).
+static bool server_service(struct bench_server* server, TCPSession* session,
+                           const bool readable) {
+  bool eof = false;
+  if (readable) {
+    session->Read(&eof);
+    exit_on_error("server: Read()");
+  }
+
+  for (;;) {
+    if (!session->IsIncomingMsgInitialized() && !session->InitIncomingMsg())
+      break;
+    exit_on_error("server: InitIncomingMsg()");
+    if (!session->IsIncomingMsgComplete())
+      break;
+
+    server_respond(server, session);
+    session->ClearIncomingMsg();
+    exit_on_error("server: ClearIncomingMsg()");
+  }
+
+  // Send what we can; with the ring, Write() returns 0 while its
+  // last write is in flight.
+
+  while (session->IsOutgoingDataPending()) {
+    ssize_t n = session->Write();
+    exit_on_error("server: Write()");
+    if (session->IsOutgoingMsgSent()) {
+      session->delete_whdr(session->whdrs().front().msg_id());
+      session->PopOutgoingMsgQueue();
+      continue;
+    }
+    if (n == 0 || server->config->engine == ENGINE_SYNC)
+      break;
+  }
+
+  return (eof && !session->IsIOUringPending()) ? true : false;
+}
+
+// Routine to set up a new session on fd (just accepted).
+static TCPSession* server_new_session(struct bench_server* server,
+                                      const int fd) {
+  TCPSession* session = new TCPSession(MsgHdr::TYPE_HTTP);
+  session->Init();
+  if (fd < 0)
+    server->listener.Accept(session);
+  else
+    server->listener.Accept(session, fd);
+  exit_on_error("server: Accept()");
+  if (server->config->engine == ENGINE_IO_URING)
+    session->set_io_uring(&server->ring);
+  server->accepted++;
+
+  return session;
+}
+
+// Routine to delete the closed sessions.
+static void server_reap(struct bench_server* server,
+                        const vector<bool>& closed) {
+  vector<TCPSession*> open;
+  for (size_t i = 0; i < server->sessions.size(); i++) {
+    if (closed[i]) {
+      delete server->sessions[i];
+      server->closed++;
+    } else {
+      open.push_back(server->sessions[i]);
+    }
+  }
+  server->sessions.swap(open);
+}
+
+// Routine to serve connections with blocking I/O, waiting in poll(2).
+static void serve_sync(struct bench_server* server) {
+  const bench_config& config = *server->config;
+  while (server->closed < config.conns) {
+    vector<struct pollfd> fds(server->sessions.size() + 1);
+    fds[0].fd = (server->accepted < config.conns) ?
+        server->listener.fd() : -1;
+    fds[0].events = POLLIN;
+    for (size_t i = 0; i < server->sessions.size(); i++) {
+      fds[i + 1].fd = server->sessions[i]->fd();
+      fds[i + 1].events = POLLIN;
+      if (server->sessions[i]->IsOutgoingDataPending())
+        fds[i + 1].events |= POLLOUT;
+    }
+
+    if (poll(&fds[0], fds.size(), -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      _exit(EX_OSERR);
+    }
+
+    vector<bool> closed(server->sessions.size(), false);
+    for (size_t i = 0; i < server->sessions.size(); i++)
+      if (fds[i + 1].revents != 0)
+        closed[i] = server_service(server, server->sessions[i],
+                                   (fds[i + 1].revents & ~POLLOUT) ?
+                                   true : false);
+    server_reap(server, closed);
+
+    if (fds[0].revents & POLLIN)
+      server->sessions.push_back(server_new_session(server, -1));
+  }
+}
+
+// Routine run (by IOUring::Complete()) for each connection our
+// multishot accept(2) gets.
+static void server_accepted(const struct io_uring_cqe& cqe, void* arg) {
+  struct bench_server* server = (struct bench_server*)arg;
+  if (cqe.res < 0 && cqe.res != -ECANCELED) {
+    fprintf(stderr, "uring-bench: server: accept(): %s\n",
+            strerror(-cqe.res));
+    _exit(EX_OSERR);
+  }
+  if (cqe.res >= 0)
+    server->sessions.push_back(server_new_session(server, cqe.res));
+}
+
+// Routine to serve connections through our IOUring.  Each pass hands
+// what the sessions queued to the kernel (waiting for at least one
+// completion), runs the completions, then lets every session pick
+// up its results (Read() never blocks with the ring).
+static void serve_io_uring(struct bench_server* server) {
+  const bench_config& config = *server->config;
+  server->ring.Init(IOURING_DEFAULT_ENTRIES);
+  server->ring.RegisterBuffers(IOURING_DEFAULT_SLOTS,
+                               IOURING_DEFAULT_SLOT_SIZE);
+  server->ring.RegisterRecvBuffers(IOURING_DEFAULT_RECV_BUFS,
+                                   IOURING_DEFAULT_RECV_BUF_SIZE);
+  exit_on_error("server: IOUring::Init()");
+
+  if (server->ring.Accept(server->listener.fd(), true, server_accepted,
+                          server) == NULL)
+    exit_on_error("server: IOUring::Accept()");
+
+  while (server->closed < config.conns) {
+    server->ring.Submit(1);
+    exit_on_error("server: IOUring::Submit()");
+    server->ring.Complete();
+
+    vector<bool> closed(server->sessions.size(), false);
+    for (size_t i = 0; i < server->sessions.size(); i++)
+      closed[i] = server_service(server, server->sessions[i], true);
+    server_reap(server, closed);
+  }
+}
+
+// Routine to fork(2) a server for config.  Sets port to the one it
+// is listening on, and result_fd to where it will write its
+// bench_server_stats when done.
+static pid_t fork_server(const bench_config& config, in_port_t* port,
+                         int* result_fd) {
+  pid_t pid = fork_server_process(port, result_fd);
+  if (pid > 0)
+    return pid;
+
+  // Child: set up our listening socket.
+  struct bench_server* server = new struct bench_server();
+  server->config = &config;
+  server->accepted = 0;
+  server->closed = 0;
+  server->msg_id = 0;
+  for (size_t i = 0; i < sizeof(server->body); i++)
+    server->body[i] = file_byte(i);
+  server->file.Init(URING_BENCH_FILE, tmp_dir);
+  exit_on_error("server: File::Init()");
+
+  server->listener.InitServer(AF_INET);
+  server->listener.Socket(PF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  server->listener.Setsockopt(SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  set_nodelay(&server->listener);  // inherited by accepted sockets
+  server->listener.Bind(0);
+  server->listener.Listen(128);
+  exit_on_error("server: Listen()");
+
+  report_port(*result_fd, server->listener.fd());
+
+  struct bench_server_stats stats;
+  memset(&stats, 0, sizeof(stats));
+  unsigned long start_switches = 0;
+  unsigned long start_cpu = cpu_usec(&start_switches);
+  if (config.engine == ENGINE_IO_URING)
+    serve_io_uring(server);
+  else
+    serve_sync(server);
+  stats.cpu_usec = cpu_usec(&stats.ctx_switches) - start_cpu;
+  stats.ctx_switches -= start_switches;
+  stats.enters = server->ring.enters();
+  stats.ops = server->ring.ops_submitted();
+
+  report_stats_and_exit(*result_fd, &stats, sizeof(stats));
+}
+
+// Routine to connect conn to port.
+static void client_connect(const in_port_t port, TCPConn* conn) {
+  conn->Init(URING_BENCH_HOST, AF_INET, 1);
+  conn->set_port(port);
+  conn->Socket(PF_INET, SOCK_STREAM, 0);
+  set_nodelay(conn);
+  conn->Connect();
+  exit_on_error("client: Connect()");
+}
+
+// Routine to write all of buf to conn.
+static void client_send(TCPConn* conn, const char* buf, const size_t len) {
+  size_t sent = 0;
+  while (sent < len) {
+    ssize_t n = conn->Write(buf + sent, len - sent);
+    exit_on_error("client: Write()");
+    sent += n;
+  }
+}
+
+// Routine to read a response of len bytes (of which the last body_len
+// are the body) from conn, checking the body's bytes if asked.
+static void client_recv(TCPConn* conn, char* buf, const size_t len,
+                        const size_t body_len, const bool check) {
+  size_t hdr_len = len - body_len;
+  size_t got = 0;
+  bool eof = false;
+  while (got < len) {
+    size_t want = min((size_t)URING_BENCH_CHUNK_LEN, len - got);
+    ssize_t n = conn->Read(want, buf, &eof);
+    exit_on_error("client: Read()");
+    if (eof)
+      errx(EX_PROTOCOL, "client: server closed early");
+    if (check) {
+      for (ssize_t i = 0; i < n; i++)
+        if (got + i >= hdr_len &&
+            buf[i] != file_byte(got + i - hdr_len))
+          errx(EX_DATAERR, "client: body byte %lu is wrong",
+               (unsigned long)(got + i - hdr_len));
+    }
+    got += n;
+  }
+}
+
+// Routine to print a result line.
+static void print_result(const bench_config& config, const char* bench,
+                         const double elapsed,
+                         const struct bench_server_stats& stats) {
+  if (config.type == BENCH_RPC) {
+    double reqs = (double)config.conns * config.requests;
+    printf("{\"bench\":\"%s\",\"engine\":\"%s\",\"conns\":%d,"
+           "\"requests\":%.0f,\"requests_per_sec\":%.1f,",
+           bench, engine_names[config.engine], config.conns, reqs,
+           reqs / (elapsed / 1000000.0));
+  } else {
+    printf("{\"bench\":\"%s\",\"engine\":\"%s\",\"bytes\":%lu,"
+           "\"mbytes_per_sec\":%.1f,",
+           bench, engine_names[config.engine], (unsigned long)config.bytes,
+           (config.bytes / (1024.0 * 1024.0)) / (elapsed / 1000000.0));
+  }
+  printf("\"server_cpu_usec\":%lu,\"server_ctx_switches\":%lu,"
+         "\"io_uring_enters\":%lu,\"io_uring_ops\":%lu}\n",
+         stats.cpu_usec, stats.ctx_switches, stats.enters, stats.ops);
+}
+
+// Routine to time config.requests small request/response exchanges
+// on each of config.conns connections (one request outstanding per
+// connection).
+static void bench_rpc(const bench_config& config) {
+  in_port_t port = 0;
+  int result_fd = -1;
+  pid_t pid = fork_server(config, &port, &result_fd);
+
+  char req[512];
+  int req_len = snprintf(req, sizeof(req), "POST /bench HTTP/1.1\r\n"
+                         "Host: localhost\r\nContent-Length: %d\r\n\r\n",
+                         URING_BENCH_BODY_LEN);
+  memset(req + req_len, 'r', URING_BENCH_BODY_LEN);
+  req_len += URING_BENCH_BODY_LEN;
+
+  char resp[512];
+  int resp_len = snprintf(resp, sizeof(resp), "HTTP/1.1 200 OK\r\n"
+                          "Content-Length: %d\r\n\r\n",
+                          URING_BENCH_BODY_LEN) + URING_BENCH_BODY_LEN;
+
+  vector<TCPConn*> conns;
+  for (int i = 0; i < config.conns; i++) {
+    conns.push_back(new TCPConn());
+    client_connect(port, conns.back());
+  }
+
+  double start = now_usec();
+  for (int r = 0; r < config.requests; r++) {
+    for (int i = 0; i < config.conns; i++)
+      client_send(conns[i], req, req_len);
+    for (int i = 0; i < config.conns; i++)
+      client_recv(conns[i], resp, resp_len, URING_BENCH_BODY_LEN,
+                  (r == 0) ? true : false);
+  }
+  double elapsed = now_usec() - start;
+
+  for (int i = 0; i < config.conns; i++) {
+    conns[i]->Close();
+    delete conns[i];
+  }
+  error.clear();
+
+  struct bench_server_stats stats;
+  if (!wait_server(pid, result_fd, &stats, sizeof(stats)))
+    errx(EX_SOFTWARE, "rpc server failed");
+
+  print_result(config, "rpc", elapsed, stats);
+}
+
+// Routine to time fetching (and checking) our file over one connection.
+static void bench_file(const bench_config& config) {
+  in_port_t port = 0;
+  int result_fd = -1;
+  pid_t pid = fork_server(config, &port, &result_fd);
+
+  const char* req = "POST /bench HTTP/1.1\r\nHost: localhost\r\n"
+      "Content-Length: 1\r\n\r\nf";
+  char hdr[256];
+  size_t resp_len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n"
+                             "Content-Length: %lu\r\n\r\n",
+                             (unsigned long)config.bytes) + config.bytes;
+  char* buf = (char*)malloc(URING_BENCH_CHUNK_LEN);
+
+  TCPConn conn;
+  client_connect(port, &conn);
+
+  double start = now_usec();
+  client_send(&conn, req, strlen(req));
+  client_recv(&conn, buf, resp_len, config.bytes, true);
+  double elapsed = now_usec() - start;
+
+  conn.Close();
+  error.clear();
+  free(buf);
+
+  struct bench_server_stats stats;
+  if (!wait_server(pid, result_fd, &stats, sizeof(stats)))
+    errx(EX_SOFTWARE, "file server failed");
+
+  print_result(config, "file", elapsed, stats);
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: uring-bench [-v] [-c conns] [-n requests] "
+          "[-m mbytes]\n");
+  exit(EX_USAGE);
+}
+
+int main(int argc, char* argv[]) {
+  int conns = URING_BENCH_DEFAULT_CONNS;
+  int requests = URING_BENCH_DEFAULT_REQUESTS;
+  size_t mbytes = URING_BENCH_DEFAULT_MBYTES;
+  bool verbose = false;
+
+  int ch;
+  while ((ch = getopt(argc, argv, "c:m:n:v")) != -1) {
+    switch (ch) {
+      case 'c' :
+        conns = atoi(optarg);
+        break;
+
+      case 'm' :
+        mbytes = strtoul(optarg, NULL, 10);
+        break;
+
+      case 'n' :
+        requests = atoi(optarg);
+        break;
+
+      case 'v' :
+        verbose = true;
+        break;
+
+      default :
+        usage();
+    }
+  }
+  if (conns <= 0 || requests <= 0 || mbytes == 0)
+    usage();
+
+  // Our results go to stdout; keep the library's chatter off stderr.
+  if (!verbose)
+    logger.set_mechanism_priority(LOG_TO_STDERR, LOG_WARNING);
+  signal(SIGPIPE, SIG_IGN);
+
+  bench_init("uring-bench", "/tmp", remove_file);
+
+  if (!make_file(mbytes * 1024 * 1024))
+    exit(EX_CANTCREAT);
+
+  for (int engine = ENGINE_SYNC; engine <= ENGINE_IO_URING; engine++) {
+    bench_config config;
+    memset(&config, 0, sizeof(config));
+    config.type = BENCH_RPC;
+    config.engine = engine;
+    config.conns = conns;
+    config.requests = requests;
+    bench_rpc(config);
+  }
+
+  for (int engine = ENGINE_SYNC; engine <= ENGINE_IO_URING; engine++) {
+    bench_config config;
+    memset(&config, 0, sizeof(config));
+    config.type = BENCH_FILE;
+    config.engine = engine;
+    config.conns = 1;
+    config.bytes = mbytes * 1024 * 1024;
+    bench_file(config);
+  }
+
+  return 0;
+}